@@ -1,6 +1,10 @@
 #include "analyser.h"
+#include "analyser/function_cache.h"
 
+#include <algorithm>
+#include <atomic>
 #include <climits>
+#include <thread>
 #include <sstream>
 #include <cstring>
 #include <map>
@@ -8,9 +12,11 @@
 using namespace std;
 namespace cc0 {
 #define TT TokenType
-#define opError std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrAll)
+#define opError std::make_optional<CompilationError>(currentPos(), ErrorCode::ErrAll)
     // 错误输出
-    void errOut(std::pair<uint64_t, uint64_t> p,const std::string& errCon){
+    void Analyser::errOut(std::pair<uint64_t, uint64_t> p,const std::string& errCon) const {
+        if (_tokenError.has_value() || _quiet)
+            return;
         cout<<"Syntactic analysis error: Line: "<<p.first<<" Column: "<<p.second<<" Error: "<<errCon<<'\n';
     }
 
@@ -48,16 +54,40 @@ namespace cc0 {
         return charNum;
     }
 
+    // token 少于这个数时不用多线程：线程的启动和多出的一遍函数头分析比省下的时间更多
+    static constexpr std::size_t minParallelTokens = 4096;
+
     std::pair<cc0::resultInfo, std::optional<CompilationError>> Analyser::Analyse() {
-        auto err = c0Program();
+        std::optional<CompilationError> err;
+        bool parallel = false;
+        unsigned jobs = _jobs;
+        // 线程比核多时只会互相抢占
+        if (unsigned cores = std::thread::hardware_concurrency(); cores != 0) {
+            jobs = std::min(jobs, cores);
+        }
+        if (_tokenizer == nullptr && _context->size() < minParallelTokens) {
+            jobs = 1;
+        }
+        if ((jobs > 1 || _cache != nullptr) && _tokenizer == nullptr) {
+            _quiet = true;
+            parallel = parallelProgram(jobs);
+            _quiet = false;
+        }
+        // 并行分析失败（包括源代码有错）时重新串行分析，错误信息与串行时完全相同
+        if (!parallel)
+            err = c0Program();
+        // 流式分析时词法错误优先，之后的语法错误只是它的结果
+        if (_tokenError.has_value()){
+            return std::make_pair(std::move(result), _tokenError);
+        }
         if (err.has_value()){
-            return std::make_pair(result, err);
+            return std::make_pair(std::move(result), err);
         }
         else{
-            result.funcList = funcList;
-            result.constList = constList;
-            result.globalCode = globalCode;
-            return std::make_pair(result, std::optional<CompilationError>());
+            result.funcList = std::move(funcList);
+            result.constList = std::move(constList);
+            result.globalCode = std::move(globalCode);
+            return std::make_pair(std::move(result), std::optional<CompilationError>());
         }
     }
 
@@ -68,24 +98,245 @@ namespace cc0 {
     // 最后注意，不是所有情况都需要对错误进行输出，如果是子过程报错，那么在子过程已经输出了错误信息，自己遇到时直接return err即可
     std::optional<CompilationError> Analyser::c0Program() {
         std::optional<CompilationError> err;
-        std::optional<Token> next;
+        std::optional<TokenRef> next;
+
+        resetProgram();
+        err = globalDeclarations();
+        if (err.has_value()) {
+            return err;
+        }
+        while (true) {
+            // 判断程序结束
+            next = nextToken();
+            if (!next.has_value()) {
+                // 输入结束，判断有无main函数
+                if(getFunc("main") == -1){
+                    errOut(currentPos(),"no main function to run");
+                    return opError;
+                }
+                return {};
+            }
+            // 如果代码最后有奇怪的东西则借助函数定义判断
+            unreadToken();
+            err = functionDefinition();
+            if(err.has_value()){
+                return err;
+            }
+        }
+        return {};
+    }
 
+    void Analyser::resetProgram() {
+        _offset = 0;
+        _current_end = 0;
         globalFlag = true;
         globalCode.clear();
-        globalVarList.clear();
+        varTable.Clear();
         globalOffset = 0;
         funcList.clear();
+        funcIndex.clear();
         constList.clear();
+        constIndex.clear();
         jumpPos.clear();
         inLoop = false;
         inSwitch = false;
+        switchCases.clear();
+        switchDefault = -1;
+    }
+
+    Analyser::Analyser(const Analyser* parent)
+        : _tokens(), _context(parent->_context), _tokenizer(nullptr), _offset(0), _read(0), _current_end(0), _nextTokenIndex(0) {
+        _quiet = true;
+        _parent = parent;
+        varTable = parent->varTable;
+        globalFlag = false;
+        globalOffset = parent->globalOffset;
+    }
+
+    std::optional<CompilationError> Analyser::parallelFunction(std::size_t offset, std::size_t index) {
+        _offset = offset;
+        // 之前的函数直接在 _parent 中查找，不复制
+        _funcBase = index;
+        funcList.clear();
+        funcIndex.clear();
+        constList.clear();
+        constIndex.clear();
+        jumpPos.clear();
+        inLoop = false;
+        inSwitch = false;
+        switchCases.clear();
+        switchDefault = -1;
+        return functionDefinition();
+    }
+
+    // 函数只能调用它自己和在它之前定义的函数，函数体之间没有其他依赖
+    // 因此先串行确定全局变量和函数表，再由各个线程从函数的开头分析，每个函数只看到它之前的函数
+    // 常量按串行分析的顺序（函数名，然后是函数体中的常量）重新驻留，结果与串行分析完全相同
+    // 有缓存时命中的函数直接使用保存的代码和常量，合并的方式与分析的结果相同
+    bool Analyser::parallelProgram(unsigned jobs) {
+        resetProgram();
+        if (globalDeclarations().has_value()) {
+            return false;
+        }
+        // 按大括号配对划分各个函数的 token，[first, second)
+        std::vector<std::pair<std::size_t, std::size_t>> ranges;
+        for (std::size_t pos = _offset; pos < _context->size();) {
+            std::size_t depth = 0, end = pos;
+            for (; end < _context->size(); end++) {
+                auto type = (*_context)[end].GetType();
+                if (type == TT::LEFT_BRACE) {
+                    depth++;
+                }
+                else if (type == TT::RIGHT_BRACE && depth > 0 && --depth == 0) {
+                    break;
+                }
+            }
+            if (end == _context->size()) {
+                return false;
+            }
+            ranges.emplace_back(pos, end + 1);
+            pos = end + 1;
+        }
+        if (ranges.empty()) {
+            return false;
+        }
+
+        // 函数头决定函数表，函数名的常量稍后与函数体中的常量一起按顺序加入
+        auto consts = constList;
+        auto indices = constIndex;
+        for (auto& range : ranges) {
+            _offset = range.first;
+            if (functionHeader().has_value()) {
+                return false;
+            }
+        }
+        varTable.PopScope();
+        constList = std::move(consts);
+        constIndex = std::move(indices);
+
+        struct Parsed {
+            funcInfo func;
+            std::vector<constInfo> consts;
+        };
+        std::vector<Parsed> parsed(ranges.size());
+        std::atomic<std::size_t> next{0};
+        std::atomic<bool> failed{false};
+        auto work = [&]() {
+            Analyser worker(this);
+            for (std::size_t i; !failed && (i = next++) < ranges.size();) {
+                std::uint64_t key = 0;
+                if (_cache != nullptr) {
+                    key = functionKey(ranges[i], i);
+                    if (auto cached = _cache->Load(key, funcList[i])) {
+                        parsed[i].func = std::move(cached->func);
+                        parsed[i].consts = std::move(cached->consts);
+                        continue;
+                    }
+                }
+                // 函数体必须恰好在配对的大括号处结束
+                if (worker.parallelFunction(ranges[i].first, i).has_value() || worker._offset != ranges[i].second) {
+                    failed = true;
+                    break;
+                }
+                parsed[i].func = std::move(worker.funcList.back());
+                parsed[i].consts = std::move(worker.constList);
+                if (_cache != nullptr) {
+                    _cache->Store(key, parsed[i].func, parsed[i].consts);
+                }
+            }
+        };
+        std::vector<std::thread> threads;
+        auto count = std::min<std::size_t>(jobs, ranges.size());
+        for (std::size_t t = 1; t < count; t++) {
+            threads.emplace_back(work);
+        }
+        work();
+        for (auto& t : threads) {
+            t.join();
+        }
+        if (failed) {
+            return false;
+        }
+
+        for (std::size_t i = 0; i < parsed.size(); i++) {
+            auto& func = parsed[i].func;
+            std::vector<int> remap;
+            remap.reserve(parsed[i].consts.size());
+            for (auto& c : parsed[i].consts) {
+                remap.push_back(internConst(c.type, c.value));
+            }
+            func.constOffset = remap[func.constOffset];
+            for (auto& ins : func.localCode) {
+                if (ins.GetOperation() == LOADC) {
+                    ins.SetParam1(remap[ins.GetParam1()]);
+                }
+            }
+            funcList[i] = std::move(func);
+            if (_funcSink) {
+                _funcSink(funcList[i]);
+            }
+        }
+        _offset = _context->size();
+        return getFunc("main") != -1;
+    }
+
+    // 函数体的代码只取决于它的 token、它引用的全局变量的偏移和是否为常量、它调用的函数的下标和函数头
+    // 这些都加入键中，其他函数或全局变量的改变不影响这个函数的缓存
+    // 局部变量遮蔽的全局变量也会被计入，最多使缓存多失效一次
+    std::uint64_t Analyser::functionKey(std::pair<std::size_t, std::size_t> range, std::size_t index) const {
+        Fnv1a hash;
+        hash.Add(FunctionCache::Version);
+        for (auto i = range.first; i < range.second; i++) {
+            auto token = (*_context)[i].Get();
+            hash.AddValue(token.type);
+            switch (token.type) {
+                case TT::IDENTIFIER: {
+                    auto& name = _context->Text(token);
+                    hash.Add(name);
+                    if (auto var = varTable.FindIn(name, 0)) {
+                        hash.AddValue(var->value.offset);
+                        hash.AddValue(var->value.isConst);
+                    }
+                    // 只能调用自己和之前的函数，之后的函数不影响结果
+                    int func = getFunc(name);
+                    if (func >= 0 && static_cast<std::size_t>(func) <= index) {
+                        hash.AddValue(func);
+                        hash.AddValue(funcAt(func).paramNum);
+                        hash.Add(funcAt(func).funcType);
+                    }
+                    break;
+                }
+                case TT::CHAR:
+                case TT::STRING:
+                    hash.Add(_context->Text(token));
+                    break;
+                case TT::DECIMAL_INTEGER:
+                case TT::HEXADECIMAL_INTEGER:
+                    hash.AddValue(token.overflow);
+                    if (token.overflow) {
+                        hash.Add(_context->Text(token));
+                    }
+                    else {
+                        hash.AddValue(token.payload);
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+        return hash.Value();
+    }
+
+    std::optional<CompilationError> Analyser::globalDeclarations() {
+        std::optional<CompilationError> err;
+        std::optional<TokenRef> next;
 
         // 全局不记录栈偏移：全局变量的脚标就等于栈偏移
         while (true) {
             next = nextToken();
             if (!next.has_value()) {
                 // 这里是说明在函数定义之前遇到文件尾，因此直接报错即可
-                errOut(_current_pos,"need main function");
+                errOut(currentPos(),"need main function");
                 return opError;
             }
             // 如果是const一定是变量定义
@@ -101,23 +352,19 @@ namespace cc0 {
             if(next.value().GetType() == TT::VOID){
                 globalFlag = false;
                 unreadToken();
-                err = functionDefinition();
-                if(err.has_value()){
-                    return err;
-                }
                 // 后面一定是函数定义
-                break;
+                return {};
             }
             // 如果int需要再次预读
             if(next.value().GetType() == TT::INT){
                 next = nextToken();
                 if(!next.has_value()||next.value().GetType() != TT::IDENTIFIER){
-                    errOut(_current_pos,"var declaration need var name");
+                    errOut(currentPos(),"var declaration need var name");
                     return opError;
                 }
                 next = nextToken();
                 if(!next.has_value()){
-                    errOut(_current_pos,"var is not declared in this scope");
+                    errOut(currentPos(),"var is not declared in this scope");
                     return opError;
                 }
                 // 左括号一定为函数
@@ -126,11 +373,7 @@ namespace cc0 {
                     unreadToken(); // 左括号
                     unreadToken(); // 标识符
                     unreadToken(); // INT
-                    err = functionDefinition();
-                    if(err.has_value()){
-                        return err;
-                    }
-                    break;
+                    return {};
                 }
                 unreadToken(); // 当前符号
                 unreadToken(); // 标识符
@@ -141,27 +384,9 @@ namespace cc0 {
                 }
                 continue;
             }
-            errOut(_current_pos,"wrong var or function type");
+            errOut(currentPos(),"wrong var or function type");
             return opError;
         }
-        while (true) {
-            // 判断程序结束
-            next = nextToken();
-            if (!next.has_value()) {
-                // 输入结束，判断有无main函数
-                if(getFunc("main") == -1){
-                    errOut(_current_pos,"no main function to run");
-                    return opError;
-                }
-                return {};
-            }
-            // 如果代码最后有奇怪的东西则借助函数定义判断
-            unreadToken();
-            err = functionDefinition();
-            if(err.has_value()){
-                return err;
-            }
-        }
         return {};
     }
 
@@ -173,7 +398,7 @@ namespace cc0 {
         std::optional<CompilationError> err;
         auto next = nextToken();
         if (!next.has_value()) {
-            errOut(_current_pos,"var is not declared in this scope");
+            errOut(currentPos(),"var is not declared in this scope");
             return opError;
         }
         if (next.value().GetType() == TT::CONST) {
@@ -185,7 +410,7 @@ namespace cc0 {
         // 变量类型此时只能是int
         next = nextToken();
         if(!next.has_value()||next.value().GetType() != TT::INT){
-            errOut(_current_pos,"wrong var declaration type ");
+            errOut(currentPos(),"wrong var declaration type ");
             return opError;
         }
         // 如果多类型还需要传入type
@@ -196,7 +421,7 @@ namespace cc0 {
 
         next = nextToken();
         if (!next.has_value() || next.value().GetType() != TT::SEMICOLON) {
-            errOut(_current_pos,"no semicolon");
+            errOut(currentPos(),"no semicolon");
             return opError;
         }
 
@@ -231,24 +456,24 @@ namespace cc0 {
     //    '='<expression>
     std::optional<CompilationError> Analyser::initDeclarator(bool isConst) {
         varInfo tempVar;
-        std::pair<string,string> tempPair;
+        std::pair<int32_t,int32_t> tempPair;
         tempVar.isConst = isConst;
         auto next = nextToken();
         if (!next.has_value() || next.value().GetType() != TT::IDENTIFIER) {
-            errOut(_current_pos,"declaration need identifier");
+            errOut(currentPos(),"declaration need identifier");
             return opError;
         }
         tempVar.varName = next.value().GetValueString();
         if(globalFlag){
             // 全局只需考虑全局和函数
-            if(isDeclared(tempVar.varName,"global")||getFunc(tempVar.varName)!=-1){
-                errOut(_current_pos,"duplicated var declaration");
+            if(isDeclared(tempVar.varName,Scope::Global)||getFunc(tempVar.varName)!=-1){
+                errOut(currentPos(),"duplicated var declaration");
                 return opError;
             }
-            globalVarList.emplace_back(tempVar);
+            declareVar(tempVar);
             tempPair = getVar(tempVar.varName);
-            if(tempPair.first == "-"){
-                errOut(_current_pos,"var is not declared in this scope");
+            if(tempPair.first < 0){
+                errOut(currentPos(),"var is not declared in this scope");
                 return opError;
             }
             // 变量占位
@@ -259,14 +484,14 @@ namespace cc0 {
             // 局部的话只需要考虑当前作用域
             // 声明为参数的标识符，在同级作用域中只能被声明一次，可以覆盖全局的
             // 此时不是全局变量定义，因此可以有全局变量定义，只需判断local即可
-            if(isDeclared(tempVar.varName,"local")){
-                errOut(_current_pos,"duplicated var declaration");
+            if(isDeclared(tempVar.varName,Scope::Local)){
+                errOut(currentPos(),"duplicated var declaration");
                 return opError;
             }
-            localVarList.emplace_back(tempVar);
+            declareVar(tempVar);
             tempPair = getVar(tempVar.varName);
-            if(tempPair.first == "-"){
-                errOut(_current_pos,"var is not declared in this scope");
+            if(tempPair.first < 0){
+                errOut(currentPos(),"var is not declared in this scope");
                 return opError;
             }
             // 变量占位
@@ -279,7 +504,7 @@ namespace cc0 {
         if(isConst){
             next = nextToken();
             if (!next.has_value() || next.value().GetType() != TT::EQUAL_SIGN) {
-                errOut(_current_pos,"const var need initialization");
+                errOut(currentPos(),"const var need initialization");
                 return opError;
             }
             auto err = normalExpression();
@@ -327,15 +552,34 @@ namespace cc0 {
     // 为了方便，和变量一样，int类型return则就返回值默认为0
     // 但是汇编必须保证每一种控制流分支都能够返回（没有return也能返回）。
     std::optional<CompilationError> Analyser::functionDefinition() {
+        auto err = functionHeader();
+        if(err.has_value()){
+            return err;
+        }
+        err = compoundStatement();
+        if(err.has_value()){
+            return err;
+        }
+        // 保存函数的代码然后更新
+        funcNow.localCode = localCode;
+        funcList.back() = funcNow;
+        if (_funcSink) {
+            _funcSink(funcList.back());
+        }
+        return {};
+    }
+
+    std::optional<CompilationError> Analyser::functionHeader() {
         // 更新局部变量表和局部指令集
-        localVarList.clear();
+        varTable.PopScope();
+        varTable.PushScope();
         localCode.clear();
         localOffset = 0;
         resetFunc();
         funcNow.isReturn = false;
         auto next = nextToken();
         if(!next.has_value()){
-            errOut(_current_pos,"need function type");
+            errOut(currentPos(),"need function type");
             return opError;
         }
         if(next.value().GetType() == TT::VOID) {
@@ -345,19 +589,19 @@ namespace cc0 {
                 // 先直接int，因为函数没有返回值直接默认即可
                 funcNow.funcType = "int";
             }else{
-                errOut(_current_pos,"wrong function type");
+                errOut(currentPos(),"wrong function type");
                 return opError;
             }
         }
         next = nextToken();
         if (!next.has_value() || next.value().GetType() != TT::IDENTIFIER) {
-            errOut(_current_pos,"declaration need function name");
+            errOut(currentPos(),"declaration need function name");
             return opError;
         }
         funcNow.funcName = next.value().GetValueString();
         // 一定全局，直接判断重名
-        if(isDeclared(funcNow.funcName,"global")||getFunc(funcNow.funcName) != -1){
-            errOut(_current_pos,"duplicated var declaration");
+        if(isDeclared(funcNow.funcName,Scope::Global)||getFunc(funcNow.funcName) != -1){
+            errOut(currentPos(),"duplicated var declaration");
             return opError;
         }
         funcNow.paramNum = 0;
@@ -367,21 +611,11 @@ namespace cc0 {
         }
         // 更新函数指令集
         funcNow.localCode = localCode;
-        constInfo tempConst;
-        tempConst.type = 'S';
-        tempConst.value = '\"'+funcNow.funcName+'\"';
-        constList.emplace_back(tempConst);
-        funcNow.constOffset = constList.size()-1;
+        funcNow.constOffset = internConst('S', '\"'+funcNow.funcName+'\"');
         // 先更新偏移再入栈
+        funcIndex.emplace(funcNow.funcName, static_cast<int>(_funcBase + funcList.size()));
         funcList.emplace_back(funcNow);
 //        cout << funcNow.funcType << ' ' << funcNow.funcName << ' ' << funcNow.paramNum << '\n';
-        err = compoundStatement();
-        if(err.has_value()){
-            return err;
-        }
-        // 保存函数的代码然后更新
-        funcNow.localCode = localCode;
-        funcList.back() = funcNow;
         return {};
     }
 
@@ -390,7 +624,7 @@ namespace cc0 {
     std::optional<CompilationError> Analyser::parameterClause(int& paramNum) {
         auto next = nextToken();
         if (!next.has_value() || next.value().GetType() != TT::LEFT_PARENTHESIS) {
-            errOut(_current_pos,"no \' ( \' ");
+            errOut(currentPos(),"no \' ( \' ");
             return opError;
         }
 
@@ -406,7 +640,7 @@ namespace cc0 {
             }
             next = nextToken();
             if (!next.has_value() || next.value().GetType() != TT::RIGHT_PARENTHESIS) {
-                errOut(_current_pos,"no \' ) \' ");
+                errOut(currentPos(),"no \' ) \' ");
                 return opError;
             }
             return {};
@@ -455,25 +689,25 @@ namespace cc0 {
         // 检测类型
         next = nextToken();
         if (!next.has_value() || next.value().GetType() != TT::INT) {
-            errOut(_current_pos,"wrong var type ");
+            errOut(currentPos(),"wrong var type ");
             return opError;
         }
         next = nextToken();
         if (!next.has_value() || next.value().GetType() != TT::IDENTIFIER) {
-            errOut(_current_pos,"declaration need var name");
+            errOut(currentPos(),"declaration need var name");
             return opError;
         }
         tempVar.varName = next.value().GetValueString();
         // 此时globalFlag一定是false，只用判断局部
         // 如果定义了但是是全局的也是正常的
-        if(isDeclared(tempVar.varName,"local")){
-            errOut(_current_pos,"duplicated var declaration");
+        if(isDeclared(tempVar.varName,Scope::Local)){
+            errOut(currentPos(),"duplicated var declaration");
             return opError;
         }
-        localVarList.emplace_back(tempVar);
-        std::pair<string,string> tempPair = getVar(tempVar.varName);
-        if(tempPair.first == "-"){
-            errOut(_current_pos,"var is not declared in this scope");
+        declareVar(tempVar);
+        std::pair<int32_t,int32_t> tempPair = getVar(tempVar.varName);
+        if(tempPair.first < 0){
+            errOut(currentPos(),"var is not declared in this scope");
             return opError;
         }
         // 变量占位
@@ -490,7 +724,7 @@ namespace cc0 {
         std::optional<CompilationError> err;
         auto next = nextToken();
         if (!next.has_value() || next.value().GetType() != TT::LEFT_BRACE) {
-            errOut(_current_pos,"no \' { \' ");
+            errOut(currentPos(),"no \' { \' ");
             return opError;
         }
         // 预读进行变量声明
@@ -522,18 +756,19 @@ namespace cc0 {
         }
         next = nextToken();
         if (!next.has_value() || next.value().GetType() != TT::RIGHT_BRACE) {
-            errOut(_current_pos,"no \' } \' ");
+            errOut(currentPos(),"no \' } \' ");
             return opError;
         }
         // 对函数未返回的情况进行处理
         if(!funcNow.isReturn){
             if(funcNow.funcType == "void"){
                 // 如果void直接手动ret即可
+                tailCall(0);
                 localCode.emplace_back(RET);
             }
             if(funcNow.funcType == "int"){
                 // 如果int则说明没有return语句，一定错误
-                errOut(_current_pos,"function need return value");
+                errOut(currentPos(),"function need return value");
                 return opError;
             }
         }
@@ -551,7 +786,9 @@ namespace cc0 {
                 unreadToken();
                 return {};
             }
-            unreadToken();
+            // 文件尾时没有读入 token，不能回退，交给 normalStatement 报错
+            if (next.has_value())
+                unreadToken();
             auto err = normalStatement();
             if(err.has_value()){
                 return err;
@@ -576,7 +813,7 @@ namespace cc0 {
         std::optional<CompilationError> err;
         auto next = nextToken();
         if (!next.has_value()) {
-            errOut(_current_pos,"incomplete statement");
+            errOut(currentPos(),"incomplete statement");
             return opError;
         }
         // 预读first集
@@ -630,7 +867,7 @@ namespace cc0 {
                 }
                 next = nextToken();
                 if (!next.has_value() || next.value().GetType() != TT::RIGHT_BRACE) {
-                    errOut(_current_pos,"no \' } \' ");
+                    errOut(currentPos(),"no \' } \' ");
                     return opError;
                 }
                 break;
@@ -648,7 +885,7 @@ namespace cc0 {
                         }
                         next = nextToken();
                         if (!next.has_value() || next.value().GetType() != TT::SEMICOLON) {
-                            errOut(_current_pos,"no semicolon");
+                            errOut(currentPos(),"no semicolon");
                             return opError;
                         }
                         break;
@@ -663,22 +900,22 @@ namespace cc0 {
                         }
                         next = nextToken();
                         if (!next.has_value() || next.value().GetType() != TT::SEMICOLON) {
-                            errOut(_current_pos,"no semicolon");
+                            errOut(currentPos(),"no semicolon");
                             return opError;
                         }
                         break;
                     }
                     // 相当于default
-                    errOut(_current_pos,"wrong statement content");
+                    errOut(currentPos(),"wrong statement content");
                     return opError;
                 }else{
                     // 只有变量名没有后续
-                    errOut(_current_pos,"wrong statement content");
+                    errOut(currentPos(),"wrong statement content");
                     return opError;
                 }
                 break;
             default:
-                errOut(_current_pos,"wrong statement content");
+                errOut(currentPos(),"wrong statement content");
                 return opError;
         }
         return {};
@@ -689,21 +926,24 @@ namespace cc0 {
     std::optional<CompilationError> Analyser::functionCall() {
         auto next = nextToken();
         if (!next.has_value() || next.value().GetType() != TT::IDENTIFIER) {
-            errOut(_current_pos,"functionCall need function name");
+            errOut(currentPos(),"functionCall need function name");
             return opError;
         }
         string tempName = next.value().GetValueString();
         // 使用时同样需要判断是否存在
         // 如果是本地变量（覆盖了函数名）或者不是函数
-        if(isDeclared(tempName,"local")||getFunc(tempName) == -1){
-            errOut(_current_pos,"no such function to call");
+        if(isDeclared(tempName,Scope::Local)||getFunc(tempName) == -1){
+            errOut(currentPos(),"no such function to call");
             return opError;
         }
-        funcInfo funcTemp = funcList[getFunc(tempName)];
+        // 不复制函数，其代码可能很长
+        // call 的操作数是函数表中的下标，而不是函数名在常量表中的下标
+        int funcPos = getFunc(tempName);
+        const funcInfo& funcTemp = funcAt(funcPos);
 //        cout << next.value().GetValueString() << " call" << '\n';
         next = nextToken();
         if (!next.has_value() || next.value().GetType() != TT::LEFT_PARENTHESIS) {
-            errOut(_current_pos,"no \' ( \' ");
+            errOut(currentPos(),"no \' ( \' ");
             return opError;
         }
         // 预读判断有没有表达式列表
@@ -711,11 +951,11 @@ namespace cc0 {
         if (next.has_value() && next.value().GetType() == TT::RIGHT_PARENTHESIS) {
             // 比较参数个数
             if(funcTemp.paramNum!=0){
-                errOut(_current_pos,"param num not match ");
+                errOut(currentPos(),"param num not match ");
                 return opError;
             }
             // 一定不是全局
-            localCode.emplace_back(CALL,to_string(funcTemp.constOffset));
+            localCode.emplace_back(CALL, funcPos);
             return {};
         } else {
             unreadToken();
@@ -727,15 +967,15 @@ namespace cc0 {
             }
             // 同样进行个数判断
             if(paramNum != funcTemp.paramNum){
-                errOut(_current_pos,"param num not match ");
+                errOut(currentPos(),"param num not match ");
                 return opError;
             }
             next = nextToken();
             if (!next.has_value() || next.value().GetType() != TT::RIGHT_PARENTHESIS) {
-                errOut(_current_pos,"no \' ) \' ");
+                errOut(currentPos(),"no \' ) \' ");
                 return opError;
             }
-            localCode.emplace_back(CALL,to_string(funcTemp.constOffset));
+            localCode.emplace_back(CALL, funcPos);
             return {};
         }
         return {};
@@ -770,24 +1010,24 @@ namespace cc0 {
     std::optional<CompilationError> Analyser::assignmentExpression() {
         auto next = nextToken();
         if (!next.has_value() || next.value().GetType() != TT::IDENTIFIER) {
-            errOut(_current_pos,"assignment need var name");
+            errOut(currentPos(),"assignment need var name");
             return opError;
         }
         string tempName = next.value().GetValueString();
-        if(((!isDeclared(tempName,"local"))&&(!isDeclared(tempName,"global")))||getFunc(tempName)!=-1){
-            errOut(_current_pos,"the var is not declared or is a function");
+        if(((!isDeclared(tempName,Scope::Local))&&(!isDeclared(tempName,Scope::Global)))||getFunc(tempName)!=-1){
+            errOut(currentPos(),"the var is not declared or is a function");
             return opError;
         }
-        std::pair<std::string,std::string> tempPair;
+        std::pair<int32_t,int32_t> tempPair;
         // 看是不是局部变量
-        if(isDeclared(tempName,"local")){
+        if(isDeclared(tempName,Scope::Local)){
             if(isConst(tempName)){
-                errOut(_current_pos,"const var can not be assigned");
+                errOut(currentPos(),"const var can not be assigned");
                 return opError;
             }
             tempPair = getVar(tempName);
-            if(tempPair.first == "-"){
-                errOut(_current_pos,"var is not declared in this scope");
+            if(tempPair.first < 0){
+                errOut(currentPos(),"var is not declared in this scope");
                 return opError;
             }
             localCode.emplace_back(LOADA,tempPair.first,tempPair.second);
@@ -795,14 +1035,14 @@ namespace cc0 {
 //            localCode.emplace_back(ILOAD);
         }else{
             // 看是不是全局
-            if(isDeclared(tempName,"global")){
+            if(isDeclared(tempName,Scope::Global)){
                 if(isConst(tempName)){
-                    errOut(_current_pos,"const var can not be assigned");
+                    errOut(currentPos(),"const var can not be assigned");
                     return opError;
                 }
                 tempPair = getVar(tempName);
-                if(tempPair.first == "-"){
-                    errOut(_current_pos,"var is not declared in this scope");
+                if(tempPair.first < 0){
+                    errOut(currentPos(),"var is not declared in this scope");
                     return opError;
                 }
                 if(globalFlag){
@@ -811,14 +1051,14 @@ namespace cc0 {
                     localCode.emplace_back(LOADA,tempPair.first,tempPair.second);
                 }
             }else{
-                errOut(_current_pos,"var is not declared");
+                errOut(currentPos(),"var is not declared");
                 return opError;
             }
         }
 
         next = nextToken();
         if (!next.has_value() || next.value().GetType() != TT::EQUAL_SIGN) {
-            errOut(_current_pos,"assignment need equal sign");
+            errOut(currentPos(),"assignment need equal sign");
             return opError;
         }
         auto err = normalExpression();
@@ -842,19 +1082,19 @@ namespace cc0 {
         std::optional<CompilationError> err;
         auto next = nextToken();
         if (!next.has_value()) {
-            errOut(_current_pos,"incomplete jumpStatement");
+            errOut(currentPos(),"incomplete jumpStatement");
             return opError;
         }
         jumpInfo tmpJmp;
         if(next.value().GetType() == TT::CONTINUE){
             if(!inLoop){
-                errOut(_current_pos,"wrong continue position");
+                errOut(currentPos(),"wrong continue position");
                 return opError;
             }
             // 预读判断分号
             next = nextToken();
             if(!next.has_value()||next.value().GetType() != TT::SEMICOLON){
-                errOut(_current_pos,"no semicolon");
+                errOut(currentPos(),"no semicolon");
                 return opError;
             }
             // 此时的size就是下一条jmp语句的位置
@@ -866,12 +1106,12 @@ namespace cc0 {
         }
         if(next.value().GetType() == TT::BREAK){
             if(!inLoop&&!inSwitch){
-                errOut(_current_pos,"wrong break position");
+                errOut(currentPos(),"wrong break position");
                 return opError;
             }
             next = nextToken();
             if(!next.has_value()||next.value().GetType() != TT::SEMICOLON){
-                errOut(_current_pos,"no semicolon");
+                errOut(currentPos(),"no semicolon");
                 return opError;
             }
             tmpJmp.pos = localCode.size();
@@ -888,7 +1128,7 @@ namespace cc0 {
             }
             return {};
         }
-        errOut(_current_pos,"wrong jump statement");
+        errOut(currentPos(),"wrong jump statement");
         return opError;
     }
 
@@ -896,7 +1136,7 @@ namespace cc0 {
     std::optional<CompilationError> Analyser::returnStatement() {
         auto next = nextToken();
         if (!next.has_value() || next.value().GetType() != TT::RETURN) {
-            errOut(_current_pos,"no \' return \'");
+            errOut(currentPos(),"no \' return \'");
             return opError;
         }
         // return一定在函数中
@@ -904,9 +1144,11 @@ namespace cc0 {
             next = nextToken();
             // 如果返回，必须无值
             funcNow.isReturn = true;
+            // 紧接在 return 之前的 void 函数调用同样是尾调用
+            tailCall(0);
             localCode.emplace_back(RET);
             if(!next.has_value()||next.value().GetType() != TT::SEMICOLON){
-                errOut(_current_pos,"\' void \' function cannot have return value");
+                errOut(currentPos(),"\' void \' function cannot have return value");
                 return opError;
             }
             return {};
@@ -915,10 +1157,11 @@ namespace cc0 {
             next = nextToken();
             // int则必须有值
             if(!next.has_value()||next.value().GetType() == TT::SEMICOLON){
-                errOut(_current_pos,"\' int \' function need return value");
+                errOut(currentPos(),"\' int \' function need return value");
                 return opError;
             }
             unreadToken();
+            std::size_t start = localCode.size();
             auto err = normalExpression();
             if(err.has_value()){
                 return err;
@@ -926,17 +1169,32 @@ namespace cc0 {
             // 也要注意判断分号
             next = nextToken();
             if(!next.has_value()||next.value().GetType() != TT::SEMICOLON){
-                errOut(_current_pos,"no semicolon");
+                errOut(currentPos(),"no semicolon");
                 return opError;
             }
             funcNow.isReturn = true;
+            // return f(...);
+            tailCall(start);
             localCode.emplace_back(IRET);
             return {};
         }
-        errOut(_current_pos,"wrong function type");
+        errOut(currentPos(),"wrong function type");
         return opError;
     }
 
+    // 即将生成返回指令时，如果 [start, 末尾) 的最后一条是对同类型函数的 call，把它换成 tailcall
+    // call 之后执行的一定是这条返回指令：表达式中没有跳转，之前记录的跳转目标也都不会越过这条 call
+    // 返回指令照常生成，跳到它的分支不受影响
+    void Analyser::tailCall(std::size_t start) {
+        if (localCode.size() <= start || localCode.back().GetOperation() != CALL) {
+            return;
+        }
+        auto& call = localCode.back();
+        if (funcAt(call.GetParam1()).funcType == funcNow.funcType) {
+            call = Instruction(TAILCALL, call.GetParam1());
+        }
+    }
+
     // <condition-statement> ::=
     //     'if' '(' <condition> ')' <statement> ['else' <statement>]
     //    |'switch' '(' <expression> ')' '{' {<labeled-statement>} '}'
@@ -961,7 +1219,7 @@ namespace cc0 {
                 }
                 break;
             default:
-                errOut(_current_pos,"wrong conditionStatement");
+                errOut(currentPos(),"wrong conditionStatement");
                 return opError;
                 break;
         }
@@ -972,12 +1230,12 @@ namespace cc0 {
     std::optional<CompilationError> Analyser::ifCondition() {
         auto next = nextToken();
         if (!next.has_value() || next.value().GetType() != TT::IF) {
-            errOut(_current_pos,"no \' if \'");
+            errOut(currentPos(),"no \' if \'");
             return opError;
         }
         next = nextToken();
         if (!next.has_value() || next.value().GetType() != TT::LEFT_PARENTHESIS) {
-            errOut(_current_pos,"no \' ( \'");
+            errOut(currentPos(),"no \' ( \'");
             return opError;
         }
         auto err = normalCondition();
@@ -987,26 +1245,26 @@ namespace cc0 {
         unsigned long long conditionEnd = localCode.size()-1;
         next = nextToken();
         if (!next.has_value() || next.value().GetType() != TT::RIGHT_PARENTHESIS) {
-            errOut(_current_pos,"no \' ) \'");
+            errOut(currentPos(),"no \' ) \'");
             return opError;
         }
         err = normalStatement();
         if(err.has_value()){
             return err;
         }
-        localCode[conditionEnd] = Instruction(localCode[conditionEnd].GetOperation(),to_string(localCode.size()));
+        localCode[conditionEnd].SetParam1(localCode.size());
 
         next = nextToken();
         if (next.has_value() && next.value().GetType() == TT::ELSE) {
             localCode.emplace_back(JMP);
             // 更新if的jump
-            localCode[conditionEnd] = Instruction(localCode[conditionEnd].GetOperation(),to_string(localCode.size()));
+            localCode[conditionEnd].SetParam1(localCode.size());
             unsigned long long jumpEnd = localCode.size()-1;
             err = normalStatement();
             if(err.has_value()){
                 return err;
             }
-            localCode[jumpEnd] = Instruction(localCode[jumpEnd].GetOperation(),to_string(localCode.size()));
+            localCode[jumpEnd].SetParam1(localCode.size());
         } else {
             unreadToken();
             return {};
@@ -1075,66 +1333,59 @@ namespace cc0 {
                 localCode.emplace_back(JNE);
                 break;
             default:
-                errOut(_current_pos,"wrong condition statement");
+                errOut(currentPos(),"wrong condition statement");
                 return opError;
         }
         return {};
     }
 
     // 'switch' '(' <expression> ')' '{' {<labeled-statement>} '}'
+    // 表达式只计算一次，值留在栈上，先跳过各个分支到最后的分派代码：
+    //     <expression>; jmp dispatch; 各分支依次排列; jmp end; dispatch: ...; end:
+    // 分支之间按照 C 的语义顺序执行，分派代码在所有 case 的值都确定之后才生成
     std::optional<CompilationError> Analyser::switchCondition() {
         // switch中也会用到break
         // 有可能之前有jumpPos，因此需要储存
         std::vector<cc0::jumpInfo> beforeJumpPos;
         beforeJumpPos = jumpPos;
         jumpPos.clear();
-        switchCode.clear();
-        caseValue.clear();
+        // 嵌套的 switch 需要保存外层的 case
+        auto beforeCases = std::move(switchCases);
+        auto beforeDefault = switchDefault;
+        switchCases.clear();
+        switchDefault = -1;
         bool beforeInSwitch = inSwitch;
         inSwitch = true;
         auto next = nextToken();
         if(!next.has_value()||next.value().GetType() != TT::SWITCH){
-            errOut(_current_pos,"incomplete switch");
+            errOut(currentPos(),"incomplete switch");
             return opError;
         }
         next = nextToken();
         if(!next.has_value()||next.value().GetType() != TT::LEFT_PARENTHESIS){
-            errOut(_current_pos,"no \' ( \'");
+            errOut(currentPos(),"no \' ( \'");
             return opError;
         }
-        auto eBegin = localCode.size();
         auto err = normalExpression();
         if(err.has_value()){
             return err;
         }
-        auto eEnd = localCode.size()-1;
-        // 将表达式代码进行另外存储，注意顺序一定从开始到结束
-        for(unsigned long long i = eBegin;i<=eEnd;i++){
-            switchCode.emplace_back(localCode[i]);
-        }
-        // 弹出对应条代码
-        for(unsigned long long i = eBegin;i<=eEnd;i++){
-            localCode.pop_back();
-        }
         next = nextToken();
         if(!next.has_value()||next.value().GetType() != TT::RIGHT_PARENTHESIS){
-            errOut(_current_pos,"no \' ) \'");
+            errOut(currentPos(),"no \' ) \'");
             return opError;
         }
         next = nextToken();
         if(!next.has_value()||next.value().GetType() != TT::LEFT_BRACE){
-            errOut(_current_pos,"no \' { \'");
+            errOut(currentPos(),"no \' { \'");
             return opError;
         }
-        bool firstJump = false;
+        // 跳到分派代码，稍后回填
+        auto dispatchJump = localCode.size();
+        localCode.emplace_back(JMP);
         while(true){
             next = nextToken();
             if(next.has_value()&&next.value().GetType()!=RIGHT_BRACE){
-                // 如果第一个是case，则需要跳过第一行的强制jmp指令
-                if(!firstJump&&next.value().GetType() == CASE){
-                    firstJump = true;
-                    localCode.emplace_back(JMP,to_string(localCode.size()+2));
-                }
                 unreadToken();
                 err = labeledStatement();
                 if(err.has_value()){
@@ -1148,122 +1399,166 @@ namespace cc0 {
         }
         next = nextToken();
         if(!next.has_value()||next.value().GetType() != TT::RIGHT_BRACE){
-            errOut(_current_pos,"no \' } \'");
+            errOut(currentPos(),"no \' } \'");
             return opError;
         }
-        auto switchEnd = to_string(localCode.size());
+        // 最后一个分支执行完之后跳过分派代码
+        jumpPos.push_back(jumpInfo{static_cast<int>(localCode.size()), "break"});
+        localCode.emplace_back(JMP);
+        localCode[dispatchJump].SetParam1(localCode.size());
+        auto cases = switchCases;
+        std::sort(cases.begin(), cases.end());
+        switchDispatch(cases, 0, cases.size());
+        auto switchEnd = localCode.size();
         for(auto & jump : jumpPos) {
             // 都是无条件跳转，直接jmp就行
             if (jump.type == "break") {
                 localCode[jump.pos] = Instruction(JMP, switchEnd);
             }
+            // continue 属于外层的循环
+            else {
+                beforeJumpPos.push_back(jump);
+            }
         }
         jumpPos = beforeJumpPos;
+        switchCases = std::move(beforeCases);
+        switchDefault = beforeDefault;
         inSwitch = beforeInSwitch;
         return {};
     }
 
+    namespace {
+        // 至少有这么多个 case、且值的范围不超过 case 个数的两倍时使用跳转表
+        constexpr std::size_t MinTableCases = 4;
+        // 不超过这么多个 case 时逐个比较，否则二分
+        constexpr std::size_t MaxLinearCases = 3;
+    }
+
+    void Analyser::jumpToDefault() {
+        if (switchDefault >= 0) {
+            localCode.emplace_back(JMP, switchDefault);
+        }
+        else {
+            jumpPos.push_back(jumpInfo{static_cast<int>(localCode.size()), "break"});
+            localCode.emplace_back(JMP);
+        }
+    }
+
+    // 稠密的 case 用 tableswitch low, count，其后是 count 个跳到各个值的分支的 jmp 和一个跳到 default 的 jmp
+    // 稀疏的 case 二分比较，直到剩下的值足够稠密或者足够少
+    void Analyser::switchDispatch(const std::vector<std::pair<int32_t, int>>& cases, std::size_t first, std::size_t last) {
+        auto count = last - first;
+        if (count >= MinTableCases) {
+            auto low = cases[first].first;
+            auto span = static_cast<int64_t>(cases[last - 1].first) - low + 1;
+            if (span <= static_cast<int64_t>(count) * 2) {
+                localCode.emplace_back(TABLESWITCH, low, static_cast<int32_t>(span));
+                // 中间没有 case 的值跳到 default
+                std::size_t i = first;
+                for (int64_t value = low; value < low + span; value++) {
+                    if (cases[i].first == value) {
+                        localCode.emplace_back(JMP, cases[i++].second);
+                    }
+                    else {
+                        jumpToDefault();
+                    }
+                }
+                jumpToDefault();
+                return;
+            }
+        }
+        if (count <= MaxLinearCases) {
+            for (auto i = first; i < last; i++) {
+                // dup; ipush value; icmp; jne next; pop; jmp case; next:
+                localCode.emplace_back(DUP);
+                localCode.emplace_back(IPUSH, cases[i].first);
+                localCode.emplace_back(ICMP);
+                localCode.emplace_back(JNE, localCode.size() + 3);
+                localCode.emplace_back(POP);
+                localCode.emplace_back(JMP, cases[i].second);
+            }
+            localCode.emplace_back(POP);
+            jumpToDefault();
+            return;
+        }
+        // 小于中间的值时顺序执行左半部分，否则跳到右半部分
+        auto middle = first + count / 2;
+        localCode.emplace_back(DUP);
+        localCode.emplace_back(IPUSH, cases[middle].first);
+        localCode.emplace_back(ICMP);
+        auto rightJump = localCode.size();
+        localCode.emplace_back(JGE);
+        switchDispatch(cases, first, middle);
+        localCode[rightJump].SetParam1(localCode.size());
+        switchDispatch(cases, middle, last);
+    }
+
     // <labeled-statement> ::=
     //     'case' (<integer-literal>|<char-literal>) ':' <statement>
     //    |'default' ':' <statement>
-    // 每一个case都需要加载expression的值然后对interger进行比较
+    // 只记录分支的开始位置，分支之间没有额外的代码
     std::optional<CompilationError> Analyser::labeledStatement(){
         auto next = nextToken();
         std::optional<CompilationError> err;
         if(!next.has_value()){
-            errOut(_current_pos,"incomplete switch label");
+            errOut(currentPos(),"incomplete switch label");
             return opError;
         }
-        auto labelType = next.value().GetType();
-        // 防止跳过初始化语句，提前定义
-        auto caseType = next.value().GetType();
-        std::string nextValue;
-        int jmpPos,statementEnd;
-        jumpInfo tmpJmp;
-        switch(labelType){
+        int32_t caseNum;
+        switch(next.value().GetType()){
             case CASE:
-                // 首先顺流下来的值，跳过自己的条件判断，直接执行代码，因此需要有个jmp
-                // 当前的位置加上表达式代码的长度，再加上每个case判断时增加的三个指令的下一个
-                localCode.emplace_back(JMP,to_string(localCode.size()+switchCode.size()+3+1));
-                // 将expression的值加载过来
-                for(auto & code:switchCode){
-                    localCode.emplace_back(code);
-                }
                 next = nextToken();
                 if(!next.has_value()){
-                    errOut(_current_pos,"need compare value after \'case\'");
+                    errOut(currentPos(),"need compare value after \'case\'");
                     return opError;
                 }
-                caseType = next.value().GetType();
                 // 这里只可能是int的，因此其他的都是类型错误
-                switch(caseType){
+                switch(next.value().GetType()){
                     case DECIMAL_INTEGER:
                     case HEXADECIMAL_INTEGER:
-                        nextValue = next.value().GetValueString();
-                        // case查重
-                        for(auto & caseV:caseValue){
-                            if(caseV == nextValue){
-                                errOut(_current_pos,"duplicated case value");
+                        if(!next.value().GetIntValue(caseNum)){
+                            errOut(currentPos(),"integer overflow");
+                            return std::make_optional<CompilationError>(currentPos(), ErrorCode::ErrIntegerOverflow);
+                        }
+                        // case查重，按值比较，0x10 和 16 是重复的
+                        for(auto & caseV:switchCases){
+                            if(caseV.first == caseNum){
+                                errOut(currentPos(),"duplicated case value");
                                 return opError;
                             }
                         }
-                        caseValue.emplace_back(nextValue);
-                        localCode.emplace_back(IPUSH,nextValue);
-                        localCode.emplace_back(ICMP);
-                        // 如果不等于，就跳转到当前case语句的下一条
-                        localCode.emplace_back(JNE);
                         break;
                     default:
-                        errOut(_current_pos,"wrong case value type");
+                        errOut(currentPos(),"wrong case value type");
                         return opError;
                 }
                 next = nextToken();
                 if(!next.has_value()||next.value().GetType()!=TT::COLON){
-                    errOut(_current_pos,"no \' : \'");
+                    errOut(currentPos(),"no \' : \'");
                     return opError;
                 }
-                // 记录jne的位置
-                jmpPos = localCode.size()-1;
-                err = normalStatement();
-                if(err.has_value()){
-                    return err;
-                }
-                //
-                // 当前statement的下一语句的位置，用于进行多重判断
-                statementEnd = localCode.size();
-                // 跳过前面的强制jmp
-                localCode[jmpPos] = Instruction(localCode[jmpPos].GetOperation(),to_string(statementEnd+1));
+                switchCases.emplace_back(caseNum, static_cast<int>(localCode.size()));
                 break;
             case DEFAULT:
-                // 用default代替
-                nextValue = "default";
-                for(auto & caseV:caseValue){
-                    if(caseV == nextValue){
-                        errOut(_current_pos,"duplicated case value");
-                        return opError;
-                    }
+                if(switchDefault >= 0){
+                    errOut(currentPos(),"duplicated case value");
+                    return opError;
                 }
-                caseValue.emplace_back(nextValue);
-                // default直接默认执行，然后结束强制离开switch
                 next = nextToken();
                 if(!next.has_value()||next.value().GetType()!=TT::COLON){
-                    errOut(_current_pos,"no \' : \'");
+                    errOut(currentPos(),"no \' : \'");
                     return opError;
                 }
-                err = normalStatement();
-                if(err.has_value()){
-                    return err;
-                }
-                // 添加虚无的break
-                tmpJmp.pos = localCode.size();
-                tmpJmp.type = "break";
-                jumpPos.emplace_back(tmpJmp);
-                localCode.emplace_back(JMP);
+                switchDefault = static_cast<int>(localCode.size());
                 break;
             default:
-                errOut(_current_pos,"wrong switch label type");
+                errOut(currentPos(),"wrong switch label type");
                 return opError;
         }
+        err = normalStatement();
+        if(err.has_value()){
+            return err;
+        }
         return {};
     }
 
@@ -1307,7 +1602,7 @@ namespace cc0 {
                 }
                 break;
             default:
-                errOut(_current_pos,"wrong loopStatement");
+                errOut(currentPos(),"wrong loopStatement");
                 return opError;
                 break;
         }
@@ -1322,12 +1617,12 @@ namespace cc0 {
         jumpPos.clear();
         auto next = nextToken();
         if (!next.has_value() || next.value().GetType() != TT::WHILE) {
-            errOut(_current_pos,"no \' while \'");
+            errOut(currentPos(),"no \' while \'");
             return opError;
         }
         next = nextToken();
         if (!next.has_value() || next.value().GetType() != TT::LEFT_PARENTHESIS) {
-            errOut(_current_pos,"no \' ( \'");
+            errOut(currentPos(),"no \' ( \'");
             return opError;
         }
         // 记录开始位置，size就是下一个指令的位置
@@ -1340,7 +1635,7 @@ namespace cc0 {
         auto conditionEnd = localCode.size()-1;
         next = nextToken();
         if (!next.has_value() || next.value().GetType() != TT::RIGHT_PARENTHESIS) {
-            errOut(_current_pos,"no \' ) \'");
+            errOut(currentPos(),"no \' ) \'");
             return opError;
         }
         err = normalStatement();
@@ -1348,15 +1643,15 @@ namespace cc0 {
             return err;
         }
         // 增加jmp到开头的循环语句，对所有的continue也要设置如此
-        localCode.emplace_back(JMP,to_string(conditionBegin));
+        localCode.emplace_back(JMP, conditionBegin);
         // 记录循环语句的下一句的位置，更新jmp
-        auto loopEnd = to_string(localCode.size());
+        auto loopEnd = localCode.size();
         // 为条件判断处的jmp语句进行退出地址的回填，对所有的break也要设置如此
-        localCode[conditionEnd] = Instruction(localCode[conditionEnd].GetOperation(),loopEnd);
+        localCode[conditionEnd].SetParam1(loopEnd);
         for(auto & jump : jumpPos){
             // 都是无条件跳转，直接jmp就行
             if(jump.type == "continue"){
-                localCode[jump.pos] = Instruction(JMP,to_string(conditionBegin));
+                localCode[jump.pos] = Instruction(JMP, conditionBegin);
             }
             if(jump.type == "break"){
                 localCode[jump.pos] = Instruction(JMP,loopEnd);
@@ -1372,7 +1667,7 @@ namespace cc0 {
         jumpPos.clear();
         auto next = nextToken();
         if(!next.has_value()||next.value().GetType() != TT::DO){
-            errOut(_current_pos,"no \' do \' ");
+            errOut(currentPos(),"no \' do \' ");
             return opError;
         }
         // {}是在statement中判断的
@@ -1383,12 +1678,12 @@ namespace cc0 {
         }
         next = nextToken();
         if (!next.has_value() || next.value().GetType() != TT::WHILE) {
-            errOut(_current_pos,"no \' while \'");
+            errOut(currentPos(),"no \' while \'");
             return opError;
         }
         next = nextToken();
         if (!next.has_value() || next.value().GetType() != TT::LEFT_PARENTHESIS) {
-            errOut(_current_pos,"no \' ( \'");
+            errOut(currentPos(),"no \' ( \'");
             return opError;
         }
         // 记录开始位置，size就是下一个指令的位置
@@ -1401,23 +1696,23 @@ namespace cc0 {
         auto conditionEnd = localCode.size()-1;
         next = nextToken();
         if (!next.has_value() || next.value().GetType() != TT::RIGHT_PARENTHESIS) {
-            errOut(_current_pos,"no \' ) \'");
+            errOut(currentPos(),"no \' ) \'");
             return opError;
         }
         next = nextToken();
         if (!next.has_value() || next.value().GetType() != TT::SEMICOLON) {
-            errOut(_current_pos,"no semicolon");
+            errOut(currentPos(),"no semicolon");
             return opError;
         }
         // do-while需要在条件语句的最后jmp到循环的开头，和其他两个的区别
-        localCode.emplace_back(JMP,to_string(loopBegin));
-        auto loopEnd = to_string(localCode.size());
+        localCode.emplace_back(JMP, loopBegin);
+        auto loopEnd = localCode.size();
         // 为条件判断处的jmp语句进行退出地址的回填，对所有的break也要设置如此
-        localCode[conditionEnd] = Instruction(localCode[conditionEnd].GetOperation(),loopEnd);
+        localCode[conditionEnd].SetParam1(loopEnd);
         for(auto & jump : jumpPos){
             // 都是无条件跳转，直接jmp就行
             if(jump.type == "continue"){
-                localCode[jump.pos] = Instruction(JMP,to_string(conditionBegin));
+                localCode[jump.pos] = Instruction(JMP, conditionBegin);
             }
             if(jump.type == "break"){
                 localCode[jump.pos] = Instruction(JMP,loopEnd);
@@ -1437,17 +1732,17 @@ namespace cc0 {
         jumpPos.clear();
         auto next = nextToken();
         if(!next.has_value()||next.value().GetType() != TT::FOR){
-            errOut(_current_pos,"no \' for \'");
+            errOut(currentPos(),"no \' for \'");
             return opError;
         }
         next = nextToken();
         if(!next.has_value()||next.value().GetType() != TT::LEFT_PARENTHESIS){
-            errOut(_current_pos,"no \' ( \'");
+            errOut(currentPos(),"no \' ( \'");
             return opError;
         }
         next = nextToken();
         if(!next.has_value()){
-            errOut(_current_pos,"incomplete for head");
+            errOut(currentPos(),"incomplete for head");
             return opError;
         }
         std::optional<CompilationError> err;
@@ -1473,13 +1768,13 @@ namespace cc0 {
             // 防止影响下一个
             next = nextToken();
             if(!next.has_value()||next.value().GetType()!=TT::SEMICOLON){
-                errOut(_current_pos,"incomplete for head");
+                errOut(currentPos(),"incomplete for head");
                 return opError;
             }
         }
         next = nextToken();
         if(!next.has_value()){
-            errOut(_current_pos,"incomplete for head");
+            errOut(currentPos(),"incomplete for head");
             return opError;
         }
         // 判断有无条件语句
@@ -1494,7 +1789,7 @@ namespace cc0 {
             }
             next = nextToken();
             if(!next.has_value()||next.value().GetType()!=TT::SEMICOLON){
-                errOut(_current_pos,"incomplete for head");
+                errOut(currentPos(),"incomplete for head");
                 return opError;
             }
         }
@@ -1502,7 +1797,7 @@ namespace cc0 {
         // 没有条件则默认为真，直接顺序执行，不必更新conditionEnd
         next = nextToken();
         if(!next.has_value()){
-            errOut(_current_pos,"incomplete for head");
+            errOut(currentPos(),"incomplete for head");
             return opError;
         }
         // 判断有无更新语句
@@ -1518,7 +1813,7 @@ namespace cc0 {
             updateBegin = localCode.size();
             // 此时是标识符
 //            if(!next.has_value()||next.value().GetType()!=TT::IDENTIFIER){
-//                errOut(_current_pos,"wrong for update expression");
+//                errOut(currentPos(),"wrong for update expression");
 //                return opError;
 //            }
             next = nextToken();//下一个符号
@@ -1540,7 +1835,7 @@ namespace cc0 {
                         return err;
                     }
                 }else{
-                    errOut(_current_pos,"wrong for update expression");
+                    errOut(currentPos(),"wrong for update expression");
                     return opError;
                 }
             }
@@ -1549,7 +1844,7 @@ namespace cc0 {
                 if (next.has_value() && next.value().GetType() == TT::COMMA) {
                     next = nextToken();// 此时应该是标识符
                     if(!next.has_value()){
-                        errOut(_current_pos,"wrong for update expression");
+                        errOut(currentPos(),"wrong for update expression");
                         return opError;
                     }
                     next = nextToken();// 符号
@@ -1569,7 +1864,7 @@ namespace cc0 {
                                 return err;
                             }
                         }else{
-                            errOut(_current_pos,"wrong for update expression");
+                            errOut(currentPos(),"wrong for update expression");
                             return opError;
                         }
                     }
@@ -1580,11 +1875,11 @@ namespace cc0 {
             }
             next = nextToken();
             if(!next.has_value()||next.value().GetType() != TT::RIGHT_PARENTHESIS){
-                errOut(_current_pos,"incomplete for head");
+                errOut(currentPos(),"incomplete for head");
                 return opError;
             }
-            localCode.emplace_back(JMP,to_string(conditionBegin));
-            localCode[updateBefore] = Instruction(JMP,to_string(localCode.size()));
+            localCode.emplace_back(JMP, conditionBegin);
+            localCode[updateBefore] = Instruction(JMP, localCode.size());
         }
         err = normalStatement();
         if(err.has_value()){
@@ -1592,16 +1887,16 @@ namespace cc0 {
         }
 
         // for需要在语句的最后jmp到更新的开头
-        localCode.emplace_back(JMP,to_string(updateBegin));
-        auto loopEnd = to_string(localCode.size());
+        localCode.emplace_back(JMP, updateBegin);
+        auto loopEnd = localCode.size();
         // 为条件判断处的jmp语句进行退出地址的回填，break同样需要
         if(hasCondition){
-            localCode[conditionEnd] = Instruction(localCode[conditionEnd].GetOperation(),loopEnd);
+            localCode[conditionEnd].SetParam1(loopEnd);
         }
         for(auto & jump : jumpPos){
             // 都是无条件跳转，直接jmp就行
             if(jump.type == "continue"){
-                localCode[jump.pos] = Instruction(JMP,to_string(updateBegin));
+                localCode[jump.pos] = Instruction(JMP, updateBegin);
             }
             if(jump.type == "break"){
                 localCode[jump.pos] = Instruction(JMP,loopEnd);
@@ -1615,40 +1910,40 @@ namespace cc0 {
     std::optional<CompilationError> Analyser::scanStatement() {
         auto next = nextToken();
         if (!next.has_value() || next.value().GetType() != TT::SCAN) {
-            errOut(_current_pos,"no \' scan \'");
+            errOut(currentPos(),"no \' scan \'");
             return opError;
         }
         next = nextToken();
         if (!next.has_value() || next.value().GetType() != TT::LEFT_PARENTHESIS) {
-            errOut(_current_pos,"no \' ( \'");
+            errOut(currentPos(),"no \' ( \'");
             return opError;
         }
         next = nextToken();
         if (!next.has_value() || next.value().GetType() != TT::IDENTIFIER) {
-            errOut(_current_pos,"\'scan\' need var to assign");
+            errOut(currentPos(),"\'scan\' need var to assign");
             return opError;
         }
         string tempName = next.value().GetValueString();
         // 判断是否合法
-        if(((!isDeclared(tempName,"local"))&&(!isDeclared(tempName,"global")))||getFunc(tempName)!=-1||isConst(tempName)){
-            errOut(_current_pos,"var is not declaration or is function or is const");
+        if(((!isDeclared(tempName,Scope::Local))&&(!isDeclared(tempName,Scope::Global)))||getFunc(tempName)!=-1||isConst(tempName)){
+            errOut(currentPos(),"var is not declaration or is function or is const");
             return opError;
         }
-        std::pair<std::string,std::string> tempPair = getVar(tempName);
-        if(tempPair.first == "-"){
-            errOut(_current_pos,"var is not declared in this scope");
+        std::pair<int32_t,int32_t> tempPair = getVar(tempName);
+        if(tempPair.first < 0){
+            errOut(currentPos(),"var is not declared in this scope");
             return opError;
         }
         localCode.emplace_back(LOADA,tempPair.first,tempPair.second);
 
         next = nextToken();
         if (!next.has_value() || next.value().GetType() != TT::RIGHT_PARENTHESIS) {
-            errOut(_current_pos,"no \' ) \'");
+            errOut(currentPos(),"no \' ) \'");
             return opError;
         }
         next = nextToken();
         if (!next.has_value() || next.value().GetType() != TT::SEMICOLON) {
-            errOut(_current_pos,"no semicolon");
+            errOut(currentPos(),"no semicolon");
             return opError;
         }
 
@@ -1662,12 +1957,12 @@ namespace cc0 {
     std::optional<CompilationError> Analyser::printStatement() {
         auto next = nextToken();
         if (!next.has_value() || next.value().GetType() != TT::PRINT) {
-            errOut(_current_pos,"no \' print \'");
+            errOut(currentPos(),"no \' print \'");
             return opError;
         }
         next = nextToken();
         if (!next.has_value() || next.value().GetType() != TT::LEFT_PARENTHESIS) {
-            errOut(_current_pos,"no \' ( \'");
+            errOut(currentPos(),"no \' ( \'");
             return opError;
         }
         // 预读判断follow
@@ -1675,7 +1970,7 @@ namespace cc0 {
         if (next.has_value() && next.value().GetType() == TT::RIGHT_PARENTHESIS) {
             next = nextToken();
             if (!next.has_value() || next.value().GetType() != TT::SEMICOLON) {
-                errOut(_current_pos,"no semicolon");
+                errOut(currentPos(),"no semicolon");
                 return opError;
             }
         } else {
@@ -1686,12 +1981,12 @@ namespace cc0 {
             }
             next = nextToken();
             if (!next.has_value() || next.value().GetType() != TT::RIGHT_PARENTHESIS) {
-                errOut(_current_pos,"no \' ) \'");
+                errOut(currentPos(),"no \' ) \'");
                 return opError;
             }
             next = nextToken();
             if (!next.has_value() || next.value().GetType() != TT::SEMICOLON) {
-                errOut(_current_pos,"no semicolon");
+                errOut(currentPos(),"no semicolon");
                 return opError;
             }
         }
@@ -1710,7 +2005,7 @@ namespace cc0 {
             auto next = nextToken();
             if (next.has_value() && next.value().GetType() == TT::COMMA) {
                 // 输出空格
-                localCode.emplace_back(IPUSH,"32");
+                localCode.emplace_back(IPUSH, 32);
                 localCode.emplace_back(CPRINT);
                 err = printable();
                 if(err.has_value()){
@@ -1735,11 +2030,7 @@ namespace cc0 {
             // string作为常量存储
             if(next.value().GetType() == TT::STRING){
                 std::string str = next.value().GetValueString();
-                constInfo tempConst;
-                tempConst.type = 'S';
-                tempConst.value = '\"'+str.substr(1,str.length()-2)+'\"';
-                constList.emplace_back(tempConst);
-                localCode.emplace_back(LOADC,to_string(constList.size()-1));
+                localCode.emplace_back(LOADC, internConst('S', '\"'+str.substr(1,str.length()-2)+'\"'));
                 localCode.emplace_back(SPRINT);
             }else{
                 if(next.value().GetType() == TT::CHAR){
@@ -1747,10 +2038,10 @@ namespace cc0 {
                     std::string str = next.value().GetValueString();
                     int charNum = getCharNum(str);
                     if(charNum<0||charNum>255){
-                        errOut(_current_pos,"wrong char content");
+                        errOut(currentPos(),"wrong char content");
                         return opError;
                     }
-                    localCode.emplace_back(IPUSH,to_string(charNum));
+                    localCode.emplace_back(IPUSH, charNum);
                     localCode.emplace_back(CPRINT);
                 }else{
                     unreadToken();
@@ -1880,13 +2171,13 @@ namespace cc0 {
             if(next.has_value()&&next.value().GetType() == TT::LEFT_PARENTHESIS){
                 next = nextToken();
                 if(!next.has_value()){
-                    errOut(_current_pos,"wrong expression");
+                    errOut(currentPos(),"wrong expression");
                     return opError;
                 }
                 auto type = next.value().GetType();
                 switch (type){
                     case VOID:
-                        errOut(_current_pos,"cannot transfer type to void");
+                        errOut(currentPos(),"cannot transfer type to void");
                         return opError;
                     case INT:
                     case CHAR:
@@ -1894,7 +2185,7 @@ namespace cc0 {
 
                         next = nextToken();
                         if(!next.has_value()||next.value().GetType()!=TT::RIGHT_PARENTHESIS){
-                            errOut(_current_pos,"incomplete type transfer");
+                            errOut(currentPos(),"incomplete type transfer");
                             return opError;
                         }
                         break;
@@ -1925,7 +2216,7 @@ namespace cc0 {
     std::optional<CompilationError> Analyser::unaryExpression() {
         auto next = nextToken();
         if (!next.has_value()) {
-            errOut(_current_pos,"expression is not complete");
+            errOut(currentPos(),"expression is not complete");
             return opError;
         }
         bool _negative = false;
@@ -1963,7 +2254,7 @@ namespace cc0 {
         auto next = nextToken();
         std::optional<CompilationError> err;
         if (!next.has_value()) {
-            errOut(_current_pos,"expression is not complete");
+            errOut(currentPos(),"expression is not complete");
             return opError;
         }
         switch (next.value().GetType()) {
@@ -1974,18 +2265,24 @@ namespace cc0 {
                 }
                 next = nextToken();
                 if (!next.has_value() || next.value().GetType() != RIGHT_PARENTHESIS) {
-                    errOut(_current_pos,"no \' ) \' ");
+                    errOut(currentPos(),"no \' ) \' ");
                     return opError;
                 }
                 break;
             case DECIMAL_INTEGER:
-            case HEXADECIMAL_INTEGER:
+            case HEXADECIMAL_INTEGER: {
+                int32_t num;
+                if(!next.value().GetIntValue(num)){
+                    errOut(currentPos(),"integer overflow");
+                    return std::make_optional<CompilationError>(currentPos(), ErrorCode::ErrIntegerOverflow);
+                }
                 if(globalFlag){
-                    globalCode.emplace_back(IPUSH,next.value().GetValueString());
+                    globalCode.emplace_back(IPUSH,num);
                 }else{
-                    localCode.emplace_back(IPUSH,next.value().GetValueString());
+                    localCode.emplace_back(IPUSH,num);
                 }
                 break;
+            }
             case IDENTIFIER:
                 // 再次预读，判断是不是函数
                 next = nextToken();
@@ -1998,8 +2295,8 @@ namespace cc0 {
                     next = nextToken();
                     string tempName = next.value().GetValueString();
                     // 未定义或者返回值为void
-                    if(getFunc(tempName)==-1||funcList[getFunc(tempName)].funcType == "void"){
-                        errOut(_current_pos,"function not declared or has no return value ");
+                    if(getFunc(tempName)==-1||funcAt(getFunc(tempName)).funcType == "void"){
+                        errOut(currentPos(),"function not declared or has no return value ");
                         return opError;
                     }
                     // 如果正常则需要再次回退
@@ -2016,26 +2313,26 @@ namespace cc0 {
                     string tempName = next.value().GetValueString();
                     // 判断是否合法的变量，可能是全局，因为初始化时可以表达式赋值
                     if(globalFlag){
-                        if(!isDeclared(tempName,"global")){
-                            errOut(_current_pos,"var is not declared in this scope");
+                        if(!isDeclared(tempName,Scope::Global)){
+                            errOut(currentPos(),"var is not declared in this scope");
                             return opError;
                         }
-                        std::pair<std::string,std::string> tempPair = getVar(tempName);
-                        if(tempPair.first == "-"){
-                            errOut(_current_pos,"var is not declared in this scope");
+                        std::pair<int32_t,int32_t> tempPair = getVar(tempName);
+                        if(tempPair.first < 0){
+                            errOut(currentPos(),"var is not declared in this scope");
                             return opError;
                         }
                         globalCode.emplace_back(LOADA,tempPair.first,tempPair.second);
                         globalCode.emplace_back(ILOAD);
                     }else{
                         // 如果没有本地或者全局定义就报错
-                        if((!isDeclared(tempName,"local"))&&(!isDeclared(tempName,"global"))){
-                            errOut(_current_pos,"var is not declared in this scope");
+                        if((!isDeclared(tempName,Scope::Local))&&(!isDeclared(tempName,Scope::Global))){
+                            errOut(currentPos(),"var is not declared in this scope");
                             return opError;
                         }
-                        std::pair<std::string,std::string> tempPair = getVar(tempName);
-                        if(tempPair.first == "-"){
-                            errOut(_current_pos,"var is not declared in this scope");
+                        std::pair<int32_t,int32_t> tempPair = getVar(tempName);
+                        if(tempPair.first < 0){
+                            errOut(currentPos(),"var is not declared in this scope");
                             return opError;
                         }
                         localCode.emplace_back(LOADA,tempPair.first,tempPair.second);
@@ -2044,92 +2341,97 @@ namespace cc0 {
                 }
                 break;
             default:
-                errOut(_current_pos,"expression is not complete");
+                errOut(currentPos(),"expression is not complete");
                 return opError;
         }
         return {};
     }
 
-    std::optional<Token> Analyser::nextToken() {
-        if (_offset == _tokens.size())
+    std::optional<TokenRef> Analyser::nextToken() {
+        if (_tokenizer != nullptr) {
+            if (_offset == _read && !fetchToken())
+                return {};
+            auto& token = _ring[_offset++ % _ring.size()];
+            _current_end = token.end;
+            return TokenRef(*_context, token);
+        }
+        if (_offset == _context->size())
             return {};
-        _current_pos = _tokens[_offset].GetEndPos();
-        return _tokens[_offset++];
+        auto token = (*_context)[_offset++];
+        _current_end = token.Get().end;
+        return token;
     }
 
     void Analyser::unreadToken() {
         if (_offset == 0)
             DieAndPrint("analyser unreads token from the begining.");
-        _current_pos = _tokens[_offset - 1].GetEndPos();
+        if (_tokenizer != nullptr) {
+            if (_read - _offset >= _ring.size())
+                DieAndPrint("analyser unreads too many tokens.");
+            _current_end = _ring[(_offset - 1) % _ring.size()].end;
+        }
+        else
+            _current_end = (*_context)[_offset - 1].Get().end;
         _offset--;
     }
 
-    bool Analyser::isDeclared(const string& name,const string& type) {
-        if(type=="local"){
-            for(auto & var:localVarList)
-                if(var.varName == name)
-                    return true;
+    bool Analyser::fetchToken() {
+        if (_tokenError.has_value())
             return false;
-        }
-        if(type=="global"){
-            for(auto & var:globalVarList)
-                if(var.varName == name)
-                    return true;
+        auto p = _tokenizer->NextCompactToken();
+        if (p.second.has_value()) {
+            if (p.second.value().GetCode() != ErrorCode::ErrEOF)
+                _tokenError = p.second;
             return false;
         }
-        return false;
+        _ring[_read++ % _ring.size()] = p.first.value();
+        return true;
     }
-    bool Analyser::isConst(const string& name) {
-        if(globalFlag){
-            for(auto & var:globalVarList)
-                if(var.varName == name)
-                    if(var.isConst)
-                        return true;
-            return false;
-        }else{
-            // 是本地变量则只搜本地，否则搜外面
-            if(isDeclared(name,"local")){
-                for(auto & var:localVarList)
-                    if(var.varName == name)
-                        if(var.isConst)
-                            return true;
-                return false;
-            }else{
-                for(auto & var:globalVarList)
-                    if(var.varName == name)
-                        if(var.isConst)
-                            return true;
-                return false;
-            }
+
+    bool Analyser::isDeclared(const string& name, Scope scope) {
+        if(scope == Scope::Global){
+            return varTable.FindIn(name, 0) != nullptr;
         }
-        return false;
+        // 全局代码中没有局部变量
+        return varTable.Depth() > 0 && varTable.FindIn(name, varTable.Depth()) != nullptr;
     }
-    std::pair<string,string> Analyser::getVar(const string& name) {
-        unsigned long long i;
-        // 需要返回栈内的偏移地址才行
-        if(globalFlag){
-            // 全局只查最外层
-            for(i = 0;i<globalVarList.size();i++)
-                if(globalVarList[i].varName == name)
-                    return make_pair("0",to_string(i));
-        }else{
-            // 局部则需要从内向外
-            for(i = 0;i<localVarList.size();i++)
-                if(localVarList[i].varName == name)
-                    return make_pair("0",to_string(i));
-            for(i = 0;i<globalVarList.size();i++)
-                if(globalVarList[i].varName == name)
-                    return make_pair("1",to_string(i));
-        }
-        // 没有这个变量，出错
-        return make_pair("-","-");
+    void Analyser::declareVar(varInfo var) {
+        var.offset = static_cast<int32_t>(varTable.Size());
+        auto name = var.varName;
+        varTable.Declare(name, std::move(var));
+    }
+    // 局部变量遮蔽同名的全局变量
+    bool Analyser::isConst(const string& name) {
+        auto var = varTable.Find(name);
+        return var != nullptr && var->value.isConst;
+    }
+    std::pair<int32_t,int32_t> Analyser::getVar(const string& name) {
+        // 需要返回栈内的偏移地址才行，层次差为当前层与声明层之差
+        auto var = varTable.Find(name);
+        if(var == nullptr){
+            // 没有这个变量，出错
+            return make_pair(-1, -1);
+        }
+        return make_pair(static_cast<int32_t>(varTable.Depth() - var->scope), var->value.offset);
+    }
+    int Analyser::internConst(char type, const string& value) {
+        auto it = constIndex.try_emplace(type + value, static_cast<int>(constList.size())).first;
+        if (it->second == static_cast<int>(constList.size())) {
+            constList.push_back(constInfo{type, value});
+        }
+        return it->second;
     }
     // 同样可判断是否和函数重名
-    int Analyser::getFunc(const string& name) {
-        unsigned long long i;
-        for(i = 0;i<funcList.size();i++)
-            if(funcList[i].funcName == name)
-                return (int)i;
+    int Analyser::getFunc(const string& name) const {
+        auto it = funcIndex.find(name);
+        if (it != funcIndex.end())
+            return it->second;
+        // 并行分析时只能看到在这个函数之前定义的函数
+        if (_parent != nullptr) {
+            int index = _parent->getFunc(name);
+            if (index >= 0 && static_cast<std::size_t>(index) < _funcBase)
+                return index;
+        }
         return -1;
     }
 //    int Analyser::getConst(const string& name) {
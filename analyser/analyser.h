@@ -3,11 +3,17 @@
 #include "error/error.h"
 #include "instruction/instruction.h"
 #include "tokenizer/token.h"
+#include "tokenizer/token_list.h"
+#include "tokenizer/tokenizer.h"
+#include "analyser/symbol_table.h"
 
+#include <array>
+#include <functional>
 #include <vector>
 #include <optional>
 #include <utility>
 #include <map>
+#include <unordered_map>
 #include <cstdint>
 #include <cstddef> // for std::size_t
 
@@ -17,7 +23,8 @@ namespace cc0 {
     struct varInfo{
         std::string varName;
         bool isConst;
-//        long long offsetIndex; // 直接在变量表中查看即可
+        // 在所属作用域中的栈偏移，即声明的顺序
+        int32_t offset;
 //        std::string varType; // 暂时有int和char两种，最后还是放弃了，太麻烦了
     };
 
@@ -38,6 +45,8 @@ namespace cc0 {
         std::string value;
     };
 
+    class FunctionCache;
+
     // jump记录格式
     struct jumpInfo{
         int pos;
@@ -58,14 +67,32 @@ namespace cc0 {
 		using uint32_t = std::uint32_t;
 		using int32_t = std::int32_t;
 	public:
-		Analyser(std::vector<Token> v)
-			: _tokens(std::move(v)), _offset(0), _current_pos(0, 0), _nextTokenIndex(0) {}
+		Analyser(TokenList v)
+			: _tokens(std::move(v)), _context(&_tokens), _tokenizer(nullptr), _offset(0), _read(0), _current_end(0), _nextTokenIndex(0) {}
+		// 流式分析：需要时才从词法分析器读取 token，只保留最近的几个用于回退
+		// 内存占用与 token 总数无关
+		Analyser(Tokenizer& tkz)
+			: _tokens(), _context(&tkz.Tokens()), _tokenizer(&tkz), _offset(0), _read(0), _current_end(0), _nextTokenIndex(0) {}
 		Analyser(Analyser&&) = delete;
 		Analyser(const Analyser&) = delete;
 		Analyser& operator=(Analyser) = delete;
+	private:
+		// 并行分析中的一个线程，共享 parent 的 token、全局变量和函数表
+		explicit Analyser(const Analyser* parent);
+	public:
 
 		// 唯一接口
 		std::pair<cc0::resultInfo, std::optional<CompilationError>> Analyse();
+		// 每个函数分析完成后调用，可以在读完整个文件之前处理这个函数的代码
+		void SetFunctionSink(std::function<void(funcInfo&)> sink) { _funcSink = std::move(sink); }
+		// 分析函数体的线程数，1（默认）为串行，流式分析时不起作用
+		// 不超过 CPU 核数，程序很小时也串行分析，多线程的额外开销得不偿失
+		// 结果与串行分析完全相同，有错误时由串行分析重新报告
+		void SetJobs(unsigned jobs) { _jobs = jobs; }
+		// 函数级的分析结果缓存，命中的函数不再分析函数体，流式分析时不起作用
+		void SetCache(FunctionCache* cache) { _cache = cache; }
+		// 流式分析时遇到的词法错误，此时 Analyse 返回的就是它
+		const std::optional<CompilationError>& TokenizationError() const { return _tokenError; }
 
 	private:
 		// 所有的递归子程序
@@ -75,6 +102,19 @@ namespace cc0 {
 
         // 对可能有特殊含义的值增加了normal前缀
         std::optional<CompilationError> c0Program();
+        // 程序开头的全局变量，停在第一个函数定义之前
+        std::optional<CompilationError> globalDeclarations();
+        // 函数定义中函数体之前的部分，分析后函数即加入函数表
+        std::optional<CompilationError> functionHeader();
+        // 串行分析全局变量和函数头，然后多线程分析函数体，失败时返回 false
+        // 使用缓存时即使只有一个线程也这样分析
+        bool parallelProgram(unsigned jobs);
+        // 第 index 个函数（token 为 range）在缓存中的键
+        std::uint64_t functionKey(std::pair<std::size_t, std::size_t> range, std::size_t index) const;
+        // 开始分析之前清空所有的表
+        void resetProgram();
+        // 并行分析时分析从 offset 开始的第 index 个函数，只能看到它之前的函数
+        std::optional<CompilationError> parallelFunction(std::size_t offset, std::size_t index);
         std::optional<CompilationError> assignmentExpression();
         std::optional<CompilationError> normalExpression();
         std::optional<CompilationError> additiveExpression();
@@ -96,6 +136,8 @@ namespace cc0 {
         std::optional<CompilationError> normalStatement();
         std::optional<CompilationError> jumpStatement();
         std::optional<CompilationError> returnStatement();
+        // 返回之前的调用改为尾调用，复用当前的栈帧
+        void tailCall(std::size_t start);
         std::optional<CompilationError> conditionStatement();
         std::optional<CompilationError> ifCondition();
         std::optional<CompilationError> switchCondition();
@@ -111,19 +153,44 @@ namespace cc0 {
         std::optional<CompilationError> printable();
 
 	private:
-		std::vector<Token> _tokens;
+		TokenList _tokens;
+		// token 的值和位置从这里取得，即 _tokens 或词法分析器的 Tokens()
+		const TokenList* _context;
+		// 流式分析时的词法分析器，否则为空
+		Tokenizer* _tokenizer;
+		// 流式分析时最近读到的 token，_read 是已经读入的总数
+		std::array<CompactToken, 8> _ring;
 		std::size_t _offset;
-		std::pair<uint64_t, uint64_t> _current_pos;
+		std::size_t _read;
+		// 最近读到的 token 的结束偏移，报错时才换算为位置
+		std::size_t _current_end;
+		std::optional<CompilationError> _tokenError;
+		std::function<void(funcInfo&)> _funcSink;
+		unsigned _jobs = 1;
+		FunctionCache* _cache = nullptr;
+		// 并行分析一个函数时，之前的 _funcBase 个函数在 _parent 的函数表中
+		const Analyser* _parent = nullptr;
+		std::size_t _funcBase = 0;
+		// 并行分析时不输出错误，也不换算位置（SourceBuffer 的位置缓存不是线程安全的）
+		bool _quiet = false;
 
 
         // 下一个 token 在栈的偏移
         int32_t _nextTokenIndex;
 
         // Token 缓冲区相关操作
-        // 返回下一个 token
-        std::optional<Token> nextToken();
+        // 返回下一个 token，只是对 _tokens 中元素的引用
+        std::optional<TokenRef> nextToken();
         // 回退一个 token
         void unreadToken();
+        // 流式分析时再读入一个 token，文件尾或者词法错误时返回 false
+        bool fetchToken();
+        // 最近读到的 token 的结束位置，用于报错
+        std::pair<uint64_t, uint64_t> currentPos() const {
+            return _quiet ? std::pair<uint64_t, uint64_t>() : _context->Position(_current_end);
+        }
+        // 输出语法错误，流式分析遇到词法错误后不再输出
+        void errOut(std::pair<uint64_t, uint64_t> p, const std::string& errCon) const;
 
 		// 为了简单处理，直接把符号表耦合在语法分析里
 
@@ -131,11 +198,9 @@ namespace cc0 {
 		// 默认值，这里是指变量的默认初始值和int函数的默认返回值
 		cc0::resultInfo result ;
         // 变量的占位符
-		std::string defaultValue = "0";
-		// 全局变量表
-		std::vector<cc0::varInfo> globalVarList;
-		// 局部变量表
-        std::vector<cc0::varInfo> localVarList;
+		int32_t defaultValue = 0;
+		// 变量表，第 0 层为全局变量，函数体为第 1 层
+		SymbolTable<cc0::varInfo> varTable;
 
         bool globalFlag;
 		// 启动代码
@@ -144,9 +209,14 @@ namespace cc0 {
         // 临时函数代码
         std::vector<cc0::Instruction> localCode;
         long long localOffset;
-        // 临时存储switch的表达式代码
-        std::vector<cc0::Instruction> switchCode;
-        std::vector<std::string> caseValue;
+        // 当前 switch 的各个 case：值 => 分支代码的开始位置
+        std::vector<std::pair<int32_t, int>> switchCases;
+        // default 分支的开始位置，没有时为 -1
+        int switchDefault = -1;
+        // 生成 cases 中 [first, last) 的分派代码，switch 的值在栈顶，进入分支之前出栈
+        void switchDispatch(const std::vector<std::pair<int32_t, int>>& cases, std::size_t first, std::size_t last);
+        // 跳到 default 分支，没有时跳出 switch
+        void jumpToDefault();
 
         // 记录break和continue位置的临时变量
         std::vector<cc0::jumpInfo> jumpPos;
@@ -156,22 +226,36 @@ namespace cc0 {
 
 		// 维护函数表及函数体的指令
 		std::vector<cc0::funcInfo> funcList;
+        // 函数名 => funcList 中的下标
+        std::unordered_map<std::string, int> funcIndex;
         funcInfo funcNow,zeroFunc;
 
-        // 维护常量表
+        // 维护常量表，相同的常量只保存一次
         std::vector<cc0::constInfo> constList;
+        // 类型和值 => constList 中的下标
+        std::unordered_map<std::string, int> constIndex;
+        // 返回常量在常量表中的下标，没有时添加到末尾
+        int internConst(char type, const std::string& value);
 
         // 下面是符号表相关操作
+        enum class Scope { Global, Local };
         // 判断变量重定义
-        bool isDeclared(const std::string& name, const std::string& type);
+        bool isDeclared(const std::string& name, Scope scope);
+        // 声明变量，偏移为所在作用域中已有的变量个数
+        void declareVar(varInfo var);
         // 判断常量
         bool isConst(const std::string& name);
         // 判断函数重名并const 获取函数&脚标
-        int getFunc(const std::string& name);
+        int getFunc(const std::string& name) const;
+        // 脚标为 index 的函数
+        const funcInfo& funcAt(int index) const {
+            return static_cast<std::size_t>(index) < _funcBase ? _parent->funcList[index] : funcList[index - _funcBase];
+        }
         void resetFunc(){funcNow = zeroFunc;}
         // 获取常量
         int getConst(const std::string& name);
         // 获取变量脚标
-        std::pair<std::string, std::string> getVar(const std::string &name);
+        // 不存在时返回 (-1, -1)
+        std::pair<int32_t, int32_t> getVar(const std::string &name);
     };
 }
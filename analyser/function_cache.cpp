@@ -0,0 +1,182 @@
+#include "analyser/function_cache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <thread>
+#include <utility>
+
+namespace cc0 {
+
+    namespace {
+        // 文件格式：魔数，函数头，常量表，指令，整数都是本机字节序
+        // 缓存只在同一台机器上使用，不考虑移植
+        constexpr char Magic[4] = {'c', '0', 'f', 'n'};
+
+        class Writer {
+        public:
+            explicit Writer(std::ofstream& out) : _out(out) {}
+            void u32(std::uint32_t value) { _out.write(reinterpret_cast<const char*>(&value), sizeof value); }
+            void str(const std::string& text) {
+                u32(static_cast<std::uint32_t>(text.size()));
+                _out.write(text.data(), static_cast<std::streamsize>(text.size()));
+            }
+        private:
+            std::ofstream& _out;
+        };
+
+        class Reader {
+        public:
+            explicit Reader(std::ifstream& in) : _in(in) {}
+            bool u32(std::uint32_t& value) {
+                return static_cast<bool>(_in.read(reinterpret_cast<char*>(&value), sizeof value));
+            }
+            bool str(std::string& text) {
+                std::uint32_t size;
+                // 函数中的字符串不会超过源文件的大小，这里只是防止损坏的文件申请过多内存
+                if (!u32(size) || size > (1u << 24)) {
+                    return false;
+                }
+                text.resize(size);
+                return static_cast<bool>(_in.read(text.data(), size));
+            }
+        private:
+            std::ifstream& _in;
+        };
+    }
+
+    FunctionCache::FunctionCache(std::string directory) : _directory(std::move(directory)) {
+        std::error_code ec;
+        std::filesystem::create_directories(_directory, ec);
+    }
+
+    std::string FunctionCache::path(std::uint64_t key) const {
+        char name[24];
+        std::snprintf(name, sizeof name, "%016llx.fn", static_cast<unsigned long long>(key));
+        return (std::filesystem::path(_directory) / name).string();
+    }
+
+    std::optional<CachedFunction> FunctionCache::Load(std::uint64_t key, const funcInfo& header) {
+        auto result = [&]() -> std::optional<CachedFunction> {
+            std::ifstream in(path(key), std::ios::binary);
+            if (!in) {
+                return {};
+            }
+            char magic[sizeof Magic];
+            if (!in.read(magic, sizeof magic) || !std::equal(magic, magic + sizeof magic, Magic)) {
+                return {};
+            }
+            Reader r(in);
+            CachedFunction cached;
+            auto& func = cached.func;
+            std::uint32_t paramNum, constOffset, isReturn, count;
+            if (!r.str(func.funcName) || !r.str(func.funcType) || !r.u32(paramNum) || !r.u32(constOffset) || !r.u32(isReturn)) {
+                return {};
+            }
+            // 键冲突的概率很小，但是检查一下函数头并不费事
+            if (func.funcName != header.funcName || func.funcType != header.funcType
+                || static_cast<int>(paramNum) != header.paramNum) {
+                return {};
+            }
+            func.paramNum = static_cast<int>(paramNum);
+            func.constOffset = static_cast<int>(constOffset);
+            func.isReturn = isReturn != 0;
+
+            if (!r.u32(count)) {
+                return {};
+            }
+            for (std::uint32_t i = 0; i < count; i++) {
+                std::uint32_t type;
+                constInfo c;
+                if (!r.u32(type) || !r.str(c.value)) {
+                    return {};
+                }
+                c.type = static_cast<char>(type);
+                cached.consts.push_back(std::move(c));
+            }
+            if (constOffset >= cached.consts.size()) {
+                return {};
+            }
+
+            if (!r.u32(count)) {
+                return {};
+            }
+            func.localCode.reserve(count);
+            for (std::uint32_t i = 0; i < count; i++) {
+                std::uint32_t opr, x, y;
+                if (!r.u32(opr) || !r.u32(x) || !r.u32(y) || opr > TAILCALL) {
+                    return {};
+                }
+                func.localCode.emplace_back(static_cast<Operation>(opr), static_cast<std::int32_t>(x), static_cast<std::int32_t>(y));
+                if (func.localCode.back().GetOperation() == LOADC && x >= cached.consts.size()) {
+                    return {};
+                }
+            }
+            // 文件必须恰好在这里结束
+            if (in.peek() != std::ifstream::traits_type::eof()) {
+                return {};
+            }
+            return cached;
+        }();
+        ++(result.has_value() ? _hits : _misses);
+        return result;
+    }
+
+    void FunctionCache::Store(std::uint64_t key, const funcInfo& func, const std::vector<constInfo>& consts) {
+        // 先写入临时文件再改名，读者不会看到写了一半的文件
+        // 编号、线程和时间的组合在同时运行的多个编译器之间也不会重复
+        auto stamp = static_cast<unsigned long long>(std::chrono::steady_clock::now().time_since_epoch().count());
+        auto thread = static_cast<unsigned long long>(std::hash<std::thread::id>()(std::this_thread::get_id()));
+        auto target = path(key);
+        auto temporary = target + "." + std::to_string(_temporary++) + "." + std::to_string(thread ^ stamp) + ".tmp";
+        {
+            std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+            if (!out) {
+                return;
+            }
+            out.write(Magic, sizeof Magic);
+            Writer w(out);
+            w.str(func.funcName);
+            w.str(func.funcType);
+            w.u32(static_cast<std::uint32_t>(func.paramNum));
+            w.u32(static_cast<std::uint32_t>(func.constOffset));
+            w.u32(func.isReturn ? 1 : 0);
+            w.u32(static_cast<std::uint32_t>(consts.size()));
+            for (auto& c : consts) {
+                w.u32(static_cast<unsigned char>(c.type));
+                w.str(c.value);
+            }
+            w.u32(static_cast<std::uint32_t>(func.localCode.size()));
+            for (auto& ins : func.localCode) {
+                w.u32(static_cast<std::uint32_t>(ins.GetOperation()));
+                w.u32(static_cast<std::uint32_t>(ins.GetParam1()));
+                w.u32(static_cast<std::uint32_t>(ins.GetParam2()));
+            }
+            if (!out.flush()) {
+                out.close();
+                std::remove(temporary.c_str());
+                return;
+            }
+        }
+        std::error_code ec;
+        std::filesystem::rename(temporary, target, ec);
+        if (ec) {
+            std::filesystem::remove(temporary, ec);
+            return;
+        }
+        _stored++;
+    }
+
+    void FunctionCache::PrintStats(std::ostream& out) const {
+        std::size_t hits = _hits, misses = _misses, stored = _stored;
+        auto total = hits + misses;
+        out << "Function cache: " << hits << " hits, " << misses << " misses";
+        if (total != 0) {
+            out << " (" << hits * 100 / total << "% hit rate)";
+        }
+        out << ", " << stored << " stored in " << _directory << '\n';
+    }
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "analyser/analyser.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace cc0 {
+
+    // 64 位 FNV-1a，用于计算缓存的键
+    class Fnv1a final {
+    public:
+        void Add(const void* data, std::size_t size) {
+            auto bytes = static_cast<const unsigned char*>(data);
+            for (std::size_t i = 0; i < size; i++) {
+                _hash = (_hash ^ bytes[i]) * 1099511628211ull;
+            }
+        }
+        // 先加入长度，相邻的两个字符串不会因为边界不同而得到相同的结果
+        void Add(std::string_view text) {
+            AddValue(static_cast<std::uint64_t>(text.size()));
+            Add(text.data(), text.size());
+        }
+        template <typename T>
+        void AddValue(T value) {
+            static_assert(std::is_trivially_copyable_v<T>);
+            Add(&value, sizeof value);
+        }
+        std::uint64_t Value() const { return _hash; }
+    private:
+        std::uint64_t _hash = 14695981039346656037ull;
+    };
+
+    // 一个函数的分析结果，LOADC 的操作数和 constOffset 是 consts 中的下标
+    struct CachedFunction {
+        funcInfo func;
+        std::vector<constInfo> consts;
+    };
+
+    // 按函数缓存分析结果的目录，每个函数一个文件，文件名就是键
+    // 键由 Analyser 计算，包括编译器版本、函数的 token 以及它引用的全局变量和函数
+    // 多个线程（以及多个同时运行的编译器）可以同时读写
+    class FunctionCache final {
+    public:
+        // 改变生成的代码或者文件格式时都要修改，之前的缓存随之失效
+        static constexpr std::string_view Version = "cc0 function cache 3";
+
+        // 目录不存在时创建
+        explicit FunctionCache(std::string directory);
+        FunctionCache(const FunctionCache&) = delete;
+        FunctionCache& operator=(const FunctionCache&) = delete;
+
+        // 取得键对应的结果，函数名、返回类型和参数个数必须与 header 相同
+        // 文件不存在或者损坏时返回空，计为一次未命中
+        std::optional<CachedFunction> Load(std::uint64_t key, const funcInfo& header);
+        // 保存一个函数的分析结果，失败时忽略
+        void Store(std::uint64_t key, const funcInfo& func, const std::vector<constInfo>& consts);
+
+        std::size_t Hits() const { return _hits; }
+        std::size_t Misses() const { return _misses; }
+        void PrintStats(std::ostream& out) const;
+
+    private:
+        std::string path(std::uint64_t key) const;
+
+        std::string _directory;
+        std::atomic<std::size_t> _hits{0};
+        std::atomic<std::size_t> _misses{0};
+        std::atomic<std::size_t> _stored{0};
+        // 临时文件的编号，写完之后才改名为正式的文件
+        std::atomic<std::size_t> _temporary{0};
+    };
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace cc0 {
+
+    // 分层的符号表，查找和声明都是按名字哈希，与符号总数无关
+    // 最外层（第 0 层）始终存在，PushScope/PopScope 进入和离开内层作用域
+    // 同名符号在内层会遮蔽外层，离开内层后外层的重新可见
+    template <typename T>
+    class SymbolTable final {
+    public:
+        struct Symbol {
+            // 声明所在的层
+            std::size_t scope;
+            T value;
+        };
+
+        SymbolTable() : _scopes(1) {}
+        // _scopes 指向 _symbols 的键，复制时要改为指向新表中的键
+        SymbolTable(const SymbolTable& other) : _symbols(other._symbols), _scopes() {
+            _scopes.reserve(other._scopes.size());
+            for (auto& scope : other._scopes) {
+                auto& names = _scopes.emplace_back();
+                names.reserve(scope.size());
+                for (auto name : scope) {
+                    names.push_back(&_symbols.find(*name)->first);
+                }
+            }
+        }
+        SymbolTable(SymbolTable&&) = default;
+        SymbolTable& operator=(const SymbolTable& other) {
+            return *this = SymbolTable(other);
+        }
+        SymbolTable& operator=(SymbolTable&&) = default;
+
+        // 当前层已有同名符号时返回 false
+        bool Declare(const std::string& name, T value) {
+            auto& bindings = _symbols[name];
+            if (!bindings.empty() && bindings.back().scope == Depth()) {
+                return false;
+            }
+            bindings.push_back(Symbol{Depth(), std::move(value)});
+            auto it = _symbols.find(name);
+            _scopes.back().push_back(&it->first);
+            return true;
+        }
+
+        // 从内向外查找，找不到返回 nullptr
+        const Symbol* Find(const std::string& name) const {
+            auto it = _symbols.find(name);
+            if (it == _symbols.end() || it->second.empty()) {
+                return nullptr;
+            }
+            return &it->second.back();
+        }
+
+        // 只在指定层中查找
+        const Symbol* FindIn(const std::string& name, std::size_t scope) const {
+            auto it = _symbols.find(name);
+            if (it == _symbols.end()) {
+                return nullptr;
+            }
+            for (auto b = it->second.rbegin(); b != it->second.rend(); ++b) {
+                if (b->scope == scope) {
+                    return &*b;
+                }
+                if (b->scope < scope) {
+                    break;
+                }
+            }
+            return nullptr;
+        }
+
+        void PushScope() {
+            _scopes.emplace_back();
+        }
+
+        // 删除当前层声明的全部符号，最外层不会被弹出
+        void PopScope() {
+            if (_scopes.size() == 1) {
+                return;
+            }
+            for (auto name : _scopes.back()) {
+                auto it = _symbols.find(*name);
+                it->second.pop_back();
+                if (it->second.empty()) {
+                    _symbols.erase(it);
+                }
+            }
+            _scopes.pop_back();
+        }
+
+        void Clear() {
+            _symbols.clear();
+            _scopes.assign(1, {});
+        }
+
+        // 当前层号，最外层为 0
+        std::size_t Depth() const {
+            return _scopes.size() - 1;
+        }
+
+        // 当前层已声明的符号个数
+        std::size_t Size() const {
+            return _scopes.back().size();
+        }
+
+    private:
+        // 名字 => 由外向内的各层声明
+        std::unordered_map<std::string, std::vector<Symbol>> _symbols;
+        // 每层按声明顺序记录名字，指向 _symbols 的键，重新散列时也不会失效
+        std::vector<std::vector<const std::string*>> _scopes;
+    };
+}
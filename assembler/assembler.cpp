@@ -0,0 +1,217 @@
+#include "assembler/assembler.h"
+
+#include "exception.h"
+#include "fmts.hpp"
+#include "util/util.hpp"
+
+#include "fmt/core.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace cc0 {
+
+    namespace {
+
+        vm::OpCode opCodeOf(Operation op) {
+            switch (op) {
+                case NOP:    return vm::OpCode::nop;
+                case BIPUSH: return vm::OpCode::bipush;
+                case IPUSH:  return vm::OpCode::ipush;
+                case POP:    return vm::OpCode::pop;
+                case POP2:   return vm::OpCode::pop2;
+                case POPN:   return vm::OpCode::popn;
+                case DUP:    return vm::OpCode::dup;
+                case DUP2:   return vm::OpCode::dup2;
+                case LOADC:  return vm::OpCode::loadc;
+                case LOADA:  return vm::OpCode::loada;
+                case ILOAD:  return vm::OpCode::iload;
+                case ALOAD:  return vm::OpCode::aload;
+                case ISTORE: return vm::OpCode::istore;
+                case ASTORE: return vm::OpCode::astore;
+                case IADD:   return vm::OpCode::iadd;
+                case ISUB:   return vm::OpCode::isub;
+                case IMUL:   return vm::OpCode::imul;
+                case IDIV:   return vm::OpCode::idiv;
+                case INEG:   return vm::OpCode::ineg;
+                case ICMP:   return vm::OpCode::icmp;
+                case I2C:    return vm::OpCode::i2c;
+                case JMP:    return vm::OpCode::jmp;
+                case JE:     return vm::OpCode::je;
+                case JNE:    return vm::OpCode::jne;
+                case JL:     return vm::OpCode::jl;
+                case JGE:    return vm::OpCode::jge;
+                case JG:     return vm::OpCode::jg;
+                case JLE:    return vm::OpCode::jle;
+                case CALL:   return vm::OpCode::call;
+                case RET:    return vm::OpCode::ret;
+                case IRET:   return vm::OpCode::iret;
+                case IPRINT: return vm::OpCode::iprint;
+                case CPRINT: return vm::OpCode::cprint;
+                case SPRINT: return vm::OpCode::sprint;
+                case PRINTL: return vm::OpCode::printl;
+                case ISCAN:  return vm::OpCode::iscan;
+                case CSCAN:  return vm::OpCode::cscan;
+                case TABLESWITCH: return vm::OpCode::tableswitch;
+                case TAILCALL: return vm::OpCode::tailcall;
+            }
+            throw InvalidFile("no such opcode");
+        }
+
+        std::vector<vm::Instruction> instructionsOf(const std::vector<Instruction>& code) {
+            if (code.size() > U2_MAX) {
+                throw InvalidFile("too many instructions");
+            }
+            std::vector<vm::Instruction> rtv;
+            rtv.reserve(code.size());
+            for (auto& ins : code) {
+                vm::Instruction out{opCodeOf(ins.GetOperation()), 0, 0};
+                if (auto it = vm::paramSizeOfOpCode.find(out.op); it != vm::paramSizeOfOpCode.end()) {
+                    out.x = static_cast<vm::u4>(ins.GetParam1());
+                    if (it->second.size() == 2) {
+                        out.y = static_cast<vm::u4>(ins.GetParam2());
+                    }
+                }
+                rtv.push_back(out);
+            }
+            return rtv;
+        }
+
+        // 分析器保存的字符串常量带引号，转义序列保持源码中的写法
+        vm::str_t stringOf(const std::string& quoted) {
+            if (quoted.size() < 2 || quoted.front() != '\"' || quoted.back() != '\"') {
+                throw InvalidFile("invalid string constant");
+            }
+            vm::str_t value;
+            for (std::size_t i = 1; i + 1 < quoted.size(); ++i) {
+                char ch = quoted[i];
+                if (ch != '\\') {
+                    value += ch;
+                    continue;
+                }
+                if (++i + 1 >= quoted.size()) {
+                    throw InvalidFile("incomplete escape seq");
+                }
+                switch (ch = quoted[i]) {
+                    case '\\': value += '\\'; break;
+                    case '\'': value += '\''; break;
+                    case '\"': value += '\"'; break;
+                    case 'n':  value += '\n'; break;
+                    case 'r':  value += '\r'; break;
+                    case 't':  value += '\t'; break;
+                    case 'x': {
+                        if (i + 3 >= quoted.size() || !is_hex_digit(quoted[i+1]) || !is_hex_digit(quoted[i+2])) {
+                            throw InvalidFile("invalid hex escape seq");
+                        }
+                        value += static_cast<char>((hex_digit_to_int(quoted[i+1]) << 4) | hex_digit_to_int(quoted[i+2]));
+                        i += 2;
+                    } break;
+                    default: throw InvalidFile(fmt::format("unknown escape seq \"\\{}\"", ch));
+                }
+            }
+            if (value.length() > U2_MAX) {
+                throw InvalidFile("too long the string constant");
+            }
+            return value;
+        }
+
+        vm::Constant constantOf(const constInfo& c) {
+            vm::Constant constant;
+            try {
+                switch (c.type) {
+                    case 'S':
+                        constant.type = vm::Constant::Type::STRING;
+                        constant.value = stringOf(c.value);
+                        return constant;
+                    case 'I':
+                        constant.type = vm::Constant::Type::INT;
+                        constant.value = try_to_int(c.value);
+                        return constant;
+                    case 'D':
+                        constant.type = vm::Constant::Type::DOUBLE;
+                        constant.value = try_to_double(c.value);
+                        return constant;
+                }
+            }
+            catch (const InvalidFile&) {
+                throw;
+            }
+            catch (const std::exception&) {
+                throw InvalidFile("out of range or invalid format");
+            }
+            throw InvalidFile("invalid constant type");
+        }
+    }
+
+    File Assemble(const resultInfo& result) {
+        std::vector<vm::Constant> constants;
+        if (result.constList.size() > U2_MAX) {
+            throw InvalidFile("too many constants");
+        }
+        constants.reserve(result.constList.size());
+        for (auto& c : result.constList) {
+            constants.push_back(constantOf(c));
+        }
+
+        auto start = instructionsOf(result.globalCode);
+
+        if (result.funcList.size() > U2_MAX) {
+            throw InvalidFile("too many functions");
+        }
+        std::vector<vm::Function> functions;
+        bool mainFound = false;
+        for (auto& func : result.funcList) {
+            if (func.constOffset < 0 || static_cast<std::size_t>(func.constOffset) >= constants.size()
+                || constants[func.constOffset].type != vm::Constant::Type::STRING) {
+                throw InvalidFile("name not found");
+            }
+            if (std::get<vm::str_t>(constants[func.constOffset].value) == "main") {
+                mainFound = true;
+            }
+            if (func.paramNum < 0 || func.paramNum > U2_MAX) {
+                throw InvalidFile("too many parameters");
+            }
+            vm::Function function;
+            function.nameIndex = static_cast<vm::u2>(func.constOffset);
+            function.paramSize = static_cast<vm::u2>(func.paramNum);
+            // 不支持嵌套函数，层次始终为 0
+            function.level = 0;
+            function.instructions = instructionsOf(func.localCode);
+            functions.push_back(std::move(function));
+        }
+        if (!mainFound) {
+            throw InvalidFile("main() not found");
+        }
+
+        return File{0x00000001, std::move(constants), std::move(start), std::move(functions)};
+    }
+
+    void WriteText(const resultInfo& result, std::ostream& output) {
+        auto& constList = result.constList;
+        auto& globalCode = result.globalCode;
+        auto& funcList = result.funcList;
+        // 常量表
+        output << ".constants:\n";
+        for (std::size_t i = 0; i < constList.size(); i++) {
+            output << "    " << i << ' ' << constList[i].type << ' ' << constList[i].value << '\n';
+        }
+        // 启动代码
+        output << ".start:\n";
+        for (std::size_t i = 0; i < globalCode.size(); i++) {
+            output << "    " << i << ' ' << fmt::format("{}", globalCode[i]) << '\n';
+        }
+        // 函数定义
+        output << ".functions:\n";
+        for (std::size_t i = 0; i < funcList.size(); i++) {
+            output << "    " << i << ' ' << funcList[i].constOffset << ' ' << funcList[i].paramNum << " 0\n";
+        }
+        // 各个函数的代码
+        for (std::size_t i = 0; i < funcList.size(); i++) {
+            output << ".F" << i << ":\n";
+            for (std::size_t j = 0; j < funcList[i].localCode.size(); j++) {
+                output << "    " << j << ' ' << fmt::format("{}", funcList[i].localCode[j]) << '\n';
+            }
+        }
+    }
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "analyser/analyser.h"
+#include "file.h"
+
+#include <ostream>
+
+namespace cc0 {
+
+    // 直接由分析结果构造目标文件，不再经过文本汇编
+    // 结果与输出文本后再用 File::parse_file_text 读入的完全一致
+    // 分析结果有误（如操作数越界、没有 main）时抛出 InvalidFile
+    File Assemble(const resultInfo& result);
+
+    // 写出 -s 的文本汇编
+    void WriteText(const resultInfo& result, std::ostream& output);
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace bench {
+
+    // 一个性能测试：名称、说明以及执行体
+    struct Benchmark {
+        std::string name;
+        std::string help;
+        std::function<void()> run;
+    };
+
+    std::vector<Benchmark>& registry();
+
+    // 在静态初始化阶段注册性能测试
+    struct Register {
+        Register(std::string name, std::string help, std::function<void()> run) {
+            registry().push_back(Benchmark{std::move(name), std::move(help), std::move(run)});
+        }
+    };
+
+    // 执行一次并返回耗时（秒）
+    template <typename F>
+    double measure(F&& f) {
+        auto begin = std::chrono::steady_clock::now();
+        f();
+        auto end = std::chrono::steady_clock::now();
+        return std::chrono::duration<double>(end - begin).count();
+    }
+
+    // 执行多次取最短耗时，减少噪声
+    template <typename F>
+    double best_of(int times, F&& f) {
+        double best = measure(f);
+        for (int i = 1; i < times; ++i) {
+            best = std::min(best, measure(f));
+        }
+        return best;
+    }
+}
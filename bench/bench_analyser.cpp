@@ -0,0 +1,107 @@
+#include "bench/bench.h"
+#include "fmt/core.h"
+
+#include "tokenizer/tokenizer.h"
+#include "analyser/analyser.h"
+
+#include <algorithm>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+    // 一半全局变量、一半函数，每个函数都引用一个全局变量并调用前一个函数
+    std::string makeSymbolProgram(int symbols) {
+        int count = symbols / 2;
+        std::string source;
+        for (int i = 0; i < count; ++i) {
+            source += fmt::format("int g{} = {};\n", i, i);
+        }
+        for (int i = 0; i < count; ++i) {
+            if (i == 0) {
+                source += "int f0(int p) { return p + g0; }\n";
+            }
+            else {
+                source += fmt::format("int f{}(int p) {{ return f{}(p) + g{}; }}\n", i, i - 1, i);
+            }
+        }
+        source += fmt::format("int main() {{ print(f{}(1)); return 0; }}\n", count - 1);
+        return source;
+    }
+
+    // 声明和查找的开销不应随符号总数增长
+    void symbols() {
+        fmt::print("{:>10}{:>12}{:>16}\n", "symbols", "ms", "ns / symbol");
+        for (int symbols : {10000, 20000, 50000}) {
+            auto source = makeSymbolProgram(symbols);
+            double seconds = bench::best_of(3, [&]() {
+                std::istringstream input(source);
+                cc0::Tokenizer tkz(input);
+                auto tokens = tkz.AllCompactTokens();
+                cc0::Analyser analyser(std::move(tokens.first));
+                auto result = analyser.Analyse();
+                if (tokens.second.has_value() || result.second.has_value()) {
+                    fmt::print("compilation failed\n");
+                }
+            });
+            fmt::print("{:>10}{:>12.1f}{:>16.1f}\n", symbols, seconds * 1e3, seconds * 1e9 / symbols);
+        }
+    }
+
+    // 很多互相独立、带循环和分支的函数，每个函数调用之前的一个函数
+    std::string makeFunctionProgram(int functions) {
+        std::string source = "int g = 1;\n";
+        for (int i = 0; i < functions; ++i) {
+            source += fmt::format(
+                "int f{}(int a, int b) {{\n"
+                "    int s = 0, j = 0;\n"
+                "    while (j < a) {{ s = s + j * b; j = j + 1; if (s > 1000) {{ s = s - 1000; }} else {{ s = s + 1; }} }}\n"
+                "    print(\"f{}\", s);\n"
+                "    return s + g{};\n"
+                "}}\n", i, i, i == 0 ? "" : fmt::format(" + f{}(a - 1, b)", i / 2));
+        }
+        source += fmt::format("int main() {{ print(f{}(3, 4)); return 0; }}\n", functions - 1);
+        return source;
+    }
+
+    // 只计语法分析的时间，不同线程数的结果完全相同
+    // 线程数超过核数的部分不起作用，因此先给出核数
+    void parallel() {
+        fmt::print("cores: {}\n", std::thread::hardware_concurrency());
+        fmt::print("{:>10}{:>8}{:>12}{:>10}\n", "functions", "jobs", "ms", "speedup");
+        std::vector<unsigned> counts{1, 2, 4};
+        if (unsigned cores = std::thread::hardware_concurrency(); cores > 4) {
+            counts.push_back(cores);
+        }
+        for (int functions : {2000, 20000}) {
+            auto source = makeFunctionProgram(functions);
+            double serial = 0;
+            for (unsigned jobs : counts) {
+                double best = 0;
+                for (int i = 0; i < 3; ++i) {
+                    std::istringstream input(source);
+                    cc0::Tokenizer tkz(input);
+                    auto tokens = tkz.AllCompactTokens();
+                    cc0::Analyser analyser(std::move(tokens.first));
+                    analyser.SetJobs(jobs);
+                    std::optional<cc0::CompilationError> err;
+                    double seconds = bench::measure([&]() { err = analyser.Analyse().second; });
+                    if (tokens.second.has_value() || err.has_value()) {
+                        fmt::print("compilation failed\n");
+                    }
+                    best = i == 0 ? seconds : std::min(best, seconds);
+                }
+                if (jobs == 1) {
+                    serial = best;
+                }
+                fmt::print("{:>10}{:>8}{:>12.1f}{:>10.2f}\n", functions, jobs, best * 1e3, serial / best);
+            }
+        }
+    }
+
+    bench::Register registerSymbols("symbols", "tokenize and analyse a program against its number of symbols", symbols);
+    bench::Register registerParallel("parallel", "analyse function bodies on 1, 2, 4 and all cores", parallel);
+}
@@ -0,0 +1,35 @@
+#include "bench/bench.h"
+#include "fmt/core.h"
+
+#include <cstring>
+
+namespace bench {
+    std::vector<Benchmark>& registry() {
+        static std::vector<Benchmark> benchmarks;
+        return benchmarks;
+    }
+}
+
+// 用法：cc0_bench [name...]，不带参数时执行全部性能测试
+int main(int argc, char** argv) {
+    auto& benchmarks = bench::registry();
+    if (argc > 1 && (std::strcmp(argv[1], "-h") == 0 || std::strcmp(argv[1], "--help") == 0)) {
+        for (auto& b : benchmarks) {
+            fmt::print("{:<16}{}\n", b.name, b.help);
+        }
+        return 0;
+    }
+    for (auto& b : benchmarks) {
+        bool selected = argc == 1;
+        for (int i = 1; i < argc; ++i) {
+            if (b.name == argv[i]) {
+                selected = true;
+            }
+        }
+        if (selected) {
+            fmt::print("== {}: {}\n", b.name, b.help);
+            b.run();
+        }
+    }
+    return 0;
+}
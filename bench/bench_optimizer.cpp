@@ -0,0 +1,154 @@
+#include "bench/bench.h"
+#include "fmt/core.h"
+
+#include "./vm.h"
+#include "tokenizer/tokenizer.h"
+#include "analyser/analyser.h"
+#include "optimizer/pipeline.h"
+#include "assembler/assembler.h"
+
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <utility>
+
+namespace {
+
+    // sample/ 中的程序都用了 double，本分析器不接受，因此使用下面这些程序
+    // 每个程序针对 -O2 的一种优化，循环的次数让执行的指令数有意义
+    const std::pair<const char*, const char*> programs[] = {
+        // 常量传播：循环中的条件和运算都只依赖常量
+        {"fold",
+            "int main() {\n"
+            "    int i = 0, s = 0, k = 6, m;\n"
+            "    while (i < 200000) {\n"
+            "        m = k * 7 - 2;\n"
+            "        if (m > 30) { s = s + m / 4; } else { s = s - 1; }\n"
+            "        i = i + 1;\n"
+            "    }\n"
+            "    print(s);\n"
+            "    return 0;\n"
+            "}\n"},
+        // 值编号：重复的子表达式只计算一次
+        {"cse",
+            "int main() {\n"
+            "    int i = 0, s = 0;\n"
+            "    while (i < 200000) {\n"
+            "        s = s + (i * 3 + 1) * (i * 3 + 1) - (i * 3 + 1);\n"
+            "        i = i + 1;\n"
+            "    }\n"
+            "    print(s);\n"
+            "    return 0;\n"
+            "}\n"},
+        // 循环不变量外提：内层循环中只依赖外层变量和全局变量的运算
+        {"invariant",
+            "int w = 7, h = 3;\n"
+            "int main() {\n"
+            "    int i = 0, j, s = 0;\n"
+            "    while (i < 400) {\n"
+            "        j = 0;\n"
+            "        while (j < 500) {\n"
+            "            s = s + (w * h + i * w) - j;\n"
+            "            j = j + 1;\n"
+            "        }\n"
+            "        i = i + 1;\n"
+            "    }\n"
+            "    print(s);\n"
+            "    return 0;\n"
+            "}\n"},
+        // 条件已知的分支：phi 合并之后变成常量
+        {"branches",
+            "int main() {\n"
+            "    int i = 0, s = 0, mode = 2, step;\n"
+            "    while (i < 200000) {\n"
+            "        if (mode == 1) { step = 3; } else { step = 5; }\n"
+            "        if (step > 4) { s = s + step; } else { s = s - step; }\n"
+            "        i = i + 1;\n"
+            "    }\n"
+            "    print(s);\n"
+            "    return 0;\n"
+            "}\n"},
+        // 内联之后实参是常量，函数体可以折叠
+        {"inlined",
+            "int scale(int x, int k) { return x * k + k; }\n"
+            "int clamp(int x, int lo) { if (x < lo) return lo; return x; }\n"
+            "int main() {\n"
+            "    int i = 0, s = 0;\n"
+            "    while (i < 200000) {\n"
+            "        s = s + scale(i, 2) - scale(1, 3) + clamp(4, 9);\n"
+            "        i = i + 1;\n"
+            "    }\n"
+            "    print(s);\n"
+            "    return 0;\n"
+            "}\n"},
+    };
+
+    // 按 level 优化之后的结果，出错时为空
+    std::optional<cc0::resultInfo> compile(const char* source, int level) {
+        std::istringstream input(source);
+        cc0::Tokenizer tkz(input);
+        auto tokens = tkz.AllCompactTokens();
+        if (tokens.second.has_value()) {
+            return {};
+        }
+        cc0::Analyser analyser(std::move(tokens.first));
+        auto result = analyser.Analyse();
+        if (result.second.has_value()) {
+            return {};
+        }
+        cc0::Optimize(result.first, level);
+        return std::move(result.first);
+    }
+
+    std::size_t instructions(const cc0::resultInfo& result) {
+        std::size_t count = result.globalCode.size();
+        for (auto& func : result.funcList) {
+            count += func.localCode.size();
+        }
+        return count;
+    }
+
+    // 在 switch 引擎上执行，返回执行的指令条数和程序的输出
+    std::pair<long long, std::string> execute(const cc0::resultInfo& result) {
+        std::ostringstream output;
+        auto* saved = std::cout.rdbuf(output.rdbuf());
+        auto avm = vm::VM::make_vm(cc0::Assemble(result));
+        avm->start();
+        std::cout.rdbuf(saved);
+        return {avm->executedInstructions(), output.str()};
+    }
+
+    // -O 与 -O2 的静态指令条数和执行的指令条数
+    void ssa() {
+        fmt::print("{:<12}{:>10}{:>10}{:>8}{:>14}{:>14}{:>8}\n",
+            "program", "-O", "-O2", "%", "-O run", "-O2 run", "%");
+        std::size_t staticTotal[2] = {0, 0};
+        long long runTotal[2] = {0, 0};
+        for (auto& [name, source] : programs) {
+            auto o1 = compile(source, 1), o2 = compile(source, 2);
+            if (!o1.has_value() || !o2.has_value()) {
+                fmt::print("{:<12}compilation failed\n", name);
+                continue;
+            }
+            auto r1 = execute(*o1), r2 = execute(*o2);
+            if (r1.second != r2.second) {
+                fmt::print("{:<12}output differs\n", name);
+                continue;
+            }
+            std::size_t size[2] = {instructions(*o1), instructions(*o2)};
+            long long run[2] = {r1.first, r2.first};
+            for (int k = 0; k < 2; ++k) {
+                staticTotal[k] += size[k];
+                runTotal[k] += run[k];
+            }
+            fmt::print("{:<12}{:>10}{:>10}{:>8.1f}{:>14}{:>14}{:>8.1f}\n", name, size[0], size[1],
+                100.0 * size[1] / size[0] - 100, run[0], run[1], 100.0 * run[1] / run[0] - 100);
+        }
+        fmt::print("{:<12}{:>10}{:>10}{:>8.1f}{:>14}{:>14}{:>8.1f}\n", "total", staticTotal[0], staticTotal[1],
+            100.0 * staticTotal[1] / staticTotal[0] - 100, runTotal[0], runTotal[1],
+            100.0 * runTotal[1] / runTotal[0] - 100);
+    }
+
+    bench::Register registerSSA("ssa", "instructions at -O against -O2 on programs for each SSA optimization", ssa);
+}
@@ -0,0 +1,106 @@
+#include "bench/bench.h"
+#include "fmt/core.h"
+
+#include "tokenizer/tokenizer.h"
+
+#include <sstream>
+#include <string>
+#include <utility>
+
+namespace {
+
+    // 各类 token 混杂的一个长函数，约 lines * 30 字节
+    std::string makeTokenProgram(int lines) {
+        std::string source = "int main() {\n    int a = 0;\n";
+        for (int i = 0; i < lines; ++i) {
+            source += fmt::format("    a = a * 3 + {}; /* c */ print(\"s\", 0x{:x});\n", i, i);
+        }
+        source += "    return a;\n}\n";
+        return source;
+    }
+
+    // 长标识符、长注释、长字符串和深缩进，成块扫描能一次跳过较多字节
+    std::string makeScanProgram(int lines) {
+        std::string source = "int main() {\n    int accumulatedValueOfTheLoop = 0;\n";
+        for (int i = 0; i < lines; ++i) {
+            source += fmt::format(
+                "            accumulatedValueOfTheLoop = accumulatedValueOfTheLoop + {}; // keep adding to the total\n"
+                "            /* the block comment explains what happens on the next line in some detail,\n"
+                "               why the value is accumulated this way and what the printed string is for */\n"
+                "            print(\"a reasonably long string literal, printed on line {}\");\n", i * 7919, i);
+        }
+        source += "    return accumulatedValueOfTheLoop;\n}\n";
+        return source;
+    }
+
+    // 关键字、短标识符和运算符密集，主要考察状态机和关键字的查找
+    std::string makeWordProgram(int lines) {
+        std::string source = "int main() {\n    int i = 0;\n";
+        for (int i = 0; i < lines; ++i) {
+            source += fmt::format(
+                "    while (i < {}) {{ if (i != 3) {{ const int c{} = i; i = c{} + 1; }} else {{ continue; }} }}\n", i, i, i);
+        }
+        source += "    return i;\n}\n";
+        return source;
+    }
+
+    // 同一输入分别使用逐字节和成块扫描
+    void scan() {
+        fmt::print("{:>10}{:>10}{:>10}{:>12}{:>12}\n", "input", "MB", "kernels", "ms", "MB / s");
+        const std::pair<const char*, std::string> inputs[] = {
+            {"mixed", makeTokenProgram(100000)},
+            {"long", makeScanProgram(30000)},
+            {"words", makeWordProgram(100000)},
+        };
+        for (auto& input : inputs) {
+            auto& source = input.second;
+            for (auto kernels : {&cc0::ScalarKernels(), &cc0::BestKernels()}) {
+                double seconds = bench::best_of(5, [&]() {
+                    std::istringstream in(source);
+                    cc0::Tokenizer tkz(in);
+                    tkz.SetScanKernels(*kernels);
+                    auto tokens = tkz.AllCompactTokens();
+                    if (tokens.second.has_value()) {
+                        fmt::print("tokenization failed\n");
+                    }
+                });
+                fmt::print("{:>10}{:>10.1f}{:>10}{:>12.1f}{:>12.1f}\n",
+                    input.first, source.size() / 1e6, kernels->name, seconds * 1e3, source.size() / 1e6 / seconds);
+            }
+        }
+    }
+
+    // 展开的 Token 与语法分析使用的 CompactToken 对比，B / token 只计 token 本身的大小
+    void tokens() {
+        fmt::print("{:>10}{:>12}{:>10}{:>12}{:>14}{:>12}\n", "MB", "tokens", "form", "ms", "ns / token", "B / token");
+        for (int lines : {10000, 100000}) {
+            auto source = makeTokenProgram(lines);
+            std::size_t count = 0;
+            double expanded = bench::best_of(3, [&]() {
+                std::istringstream input(source);
+                cc0::Tokenizer tkz(input);
+                auto tokens = tkz.AllTokens();
+                if (tokens.second.has_value()) {
+                    fmt::print("tokenization failed\n");
+                }
+                count = tokens.first.size();
+            });
+            fmt::print("{:>10.1f}{:>12}{:>10}{:>12.1f}{:>14.1f}{:>12}\n",
+                source.size() / 1e6, count, "Token", expanded * 1e3, expanded * 1e9 / count, sizeof(cc0::Token));
+            double compact = bench::best_of(3, [&]() {
+                std::istringstream input(source);
+                cc0::Tokenizer tkz(input);
+                auto tokens = tkz.AllCompactTokens();
+                if (tokens.second.has_value()) {
+                    fmt::print("tokenization failed\n");
+                }
+                count = tokens.first.size();
+            });
+            fmt::print("{:>10.1f}{:>12}{:>10}{:>12.1f}{:>14.1f}{:>12}\n",
+                source.size() / 1e6, count, "compact", compact * 1e3, compact * 1e9 / count, sizeof(cc0::CompactToken));
+        }
+    }
+
+    bench::Register registerTokens("tokens", "tokenize a long generated source", tokens);
+    bench::Register registerScan("scan", "tokenizer throughput with scalar and SIMD scanning", scan);
+}
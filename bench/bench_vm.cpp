@@ -0,0 +1,327 @@
+#include "bench/bench.h"
+#include "fmt/core.h"
+
+#include "./vm.h"
+
+namespace {
+
+    using vm::OpCode;
+    using vm::Instruction;
+
+    // main 循环 count 次调用 f，f 只有一条 ret，其后填充 padding 条不可达的 nop
+    // 调用的开销不应随 f 的长度增长
+    File makeCallProgram(vm::u4 count, vm::u4 padding) {
+        std::vector<vm::Constant> constants = {
+            {vm::Constant::Type::STRING, vm::str_t("main")},
+            {vm::Constant::Type::STRING, vm::str_t("f")},
+        };
+        std::vector<Instruction> main = {
+            {OpCode::ipush, 0, 0},       // 0  int i = 0
+            {OpCode::loada, 0, 0},       // 1  loop:
+            {OpCode::iload, 0, 0},       // 2
+            {OpCode::ipush, count, 0},   // 3
+            {OpCode::icmp, 0, 0},        // 4
+            {OpCode::jge, 14, 0},        // 5  i >= count
+            {OpCode::call, 1, 0},        // 6  f()
+            {OpCode::loada, 0, 0},       // 7
+            {OpCode::loada, 0, 0},       // 8
+            {OpCode::iload, 0, 0},       // 9
+            {OpCode::ipush, 1, 0},       // 10
+            {OpCode::iadd, 0, 0},        // 11
+            {OpCode::istore, 0, 0},      // 12 i = i+1
+            {OpCode::jmp, 1, 0},         // 13
+            {OpCode::ipush, 0, 0},       // 14
+            {OpCode::iret, 0, 0},        // 15
+        };
+        std::vector<Instruction> f = {{OpCode::ret, 0, 0}};
+        f.resize(1 + padding, Instruction{OpCode::nop, 0, 0});
+        std::vector<vm::Function> functions = {
+            {0, 0, 1, std::move(main)},
+            {1, 0, 1, std::move(f)},
+        };
+        return File{1, std::move(constants), {}, std::move(functions)};
+    }
+
+    void calls() {
+        const vm::u4 count = 1000000;
+        const std::pair<const char*, vm::VM::Engine> engines[] = {
+            {"switch", vm::VM::Engine::Switch},
+            {"threaded", vm::VM::Engine::Threaded},
+        };
+        fmt::print("{:<10}{:>10}{:>14}\n", "engine", "f size", "ns / call");
+        for (auto& [name, engine] : engines) {
+            for (vm::u4 padding : {0u, 100u, 1000u, 10000u}) {
+                auto avm = vm::VM::make_vm(makeCallProgram(count, padding), engine);
+                double seconds = bench::best_of(3, [&]() { avm->start(); });
+                fmt::print("{:<10}{:>10}{:>14.1f}\n", name, padding + 1, seconds * 1e9 / count);
+            }
+        }
+    }
+
+    // f(n) 递归调用 f(n-1) 直到 0，op 是 call 或者 tailcall
+    // tailcall 复用栈帧，栈的使用与递归深度无关
+    File makeRecursiveProgram(vm::u4 depth, OpCode op) {
+        std::vector<vm::Constant> constants = {
+            {vm::Constant::Type::STRING, vm::str_t("main")},
+            {vm::Constant::Type::STRING, vm::str_t("f")},
+        };
+        std::vector<Instruction> main = {
+            {OpCode::ipush, depth, 0},
+            {OpCode::call, 1, 0},
+            {OpCode::pop, 0, 0},
+            {OpCode::ipush, 0, 0},
+            {OpCode::iret, 0, 0},
+        };
+        std::vector<Instruction> f = {
+            {OpCode::loada, 0, 0},       // 0
+            {OpCode::iload, 0, 0},       // 1
+            {OpCode::jne, 5, 0},         // 2  n != 0
+            {OpCode::ipush, 0, 0},       // 3
+            {OpCode::iret, 0, 0},        // 4
+            {OpCode::loada, 0, 0},       // 5
+            {OpCode::iload, 0, 0},       // 6
+            {OpCode::ipush, 1, 0},       // 7
+            {OpCode::isub, 0, 0},        // 8
+            {op, 1, 0},                  // 9  return f(n-1)
+            {OpCode::iret, 0, 0},        // 10
+        };
+        std::vector<vm::Function> functions = {
+            {0, 0, 1, std::move(main)},
+            {1, 1, 1, std::move(f)},
+        };
+        return File{1, std::move(constants), {}, std::move(functions)};
+    }
+
+    void tailcalls() {
+        const vm::u4 depth = 100000;
+        const std::pair<const char*, vm::VM::Engine> engines[] = {
+            {"switch", vm::VM::Engine::Switch},
+            {"threaded", vm::VM::Engine::Threaded},
+            {"register", vm::VM::Engine::Register},
+            {"jit", vm::VM::Engine::Jit},
+        };
+        fmt::print("{:<10}{:>14}{:>14}\n", "engine", "call ns", "tailcall ns");
+        for (auto& [name, engine] : engines) {
+            double seconds[2];
+            for (bool tail : {false, true}) {
+                auto avm = vm::VM::make_vm(makeRecursiveProgram(depth, tail ? OpCode::tailcall : OpCode::call), engine);
+                seconds[tail] = bench::best_of(3, [&]() { avm->start(); });
+            }
+            fmt::print("{:<10}{:>14.1f}{:>14.1f}\n", name, seconds[0] * 1e9 / depth, seconds[1] * 1e9 / depth);
+        }
+    }
+
+    // main 直接返回，只衡量创建并启动虚拟机的开销
+    void startup() {
+        const int count = 1000;
+        File file{1, {{vm::Constant::Type::STRING, vm::str_t("main")}}, {},
+            {{0, 0, 1, {{OpCode::ipush, 0, 0}, {OpCode::iret, 0, 0}}}}};
+        double seconds = bench::best_of(3, [&]() {
+            for (int i = 0; i < count; ++i) {
+                vm::VM::make_vm(file)->start();
+            }
+        });
+        fmt::print("{:>14.1f} us / run\n", seconds * 1e6 / count);
+    }
+
+    // 每次循环 new 一个新数组 b，再交替访问最早分配的 a 和最新的 b
+    // 堆地址校验的开销不应随已分配的块数增长
+    File makeArrayProgram(vm::u4 count) {
+        std::vector<Instruction> main = {
+            {OpCode::ipush, 1, 0},       // 0  int a = new 1
+            {OpCode::_new, 0, 0},        // 1
+            {OpCode::ipush, 0, 0},       // 2  int i = 0
+            {OpCode::ipush, 0, 0},       // 3  int b = 0
+            {OpCode::loada, 0, 1},       // 4  loop:
+            {OpCode::iload, 0, 0},       // 5
+            {OpCode::ipush, count, 0},   // 6
+            {OpCode::icmp, 0, 0},        // 7
+            {OpCode::jge, 33, 0},        // 8  i >= count
+            {OpCode::loada, 0, 2},       // 9
+            {OpCode::ipush, 4, 0},       // 10
+            {OpCode::_new, 0, 0},        // 11
+            {OpCode::istore, 0, 0},      // 12 b = new 4
+            {OpCode::loada, 0, 2},       // 13
+            {OpCode::iload, 0, 0},       // 14
+            {OpCode::ipush, 0, 0},       // 15
+            {OpCode::ipush, 7, 0},       // 16
+            {OpCode::iastore, 0, 0},     // 17 b[0] = 7
+            {OpCode::loada, 0, 0},       // 18
+            {OpCode::iload, 0, 0},       // 19
+            {OpCode::ipush, 0, 0},       // 20
+            {OpCode::loada, 0, 2},       // 21
+            {OpCode::iload, 0, 0},       // 22
+            {OpCode::ipush, 0, 0},       // 23
+            {OpCode::iaload, 0, 0},      // 24
+            {OpCode::iastore, 0, 0},     // 25 a[0] = b[0]
+            {OpCode::loada, 0, 1},       // 26
+            {OpCode::loada, 0, 1},       // 27
+            {OpCode::iload, 0, 0},       // 28
+            {OpCode::ipush, 1, 0},       // 29
+            {OpCode::iadd, 0, 0},        // 30
+            {OpCode::istore, 0, 0},      // 31 i = i+1
+            {OpCode::jmp, 4, 0},         // 32
+            {OpCode::ipush, 0, 0},       // 33
+            {OpCode::iret, 0, 0},        // 34
+        };
+        return File{1, {{vm::Constant::Type::STRING, vm::str_t("main")}}, {}, {{0, 0, 1, std::move(main)}}};
+    }
+
+    void arrays() {
+        fmt::print("{:>10}{:>16}\n", "blocks", "ns / iteration");
+        for (vm::u4 count : {1000u, 10000u, 100000u}) {
+            auto avm = vm::VM::make_vm(makeArrayProgram(count), vm::VM::Engine::Threaded);
+            double seconds = bench::best_of(3, [&]() { avm->start(); });
+            fmt::print("{:>10}{:>16.1f}\n", count, seconds * 1e9 / count);
+        }
+    }
+
+    // main 循环 count 次执行 switch (i % cases)，每个 case 把 k 加到 sum 上
+    // chain 是原来的做法：每个 case 重新计算表达式再比较，table 只计算一次然后 tableswitch
+    File makeSwitchProgram(vm::u4 count, vm::u4 cases, bool table) {
+        std::vector<Instruction> main = {
+            {OpCode::ipush, 0, 0},       // 0  int i = 0
+            {OpCode::ipush, 0, 0},       // 1  int sum = 0
+            {OpCode::loada, 0, 0},       // 2  loop:
+            {OpCode::iload, 0, 0},       // 3
+            {OpCode::ipush, count, 0},   // 4
+            {OpCode::icmp, 0, 0},        // 5
+            {OpCode::jge, 0, 0},         // 6  i >= count，目标最后回填
+        };
+        const auto value = [&]() {
+            main.insert(main.end(), {
+                {OpCode::loada, 0, 0}, {OpCode::iload, 0, 0},
+                {OpCode::loada, 0, 0}, {OpCode::iload, 0, 0},
+                {OpCode::ipush, cases, 0}, {OpCode::idiv, 0, 0},
+                {OpCode::ipush, cases, 0}, {OpCode::imul, 0, 0},
+                {OpCode::isub, 0, 0},
+            });
+        };
+        // 跳到各个 case 的 jmp，case 的位置最后回填
+        std::vector<std::size_t> entries;
+        if (table) {
+            value();
+            main.push_back({OpCode::tableswitch, 0, cases});
+            for (vm::u4 k = 0; k <= cases; ++k) {
+                entries.push_back(main.size());
+                main.push_back({OpCode::jmp, 0, 0});
+            }
+        }
+        else {
+            for (vm::u4 k = 0; k < cases; ++k) {
+                value();
+                main.push_back({OpCode::ipush, k, 0});
+                main.push_back({OpCode::icmp, 0, 0});
+                main.push_back({OpCode::jne, static_cast<vm::u4>(main.size() + 2), 0});
+                entries.push_back(main.size());
+                main.push_back({OpCode::jmp, 0, 0});
+            }
+            entries.push_back(main.size());
+            main.push_back({OpCode::jmp, 0, 0});
+        }
+        std::vector<std::size_t> breaks;
+        for (vm::u4 k = 0; k < cases; ++k) {
+            main[entries[k]].x = main.size();
+            main.insert(main.end(), {
+                {OpCode::loada, 0, 1}, {OpCode::loada, 0, 1}, {OpCode::iload, 0, 0},
+                {OpCode::ipush, k, 0}, {OpCode::iadd, 0, 0}, {OpCode::istore, 0, 0},
+            });
+            breaks.push_back(main.size());
+            main.push_back({OpCode::jmp, 0, 0});
+        }
+        // default 和 break 都到这里
+        main[entries.back()].x = main.size();
+        for (auto b : breaks) {
+            main[b].x = main.size();
+        }
+        main.insert(main.end(), {
+            {OpCode::loada, 0, 0}, {OpCode::loada, 0, 0}, {OpCode::iload, 0, 0},
+            {OpCode::ipush, 1, 0}, {OpCode::iadd, 0, 0}, {OpCode::istore, 0, 0},
+            {OpCode::jmp, 2, 0},
+        });
+        main[6].x = main.size();
+        main.insert(main.end(), {{OpCode::ipush, 0, 0}, {OpCode::iret, 0, 0}});
+        return File{1, {{vm::Constant::Type::STRING, vm::str_t("main")}}, {}, {{0, 0, 1, std::move(main)}}};
+    }
+
+    void switches() {
+        const vm::u4 count = 200000;
+        const std::pair<const char*, vm::VM::Engine> engines[] = {
+            {"switch", vm::VM::Engine::Switch},
+            {"threaded", vm::VM::Engine::Threaded},
+            {"register", vm::VM::Engine::Register},
+            {"jit", vm::VM::Engine::Jit},
+        };
+        fmt::print("{:<10}{:>8}{:>16}{:>16}\n", "engine", "cases", "chain ns / it", "table ns / it");
+        for (auto& [name, engine] : engines) {
+            for (vm::u4 cases : {4u, 16u, 64u}) {
+                double seconds[2];
+                for (bool table : {false, true}) {
+                    auto avm = vm::VM::make_vm(makeSwitchProgram(count, cases, table), engine);
+                    seconds[table] = bench::best_of(3, [&]() { avm->start(); });
+                }
+                fmt::print("{:<10}{:>8}{:>16.1f}{:>16.1f}\n", name, cases, seconds[0] * 1e9 / count, seconds[1] * 1e9 / count);
+            }
+        }
+    }
+
+    // 只有整数运算和局部变量的循环：s = s + i*3 - s/7，衡量指令本身而不是调用的开销
+    File makeLoopProgram(vm::u4 count) {
+        std::vector<Instruction> main = {
+            {OpCode::ipush, 0, 0},       // 0  int i = 0
+            {OpCode::ipush, 0, 0},       // 1  int s = 0
+            {OpCode::loada, 0, 0},       // 2  loop:
+            {OpCode::iload, 0, 0},       // 3
+            {OpCode::ipush, count, 0},   // 4
+            {OpCode::icmp, 0, 0},        // 5
+            {OpCode::jge, 28, 0},        // 6  i >= count
+            {OpCode::loada, 0, 1},       // 7
+            {OpCode::loada, 0, 1},       // 8
+            {OpCode::iload, 0, 0},       // 9
+            {OpCode::loada, 0, 0},       // 10
+            {OpCode::iload, 0, 0},       // 11
+            {OpCode::ipush, 3, 0},       // 12
+            {OpCode::imul, 0, 0},        // 13
+            {OpCode::iadd, 0, 0},        // 14 s + i*3
+            {OpCode::loada, 0, 1},       // 15
+            {OpCode::iload, 0, 0},       // 16
+            {OpCode::ipush, 7, 0},       // 17
+            {OpCode::idiv, 0, 0},        // 18
+            {OpCode::isub, 0, 0},        // 19 - s/7
+            {OpCode::istore, 0, 0},      // 20
+            {OpCode::loada, 0, 0},       // 21
+            {OpCode::loada, 0, 0},       // 22
+            {OpCode::iload, 0, 0},       // 23
+            {OpCode::ipush, 1, 0},       // 24
+            {OpCode::iadd, 0, 0},        // 25
+            {OpCode::istore, 0, 0},      // 26 i = i+1
+            {OpCode::jmp, 2, 0},         // 27
+            {OpCode::ipush, 0, 0},       // 28
+            {OpCode::iret, 0, 0},        // 29
+        };
+        return File{1, {{vm::Constant::Type::STRING, vm::str_t("main")}}, {}, {{0, 0, 1, std::move(main)}}};
+    }
+
+    void loops() {
+        const vm::u4 count = 10000000;
+        const std::pair<const char*, vm::VM::Engine> engines[] = {
+            {"switch", vm::VM::Engine::Switch},
+            {"threaded", vm::VM::Engine::Threaded},
+            {"register", vm::VM::Engine::Register},
+            {"jit", vm::VM::Engine::Jit},
+        };
+        fmt::print("{:<10}{:>14}\n", "engine", "ns / it");
+        for (auto& [name, engine] : engines) {
+            auto avm = vm::VM::make_vm(makeLoopProgram(count), engine);
+            double seconds = bench::best_of(3, [&]() { avm->start(); });
+            fmt::print("{:<10}{:>14.2f}\n", name, seconds * 1e9 / count);
+        }
+    }
+
+    bench::Register registerCalls("calls", "cost of call/ret against the size of the callee", calls);
+    bench::Register registerTailcalls("tailcalls", "deep recursion by call and by tailcall", tailcalls);
+    bench::Register registerSwitches("switches", "switch dispatch by compare chain and by tableswitch", switches);
+    bench::Register registerArrays("arrays", "heap access against the number of live blocks", arrays);
+    bench::Register registerLoops("loops", "integer arithmetic on locals in a loop", loops);
+    bench::Register registerStartup("startup", "make_vm and start of an empty main", startup);
+}
@@ -218,7 +218,12 @@ File File::parse_file_binary(std::ifstream& in) {
             default: assert(("unexpected error", false));
             }
             if (paramSizes.size() == 2) {
-                ins.y = read4bytes();
+                switch (paramSizes[1]) {
+                case 1: ins.y = readByte(); break;
+                case 2: ins.y = read2bytes(); break;
+                case 4: ins.y = read4bytes(); break;
+                default: assert(("unexpected error", false));
+                }
             }
         }
         return ins;
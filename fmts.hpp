@@ -393,6 +393,12 @@ namespace fmt {
                 case cc0::CSCAN:
                     name = "cscan";
                     break;
+                case cc0::TABLESWITCH:
+                    name = "tableswitch";
+                    break;
+                case cc0::TAILCALL:
+                    name = "tailcall";
+                    break;
             }
             return format_to(ctx.out(), name);
         }
@@ -446,9 +452,11 @@ namespace fmt {
                 case cc0::JG:
                 case cc0::JLE:
                 case cc0::CALL:
+                case cc0::TAILCALL:
                     return format_to(ctx.out(), "{} {}", p.GetOperation(), p.GetParam1());
                 // 双操作数
                 case cc0::LOADA:
+                case cc0::TABLESWITCH:
                     return format_to(ctx.out(), "{} {}, {}", p.GetOperation(), p.GetParam1(), p.GetParam2());
             }
             std::cout << "wrong instruction\n";
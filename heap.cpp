@@ -0,0 +1,125 @@
+#include "./heap.h"
+#include "./exception.h"
+#include "./util/print.hpp"
+
+#include <algorithm>
+
+namespace vm {
+
+Heap::Heap() noexcept : Heap(0, 0) {}
+
+Heap::Heap(addr_t base, addr_t capacity)
+    : _base(base), _memory(capacity), _top(base), _cacheStart(0), _cacheEnd(0) {}
+
+void Heap::reset() noexcept {
+    _top = _base;
+    _blocks.clear();
+    _free.clear();
+    _bySize.clear();
+    _cacheStart = _cacheEnd = 0;
+    _stats = Stats();
+}
+
+addr_t Heap::allocate(addr_t count) {
+    if (count < 0) {
+        throw HeapOverflow();
+    }
+    addr_t start;
+    if (auto it = _bySize.lower_bound({count, _base}); count > 0 && it != _bySize.end()) {
+        auto [size, freeStart] = *it;
+        removeFree(freeStart, size);
+        if (size > count) {
+            addFree(freeStart + count, size - count);
+        }
+        start = freeStart;
+        ++_stats.reused;
+    }
+    else {
+        if (count > _memory.capacity() - (_top - _base)) {
+            throw HeapOverflow();
+        }
+        start = _top;
+        _top += count;
+        _memory.commit(_top - _base);
+        _stats.highWater = std::max(_stats.highWater, _top - _base);
+    }
+    ++_stats.allocations;
+    // an empty block can never be accessed, so it is not indexed
+    if (count > 0) {
+        _blocks.emplace(start, count);
+        _stats.liveSlots += count;
+        _stats.peakSlots = std::max(_stats.peakSlots, _stats.liveSlots);
+    }
+    return start;
+}
+
+void Heap::release(addr_t addr) {
+    auto it = _blocks.find(addr);
+    if (it == _blocks.end()) {
+        throw InvalidMemoryAccess("tried to release unallocated heap memory");
+    }
+    addr_t start = it->first, size = it->second;
+    _blocks.erase(it);
+    ++_stats.releases;
+    _stats.liveSlots -= size;
+    if (_cacheStart == start) {
+        _cacheStart = _cacheEnd = 0;
+    }
+    // coalesce with free neighbours
+    if (auto next = _free.find(start + size); next != _free.end()) {
+        addr_t nextSize = next->second;
+        removeFree(next->first, nextSize);
+        size += nextSize;
+    }
+    if (auto prev = _free.lower_bound(start); prev != _free.begin()) {
+        --prev;
+        if (prev->first + prev->second == start) {
+            addr_t prevStart = prev->first, prevSize = prev->second;
+            removeFree(prevStart, prevSize);
+            start = prevStart;
+            size += prevSize;
+        }
+    }
+    // a free block at the top goes back to the bump area
+    if (start + size == _top) {
+        _top = start;
+    }
+    else {
+        addFree(start, size);
+    }
+}
+
+slot_t* Heap::findSlow(addr_t addr, addr_t count) {
+    auto it = _blocks.upper_bound(addr);
+    if (it == _blocks.begin()) {
+        return nullptr;
+    }
+    --it;
+    addr_t end = it->first + it->second;
+    if (addr >= end || count > end - addr) {
+        return nullptr;
+    }
+    _cacheStart = it->first;
+    _cacheEnd = end;
+    return toPtr(addr);
+}
+
+void Heap::addFree(addr_t start, addr_t size) {
+    _free.emplace(start, size);
+    _bySize.emplace(size, start);
+}
+
+void Heap::removeFree(addr_t start, addr_t size) {
+    _free.erase(start);
+    _bySize.erase({size, start});
+}
+
+void Heap::printStats(std::ostream& out) const {
+    println(out, "heap allocations:", _stats.allocations, "( reused", _stats.reused, ")");
+    println(out, "heap releases:", _stats.releases);
+    println(out, "heap live:", _blocks.size(), "blocks", _stats.liveSlots, "slots");
+    println(out, "heap peak:", _stats.peakSlots, "slots, high water", _stats.highWater, "slots");
+    println(out, "heap lookups:", _stats.lookups, "( cache hits", _stats.cacheHits, ")");
+}
+
+}
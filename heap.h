@@ -0,0 +1,79 @@
+#ifndef HEAP_H_INCLUDED
+#define HEAP_H_INCLUDED
+
+#include "./type.h"
+#include "./memory.h"
+
+#include <cstddef>
+#include <map>
+#include <ostream>
+#include <set>
+#include <utility>
+
+namespace vm {
+
+// Heap blocks in [base, base+capacity).
+// Live blocks are indexed by start address, so validating an access is a
+// single ordered-map lookup (plus a one-entry cache for the last block hit).
+// Released blocks go to a free list, are reused best-fit and coalesced with
+// their free neighbours; the untouched tail is bump-allocated.
+class Heap {
+public:
+    struct Stats {
+        std::size_t allocations = 0;
+        std::size_t releases = 0;
+        std::size_t reused = 0;       // allocations served from the free list
+        std::size_t lookups = 0;
+        std::size_t cacheHits = 0;
+        addr_t liveSlots = 0;
+        addr_t peakSlots = 0;
+        addr_t highWater = 0;         // slots ever bump-allocated
+    };
+
+public:
+    Heap() noexcept;
+    Heap(addr_t base, addr_t capacity);
+
+public:
+    // throws HeapOverflow if no block of count slots fits
+    addr_t allocate(addr_t count);
+    // throws InvalidMemoryAccess if addr is not the start of a live block
+    void release(addr_t addr);
+    // drop every block, the memory stays committed
+    void reset() noexcept;
+
+    // [addr, addr+count) must lie inside one live block, otherwise nullptr
+    slot_t* find(addr_t addr, addr_t count) {
+        ++_stats.lookups;
+        if (_cacheStart <= addr && count <= _cacheEnd - addr) {
+            ++_stats.cacheHits;
+            return toPtr(addr);
+        }
+        return findSlow(addr, count);
+    }
+    slot_t* toPtr(addr_t addr) noexcept { return _memory.data() + (addr - _base); }
+
+    std::size_t liveBlocks() const noexcept { return _blocks.size(); }
+    const Stats& stats() const noexcept { return _stats; }
+    void printStats(std::ostream&) const;
+
+private:
+    slot_t* findSlow(addr_t addr, addr_t count);
+    void addFree(addr_t start, addr_t size);
+    void removeFree(addr_t start, addr_t size);
+
+private:
+    addr_t _base;
+    SlotRegion _memory;
+    addr_t _top;                                  // next bump address
+    std::map<addr_t, addr_t> _blocks;             // live: start -> size
+    std::map<addr_t, addr_t> _free;               // free: start -> size
+    std::set<std::pair<addr_t, addr_t>> _bySize;  // free: (size, start)
+    addr_t _cacheStart;
+    addr_t _cacheEnd;
+    Stats _stats;
+};
+
+}
+
+#endif
@@ -1,7 +1,7 @@
 #pragma once
 
 #include <cstdint>
-#include <utility>
+#include <type_traits>
 
 namespace cc0 {
 
@@ -43,38 +43,37 @@ namespace cc0 {
 	    PRINTL,
 	    ISCAN,
 	    CSCAN,
+	    // tableswitch low, count：弹出 v，low <= v < low + count 时执行其后第 v - low + 1 条指令，否则执行第 count + 1 条
+	    // 其后的 count + 1 条指令都是 jmp
+	    TABLESWITCH,
+	    // tailcall index：与 call 相同，但是参数替换当前函数的栈帧，被调用者直接返回到当前函数的调用者
+	    TAILCALL,
 	};
 	
+	// 操作数直接以整数保存，指令可以按值随意复制，不涉及堆分配
+	// 文本形式只在输出时由 fmts.hpp 格式化
 	class Instruction final {
-	public:
-		friend void swap(Instruction& lhs, Instruction& rhs);
 	public:
 	    // 两操作数
-		Instruction(Operation opr, std::string x, std::string y){_opr = opr;_param1 = x;_param2 = y;}
+		Instruction(Operation opr, std::int32_t x, std::int32_t y) : _opr(opr), _param1(x), _param2(y) {}
 		// 一操作数
-        Instruction(Operation opr, std::string x){_opr = opr;_param1 = x;}
+        Instruction(Operation opr, std::int32_t x) : Instruction(opr, x, 0) {}
         // 无操作数
-        Instruction(Operation opr){_opr = opr;}
+        Instruction(Operation opr) : Instruction(opr, 0, 0) {}
 
-		Instruction() : Instruction(Operation::NOP){}
-		Instruction(const Instruction& i) { _opr = i._opr; _param1 = i._param1; _param2 = i._param2; }
-		Instruction(Instruction&& i) :Instruction() { swap(*this, i); }
-		Instruction& operator=(Instruction i) { swap(*this, i); return *this; }
+		Instruction() : Instruction(Operation::NOP) {}
 		bool operator==(const Instruction& i) const { return _opr == i._opr && _param1 == i._param1 && _param2 == i._param2; }
 
 		Operation GetOperation() const { return _opr; }
-        std::string GetParam1() const { return _param1; }
-        std::string GetParam2() const { return _param2; }
+        std::int32_t GetParam1() const { return _param1; }
+        std::int32_t GetParam2() const { return _param2; }
+        // 回填跳转地址
+        void SetParam1(std::int32_t x) { _param1 = x; }
 	private:
 		Operation _opr;
-		std::string _param1;
-		std::string _param2;
+		std::int32_t _param1;
+		std::int32_t _param2;
 	};
 
-	inline void swap(Instruction& lhs, Instruction& rhs) {
-		using std::swap;
-		swap(lhs._opr, rhs._opr);
-        swap(lhs._param1, rhs._param1);
-        swap(lhs._param2, rhs._param2);
-	}
-}
\ No newline at end of file
+	static_assert(std::is_trivially_copyable_v<Instruction>);
+}
@@ -3,17 +3,39 @@
 
 #include "./vm.h"
 #include "util/print.hpp"
+#include "util/util.hpp"
 
 #include "tokenizer/tokenizer.h"
 #include "analyser/analyser.h"
+#include "analyser/function_cache.h"
+#include "optimizer/peephole.h"
+#include "optimizer/inliner.h"
+#include "optimizer/pipeline.h"
+#include "optimizer/cfg.h"
+#include "optimizer/liveness.h"
+#include "assembler/assembler.h"
 #include "fmts.hpp"
 #include "error/error.h"
 
+#include <algorithm>
 #include <iostream>
+#include <cstring>
+#include <fstream>
+#include <thread>
 
 
-std::vector<cc0::Token> _tokenize(std::istream& input) {
-	cc0::Tokenizer tkz(input);
+// 文件输入尽量直接映射，标准输入则整个读入
+cc0::SourceBuffer _source(const std::string& input_file, std::istream& input) {
+    if (input_file != "-") {
+        if (auto source = cc0::SourceBuffer::FromFile(input_file); source.has_value()) {
+            return std::move(source.value());
+        }
+    }
+    return cc0::SourceBuffer::FromStream(input);
+}
+
+std::vector<cc0::Token> _tokenize(cc0::SourceBuffer input) {
+	cc0::Tokenizer tkz(std::move(input));
 	auto p = tkz.AllTokens();
 	if (p.second.has_value()) {
         fmt::print(stderr, "Tokenization error: {}\n", p.second.value());
@@ -22,59 +44,178 @@ std::vector<cc0::Token> _tokenize(std::istream& input) {
 	return p.first;
 }
 
-void Tokenize(std::istream& input, std::ostream& output) {
-	auto v = _tokenize(input);
+void Tokenize(cc0::SourceBuffer input, std::ostream& output) {
+	auto v = _tokenize(std::move(input));
 	for (auto& it : v)
 		output << fmt::format("{}\n", it);
 	return;
 }
 
-void Analyse(std::istream& input, std::ostream& output){
-	auto tks = _tokenize(input);
-	cc0::Analyser analyser(tks);
-	auto p = analyser.Analyse();
+// 每个函数的控制流图输出为 graphviz 的 dot 格式，一个函数一个子图
+// 块的标题是块号、入口处的栈深度和活跃的栈帧单元，条件跳转的目标边标为 taken，跳转表的边标上 case 的值
+void _dump_cfg(const cc0::resultInfo& result, std::ostream& output) {
+    auto& funcList = result.funcList;
+    output << "digraph cfg {\n";
+    output << "    node [shape=box, fontname=\"monospace\"];\n";
+    for (std::size_t f = 0; f < funcList.size(); f++) {
+        auto& code = funcList[f].localCode;
+        output << fmt::format("    subgraph cluster_F{} {{\n", f);
+        output << fmt::format("        label=\"F{} {}\";\n", f, funcList[f].funcName);
+        auto cfg = cc0::ControlFlowGraph::Build(code);
+        if (!cfg.has_value()) {
+            output << fmt::format("        F{}_invalid [label=\"invalid jump target\"];\n    }}\n", f);
+            continue;
+        }
+        auto& blocks = cfg->Blocks();
+        auto liveness = cc0::Liveness::Analyse(funcList[f], cfg.value(), funcList);
+        auto depths = cc0::StackDepths(funcList[f], funcList);
+        for (std::size_t b = 0; b < blocks.size(); b++) {
+            std::string label = fmt::format("B{}", b);
+            if (depths.has_value() && depths.value()[blocks[b].begin] >= 0) {
+                label += fmt::format("  depth {}", depths.value()[blocks[b].begin]);
+            }
+            if (liveness.has_value()) {
+                std::string live;
+                auto& in = liveness->LiveIn(b);
+                for (std::size_t c = 0; c < in.size(); c++) {
+                    if (in[c]) {
+                        live += (live.empty() ? "" : ",") + std::to_string(c);
+                    }
+                }
+                label += fmt::format("  live {{{}}}", live);
+            }
+            label += "\\l";
+            for (auto i = blocks[b].begin; i < blocks[b].end; i++) {
+                label += fmt::format("{} {}\\l", i, code[i]);
+            }
+            output << fmt::format("        F{}B{} [label=\"{}\"];\n", f, b, label);
+        }
+        for (std::size_t b = 0; b < blocks.size(); b++) {
+            auto& last = code[blocks[b].end - 1];
+            auto op = last.GetOperation();
+            auto& successors = blocks[b].successors;
+            for (std::size_t k = 0; k < successors.size(); k++) {
+                std::string attributes;
+                if (op == cc0::TABLESWITCH) {
+                    attributes = k + 1 == successors.size() ? " [label=\"default\"]"
+                                                            : fmt::format(" [label=\"{}\"]", last.GetParam1() + static_cast<std::int64_t>(k));
+                }
+                else if (k == 0 && cc0::JE <= op && op <= cc0::JLE) {
+                    attributes = " [label=\"taken\"]";
+                }
+                output << fmt::format("        F{}B{} -> F{}B{}{};\n", f, b, f, successors[k], attributes);
+            }
+        }
+        output << "    }\n";
+    }
+    output << "}\n";
+}
+
+// 流式分析时边读 token 边分析，-O 时每个函数一结束就进行窥孔优化
+// jobs 大于 1 时多线程分析函数体，cache 不为空时跳过未改变的函数，流式分析时都忽略
+// -O 时在窥孔优化之后内联小函数，把循环的条件移到末尾，再删除死存储，每次改动之后再优化一遍；流式分析时函数已经逐个输出，这几步都不做
+// optimize 是优化的级别，2 时最后再进行 SSA 上的常量传播、值编号、死代码消除和循环不变量外提，流式分析时同样不做
+// cfgFile 不为空时把最终代码的控制流图写到这个文件
+cc0::resultInfo _analyse(cc0::SourceBuffer input, int optimize, bool stream, unsigned jobs, cc0::FunctionCache* cache,
+                         const cc0::InlineOptions& inlining, const std::string& cfgFile) {
+	cc0::Tokenizer tkz(std::move(input));
+	std::optional<cc0::Analyser> analyser;
+	if (stream) {
+		analyser.emplace(tkz);
+	}
+	else {
+		auto tks = tkz.AllCompactTokens();
+		if (tks.second.has_value()) {
+			fmt::print(stderr, "Tokenization error: {}\n", tks.second.value());
+			exit(2);
+		}
+		analyser.emplace(std::move(tks.first));
+		analyser->SetJobs(jobs);
+		analyser->SetCache(cache);
+	}
+	std::size_t removed = 0;
+	if (optimize && stream) {
+		analyser->SetFunctionSink([&removed](cc0::funcInfo& func) {
+			removed += cc0::PeepholeOptimize(func.localCode);
+		});
+	}
+	auto p = analyser->Analyse();
+	if (analyser->TokenizationError().has_value()) {
+		fmt::print(stderr, "Tokenization error: {}\n", analyser->TokenizationError().value());
+		exit(2);
+	}
 	if (p.second.has_value()) {
 	    // 语法的具体报错均在analysis.cpp中直接输出
         fmt::print(stderr, "{}\n", p.second.value());
 		exit(2);
 	}
-    auto constList = p.first.constList;
-    auto globalCode = p.first.globalCode;
-    auto funcList = p.first.funcList;
-    unsigned long long i,j;
-    // 常量表
-    output << ".constants:\n";
-    for(i = 0;i<constList.size();i++){
-        output<<"    "<<i<<' '<<constList[i].type<<' '<<constList[i].value<<'\n';
-    }
-    // 启动代码
-    output << ".start:\n";
-    for(i = 0;i<globalCode.size();i++){
-        output<<"    "<<i<<' '<<fmt::format("{}", globalCode[i])<<'\n';
-    }
-    // 函数定义
-    output << ".functions:\n";
-    for(i = 0;i<funcList.size();i++){
-        output<<"    "<<i<<' '<<funcList[i].constOffset<<' '<<funcList[i].paramNum<<" 0\n";
+	if (optimize && stream) {
+	    removed += cc0::PeepholeOptimize(p.first.globalCode);
+	    fmt::print(stderr, "Peephole optimization removed {} instructions.\n", removed);
+	}
+	else if (optimize) {
+	    auto stats = cc0::Optimize(p.first, optimize, inlining);
+	    if (stats.inlined != 0) {
+	        fmt::print(stderr, "Inlined {} calls.\n", stats.inlined);
+	    }
+	    if (stats.rotated != 0) {
+	        fmt::print(stderr, "Rotated {} loops.\n", stats.rotated);
+	    }
+	    if (stats.deadStores != 0) {
+	        fmt::print(stderr, "Eliminated {} dead stores.\n", stats.deadStores);
+	    }
+	    if (optimize >= 2) {
+	        fmt::print(stderr, "SSA optimization rewrote {} functions, {} -> {} instructions.\n", stats.ssa.functions, stats.ssa.before, stats.ssa.after);
+	    }
+	    fmt::print(stderr, "Peephole optimization removed {} instructions.\n", stats.removed);
+	}
+	if (!cfgFile.empty()) {
+	    std::ofstream cfgOutput(cfgFile, std::ios::out | std::ios::trunc);
+	    if (!cfgOutput) {
+	        fmt::print(stderr, "Fail to open {} for writing.\n", cfgFile);
+	        exit(2);
+	    }
+	    _dump_cfg(p.first, cfgOutput);
+	}
+	return std::move(p.first);
+}
+
+void Analyse(cc0::SourceBuffer input, std::ostream& output, int optimize = 0, bool stream = false, unsigned jobs = 1, cc0::FunctionCache* cache = nullptr,
+             const cc0::InlineOptions& inlining = cc0::InlineOptions{}, const std::string& cfgFile = ""){
+    auto result = _analyse(std::move(input), optimize, stream, jobs, cache, inlining, cfgFile);
+    cc0::WriteText(result, output);
+}
+
+// 分析结果直接转为目标文件，不经过文本汇编
+void Assemble(cc0::SourceBuffer input, std::ofstream& output, int optimize = 0, bool stream = false, unsigned jobs = 1, cc0::FunctionCache* cache = nullptr,
+              const cc0::InlineOptions& inlining = cc0::InlineOptions{}, const std::string& cfgFile = "") {
+    auto result = _analyse(std::move(input), optimize, stream, jobs, cache, inlining, cfgFile);
+    try {
+        File f = cc0::Assemble(result);
+        f.output_binary(output);
     }
-    // 各个函数的代码
-    for(i = 0;i<funcList.size();i++){
-        output << ".F" << i << ":\n";
-        for(j = 0;j<funcList[i].localCode.size();j++){
-            output<<"    "<<j<<' '<<fmt::format("{}", funcList[i].localCode[j])<<'\n';
-        }
+    catch (const std::exception& e) {
+        println(std::cerr, e.what());
+        exit(2);
     }
-	return ;
 }
 
-void assemble_text(std::ifstream* in, std::ofstream* out, bool run = false) {
+void interpret(std::ifstream* in, vm::VM::Engine engine, vm::VM::Limits limits, bool heapStats, bool vmStats) {
     try {
-        File f = File::parse_file_text(*in);
-        // f.output_text(std::cout);
-        f.output_binary(*out);
-        if (run) {
-            auto avm = std::move(vm::VM::make_vm(f));
-            avm->start();
+        // 二进制目标文件以魔数开头，否则按照文本汇编解析
+        char magic[4] = {};
+        in->read(magic, sizeof magic);
+        bool binary = in->gcount() == sizeof magic && std::memcmp(magic, "\x43\x30\x3A\x29", sizeof magic) == 0;
+        in->clear();
+        in->seekg(0);
+        File f = binary ? File::parse_file_binary(*in) : File::parse_file_text(*in);
+        auto avm = vm::VM::make_vm(std::move(f), engine, limits);
+        avm->start();
+        if (heapStats) {
+            avm->heap().printStats(std::cerr);
+        }
+        if (vmStats) {
+            avm->printStats(std::cerr);
         }
     }
     catch (const std::exception& e) {
@@ -109,6 +250,73 @@ int main(int argc, char** argv) {
             .implicit_value(true)
             .help("translate input file to binary target file");
 
+    program.add_argument("-r")
+            .default_value(false)
+            .implicit_value(true)
+            .help("interpret the input file (text assembly or binary target) with the vm");
+
+    program.add_argument("--engine")
+            .default_value(std::string("switch"))
+            .help("vm execution engine used by -r: switch | threaded | register | jit");
+
+    program.add_argument("--stack-size")
+            .default_value(std::string("0"))
+            .help("vm stack limit in slots used by -r, 0 for the maximum");
+
+    program.add_argument("--heap-size")
+            .default_value(std::string("0"))
+            .help("vm heap limit in slots used by -r, 0 for the maximum");
+
+    program.add_argument("--heap-stats")
+            .default_value(false)
+            .implicit_value(true)
+            .help("print vm heap allocation statistics to stderr after -r");
+
+    program.add_argument("--vm-stats")
+            .default_value(false)
+            .implicit_value(true)
+            .help("print executed instructions and superinstruction fusion rate to stderr after -r");
+
+    program.add_argument("-O")
+            .default_value(false)
+            .implicit_value(true)
+            .help("optimize the generated code of -s and -c");
+
+    program.add_argument("-O2")
+            .default_value(false)
+            .implicit_value(true)
+            .help("-O, then constant propagation, value numbering and dead code elimination in SSA form");
+
+    program.add_argument("--inline-size")
+            .default_value(std::to_string(cc0::InlineOptions{}.maxSize))
+            .help("largest function in instructions inlined by -O");
+
+    program.add_argument("--inline-depth")
+            .default_value(std::to_string(cc0::InlineOptions{}.maxDepth))
+            .help("most levels of nested inlining by -O, 0 disables inlining");
+
+    program.add_argument("--dump-cfg")
+            .default_value(std::string(""))
+            .help("write the control-flow graph of every function to the given file in graphviz dot format (-s and -c)");
+
+    program.add_argument("--stream")
+            .default_value(false)
+            .implicit_value(true)
+            .help("analyse tokens as they are read instead of tokenizing the whole input first (-s and -c)");
+
+    program.add_argument("--jobs")
+            .default_value(std::string("1"))
+            .help("threads analysing function bodies for -s and -c, 0 for one per core");
+
+    program.add_argument("--cache")
+            .default_value(std::string(""))
+            .help("directory caching the code of each function for -s and -c, only changed functions are analysed again");
+
+    program.add_argument("--cache-stats")
+            .default_value(false)
+            .implicit_value(true)
+            .help("print function cache hits and misses to stderr after -s and -c");
+
 	program.add_argument("-o", "file")
 		.required()
 		.default_value(std::string("-"))
@@ -140,7 +348,12 @@ int main(int argc, char** argv) {
 	else
 		input = &std::cin;
 
-	if (output_file != "-") {
+	// 解释执行不需要输出文件
+	bool runOnly = program["-r"] == true;
+	if (runOnly) {
+	    output = nullptr;
+	}
+	else if (output_file != "-") {
 		outf.open(output_file,std::ios::binary | std::ios::out | std::ios::trunc);
 		if (!outf) {
 			fmt::print(stderr, "Fail to open {} for writing.\n", output_file);
@@ -158,10 +371,45 @@ int main(int argc, char** argv) {
         output = &outf;
 	}
 
+	unsigned jobs = 1;
+	try {
+	    auto n = try_to_int(program.get<std::string>("--jobs"));
+	    if (n < 0) {
+	        throw std::out_of_range("--jobs");
+	    }
+	    jobs = n == 0 ? std::max(1u, std::thread::hardware_concurrency()) : static_cast<unsigned>(n);
+	}
+	catch (const std::exception&) {
+	    fmt::print(stderr, "Invalid number of jobs.");
+	    exit(2);
+	}
+
+	cc0::InlineOptions inlining;
+	try {
+	    auto size = try_to_int(program.get<std::string>("--inline-size"));
+	    auto depth = try_to_int(program.get<std::string>("--inline-depth"));
+	    if (size < 0 || depth < 0) {
+	        throw std::out_of_range("--inline-size");
+	    }
+	    inlining.maxSize = static_cast<std::size_t>(size);
+	    inlining.maxDepth = static_cast<std::size_t>(depth);
+	}
+	catch (const std::exception&) {
+	    fmt::print(stderr, "Invalid inlining threshold.");
+	    exit(2);
+	}
+	int optimize = program["-O2"] == true ? 2 : program["-O"] == true ? 1 : 0;
+
+	std::optional<cc0::FunctionCache> cache;
+	if (!program.get<std::string>("--cache").empty()) {
+	    cache.emplace(program.get<std::string>("--cache"));
+	}
+
 	int num = 0;
     if(program["-t"] == true) num++;
     if(program["-s"] == true) num++;
     if(program["-c"] == true) num++;
+    if(program["-r"] == true) num++;
 
 	if (num > 1) {
 	    // 多个选项
@@ -169,34 +417,49 @@ int main(int argc, char** argv) {
 		exit(2);
 	}
 
-	// 判断三种方式
-    if (program["-t"] == true) {
-        Tokenize(*input, *output);
-    }else if (program["-s"] == true) {
-        Analyse(*input, *output);
-	}else if (program["-c"] == true) {
-        std::ofstream outTemp;
-        outTemp.open("./wyxlj.txt",std::ios::binary | std::ios::out | std::ios::trunc);
-        auto outputTemp = &outTemp;
-		Analyse(*input, *outputTemp);
-		outTemp.close();
-		std::ifstream infTemp;
-        infTemp.open("./wyxlj.txt",std::ios::binary | std::ios::in);
-        if (!infTemp) {
+	// 判断四种方式
+    if (program["-r"] == true) {
+        if (input_file == "-") {
+            fmt::print(stderr, "The vm can only run an input file.");
+            exit(2);
+        }
+        auto engineName = program.get<std::string>("--engine");
+        vm::VM::Engine engine;
+        if (engineName == "switch") {
+            engine = vm::VM::Engine::Switch;
+        }else if (engineName == "threaded") {
+            engine = vm::VM::Engine::Threaded;
+        }else if (engineName == "register") {
+            engine = vm::VM::Engine::Register;
+        }else if (engineName == "jit") {
+            engine = vm::VM::Engine::Jit;
+        }else {
+            fmt::print(stderr, "Unknown vm engine {}.", engineName);
             exit(2);
         }
-        std::ifstream* inputTemp;
-        inputTemp = &infTemp;
-        if (output_file == "-" || input_file == output_file) {
-            output_file = input_file + ".out";
+        vm::VM::Limits limits{};
+        try {
+            limits.stackSize = try_to_int(program.get<std::string>("--stack-size"));
+            limits.heapSize = try_to_int(program.get<std::string>("--heap-size"));
         }
-        assemble_text(inputTemp, dynamic_cast<std::ofstream*>(output), false);
-        infTemp.close();
-        remove("./wyxlj.txt");
+        catch (const std::exception&) {
+            fmt::print(stderr, "Invalid vm memory limit.");
+            exit(2);
+        }
+        interpret(&inf, engine, limits, program["--heap-stats"] == true, program["--vm-stats"] == true);
+    }else if (program["-t"] == true) {
+        Tokenize(_source(input_file, *input), *output);
+    }else if (program["-s"] == true) {
+        Analyse(_source(input_file, *input), *output, optimize, program["--stream"] == true, jobs, cache ? &*cache : nullptr, inlining, program.get<std::string>("--dump-cfg"));
+	}else if (program["-c"] == true) {
+        Assemble(_source(input_file, *input), outf, optimize, program["--stream"] == true, jobs, cache ? &*cache : nullptr, inlining, program.get<std::string>("--dump-cfg"));
 	}else {
 		fmt::print(stderr, "You must choose one analysis method.");
 		exit(2);
 	}
+	if (cache && program["--cache-stats"] == true) {
+	    cache->PrintStats(std::cerr);
+	}
 
 	return 0;
 }
\ No newline at end of file
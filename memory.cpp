@@ -0,0 +1,83 @@
+#include "./memory.h"
+
+#include <algorithm>
+#include <utility>
+
+#if !defined(CC0_NO_MMAP) && (defined(__unix__) || defined(__APPLE__))
+#include <sys/mman.h>
+#define CC0_USE_MMAP 1
+#endif
+
+#if defined(CC0_USE_MMAP) && !defined(MAP_NORESERVE)
+#define MAP_NORESERVE 0
+#endif
+
+namespace vm {
+
+SlotRegion::SlotRegion() noexcept
+    : _data(nullptr), _capacity(0), _committed(0), _mapped(false) {}
+
+SlotRegion::SlotRegion(addr_t capacity, bool reserve)
+    : _data(nullptr), _capacity(capacity), _committed(0), _mapped(false) {
+#ifdef CC0_USE_MMAP
+    if (!reserve) {
+        return;
+    }
+    void* p = ::mmap(nullptr, static_cast<std::size_t>(capacity) * sizeof(slot_t),
+        PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p != MAP_FAILED) {
+        _data = static_cast<slot_t*>(p);
+        _committed = capacity;
+        _mapped = true;
+    }
+#else
+    (void)reserve;
+#endif
+}
+
+SlotRegion::SlotRegion(SlotRegion&& other) noexcept
+    : _data(other._data), _capacity(other._capacity), _committed(other._committed),
+      _mapped(other._mapped), _fallback(std::move(other._fallback)) {
+    other._data = nullptr;
+    other._capacity = other._committed = 0;
+    other._mapped = false;
+}
+
+SlotRegion& SlotRegion::operator=(SlotRegion&& other) noexcept {
+    if (this != &other) {
+        release();
+        _data = std::exchange(other._data, nullptr);
+        _capacity = std::exchange(other._capacity, 0);
+        _committed = std::exchange(other._committed, 0);
+        _mapped = std::exchange(other._mapped, false);
+        _fallback = std::move(other._fallback);
+    }
+    return *this;
+}
+
+SlotRegion::~SlotRegion() {
+    release();
+}
+
+void SlotRegion::release() noexcept {
+#ifdef CC0_USE_MMAP
+    if (_mapped) {
+        ::munmap(_data, static_cast<std::size_t>(_capacity) * sizeof(slot_t));
+    }
+#endif
+    _fallback.clear();
+    _fallback.shrink_to_fit();
+    _data = nullptr;
+}
+
+void SlotRegion::grow(addr_t size) {
+    // only reachable without a mapping, new slots are zeroed like fresh pages
+    addr_t target = std::max<addr_t>(size, 4096);
+    target = std::max(target, _committed > _capacity / 2 ? _capacity : _committed * 2);
+    target = std::min(target, _capacity);
+    _fallback.resize(target);
+    _data = _fallback.data();
+    _committed = target;
+}
+
+}
@@ -0,0 +1,53 @@
+#ifndef MEMORY_H_INCLUDED
+#define MEMORY_H_INCLUDED
+
+#include "./type.h"
+
+#include <vector>
+
+namespace vm {
+
+// A contiguous range of slots whose backing memory is only committed when used.
+// On POSIX the whole capacity is reserved with mmap(MAP_NORESERVE) and pages are
+// faulted in by the kernel on first touch; elsewhere (or if the reservation fails,
+// or CC0_NO_MMAP is defined) a vector grows geometrically up to the capacity.
+// Callers must commit() a size before touching slots below it.
+// Passing reserve = false always uses the vector, which lets tests cover that path.
+class SlotRegion {
+public:
+    SlotRegion() noexcept;
+    explicit SlotRegion(addr_t capacity, bool reserve = true);
+    SlotRegion(const SlotRegion&) = delete;
+    SlotRegion(SlotRegion&&) noexcept;
+    SlotRegion& operator=(const SlotRegion&) = delete;
+    SlotRegion& operator=(SlotRegion&&) noexcept;
+    ~SlotRegion();
+
+public:
+    slot_t& operator[](addr_t index) noexcept { return _data[index]; }
+    slot_t* data() noexcept { return _data; }
+    addr_t capacity() const noexcept { return _capacity; }
+    bool mapped() const noexcept { return _mapped; }
+
+    // make slots [0, size) usable, size must not exceed capacity
+    void commit(addr_t size) {
+        if (size > _committed) {
+            grow(size);
+        }
+    }
+
+private:
+    void grow(addr_t size);
+    void release() noexcept;
+
+private:
+    slot_t* _data;
+    addr_t _capacity;
+    addr_t _committed;
+    bool _mapped;
+    std::vector<slot_t> _fallback;
+};
+
+}
+
+#endif
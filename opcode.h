@@ -105,10 +105,21 @@ enum class OpCode : u1 {
     // ...
     je = 0x71, jne = 0x72, jl = 0x73, jge = 0x74, jg = 0x75, jle = 0x76,
 
+    // tableswitch low(4), count(2)
+    // followed by count+1 jmp, one for each value from low and the last one for the rest
+    // ..., value
+    // ...
+    tableswitch = 0x77,
+
     // call index(2)
     // ..., params
     // ...
     call = 0x80,
+
+    // tailcall index(2)
+    // ..., params
+    // the params replace the current frame, the callee returns to our caller
+    tailcall = 0x81,
     
     // ret
     ret = 0x88,
@@ -156,8 +167,9 @@ const std::unordered_map<OpCode, const char*> nameOfOpCode = {
         
     NAME(jmp),
     NAME(je), NAME(jne), NAME(jl), NAME(jge), NAME(jg), NAME(jle),
+    NAME(tableswitch),
 
-    NAME(call),
+    NAME(call),   NAME(tailcall),
     NAME(ret),
     NAME(iret), NAME(dret), NAME(aret),
 
@@ -175,8 +187,9 @@ const std::unordered_map<OpCode, std::vector<int>> paramSizeOfOpCode = {
     
     { OpCode::jmp, {2} },
     { OpCode::je, {2} }, { OpCode::jne, {2} }, { OpCode::jl, {2} }, { OpCode::jge, {2} }, { OpCode::jg, {2} }, { OpCode::jle, {2} },
+    { OpCode::tableswitch, {4, 2} },
 
-    { OpCode::call, {2} },
+    { OpCode::call, {2} },     { OpCode::tailcall, {2} },
 };
 
 #define NAME(op) { #op, OpCode::op }
@@ -206,8 +219,9 @@ const std::unordered_map<std::string, OpCode> opCodeOfName = {
         
     NAME(jmp),
     NAME(je), NAME(jne), NAME(jl), NAME(jge), NAME(jg), NAME(jle),
+    NAME(tableswitch),
 
-    NAME(call),
+    NAME(call),   NAME(tailcall),
     NAME(ret),
     NAME(iret), NAME(dret), NAME(aret),
 
@@ -0,0 +1,310 @@
+#include "optimizer/cfg.h"
+
+#include <algorithm>
+
+namespace cc0 {
+
+    namespace {
+
+        bool isJump(Operation op) {
+            return JMP <= op && op <= JLE;
+        }
+
+        // 控制流不会落到下一条指令
+        bool isTerminator(Operation op) {
+            return op == JMP || op == RET || op == IRET || op == TABLESWITCH || op == TAILCALL;
+        }
+
+        // tableswitch 之后的表项个数，包括最后一个 default
+        std::size_t entryCountOf(const Instruction& ins) {
+            return static_cast<std::size_t>(ins.GetParam2()) + 1;
+        }
+    }
+
+    std::int64_t ReturnSlotsOf(const funcInfo& func) {
+        return func.funcType == "void" ? 0 : 1;
+    }
+
+    std::optional<StackEffect> StackEffectOf(const Instruction& ins, const std::vector<funcInfo>& funcs) {
+        switch (ins.GetOperation()) {
+            case NOP: case JMP: case PRINTL:
+                return StackEffect{0, 0};
+            case BIPUSH: case IPUSH: case LOADC: case LOADA: case ISCAN: case CSCAN:
+                return StackEffect{0, 1};
+            case DUP:
+                return StackEffect{1, 2};
+            case DUP2:
+                return StackEffect{2, 4};
+            case POP:
+                return StackEffect{1, 0};
+            case POP2:
+                return StackEffect{2, 0};
+            case POPN:
+                if (ins.GetParam1() < 0) {
+                    return {};
+                }
+                return StackEffect{ins.GetParam1(), 0};
+            case ILOAD: case ALOAD: case INEG: case I2C:
+                return StackEffect{1, 1};
+            case ISTORE: case ASTORE:
+                return StackEffect{2, 0};
+            case IADD: case ISUB: case IMUL: case IDIV: case ICMP:
+                return StackEffect{2, 1};
+            case JE: case JNE: case JL: case JGE: case JG: case JLE:
+            case IPRINT: case CPRINT: case SPRINT: case TABLESWITCH:
+                return StackEffect{1, 0};
+            case CALL: case TAILCALL: {
+                auto index = ins.GetParam1();
+                if (index < 0 || static_cast<std::size_t>(index) >= funcs.size()) {
+                    return {};
+                }
+                return StackEffect{funcs[index].paramNum, ReturnSlotsOf(funcs[index])};
+            }
+            case RET:
+                return StackEffect{0, 0};
+            case IRET:
+                return StackEffect{1, 0};
+        }
+        return {};
+    }
+
+    std::optional<std::vector<std::int64_t>> StackDepths(const funcInfo& func, const std::vector<funcInfo>& funcs) {
+        auto& code = func.localCode;
+        std::vector<std::int64_t> depth(code.size() + 1, -1);
+        std::vector<std::size_t> work;
+        auto reach = [&](std::size_t i, std::int64_t d) {
+            if (i > code.size()) {
+                return false;
+            }
+            if (depth[i] < 0) {
+                depth[i] = d;
+                work.push_back(i);
+                return true;
+            }
+            return depth[i] == d;
+        };
+        reach(0, func.paramNum);
+        while (!work.empty()) {
+            auto i = work.back();
+            work.pop_back();
+            if (i == code.size()) {
+                continue;
+            }
+            auto& ins = code[i];
+            auto effect = StackEffectOf(ins, funcs);
+            if (!effect.has_value() || effect->pop > depth[i]) {
+                return {};
+            }
+            auto after = depth[i] - effect->pop + effect->push;
+            auto op = ins.GetOperation();
+            if (isJump(op) && (ins.GetParam1() < 0 || !reach(static_cast<std::size_t>(ins.GetParam1()), after))) {
+                return {};
+            }
+            if (op == TABLESWITCH) {
+                if (ins.GetParam2() < 0) {
+                    return {};
+                }
+                for (std::size_t j = i + 1; j <= i + entryCountOf(ins); ++j) {
+                    if (j >= code.size() || code[j].GetOperation() != JMP || !reach(j, after)) {
+                        return {};
+                    }
+                }
+            }
+            if (!isTerminator(op) && !reach(i + 1, after)) {
+                return {};
+            }
+        }
+        return depth;
+    }
+
+    std::optional<ControlFlowGraph> ControlFlowGraph::Build(const std::vector<Instruction>& code) {
+        // 块的开始：入口、跳转目标、表项、跳转和返回之后的指令
+        std::vector<bool> leader(code.size() + 1, false);
+        leader[0] = true;
+        for (std::size_t i = 0; i < code.size(); ++i) {
+            auto& ins = code[i];
+            auto op = ins.GetOperation();
+            if (isJump(op)) {
+                if (ins.GetParam1() < 0 || static_cast<std::size_t>(ins.GetParam1()) > code.size()) {
+                    return {};
+                }
+                leader[ins.GetParam1()] = true;
+            }
+            if (op == TABLESWITCH) {
+                if (ins.GetParam2() < 0 || i + entryCountOf(ins) >= code.size()) {
+                    return {};
+                }
+                for (std::size_t j = i + 1; j <= i + entryCountOf(ins); ++j) {
+                    if (code[j].GetOperation() != JMP) {
+                        return {};
+                    }
+                    leader[j] = true;
+                }
+            }
+            if (isJump(op) || isTerminator(op) || op == TABLESWITCH) {
+                leader[i + 1] = true;
+            }
+        }
+
+        ControlFlowGraph cfg;
+        cfg._blockOf.resize(code.size());
+        for (std::size_t i = 0; i < code.size(); ++i) {
+            if (leader[i]) {
+                cfg._blocks.push_back(BasicBlock{i, i, {}, {}});
+            }
+            cfg._blocks.back().end = i + 1;
+            cfg._blockOf[i] = cfg._blocks.size() - 1;
+        }
+        // 跳到函数末尾等同于落出函数末尾，没有对应的块
+        auto link = [&](std::size_t from, std::size_t target) {
+            if (target < code.size()) {
+                cfg._blocks[from].successors.push_back(cfg._blockOf[target]);
+                cfg._blocks[cfg._blockOf[target]].predecessors.push_back(from);
+            }
+        };
+        for (std::size_t b = 0; b < cfg._blocks.size(); ++b) {
+            auto last = cfg._blocks[b].end - 1;
+            auto& ins = code[last];
+            auto op = ins.GetOperation();
+            if (isJump(op)) {
+                link(b, static_cast<std::size_t>(ins.GetParam1()));
+            }
+            if (op == TABLESWITCH) {
+                for (std::size_t j = last + 1; j <= last + entryCountOf(ins); ++j) {
+                    link(b, j);
+                }
+            }
+            else if (!isTerminator(op)) {
+                link(b, last + 1);
+            }
+        }
+        return cfg;
+    }
+
+    std::vector<bool> ControlFlowGraph::Reachable() const {
+        std::vector<bool> reached(_blocks.size(), false);
+        std::vector<std::size_t> work;
+        if (!_blocks.empty()) {
+            reached[0] = true;
+            work.push_back(0);
+        }
+        while (!work.empty()) {
+            auto b = work.back();
+            work.pop_back();
+            for (auto s : _blocks[b].successors) {
+                if (!reached[s]) {
+                    reached[s] = true;
+                    work.push_back(s);
+                }
+            }
+        }
+        return reached;
+    }
+
+    std::vector<std::size_t> ControlFlowGraph::ReversePostorder() const {
+        std::vector<std::size_t> order;
+        if (_blocks.empty()) {
+            return order;
+        }
+        // 显式的栈代替递归，每项是块和下一个要访问的后继
+        std::vector<bool> visited(_blocks.size(), false);
+        std::vector<std::pair<std::size_t, std::size_t>> stack{{0, 0}};
+        visited[0] = true;
+        while (!stack.empty()) {
+            auto& [b, next] = stack.back();
+            if (next < _blocks[b].successors.size()) {
+                auto s = _blocks[b].successors[next++];
+                if (!visited[s]) {
+                    visited[s] = true;
+                    stack.emplace_back(s, 0);
+                }
+                continue;
+            }
+            order.push_back(b);
+            stack.pop_back();
+        }
+        std::reverse(order.begin(), order.end());
+        return order;
+    }
+
+    std::vector<std::size_t> ControlFlowGraph::LoopDepths() const {
+        std::vector<std::size_t> depth(_blocks.size(), 0);
+        auto order = ReversePostorder();
+        if (order.empty()) {
+            return depth;
+        }
+        // Cooper, Harvey, Kennedy: A Simple, Fast Dominance Algorithm
+        const auto none = _blocks.size();
+        std::vector<std::size_t> number(_blocks.size(), 0);
+        for (std::size_t i = 0; i < order.size(); ++i) {
+            number[order[i]] = i;
+        }
+        std::vector<std::size_t> idom(_blocks.size(), none);
+        idom[0] = 0;
+        auto intersect = [&](std::size_t a, std::size_t b) {
+            while (a != b) {
+                while (number[a] > number[b]) {
+                    a = idom[a];
+                }
+                while (number[b] > number[a]) {
+                    b = idom[b];
+                }
+            }
+            return a;
+        };
+        for (bool changed = true; changed; ) {
+            changed = false;
+            for (std::size_t i = 1; i < order.size(); ++i) {
+                auto b = order[i];
+                auto dominator = none;
+                for (auto p : _blocks[b].predecessors) {
+                    if (idom[p] != none) {
+                        dominator = dominator == none ? p : intersect(p, dominator);
+                    }
+                }
+                if (idom[b] != dominator) {
+                    idom[b] = dominator;
+                    changed = true;
+                }
+            }
+        }
+        auto dominates = [&](std::size_t a, std::size_t b) {
+            while (b != a && b != 0) {
+                b = idom[b];
+            }
+            return b == a;
+        };
+
+        // 每个循环头的循环体是不经过它能到达回边起点的块，同一个循环头的回边合成一个循环
+        std::vector<bool> body(_blocks.size());
+        for (auto header : order) {
+            std::vector<std::size_t> work;
+            for (auto p : _blocks[header].predecessors) {
+                if (idom[p] != none && dominates(header, p)) {
+                    work.push_back(p);
+                }
+            }
+            if (work.empty()) {
+                continue;
+            }
+            std::fill(body.begin(), body.end(), false);
+            body[header] = true;
+            ++depth[header];
+            while (!work.empty()) {
+                auto b = work.back();
+                work.pop_back();
+                if (body[b]) {
+                    continue;
+                }
+                body[b] = true;
+                ++depth[b];
+                for (auto p : _blocks[b].predecessors) {
+                    if (idom[p] != none) {
+                        work.push_back(p);
+                    }
+                }
+            }
+        }
+        return depth;
+    }
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "analyser/analyser.h"
+#include "instruction/instruction.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace cc0 {
+
+    // 一条指令出栈和入栈的单元数
+    struct StackEffect {
+        std::int64_t pop;
+        std::int64_t push;
+    };
+
+    // 函数返回后留在调用者栈上的单元数
+    std::int64_t ReturnSlotsOf(const funcInfo& func);
+
+    // 不认识的指令返回空，call 的参数个数和返回值从 funcs 中查找
+    std::optional<StackEffect> StackEffectOf(const Instruction& ins, const std::vector<funcInfo>& funcs);
+
+    // 每条指令之前的栈深度，从栈帧的开始算起，包括参数；不可达的为 -1，最后一项是落出函数末尾时的深度
+    // 有不认识的指令、跳出函数或者路径汇合时深度不同都返回空
+    std::optional<std::vector<std::int64_t>> StackDepths(const funcInfo& func, const std::vector<funcInfo>& funcs);
+
+    // 基本块是 [begin, end) 的一段指令，只从第一条进入，只从最后一条离开
+    // 后继按照跳转目标、顺序执行的次序排列，tableswitch 的后继是各个表项；返回和落出函数末尾没有后继
+    struct BasicBlock {
+        std::size_t begin;
+        std::size_t end;
+        std::vector<std::size_t> successors;
+        std::vector<std::size_t> predecessors;
+    };
+
+    // 函数代码的控制流图，第 0 块是入口
+    // 跳转目标仍然是指令下标，块只记录划分，修改代码之后需要重新构造
+    class ControlFlowGraph final {
+    public:
+        // 跳转目标超出函数或者 tableswitch 的表项不是 jmp 时返回空
+        static std::optional<ControlFlowGraph> Build(const std::vector<Instruction>& code);
+
+        const std::vector<BasicBlock>& Blocks() const { return _blocks; }
+        // 指令所在的块
+        std::size_t BlockOf(std::size_t index) const { return _blockOf[index]; }
+        // 从入口可达的块
+        std::vector<bool> Reachable() const;
+        // 可达块的逆后序，前向数据流按这个顺序迭代收敛最快，后向数据流反过来
+        std::vector<std::size_t> ReversePostorder() const;
+        // 每个块所在的自然循环的层数：回边的目标支配回边的起点，不可达的块为 0
+        std::vector<std::size_t> LoopDepths() const;
+
+    private:
+        std::vector<BasicBlock> _blocks;
+        std::vector<std::size_t> _blockOf;
+    };
+}
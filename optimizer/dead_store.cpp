@@ -0,0 +1,80 @@
+#include "optimizer/dead_store.h"
+#include "optimizer/cfg.h"
+#include "optimizer/liveness.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace cc0 {
+
+    namespace {
+
+        bool isJump(Operation op) {
+            return JMP <= op && op <= JLE;
+        }
+
+        // 删除不可达的块，跳向被删除指令的跳转改为跳向其后第一条保留的指令
+        std::size_t removeUnreachable(std::vector<Instruction>& code, const ControlFlowGraph& cfg) {
+            auto reachable = cfg.Reachable();
+            std::vector<std::size_t> newIndex(code.size() + 1);
+            std::vector<Instruction> result;
+            for (std::size_t i = 0; i < code.size(); ++i) {
+                newIndex[i] = result.size();
+                if (reachable[cfg.BlockOf(i)]) {
+                    result.push_back(code[i]);
+                }
+            }
+            newIndex[code.size()] = result.size();
+            if (result.size() == code.size()) {
+                return 0;
+            }
+            for (auto& ins : result) {
+                if (isJump(ins.GetOperation())) {
+                    ins.SetParam1(static_cast<std::int32_t>(newIndex[ins.GetParam1()]));
+                }
+            }
+            std::size_t count = code.size() - result.size();
+            code = std::move(result);
+            return count;
+        }
+
+        std::size_t removeDeadStores(std::vector<Instruction>& code, const ControlFlowGraph& cfg, const Liveness& liveness) {
+            std::size_t count = 0;
+            auto& blocks = cfg.Blocks();
+            for (std::size_t b = 0; b < blocks.size(); ++b) {
+                auto live = liveness.LiveOut(b);
+                for (auto i = blocks[b].end; i-- > blocks[b].begin; ) {
+                    auto op = code[i].GetOperation();
+                    auto slot = liveness.SlotOf(i);
+                    // Transfer 按照分析时的指令计算，先倒推再修改
+                    bool dead = (op == ISTORE || op == ASTORE) && slot.has_value() && !live[slot.value()];
+                    liveness.Transfer(i, live);
+                    if (dead) {
+                        code[i] = Instruction(POPN, 2);
+                        ++count;
+                    }
+                }
+            }
+            return count;
+        }
+    }
+
+    DeadStoreStats EliminateDeadStores(resultInfo& result) {
+        DeadStoreStats stats;
+        for (auto& func : result.funcList) {
+            auto cfg = ControlFlowGraph::Build(func.localCode);
+            if (!cfg.has_value()) {
+                continue;
+            }
+            if (auto removed = removeUnreachable(func.localCode, cfg.value()); removed != 0) {
+                stats.unreachable += removed;
+                cfg = ControlFlowGraph::Build(func.localCode);
+            }
+            auto liveness = Liveness::Analyse(func, cfg.value(), result.funcList);
+            if (liveness.has_value()) {
+                stats.stores += removeDeadStores(func.localCode, cfg.value(), liveness.value());
+            }
+        }
+        return stats;
+    }
+}
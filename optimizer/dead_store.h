@@ -0,0 +1,20 @@
+#pragma once
+
+#include "analyser/analyser.h"
+
+#include <cstddef>
+
+namespace cc0 {
+
+    struct DeadStoreStats {
+        // 删除的不可达基本块中的指令
+        std::size_t unreachable = 0;
+        // 改为出栈的 istore
+        std::size_t stores = 0;
+    };
+
+    // 基于控制流图和栈帧单元活跃性的死代码消除，只处理函数，不处理启动代码
+    // 先删除从入口不可达的基本块，再把写入之后不再被读取的栈帧单元的 istore 改为 popn 2，
+    // 压入地址和值的指令留给之后的窥孔优化删除
+    DeadStoreStats EliminateDeadStores(resultInfo& result);
+}
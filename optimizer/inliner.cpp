@@ -0,0 +1,343 @@
+#include "optimizer/inliner.h"
+#include "optimizer/cfg.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace cc0 {
+
+    namespace {
+
+        bool isJump(Operation op) {
+            return JMP <= op && op <= JLE;
+        }
+
+        // 控制流不会落到下一条指令
+        bool isTerminator(Operation op) {
+            return op == JMP || op == RET || op == IRET || op == TABLESWITCH || op == TAILCALL;
+        }
+
+        // 跳转目标，包括 tableswitch 的表项
+        std::vector<bool> jumpTargets(const std::vector<Instruction>& code) {
+            std::vector<bool> target(code.size() + 1, false);
+            for (std::size_t i = 0; i < code.size(); ++i) {
+                auto& ins = code[i];
+                if (isJump(ins.GetOperation()) && ins.GetParam1() >= 0 && static_cast<std::size_t>(ins.GetParam1()) <= code.size()) {
+                    target[ins.GetParam1()] = true;
+                }
+                if (ins.GetOperation() == TABLESWITCH && ins.GetParam2() >= 0) {
+                    for (std::size_t j = i + 1; j <= i + 1 + static_cast<std::size_t>(ins.GetParam2()) && j < code.size(); ++j) {
+                        target[j] = true;
+                    }
+                }
+            }
+            return target;
+        }
+
+        // 可以内联的函数
+        struct Callee {
+            // 每条指令之前的栈深度
+            std::vector<std::int64_t> depth;
+            // 参数只以 loada 0,k; iload 的形式读取，这时调用处的简单实参可以直接替换进来，不必入栈
+            bool readOnlyParams = true;
+            // 返回值表达式开始的位置，在这里先压入返回值要存放的地址，对应的 iret 处直接 istore
+            std::vector<bool> valueStart;
+            std::vector<bool> storedReturn;
+        };
+
+        Callee analyseCallee(const funcInfo& func, std::vector<std::int64_t> depth, const std::vector<funcInfo>& funcs) {
+            auto& code = func.localCode;
+            auto target = jumpTargets(code);
+            Callee callee;
+            callee.valueStart.assign(code.size(), false);
+            callee.storedReturn.assign(code.size(), false);
+            for (std::size_t i = 0; i < code.size(); ++i) {
+                if (depth[i] < 0) {
+                    continue;
+                }
+                auto& ins = code[i];
+                if (ins.GetOperation() == LOADA && ins.GetParam1() == 0 && ins.GetParam2() < func.paramNum
+                    && (i + 1 == code.size() || code[i + 1].GetOperation() != ILOAD || target[i + 1])) {
+                    callee.readOnlyParams = false;
+                }
+                if (ins.GetOperation() != IRET) {
+                    continue;
+                }
+                // 向前找到返回值开始入栈的位置，中间是顺序执行的代码，而且不会用到其下的单元
+                auto bottom = depth[i] - 1;
+                for (std::size_t j = i; j-- > 0; ) {
+                    auto op = code[j].GetOperation();
+                    auto effect = StackEffectOf(code[j], funcs);
+                    // 插入的地址会让其上的单元都上移一个位置，所以中间也不能直接访问它们
+                    bool addressed = op == LOADA && code[j].GetParam1() == 0 && code[j].GetParam2() >= bottom;
+                    if (isJump(op) || isTerminator(op) || addressed || depth[j] < bottom || depth[j] - effect->pop < bottom) {
+                        break;
+                    }
+                    if (depth[j] == bottom) {
+                        callee.valueStart[j] = true;
+                        callee.storedReturn[i] = true;
+                        break;
+                    }
+                    if (target[j]) {
+                        break;
+                    }
+                }
+            }
+            callee.depth = std::move(depth);
+            return callee;
+        }
+
+        // 被内联的函数在深度为 depth 处返回：把返回值（如果有）移到栈帧的开始 base，弹出其上的所有单元
+        // stored 为真时返回值已经存到了 base
+        void emitReturn(std::vector<Instruction>& out, std::int32_t base, std::int64_t depth, bool value, bool stored) {
+            if (value && stored) {
+                if (depth > 1) {
+                    out.emplace_back(ISTORE);
+                    if (depth > 2) {
+                        out.emplace_back(POPN, static_cast<std::int32_t>(depth - 2));
+                    }
+                }
+            }
+            else if (value) {
+                // 返回值在 base + depth - 1
+                if (depth > 1) {
+                    out.emplace_back(LOADA, 0, base);
+                    out.emplace_back(LOADA, 0, static_cast<std::int32_t>(base + depth - 1));
+                    out.emplace_back(ILOAD);
+                    out.emplace_back(ISTORE);
+                    out.emplace_back(POPN, static_cast<std::int32_t>(depth - 1));
+                }
+            }
+            else if (depth > 0) {
+                out.emplace_back(POPN, static_cast<std::int32_t>(depth));
+            }
+        }
+
+        // 把 func 的函数体追加到 out，它的栈帧从调用者栈帧的 base 开始
+        // args 不为空时参数不在栈上，读取参数 k 改为执行 args[k]，栈帧中其它单元的位置都减去参数个数
+        // 跳转目标改为 out 中的位置，不可达的指令不复制
+        void emitBody(std::vector<Instruction>& out, const funcInfo& func, const Callee& callee, std::int32_t base,
+                      const std::vector<std::vector<Instruction>>* args, const std::vector<funcInfo>& funcs) {
+            auto& code = func.localCode;
+            auto& depth = callee.depth;
+            bool value = ReturnSlotsOf(func) != 0;
+            std::int32_t shift = args != nullptr ? func.paramNum : 0;
+            std::vector<std::size_t> newIndex(code.size() + 1);
+            std::vector<std::size_t> jumps;
+            // 跳到函数体末尾的 jmp
+            std::vector<std::size_t> exits;
+            for (std::size_t i = 0; i < code.size(); ++i) {
+                newIndex[i] = out.size();
+                if (depth[i] < 0) {
+                    continue;
+                }
+                if (callee.valueStart[i] && depth[i] - shift > 0) {
+                    out.emplace_back(LOADA, 0, base);
+                }
+                auto& ins = code[i];
+                switch (ins.GetOperation()) {
+                    case LOADA:
+                        // 第 0 层是被调用函数自己的栈帧，其它层次与调用者相同
+                        if (ins.GetParam1() != 0) {
+                            out.push_back(ins);
+                        }
+                        else if (args != nullptr && ins.GetParam2() < func.paramNum) {
+                            auto& arg = (*args)[ins.GetParam2()];
+                            out.insert(out.end(), arg.begin(), arg.end());
+                            // 跳过其后的 iload
+                            newIndex[++i] = out.size();
+                        }
+                        else {
+                            out.emplace_back(LOADA, 0, base + ins.GetParam2() - shift);
+                        }
+                        break;
+                    case RET:
+                    case IRET:
+                        emitReturn(out, base, depth[i] - shift, ins.GetOperation() == IRET, callee.storedReturn[i]);
+                        exits.push_back(out.size());
+                        out.emplace_back(JMP);
+                        break;
+                    case TAILCALL: {
+                        // 调用者的栈帧不能被替换，改为普通的调用再返回
+                        auto& target = funcs[ins.GetParam1()];
+                        out.emplace_back(CALL, ins.GetParam1());
+                        emitReturn(out, base, depth[i] - shift - target.paramNum + ReturnSlotsOf(target), value, false);
+                        exits.push_back(out.size());
+                        out.emplace_back(JMP);
+                        break;
+                    }
+                    default:
+                        if (isJump(ins.GetOperation())) {
+                            jumps.push_back(out.size());
+                        }
+                        out.push_back(ins);
+                        break;
+                }
+            }
+            newIndex[code.size()] = out.size();
+            for (auto j : jumps) {
+                out[j].SetParam1(static_cast<std::int32_t>(newIndex[out[j].GetParam1()]));
+            }
+            // 最后一条返回之后就是末尾，不需要跳转
+            if (!exits.empty() && exits.back() + 1 == out.size()) {
+                out.pop_back();
+            }
+            for (auto e : exits) {
+                if (e < out.size()) {
+                    out[e].SetParam1(static_cast<std::int32_t>(out.size()));
+                }
+            }
+        }
+
+        // 第 i 条指令之前压入 count 个实参的指令，每个实参都是常量或者 base 之下的局部变量
+        // 返回这些指令的开始位置和每个实参的指令，不是这样的形式或者中间有跳转目标时返回空
+        std::optional<std::pair<std::size_t, std::vector<std::vector<Instruction>>>> simpleArguments(
+                const std::vector<Instruction>& code, const std::vector<bool>& target, std::size_t i, int count, std::int32_t base) {
+            std::vector<std::vector<Instruction>> args(count);
+            std::size_t start = i;
+            for (int k = count - 1; k >= 0; --k) {
+                if (start >= 1 && (code[start - 1].GetOperation() == IPUSH || code[start - 1].GetOperation() == BIPUSH)) {
+                    args[k] = {code[start - 1]};
+                    start -= 1;
+                }
+                else if (start >= 2 && code[start - 1].GetOperation() == ILOAD && code[start - 2].GetOperation() == LOADA
+                         && code[start - 2].GetParam1() == 0 && code[start - 2].GetParam2() < base && !target[start - 1]) {
+                    args[k] = {code[start - 2], code[start - 1]};
+                    start -= 2;
+                }
+                else {
+                    return {};
+                }
+                // 实参之间和 call 本身都不能是跳转目标，只有第一条指令可以
+                if (target[start + args[k].size()] ) {
+                    return {};
+                }
+            }
+            return std::make_pair(start, std::move(args));
+        }
+    }
+
+    std::size_t InlineFunctions(resultInfo& result, const InlineOptions& options) {
+        auto& funcs = result.funcList;
+        if (options.maxDepth == 0) {
+            return 0;
+        }
+        // 函数中嵌套内联的层数
+        std::vector<std::size_t> nesting(funcs.size(), 0);
+        // 可以被内联的函数
+        std::vector<std::optional<Callee>> inlinable(funcs.size());
+        std::size_t inlined = 0;
+        // 被调用的函数总是先定义，按顺序处理时它们都已经内联过了
+        for (std::size_t f = 0; f < funcs.size(); ++f) {
+            auto& func = funcs[f];
+            auto depth = StackDepths(func, funcs);
+            if (!depth.has_value()) {
+                continue;
+            }
+            auto& code = func.localCode;
+            // 再内联就会超过 maxCallerSize
+            bool full = false;
+            // 第 i 条指令是否调用可以在这里内联的函数
+            auto inlinableAt = [&](std::size_t i) {
+                auto op = code[i].GetOperation();
+                if (full || (op != CALL && op != TAILCALL) || (*depth)[i] < 0) {
+                    return false;
+                }
+                auto g = static_cast<std::size_t>(code[i].GetParam1());
+                if (g == f || !inlinable[g].has_value()) {
+                    return false;
+                }
+                // tailcall 之后由调用者返回，返回类型必须相同
+                return op == CALL || funcs[g].funcType == func.funcType;
+            };
+
+            std::size_t sites = 0;
+            for (std::size_t i = 0; i < code.size(); ++i) {
+                sites += inlinableAt(i) ? 1 : 0;
+            }
+            if (sites != 0) {
+                auto target = jumpTargets(code);
+                std::vector<Instruction> out;
+                std::vector<std::size_t> newIndex(code.size() + 1);
+                std::vector<std::size_t> jumps;
+                // 实际内联的调用个数
+                std::size_t done = 0;
+                for (std::size_t i = 0; i < code.size(); ++i) {
+                    newIndex[i] = out.size();
+                    auto& ins = code[i];
+                    if (inlinableAt(i)) {
+                        auto g = static_cast<std::size_t>(ins.GetParam1());
+                        auto& callee = *inlinable[g];
+                        auto base = static_cast<std::int32_t>((*depth)[i] - funcs[g].paramNum);
+                        std::optional<std::pair<std::size_t, std::vector<std::vector<Instruction>>>> args;
+                        if (callee.readOnlyParams) {
+                            args = simpleArguments(code, target, i, funcs[g].paramNum, base);
+                        }
+                        // 实参的第一条指令在 out 中的位置
+                        auto mark = out.size();
+                        if (args.has_value()) {
+                            // 实参不再入栈，已经复制的指令都是简单的入栈，从末尾去掉
+                            mark -= i - args->first;
+                            out.resize(mark);
+                            for (auto j = args->first; j <= i; ++j) {
+                                newIndex[j] = out.size();
+                            }
+                        }
+                        emitBody(out, funcs[g], callee, base, args.has_value() ? &args->second : nullptr, funcs);
+                        if (ins.GetOperation() == TAILCALL) {
+                            out.emplace_back(ReturnSlotsOf(func) != 0 ? IRET : RET);
+                        }
+                        // 其后的指令原样保留时也放不下，撤销这一处，不再内联
+                        if (out.size() + (code.size() - i - 1) > options.maxCallerSize) {
+                            out.resize(mark);
+                            if (args.has_value()) {
+                                for (auto j = args->first; j < i; ++j) {
+                                    newIndex[j] = out.size();
+                                    out.push_back(code[j]);
+                                }
+                            }
+                            newIndex[i] = out.size();
+                            full = true;
+                        }
+                        else {
+                            nesting[f] = std::max(nesting[f], nesting[g] + 1);
+                            ++done;
+                            continue;
+                        }
+                    }
+                    if (isJump(ins.GetOperation())) {
+                        jumps.push_back(out.size());
+                    }
+                    out.push_back(ins);
+                }
+                newIndex[code.size()] = out.size();
+                for (auto j : jumps) {
+                    out[j].SetParam1(static_cast<std::int32_t>(newIndex[out[j].GetParam1()]));
+                }
+                code = std::move(out);
+                inlined += done;
+                depth = StackDepths(func, funcs);
+                if (!depth.has_value()) {
+                    continue;
+                }
+            }
+
+            // 不能落出函数末尾，也不能调用自己，尾调用的函数要返回同样的类型
+            if (code.size() > options.maxSize || (*depth)[code.size()] >= 0 || nesting[f] >= options.maxDepth) {
+                continue;
+            }
+            bool simple = std::none_of(code.begin(), code.end(), [&](const Instruction& ins) {
+                auto op = ins.GetOperation();
+                auto g = static_cast<std::size_t>(ins.GetParam1());
+                return ((op == CALL || op == TAILCALL) && g == f)
+                    || (op == TAILCALL && funcs[g].funcType != func.funcType);
+            });
+            if (simple) {
+                inlinable[f] = analyseCallee(func, std::move(*depth), funcs);
+            }
+        }
+        return inlined;
+    }
+}
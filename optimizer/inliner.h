@@ -0,0 +1,28 @@
+#pragma once
+
+#include "analyser/analyser.h"
+#include "instruction/instruction.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace cc0 {
+
+    // 内联的阈值
+    struct InlineOptions {
+        // 被调用函数（已经内联了它自己的调用之后）最多的指令条数
+        std::size_t maxSize = 16;
+        // 嵌套内联的最大层数，0 表示不内联
+        std::size_t maxDepth = 2;
+        // 调用者内联之后最多的指令条数，目标文件中一个函数的指令条数不能超过 u2 的范围
+        std::size_t maxCallerSize = UINT16_MAX;
+    };
+
+    // 把小的非递归函数的函数体替换到 call 和 tailcall 处，在窥孔优化之前进行
+    // 被调用函数的 loada 0,k 改为调用者栈帧中参数所在的位置，返回指令改为把返回值移到参数的位置再跳到末尾
+    // 参数只被读取而实参是常量或局部变量时，不再把实参压栈，直接在读取参数的地方替换成实参
+    // 只处理栈深度在每条指令处都确定的函数，启动代码不做内联
+    // 某处内联会让调用者超过 maxCallerSize 时，这一处和其后的调用都不再内联
+    // 返回内联的调用个数
+    std::size_t InlineFunctions(resultInfo& result, const InlineOptions& options = InlineOptions{});
+}
@@ -0,0 +1,206 @@
+#include "optimizer/liveness.h"
+
+#include <algorithm>
+
+namespace cc0 {
+
+    namespace {
+        // 抽象的栈：每个单元是它保存的栈帧单元的地址（非负），或者以下几种值
+        constexpr std::int64_t NotAddress = -1;
+        constexpr std::int64_t GlobalAddress = -2;
+        // 不同路径上是不同的地址
+        constexpr std::int64_t Conflict = -3;
+
+        std::int64_t meet(std::int64_t a, std::int64_t b) {
+            if (a == b) {
+                return a;
+            }
+            if (a >= 0 || b >= 0 || a == Conflict || b == Conflict) {
+                return Conflict;
+            }
+            return NotAddress;
+        }
+
+        // 地址只能被 iload、istore、pop 和 dup 使用，其它指令把它当作值使用时栈帧中的单元无法分析
+        bool escapes(std::int64_t value) {
+            return value >= 0 || value == Conflict;
+        }
+    }
+
+    std::optional<Liveness> Liveness::Analyse(const funcInfo& func, const ControlFlowGraph& cfg, const std::vector<funcInfo>& funcs) {
+        auto depth = StackDepths(func, funcs);
+        if (!depth.has_value()) {
+            return {};
+        }
+        auto& code = func.localCode;
+        auto& blocks = cfg.Blocks();
+        Liveness result;
+        result._depth = std::move(depth.value());
+        result._slot.assign(code.size(), -1);
+        result._operation.reserve(code.size());
+        result._effect.reserve(code.size());
+        std::int64_t cells = func.paramNum;
+        for (std::size_t i = 0; i < code.size(); ++i) {
+            result._operation.push_back(code[i].GetOperation());
+            // 不可达的指令也可能不认识，它们不参与分析
+            auto effect = StackEffectOf(code[i], funcs).value_or(StackEffect{0, 0});
+            result._effect.push_back(effect);
+            if (result._depth[i] >= 0) {
+                cells = std::max({cells, result._depth[i], result._depth[i] - effect.pop + effect.push});
+            }
+        }
+        auto& d = result._depth;
+
+        // 前向传播栈上的地址，同时记下每条 iload 和 istore 访问的单元
+        auto step = [&](std::size_t i, std::vector<std::int64_t>& stack) {
+            auto& ins = code[i];
+            auto& effect = result._effect[i];
+            if (static_cast<std::int64_t>(stack.size()) != d[i]) {
+                return false;
+            }
+            switch (ins.GetOperation()) {
+                case LOADA:
+                    if (ins.GetParam1() != 0) {
+                        stack.push_back(GlobalAddress);
+                    }
+                    else if (ins.GetParam2() < 0) {
+                        return false;
+                    }
+                    else {
+                        stack.push_back(ins.GetParam2());
+                    }
+                    return true;
+                case ILOAD: case ALOAD:
+                case ISTORE: case ASTORE: {
+                    bool store = ins.GetOperation() == ISTORE || ins.GetOperation() == ASTORE;
+                    if (store && escapes(stack.back())) {
+                        return false;
+                    }
+                    // 地址之上的单元都是操作数，访问它们的代码不是分析器生成的
+                    auto operand = d[i] - effect.pop;
+                    auto address = stack[operand];
+                    if (address >= operand || (address < 0 && address != GlobalAddress)) {
+                        return false;
+                    }
+                    result._slot[i] = address >= 0 ? address : -1;
+                    stack.resize(operand);
+                    if (!store) {
+                        stack.push_back(NotAddress);
+                    }
+                    return true;
+                }
+                case POP: case POP2: case POPN:
+                    stack.resize(stack.size() - effect.pop);
+                    return true;
+                case DUP:
+                    stack.push_back(stack.back());
+                    return true;
+                case DUP2:
+                    stack.push_back(stack[stack.size() - 2]);
+                    stack.push_back(stack[stack.size() - 2]);
+                    return true;
+                default:
+                    if (std::any_of(stack.end() - effect.pop, stack.end(), escapes)) {
+                        return false;
+                    }
+                    stack.resize(stack.size() - effect.pop);
+                    stack.resize(stack.size() + effect.push, NotAddress);
+                    return true;
+            }
+        };
+        auto order = cfg.ReversePostorder();
+        std::vector<std::optional<std::vector<std::int64_t>>> entry(blocks.size());
+        if (!blocks.empty()) {
+            entry[0].emplace(func.paramNum, NotAddress);
+        }
+        for (bool changed = true; changed; ) {
+            changed = false;
+            for (auto b : order) {
+                auto stack = entry[b].value();
+                for (auto i = blocks[b].begin; i < blocks[b].end; ++i) {
+                    if (!step(i, stack)) {
+                        return {};
+                    }
+                }
+                for (auto s : blocks[b].successors) {
+                    if (!entry[s].has_value()) {
+                        entry[s] = stack;
+                        changed = true;
+                        continue;
+                    }
+                    auto& target = entry[s].value();
+                    for (std::size_t k = 0; k < target.size(); ++k) {
+                        auto merged = meet(target[k], stack[k]);
+                        changed = changed || merged != target[k];
+                        target[k] = merged;
+                    }
+                }
+            }
+        }
+
+        // 后向迭代活跃单元
+        result._liveIn.assign(blocks.size(), std::vector<bool>(cells, false));
+        result._liveOut.assign(blocks.size(), std::vector<bool>(cells, false));
+        for (bool changed = true; changed; ) {
+            changed = false;
+            for (auto it = order.rbegin(); it != order.rend(); ++it) {
+                auto b = *it;
+                std::vector<bool> live(cells, false);
+                for (auto s : blocks[b].successors) {
+                    for (std::int64_t c = 0; c < cells; ++c) {
+                        live[c] = live[c] || result._liveIn[s][c];
+                    }
+                }
+                result._liveOut[b] = live;
+                for (auto i = blocks[b].end; i-- > blocks[b].begin; ) {
+                    result.Transfer(i, live);
+                }
+                if (live != result._liveIn[b]) {
+                    result._liveIn[b] = std::move(live);
+                    changed = true;
+                }
+            }
+        }
+        return result;
+    }
+
+    std::optional<std::int64_t> Liveness::SlotOf(std::size_t index) const {
+        if (_slot[index] < 0) {
+            return {};
+        }
+        return _slot[index];
+    }
+
+    void Liveness::Transfer(std::size_t index, std::vector<bool>& live) const {
+        auto d = _depth[index];
+        if (d < 0) {
+            return;
+        }
+        auto& effect = _effect[index];
+        auto operand = d - effect.pop;
+        switch (_operation[index]) {
+            case ISTORE: case ASTORE:
+                if (_slot[index] >= 0) {
+                    live[_slot[index]] = false;
+                }
+                live[operand] = live[operand + 1] = true;
+                break;
+            case ILOAD: case ALOAD:
+                live[operand] = true;
+                if (_slot[index] >= 0) {
+                    live[_slot[index]] = true;
+                }
+                break;
+            case POP: case POP2: case POPN:
+                break;
+            default:
+                for (auto c = operand; c < operand + effect.push; ++c) {
+                    live[c] = false;
+                }
+                for (auto c = operand; c < d; ++c) {
+                    live[c] = true;
+                }
+                break;
+        }
+    }
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "optimizer/cfg.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace cc0 {
+
+    // 栈帧中单元的活跃性，单元按照相对栈帧开始的位置编号
+    // 参数、局部变量和表达式的临时值都在栈帧中，统一处理：
+    // loada 0,k 压入的地址被 iload 使用时读单元 k，被 istore 使用时写单元 k；
+    // 其它指令读它的操作数所在的单元，写结果所在的单元；pop 只出栈，不算读
+    class Liveness final {
+    public:
+        // 栈深度不确定，或者栈帧中的地址被当作普通的值使用时返回空
+        static std::optional<Liveness> Analyse(const funcInfo& func, const ControlFlowGraph& cfg, const std::vector<funcInfo>& funcs);
+
+        // 块的出口处活跃的单元
+        const std::vector<bool>& LiveOut(std::size_t block) const { return _liveOut[block]; }
+        // 块的入口处活跃的单元
+        const std::vector<bool>& LiveIn(std::size_t block) const { return _liveIn[block]; }
+        // iload 和 istore 访问的栈帧单元，访问全局变量或者不是这两种指令时为空
+        std::optional<std::int64_t> SlotOf(std::size_t index) const;
+        // 每条指令之前的栈深度
+        const std::vector<std::int64_t>& Depths() const { return _depth; }
+
+        // 把第 index 条指令之后的活跃单元 live 倒推到它之前
+        void Transfer(std::size_t index, std::vector<bool>& live) const;
+
+    private:
+        std::vector<Operation> _operation;
+        std::vector<StackEffect> _effect;
+        std::vector<std::int64_t> _depth;
+        // 访问的单元，-1 表示不是栈帧中的单元
+        std::vector<std::int64_t> _slot;
+        std::vector<std::vector<bool>> _liveIn;
+        std::vector<std::vector<bool>> _liveOut;
+    };
+}
@@ -0,0 +1,138 @@
+#include "optimizer/loop_rotation.h"
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace cc0 {
+
+    namespace {
+
+        bool isJump(Operation op) {
+            return JMP <= op && op <= JLE;
+        }
+
+        bool isConditionalJump(Operation op) {
+            return JE <= op && op <= JLE;
+        }
+
+        // 条件相反的跳转，与 0 比较的六种情况两两互补
+        Operation invert(Operation op) {
+            switch (op) {
+                case JE: return JNE;
+                case JNE: return JE;
+                case JL: return JGE;
+                case JGE: return JL;
+                case JG: return JLE;
+                default: return JG;
+            }
+        }
+
+        // 目标文件中一个函数最多的指令条数
+        constexpr std::size_t maxFunctionSize = UINT16_MAX;
+
+        std::size_t targetOf(const Instruction& ins) {
+            return static_cast<std::size_t>(ins.GetParam1());
+        }
+
+        // 从 start 开始顺序执行并穿过 jmp，直到第一个条件跳转，返回它的下标
+        // 经过的其它指令按执行顺序放入 copied；遇到返回、tableswitch、死循环或者超过 maxSize 条时返回空
+        std::optional<std::size_t> traceCondition(const std::vector<Instruction>& code, std::size_t start,
+                                                  std::size_t maxSize, std::vector<Instruction>& copied) {
+            std::vector<bool> visited(code.size(), false);
+            for (auto i = start; i < code.size() && !visited[i]; ) {
+                visited[i] = true;
+                auto op = code[i].GetOperation();
+                if (op == JMP) {
+                    i = targetOf(code[i]);
+                    continue;
+                }
+                if (isConditionalJump(op)) {
+                    return i;
+                }
+                if (op == RET || op == IRET || op == TABLESWITCH || op == TAILCALL || copied.size() == maxSize) {
+                    return {};
+                }
+                copied.push_back(code[i]);
+                ++i;
+            }
+            return {};
+        }
+
+        std::size_t rotate(std::vector<Instruction>& code, std::size_t maxSize) {
+            // 表项只能是一条 jmp
+            std::vector<bool> entry(code.size(), false);
+            for (std::size_t i = 0; i < code.size(); ++i) {
+                // 跳转目标不合法的代码不做旋转
+                if (isJump(code[i].GetOperation()) && (code[i].GetParam1() < 0 || targetOf(code[i]) > code.size())) {
+                    return 0;
+                }
+                if (code[i].GetOperation() == TABLESWITCH) {
+                    for (std::size_t j = i + 1; j <= i + 1 + static_cast<std::size_t>(code[i].GetParam2()) && j < code.size(); ++j) {
+                        entry[j] = true;
+                    }
+                }
+            }
+            // 替换各个 jmp 的指令序列，其中的跳转目标仍是原来的下标
+            std::vector<std::optional<std::vector<Instruction>>> replacement(code.size());
+            std::size_t count = 0;
+            // 旋转之后的指令条数
+            std::size_t size = code.size();
+            for (std::size_t j = 0; j < code.size(); ++j) {
+                auto& ins = code[j];
+                if (ins.GetOperation() != JMP || entry[j] || targetOf(ins) > j) {
+                    continue;
+                }
+                std::vector<Instruction> copied;
+                auto k = traceCondition(code, targetOf(ins), maxSize, copied);
+                if (!k.has_value()) {
+                    continue;
+                }
+                auto& condition = code[k.value()];
+                // 条件不成立时继续循环，成立时离开：离开的位置不是下一条指令时还需要一个 jmp
+                copied.emplace_back(invert(condition.GetOperation()), static_cast<std::int32_t>(k.value() + 1));
+                if (targetOf(condition) != j + 1) {
+                    copied.emplace_back(JMP, condition.GetParam1());
+                }
+                // 放不下就保留这个 jmp，后面更短的拷贝可能还放得下
+                if (size - 1 + copied.size() > maxFunctionSize) {
+                    continue;
+                }
+                size += copied.size() - 1;
+                replacement[j] = std::move(copied);
+                ++count;
+            }
+            if (count == 0) {
+                return 0;
+            }
+
+            std::vector<std::size_t> newIndex(code.size() + 1);
+            std::vector<Instruction> result;
+            for (std::size_t i = 0; i < code.size(); ++i) {
+                newIndex[i] = result.size();
+                if (replacement[i].has_value()) {
+                    result.insert(result.end(), replacement[i]->begin(), replacement[i]->end());
+                }
+                else {
+                    result.push_back(code[i]);
+                }
+            }
+            newIndex[code.size()] = result.size();
+            for (auto& ins : result) {
+                if (isJump(ins.GetOperation())) {
+                    ins.SetParam1(static_cast<std::int32_t>(newIndex[targetOf(ins)]));
+                }
+            }
+            code = std::move(result);
+            return count;
+        }
+    }
+
+    std::size_t RotateLoops(resultInfo& result, std::size_t maxSize) {
+        std::size_t count = 0;
+        for (auto& func : result.funcList) {
+            count += rotate(func.localCode, maxSize);
+        }
+        return count;
+    }
+}
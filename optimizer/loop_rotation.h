@@ -0,0 +1,19 @@
+#pragma once
+
+#include "analyser/analyser.h"
+#include "instruction/instruction.h"
+
+#include <cstddef>
+
+namespace cc0 {
+
+    // 循环旋转，在内联之后、删除死存储之前进行
+    // while 和 for 把条件放在循环开头，每次迭代都要执行条件跳转和回到开头的 jmp 两次跳转
+    // 把向回跳的 jmp 换成从目标处顺序执行到第一个条件跳转为止的指令的拷贝，再加上反转的条件跳转：
+    //     H: cond; jX END; body; jmp H; END:  =>  H: cond; jX END; B: body; cond; j!X B; END:
+    // for 的更新语句和 continue 跳向的代码也沿着 jmp 一并复制
+    // maxSize 是每处最多复制的指令条数（不包括 jmp），启动代码不做旋转
+    // 旋转不会让函数超过目标文件允许的指令条数
+    // 返回旋转的循环个数
+    std::size_t RotateLoops(resultInfo& result, std::size_t maxSize = 16);
+}
@@ -0,0 +1,477 @@
+#include "optimizer/peephole.h"
+
+#include <cstdint>
+#include <optional>
+
+namespace cc0 {
+
+    namespace {
+
+        bool isJump(Operation op) {
+            return JMP <= op && op <= JLE;
+        }
+
+        bool isConditionalJump(Operation op) {
+            return JE <= op && op <= JLE;
+        }
+
+        // 控制流不会落到下一条指令
+        bool isTerminator(Operation op) {
+            return op == JMP || op == RET || op == IRET || op == TABLESWITCH || op == TAILCALL;
+        }
+
+        std::size_t targetOf(const Instruction& ins) {
+            return static_cast<std::size_t>(ins.GetParam1());
+        }
+
+        // tableswitch 之后的表项个数，包括最后一个 default
+        std::size_t entryCountOf(const Instruction& ins) {
+            return static_cast<std::size_t>(ins.GetParam2()) + 1;
+        }
+
+        // 跳转表的表项，它们可以改变目标，但是不能删除或者换成别的指令
+        std::vector<bool> tableEntries(const std::vector<Instruction>& code) {
+            std::vector<bool> entry(code.size() + 1, false);
+            for (std::size_t i = 0; i < code.size(); ++i) {
+                if (code[i].GetOperation() == TABLESWITCH) {
+                    for (std::size_t j = i + 1; j <= i + entryCountOf(code[i]) && j < code.size(); ++j) {
+                        entry[j] = true;
+                    }
+                }
+            }
+            return entry;
+        }
+
+        // 常量入栈，返回入栈的值
+        std::optional<std::int32_t> constantOf(const Instruction& ins) {
+            if (ins.GetOperation() != IPUSH && ins.GetOperation() != BIPUSH) {
+                return {};
+            }
+            return ins.GetParam1();
+        }
+
+        // 只入栈一个单元且没有副作用
+        bool isPurePush(const Instruction& ins) {
+            auto op = ins.GetOperation();
+            return op == IPUSH || op == BIPUSH || op == LOADA || op == LOADC;
+        }
+
+        // 没有副作用、只入栈一个结果的运算，返回操作数个数
+        // idiv 可能除零，iload 的地址可能不合法，都不算在内
+        std::optional<std::int64_t> pureOperandsOf(const Instruction& ins) {
+            switch (ins.GetOperation()) {
+                case IADD: case ISUB: case IMUL: case ICMP:
+                    return 2;
+                case INEG: case I2C:
+                    return 1;
+                default:
+                    return {};
+            }
+        }
+
+        // 出栈的单元数
+        std::optional<std::int64_t> popCountOf(const Instruction& ins) {
+            if (ins.GetOperation() == POP) {
+                return 1;
+            }
+            if (ins.GetOperation() == POPN) {
+                return ins.GetParam1();
+            }
+            return {};
+        }
+
+        // 按照虚拟机的语义计算，int 运算按补码回绕
+        std::optional<std::int32_t> fold(Operation op, std::int32_t lhs, std::int32_t rhs) {
+            auto l = static_cast<std::uint32_t>(lhs), r = static_cast<std::uint32_t>(rhs);
+            switch (op) {
+                case IADD: return static_cast<std::int32_t>(l + r);
+                case ISUB: return static_cast<std::int32_t>(l - r);
+                case IMUL: return static_cast<std::int32_t>(l * r);
+                case IDIV:
+                    // 除零留给运行时报错
+                    if (rhs == 0 || (lhs == INT32_MIN && rhs == -1)) {
+                        return {};
+                    }
+                    return lhs / rhs;
+                case ICMP: return lhs > rhs ? 1 : lhs < rhs ? -1 : 0;
+                default: return {};
+            }
+        }
+
+        bool jumpTaken(Operation op, std::int32_t cond) {
+            switch (op) {
+                case JE: return cond == 0;
+                case JNE: return cond != 0;
+                case JL: return cond < 0;
+                case JGE: return cond >= 0;
+                case JG: return cond > 0;
+                case JLE: return cond <= 0;
+                default: return true;
+            }
+        }
+
+        // 条件相反的跳转
+        Operation invert(Operation op) {
+            switch (op) {
+                case JE: return JNE;
+                case JNE: return JE;
+                case JL: return JGE;
+                case JGE: return JL;
+                case JG: return JLE;
+                default: return JG;
+            }
+        }
+
+        // 删除 removed 标记的指令并重写跳转目标
+        // 跳向被删除指令的跳转改为跳向其后第一条保留的指令
+        std::size_t compact(std::vector<Instruction>& code, const std::vector<bool>& removed) {
+            std::vector<std::size_t> newIndex(code.size() + 1);
+            std::size_t next = 0;
+            for (std::size_t i = 0; i < code.size(); ++i) {
+                newIndex[i] = next;
+                if (!removed[i]) {
+                    ++next;
+                }
+            }
+            newIndex[code.size()] = next;
+            if (next == code.size()) {
+                return 0;
+            }
+            std::vector<Instruction> result;
+            result.reserve(next);
+            for (std::size_t i = 0; i < code.size(); ++i) {
+                if (removed[i]) {
+                    continue;
+                }
+                auto& ins = code[i];
+                if (isJump(ins.GetOperation())) {
+                    ins.SetParam1(static_cast<std::int32_t>(newIndex[targetOf(ins)]));
+                }
+                result.push_back(ins);
+            }
+            std::size_t count = code.size() - next;
+            code = std::move(result);
+            return count;
+        }
+
+        // 跳转链穿透：跳向 jmp 的跳转直接跳向最终目标，jmp 到 ret 直接换成 ret
+        // 同时删除跳向下一条指令的 jmp
+        bool threadJumps(std::vector<Instruction>& code, std::vector<bool>& removed) {
+            bool changed = false;
+            auto entry = tableEntries(code);
+            for (std::size_t i = 0; i < code.size(); ++i) {
+                auto op = code[i].GetOperation();
+                if (!isJump(op)) {
+                    continue;
+                }
+                auto target = targetOf(code[i]);
+                std::size_t hops = 0;
+                while (target < code.size() && code[target].GetOperation() == JMP && hops <= code.size()) {
+                    target = targetOf(code[target]);
+                    ++hops;
+                }
+                // 死循环，保持原样
+                if (hops > code.size()) {
+                    continue;
+                }
+                if (target != targetOf(code[i])) {
+                    code[i].SetParam1(static_cast<std::int32_t>(target));
+                    changed = true;
+                }
+                if (entry[i]) {
+                    continue;
+                }
+                if (op == JMP && target < code.size()
+                    && (code[target].GetOperation() == RET || code[target].GetOperation() == IRET)) {
+                    code[i] = code[target];
+                    changed = true;
+                }
+                else if (op == JMP && target == i + 1) {
+                    removed[i] = true;
+                    changed = true;
+                }
+            }
+            return changed;
+        }
+
+        // 越过一条 jmp 的条件跳转改为反转的条件直接跳向 jmp 的目标：jX L; jmp T; L: => j!X T
+        // do-while 的条件和 for 的条件后面都是这样的代码
+        bool invertBranches(std::vector<Instruction>& code, std::vector<bool>& removed) {
+            bool changed = false;
+            auto isTarget = tableEntries(code);
+            for (auto& ins : code) {
+                if (isJump(ins.GetOperation())) {
+                    isTarget[targetOf(ins)] = true;
+                }
+            }
+            for (std::size_t i = 0; i + 1 < code.size(); ++i) {
+                auto op = code[i].GetOperation();
+                if (!isConditionalJump(op) || removed[i] || removed[i + 1] || isTarget[i + 1]
+                    || code[i + 1].GetOperation() != JMP || targetOf(code[i]) != i + 2) {
+                    continue;
+                }
+                code[i] = Instruction(invert(op), code[i + 1].GetParam1());
+                removed[i + 1] = true;
+                changed = true;
+            }
+            return changed;
+        }
+
+        // 从入口出发标记可达的指令，其余删除
+        void markUnreachable(const std::vector<Instruction>& code, std::vector<bool>& removed) {
+            std::vector<bool> reached(code.size(), false);
+            std::vector<std::size_t> work;
+            if (!code.empty()) {
+                work.push_back(0);
+            }
+            while (!work.empty()) {
+                auto i = work.back();
+                work.pop_back();
+                if (i >= code.size() || reached[i] || removed[i]) {
+                    // 被删除的 jmp 等价于顺序执行
+                    if (i < code.size() && removed[i] && !reached[i]) {
+                        reached[i] = true;
+                        work.push_back(i + 1);
+                    }
+                    continue;
+                }
+                reached[i] = true;
+                auto op = code[i].GetOperation();
+                if (isJump(op)) {
+                    work.push_back(targetOf(code[i]));
+                }
+                if (op == TABLESWITCH) {
+                    for (std::size_t j = 1; j <= entryCountOf(code[i]); ++j) {
+                        work.push_back(i + j);
+                    }
+                }
+                if (!isTerminator(op)) {
+                    work.push_back(i + 1);
+                }
+            }
+            for (std::size_t i = 0; i < code.size(); ++i) {
+                if (!reached[i]) {
+                    removed[i] = true;
+                }
+            }
+        }
+
+        // 在已输出序列的末尾反复归约
+        // 窗口内除第一条指令以外都不能是跳转目标，这样从任何入口进入的栈效果都不变
+        class Folder {
+        public:
+            Folder(const std::vector<Instruction>& code)
+                : _code(code), _isTarget(tableEntries(code)), _labeled(code.size() + 1, false),
+                  _position(code.size() + 1) {
+                // 表项都视为跳转目标，不会与前后的指令一起归约
+                for (auto& ins : code) {
+                    if (isJump(ins.GetOperation())) {
+                        _isTarget[targetOf(ins)] = true;
+                    }
+                }
+            }
+
+            std::vector<Instruction> run() {
+                for (std::size_t i = 0; i < _code.size(); ++i) {
+                    _position[i] = _out.size();
+                    if (_isTarget[i]) {
+                        _labeled[_out.size()] = true;
+                    }
+                    _out.push_back(_code[i]);
+                    while (reduce()) {
+                    }
+                }
+                _position[_code.size()] = _out.size();
+                for (auto& ins : _out) {
+                    if (isJump(ins.GetOperation())) {
+                        ins.SetParam1(static_cast<std::int32_t>(_position[targetOf(ins)]));
+                    }
+                }
+                return std::move(_out);
+            }
+
+        private:
+            // 末尾 n 条指令可以作为一个窗口
+            bool window(std::size_t n) const {
+                if (_out.size() < n) {
+                    return false;
+                }
+                for (std::size_t i = _out.size() - n + 1; i < _out.size(); ++i) {
+                    if (_labeled[i]) {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            const Instruction& back(std::size_t n) const {
+                return _out[_out.size() - 1 - n];
+            }
+
+            void replace(std::size_t n, std::vector<Instruction> with) {
+                _out.resize(_out.size() - n);
+                for (auto& ins : with) {
+                    _out.push_back(ins);
+                }
+            }
+
+            bool reduce() {
+                if (!window(1)) {
+                    return false;
+                }
+                auto op = back(0).GetOperation();
+                // popn 0
+                if (auto n = popCountOf(back(0)); n.has_value() && n.value() == 0) {
+                    replace(1, {});
+                    return true;
+                }
+                if (!window(2)) {
+                    return false;
+                }
+                auto& prev = back(1);
+                auto prevOp = prev.GetOperation();
+                auto prevConst = constantOf(prev);
+                // 常量 op
+                if (prevConst.has_value()) {
+                    auto c = prevConst.value();
+                    if (op == INEG) {
+                        replace(2, {Instruction(IPUSH, static_cast<std::int32_t>(0u - static_cast<std::uint32_t>(c)))});
+                        return true;
+                    }
+                    if ((c == 0 && (op == IADD || op == ISUB)) || (c == 1 && (op == IMUL || op == IDIV))) {
+                        replace(2, {});
+                        return true;
+                    }
+                    if (isConditionalJump(op)) {
+                        if (jumpTaken(op, c)) {
+                            replace(2, {Instruction(JMP, back(0).GetParam1())});
+                        }
+                        else {
+                            replace(2, {});
+                        }
+                        return true;
+                    }
+                }
+                // 入栈后立即出栈
+                if (isPurePush(prev)) {
+                    if (auto n = popCountOf(back(0)); n.has_value() && n.value() >= 1) {
+                        auto rest = n.value() - 1;
+                        replace(2, {});
+                        if (rest > 0) {
+                            _out.emplace_back(POPN, static_cast<std::int32_t>(rest));
+                        }
+                        return true;
+                    }
+                }
+                // 结果被丢弃的运算改为直接丢弃它的操作数
+                if (auto n = popCountOf(back(0)), operands = pureOperandsOf(prev);
+                    n.has_value() && n.value() >= 1 && operands.has_value() && n.value() - 1 + operands.value() <= INT32_MAX) {
+                    replace(2, {Instruction(POPN, static_cast<std::int32_t>(n.value() - 1 + operands.value()))});
+                    return true;
+                }
+                // 合并连续的出栈
+                if (auto n = popCountOf(back(0)), m = popCountOf(prev);
+                    n.has_value() && m.has_value() && n.value() + m.value() <= INT32_MAX) {
+                    replace(2, {Instruction(POPN, static_cast<std::int32_t>(n.value() + m.value()))});
+                    return true;
+                }
+                if (op == INEG && prevOp == INEG) {
+                    replace(2, {});
+                    return true;
+                }
+                if (!window(3)) {
+                    return false;
+                }
+                auto& first = back(2);
+                auto firstConst = constantOf(first);
+                // loada 压入的地址总是合法的，读出的值被丢弃时可以不读
+                if (first.GetOperation() == LOADA && prevOp == ILOAD) {
+                    if (auto n = popCountOf(back(0)); n.has_value() && n.value() >= 1) {
+                        auto rest = n.value() - 1;
+                        replace(3, {});
+                        if (rest > 0) {
+                            _out.emplace_back(POPN, static_cast<std::int32_t>(rest));
+                        }
+                        return true;
+                    }
+                }
+                // 常量 常量 op
+                if (firstConst.has_value() && prevConst.has_value()) {
+                    if (auto v = fold(op, firstConst.value(), prevConst.value()); v.has_value()) {
+                        replace(3, {Instruction(IPUSH, v.value())});
+                        return true;
+                    }
+                }
+                // 与 0 比较的结果和原值符号相同：ipush 0; icmp; jX => jX
+                if (firstConst.has_value() && firstConst.value() == 0 && prevOp == ICMP && isConditionalJump(op)) {
+                    replace(3, {back(0)});
+                    return true;
+                }
+                return false;
+            }
+
+        private:
+            const std::vector<Instruction>& _code;
+            std::vector<bool> _isTarget;
+            // 已输出序列中的位置是否是跳转目标
+            std::vector<bool> _labeled;
+            // 原下标 => 输出位置
+            std::vector<std::size_t> _position;
+            std::vector<Instruction> _out;
+        };
+
+        bool wellFormed(const std::vector<Instruction>& code) {
+            for (std::size_t i = 0; i < code.size(); ++i) {
+                auto& ins = code[i];
+                if (isJump(ins.GetOperation())) {
+                    auto target = ins.GetParam1();
+                    if (target < 0 || static_cast<std::size_t>(target) > code.size()) {
+                        return false;
+                    }
+                }
+                // 表项必须都是 jmp
+                if (ins.GetOperation() == TABLESWITCH) {
+                    if (ins.GetParam2() < 0 || i + entryCountOf(ins) >= code.size()) {
+                        return false;
+                    }
+                    for (std::size_t j = 1; j <= entryCountOf(ins); ++j) {
+                        if (code[i + j].GetOperation() != JMP) {
+                            return false;
+                        }
+                    }
+                }
+            }
+            return true;
+        }
+    }
+
+    std::size_t PeepholeOptimize(std::vector<Instruction>& code) {
+        // 跳转目标不合法的代码不做优化
+        if (!wellFormed(code)) {
+            return 0;
+        }
+        std::size_t before = code.size();
+        bool changed = true;
+        while (changed) {
+            std::vector<bool> removed(code.size(), false);
+            changed = threadJumps(code, removed);
+            changed = invertBranches(code, removed) || changed;
+            markUnreachable(code, removed);
+            changed = compact(code, removed) > 0 || changed;
+            auto folded = Folder(code).run();
+            if (folded.size() != code.size() || !(folded == code)) {
+                code = std::move(folded);
+                changed = true;
+            }
+        }
+        return before - code.size();
+    }
+
+    std::size_t PeepholeOptimize(resultInfo& result) {
+        std::size_t removed = PeepholeOptimize(result.globalCode);
+        for (auto& func : result.funcList) {
+            removed += PeepholeOptimize(func.localCode);
+        }
+        return removed;
+    }
+}
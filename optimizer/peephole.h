@@ -0,0 +1,17 @@
+#pragma once
+
+#include "analyser/analyser.h"
+#include "instruction/instruction.h"
+
+#include <cstddef>
+#include <vector>
+
+namespace cc0 {
+
+    // 窥孔优化，在分析结果输出之前进行
+    // 包括：常量折叠、消除无用的入栈出栈和结果被丢弃的运算、跳转链穿透、反转越过 jmp 的条件跳转、删除不可达代码
+    // 所有跳转目标都会被重写到优化后的位置，tableswitch 的表项保持原样
+    // 返回删除的指令条数
+    std::size_t PeepholeOptimize(resultInfo& result);
+    std::size_t PeepholeOptimize(std::vector<Instruction>& code);
+}
@@ -0,0 +1,33 @@
+#include "optimizer/pipeline.h"
+#include "optimizer/peephole.h"
+#include "optimizer/loop_rotation.h"
+#include "optimizer/dead_store.h"
+
+namespace cc0 {
+
+    OptimizeStats Optimize(resultInfo& result, int level, const InlineOptions& inlining) {
+        OptimizeStats stats;
+        if (level <= 0) {
+            return stats;
+        }
+        stats.removed += PeepholeOptimize(result);
+        stats.inlined = InlineFunctions(result, inlining);
+        if (stats.inlined != 0) {
+            stats.removed += PeepholeOptimize(result);
+        }
+        stats.rotated = RotateLoops(result);
+        if (stats.rotated != 0) {
+            stats.removed += PeepholeOptimize(result);
+        }
+        auto dead = EliminateDeadStores(result);
+        stats.removed += dead.unreachable;
+        stats.deadStores = dead.stores;
+        if (dead.stores != 0) {
+            stats.removed += PeepholeOptimize(result);
+        }
+        if (level >= 2) {
+            stats.ssa = OptimizeSSA(result);
+        }
+        return stats;
+    }
+}
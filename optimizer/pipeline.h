@@ -0,0 +1,26 @@
+#pragma once
+
+#include "analyser/analyser.h"
+#include "optimizer/inliner.h"
+#include "optimizer/ssa_passes.h"
+
+#include <cstddef>
+
+namespace cc0 {
+
+    struct OptimizeStats {
+        // 窥孔优化和删除不可达代码去掉的指令
+        std::size_t removed = 0;
+        std::size_t inlined = 0;
+        std::size_t rotated = 0;
+        // 改为出栈的 istore
+        std::size_t deadStores = 0;
+        // level 为 2 时 SSA 优化的结果
+        SSAStats ssa;
+    };
+
+    // 对整个分析结果进行 -O（level 1）或 -O2（level 2）的优化，level 为 0 时不做任何事
+    // 先窥孔优化，然后内联小函数、旋转循环、删除死存储，每次有改动之后再窥孔优化一遍，-O2 最后在 SSA 形式上优化
+    // 流式分析逐个函数输出，只能做窥孔优化，不使用这里
+    OptimizeStats Optimize(resultInfo& result, int level, const InlineOptions& inlining = InlineOptions{});
+}
@@ -0,0 +1,595 @@
+#include "optimizer/ssa.h"
+#include "optimizer/cfg.h"
+#include "optimizer/liveness.h"
+
+#include <algorithm>
+#include <numeric>
+#include <tuple>
+#include <utility>
+
+namespace cc0::ssa {
+
+    ValueId Function::Add(Value value) {
+        values.push_back(std::move(value));
+        return static_cast<ValueId>(values.size() - 1);
+    }
+
+    ValueId Function::Constant(std::int32_t c) {
+        if (auto it = constants.find(c); it != constants.end()) {
+            return it->second;
+        }
+        auto id = Add(Value{Op::Const, c});
+        constants.emplace(c, id);
+        return id;
+    }
+
+    void Function::RemoveEdge(BlockId from, BlockId to) {
+        auto& preds = blocks[to].predecessors;
+        auto it = std::find(preds.begin(), preds.end(), from);
+        if (it == preds.end()) {
+            return;
+        }
+        auto index = it - preds.begin();
+        preds.erase(it);
+        for (auto phi : blocks[to].phis) {
+            auto& args = values[phi].args;
+            args.erase(args.begin() + index);
+        }
+    }
+
+    void Function::Replace(std::vector<ValueId> replacement) {
+        auto find = [&](ValueId v) {
+            while (replacement[v] != v) {
+                v = replacement[v];
+            }
+            return v;
+        };
+        for (auto& block : blocks) {
+            if (block.removed) {
+                continue;
+            }
+            auto rewrite = [&](std::vector<ValueId>& list) {
+                list.erase(std::remove_if(list.begin(), list.end(), [&](ValueId v) {
+                    if (replacement[v] == v) {
+                        return false;
+                    }
+                    values[v].removed = true;
+                    return true;
+                }), list.end());
+                for (auto v : list) {
+                    for (auto& arg : values[v].args) {
+                        arg = find(arg);
+                    }
+                }
+            };
+            rewrite(block.phis);
+            rewrite(block.code);
+            for (auto& arg : block.exit.args) {
+                arg = find(arg);
+            }
+        }
+    }
+
+    std::size_t Function::RemoveTrivialPhis() {
+        std::size_t removedPhis = 0;
+        for (bool changed = true; changed; ) {
+            changed = false;
+            std::vector<ValueId> replacement(values.size());
+            std::iota(replacement.begin(), replacement.end(), 0);
+            auto find = [&](ValueId v) {
+                while (replacement[v] != v) {
+                    v = replacement[v];
+                }
+                return v;
+            };
+            for (auto& block : blocks) {
+                if (block.removed) {
+                    continue;
+                }
+                for (auto phi : block.phis) {
+                    std::optional<ValueId> unique;
+                    bool trivial = true;
+                    for (auto arg : values[phi].args) {
+                        arg = find(arg);
+                        if (arg == phi || arg == unique) {
+                            continue;
+                        }
+                        if (unique.has_value()) {
+                            trivial = false;
+                            break;
+                        }
+                        unique = arg;
+                    }
+                    if (!trivial) {
+                        continue;
+                    }
+                    // 只引用自己的 phi 在没有入口的循环里，值没有意义
+                    if (!unique.has_value()) {
+                        unique = Add(Value{Op::Undef});
+                        replacement.push_back(unique.value());
+                    }
+                    replacement[phi] = unique.value();
+                    changed = true;
+                    ++removedPhis;
+                }
+            }
+            if (changed) {
+                Replace(std::move(replacement));
+            }
+        }
+        return removedPhis;
+    }
+
+    std::vector<std::uint32_t> Function::UseCounts() const {
+        std::vector<std::uint32_t> count(values.size(), 0);
+        for (auto& block : blocks) {
+            if (block.removed) {
+                continue;
+            }
+            for (auto list : {&block.phis, &block.code}) {
+                for (auto v : *list) {
+                    for (auto arg : values[v].args) {
+                        ++count[arg];
+                    }
+                }
+            }
+            for (auto arg : block.exit.args) {
+                ++count[arg];
+            }
+        }
+        return count;
+    }
+
+    std::vector<BlockId> Function::ReversePostorder() const {
+        std::vector<BlockId> order;
+        if (blocks.empty()) {
+            return order;
+        }
+        std::vector<bool> visited(blocks.size(), false);
+        std::vector<std::pair<BlockId, std::size_t>> stack{{0, 0}};
+        visited[0] = true;
+        while (!stack.empty()) {
+            auto& [b, next] = stack.back();
+            auto& targets = blocks[b].exit.targets;
+            if (next < targets.size()) {
+                auto s = targets[next++];
+                if (!visited[s] && !blocks[s].removed) {
+                    visited[s] = true;
+                    stack.emplace_back(s, 0);
+                }
+                continue;
+            }
+            order.push_back(b);
+            stack.pop_back();
+        }
+        std::reverse(order.begin(), order.end());
+        return order;
+    }
+
+    std::vector<BlockId> Function::Dominators() const {
+        // Cooper, Harvey, Kennedy: A Simple, Fast Dominance Algorithm
+        auto order = ReversePostorder();
+        std::vector<std::size_t> number(blocks.size(), 0);
+        for (std::size_t i = 0; i < order.size(); ++i) {
+            number[order[i]] = i;
+        }
+        std::vector<BlockId> idom(blocks.size(), NoBlock);
+        if (order.empty()) {
+            return idom;
+        }
+        idom[0] = 0;
+        auto intersect = [&](BlockId a, BlockId b) {
+            while (a != b) {
+                while (number[a] > number[b]) {
+                    a = idom[a];
+                }
+                while (number[b] > number[a]) {
+                    b = idom[b];
+                }
+            }
+            return a;
+        };
+        for (bool changed = true; changed; ) {
+            changed = false;
+            for (std::size_t i = 1; i < order.size(); ++i) {
+                auto b = order[i];
+                auto dominator = NoBlock;
+                for (auto p : blocks[b].predecessors) {
+                    if (idom[p] == NoBlock) {
+                        continue;
+                    }
+                    dominator = dominator == NoBlock ? p : intersect(p, dominator);
+                }
+                if (idom[b] != dominator) {
+                    idom[b] = dominator;
+                    changed = true;
+                }
+            }
+        }
+        idom[0] = NoBlock;
+        return idom;
+    }
+
+    std::size_t Function::Size() const {
+        std::size_t size = 0;
+        for (auto& block : blocks) {
+            if (!block.removed) {
+                size += block.code.size() + 1;
+            }
+        }
+        return size;
+    }
+
+    bool HasSideEffects(const Function& function, ValueId value) {
+        auto& v = function.values[value];
+        switch (v.op) {
+            case Op::Store: case Op::Call: case Op::Scan: case Op::Print: case Op::PrintLine:
+                return true;
+            case Op::Div: {
+                // 除数是 0 或者 -1 以外的常量时不会出错
+                auto& divisor = function.values[v.args[1]];
+                return divisor.op != Op::Const || divisor.imm == 0 || divisor.imm == -1;
+            }
+            default:
+                return false;
+        }
+    }
+
+    std::optional<std::int32_t> Fold(Op op, const std::vector<std::int32_t>& operands) {
+        auto l = static_cast<std::uint32_t>(operands[0]);
+        switch (op) {
+            case Op::Neg: return static_cast<std::int32_t>(0u - l);
+            case Op::Add: return static_cast<std::int32_t>(l + static_cast<std::uint32_t>(operands[1]));
+            case Op::Sub: return static_cast<std::int32_t>(l - static_cast<std::uint32_t>(operands[1]));
+            case Op::Mul: return static_cast<std::int32_t>(l * static_cast<std::uint32_t>(operands[1]));
+            case Op::Div:
+                if (operands[1] == 0 || (operands[0] == INT32_MIN && operands[1] == -1)) {
+                    return {};
+                }
+                return operands[0] / operands[1];
+            case Op::Cmp:
+                return operands[0] > operands[1] ? 1 : operands[0] < operands[1] ? -1 : 0;
+            default:
+                return {};
+        }
+    }
+
+    namespace {
+        // 构造时栈帧单元的内容：SSA 值，或者 loada 压入的地址
+        struct Cell {
+            enum Kind { Value, Frame, Global } kind;
+            std::int64_t index;
+            std::int32_t level = 0;
+
+            bool operator==(const Cell& other) const {
+                return kind == other.kind && index == other.index && level == other.level;
+            }
+        };
+    }
+
+    std::optional<Function> Build(const funcInfo& func, const std::vector<funcInfo>& funcs) {
+        auto& code = func.localCode;
+        auto cfg = ControlFlowGraph::Build(code);
+        if (code.empty() || !cfg.has_value()) {
+            return {};
+        }
+        auto liveness = Liveness::Analyse(func, cfg.value(), funcs);
+        if (!liveness.has_value()) {
+            return {};
+        }
+        auto& blocks = cfg->Blocks();
+        auto reachable = cfg->Reachable();
+        for (auto p : blocks[0].predecessors) {
+            if (reachable[p]) {
+                return {};
+            }
+        }
+
+        Function f;
+        f.paramNum = func.paramNum;
+        // 可达的块按照代码中的顺序编号，生成代码时保持这个顺序
+        std::vector<BlockId> blockOf(blocks.size(), NoBlock);
+        for (std::size_t b = 0; b < blocks.size(); ++b) {
+            if (reachable[b]) {
+                blockOf[b] = static_cast<BlockId>(f.blocks.size());
+                f.blocks.emplace_back();
+            }
+        }
+        // 跳到函数末尾的边都指向同一个落出末尾的块
+        // 它在翻译某个块时才会加入，预留位置使得正在翻译的块的引用保持有效
+        f.blocks.reserve(f.blocks.size() + 1);
+        auto fallOff = NoBlock;
+        auto target = [&](std::size_t index) {
+            if (index < code.size()) {
+                return blockOf[cfg->BlockOf(index)];
+            }
+            if (fallOff == NoBlock) {
+                fallOff = static_cast<BlockId>(f.blocks.size());
+                f.blocks.emplace_back();
+            }
+            return fallOff;
+        };
+
+        auto undef = Cell{Cell::Value, f.Add(Value{Op::Undef})};
+        std::vector<Cell> entry;
+        for (int k = 0; k < func.paramNum; ++k) {
+            entry.push_back(Cell{Cell::Value, f.Add(Value{Op::Param, k})});
+        }
+        std::vector<std::optional<std::vector<Cell>>> exitState(f.blocks.size());
+        // 待填参数的 phi 和它对应的单元
+        std::vector<std::pair<ValueId, std::size_t>> pendingPhis;
+        // 汇合处保存地址的单元，所有前驱必须相同
+        std::vector<std::tuple<BlockId, std::size_t, Cell>> pendingAddresses;
+
+        for (auto b : cfg->ReversePostorder()) {
+            auto ib = blockOf[b];
+            auto& block = f.blocks[ib];
+            std::vector<std::size_t> preds;
+            for (auto p : blocks[b].predecessors) {
+                if (reachable[p]) {
+                    preds.push_back(p);
+                }
+            }
+            // 入口和只有一个前驱的块直接继承之前的状态
+            const std::vector<Cell>* inherited = nullptr;
+            if (b == 0) {
+                inherited = &entry;
+            }
+            else if (preds.size() == 1 && exitState[blockOf[preds[0]]].has_value()) {
+                inherited = &exitState[blockOf[preds[0]]].value();
+            }
+            std::vector<Cell> state = inherited != nullptr ? *inherited : std::vector<Cell>{};
+            if (inherited == nullptr) {
+                auto& liveIn = liveness->LiveIn(b);
+                auto depth = liveness->Depths()[blocks[b].begin];
+                for (std::int64_t c = 0; c < depth; ++c) {
+                    if (!liveIn[c]) {
+                        state.push_back(undef);
+                        continue;
+                    }
+                    std::optional<Cell> address;
+                    for (auto p : preds) {
+                        auto& known = exitState[blockOf[p]];
+                        if (known.has_value() && known.value()[c].kind != Cell::Value) {
+                            address = known.value()[c];
+                        }
+                    }
+                    if (address.has_value()) {
+                        pendingAddresses.emplace_back(ib, c, address.value());
+                        state.push_back(address.value());
+                        continue;
+                    }
+                    auto phi = f.Add(Value{Op::Phi});
+                    f.values[phi].block = ib;
+                    block.phis.push_back(phi);
+                    pendingPhis.emplace_back(phi, c);
+                    state.push_back(Cell{Cell::Value, phi});
+                }
+            }
+
+            auto emit = [&](Value value) {
+                value.block = ib;
+                auto id = f.Add(std::move(value));
+                f.blocks[ib].code.push_back(id);
+                return id;
+            };
+            auto popValue = [&]() -> std::optional<ValueId> {
+                auto cell = state.back();
+                state.pop_back();
+                if (cell.kind != Cell::Value) {
+                    return {};
+                }
+                return static_cast<ValueId>(cell.index);
+            };
+            auto pushValue = [&](ValueId v) {
+                state.push_back(Cell{Cell::Value, v});
+            };
+            auto& exit = f.blocks[ib].exit;
+            bool terminated = false;
+            for (auto i = blocks[b].begin; i < blocks[b].end; ++i) {
+                auto& ins = code[i];
+                auto op = ins.GetOperation();
+                switch (op) {
+                    case NOP:
+                        break;
+                    case BIPUSH: case IPUSH:
+                        pushValue(f.Constant(ins.GetParam1()));
+                        break;
+                    case LOADC:
+                        pushValue(f.Add(Value{Op::String, ins.GetParam1()}));
+                        break;
+                    case LOADA:
+                        if (ins.GetParam1() == 0) {
+                            state.push_back(Cell{Cell::Frame, ins.GetParam2()});
+                        }
+                        else {
+                            state.push_back(Cell{Cell::Global, ins.GetParam2(), ins.GetParam1()});
+                        }
+                        break;
+                    case ILOAD: {
+                        auto address = state.back();
+                        state.pop_back();
+                        if (address.kind == Cell::Frame) {
+                            if (address.index >= static_cast<std::int64_t>(state.size()) || state[address.index].kind != Cell::Value) {
+                                return {};
+                            }
+                            state.push_back(state[address.index]);
+                        }
+                        else if (address.kind == Cell::Global) {
+                            pushValue(emit(Value{Op::Load, static_cast<std::int32_t>(address.index), address.level}));
+                        }
+                        else {
+                            return {};
+                        }
+                        break;
+                    }
+                    case ISTORE: {
+                        auto value = popValue();
+                        auto address = state.back();
+                        state.pop_back();
+                        if (!value.has_value()) {
+                            return {};
+                        }
+                        if (address.kind == Cell::Frame && address.index < static_cast<std::int64_t>(state.size())) {
+                            state[address.index] = Cell{Cell::Value, value.value()};
+                        }
+                        else if (address.kind == Cell::Global) {
+                            Value store{Op::Store, static_cast<std::int32_t>(address.index), address.level, {value.value()}};
+                            store.hasResult = false;
+                            emit(std::move(store));
+                        }
+                        else {
+                            return {};
+                        }
+                        break;
+                    }
+                    case IADD: case ISUB: case IMUL: case IDIV: case ICMP: {
+                        auto rhs = popValue();
+                        auto lhs = popValue();
+                        if (!lhs.has_value() || !rhs.has_value()) {
+                            return {};
+                        }
+                        auto kind = op == IADD ? Op::Add : op == ISUB ? Op::Sub : op == IMUL ? Op::Mul : op == IDIV ? Op::Div : Op::Cmp;
+                        pushValue(emit(Value{kind, 0, 0, {lhs.value(), rhs.value()}}));
+                        break;
+                    }
+                    case INEG: case I2C: {
+                        auto operand = popValue();
+                        if (!operand.has_value()) {
+                            return {};
+                        }
+                        pushValue(emit(Value{op == INEG ? Op::Neg : Op::I2C, 0, 0, {operand.value()}}));
+                        break;
+                    }
+                    case DUP:
+                        state.push_back(state.back());
+                        break;
+                    case DUP2: {
+                        auto n = state.size();
+                        state.push_back(state[n - 2]);
+                        state.push_back(state[n - 1]);
+                        break;
+                    }
+                    case POP: case POP2: case POPN:
+                        state.resize(state.size() - (op == POP ? 1 : op == POP2 ? 2 : ins.GetParam1()));
+                        break;
+                    case CALL: case TAILCALL: {
+                        auto& callee = funcs[ins.GetParam1()];
+                        std::vector<ValueId> args(callee.paramNum);
+                        for (auto k = callee.paramNum; k-- > 0; ) {
+                            auto arg = popValue();
+                            if (!arg.has_value()) {
+                                return {};
+                            }
+                            args[k] = arg.value();
+                        }
+                        if (op == TAILCALL) {
+                            exit = Terminator{Exit::TailCall, JMP, ins.GetParam1(), std::move(args)};
+                            terminated = true;
+                            break;
+                        }
+                        Value call{Op::Call, ins.GetParam1(), 0, std::move(args)};
+                        call.hasResult = ReturnSlotsOf(callee) != 0;
+                        auto id = emit(std::move(call));
+                        if (f.values[id].hasResult) {
+                            pushValue(id);
+                        }
+                        break;
+                    }
+                    case ISCAN: case CSCAN:
+                        pushValue(emit(Value{Op::Scan, op}));
+                        break;
+                    case IPRINT: case CPRINT: case SPRINT: {
+                        auto operand = popValue();
+                        if (!operand.has_value()) {
+                            return {};
+                        }
+                        Value print{Op::Print, op, 0, {operand.value()}};
+                        print.hasResult = false;
+                        emit(std::move(print));
+                        break;
+                    }
+                    case PRINTL: {
+                        Value print{Op::PrintLine};
+                        print.hasResult = false;
+                        emit(std::move(print));
+                        break;
+                    }
+                    case JMP:
+                        exit = Terminator{Exit::Jump, JMP, 0, {}, {target(ins.GetParam1())}};
+                        terminated = true;
+                        break;
+                    case JE: case JNE: case JL: case JGE: case JG: case JLE: {
+                        auto condition = popValue();
+                        if (!condition.has_value()) {
+                            return {};
+                        }
+                        exit = Terminator{Exit::Branch, op, 0, {condition.value()}, {target(ins.GetParam1()), target(i + 1)}};
+                        terminated = true;
+                        break;
+                    }
+                    case TABLESWITCH: {
+                        auto operand = popValue();
+                        if (!operand.has_value()) {
+                            return {};
+                        }
+                        exit = Terminator{Exit::Switch, JMP, ins.GetParam1(), {operand.value()}};
+                        for (std::size_t j = i + 1; j <= i + 1 + static_cast<std::size_t>(ins.GetParam2()); ++j) {
+                            auto entryBlock = target(j);
+                            f.blocks[entryBlock].tableEntry = true;
+                            exit.targets.push_back(entryBlock);
+                        }
+                        terminated = true;
+                        break;
+                    }
+                    case RET:
+                        exit = Terminator{Exit::Return};
+                        terminated = true;
+                        break;
+                    case IRET: {
+                        auto operand = popValue();
+                        if (!operand.has_value()) {
+                            return {};
+                        }
+                        exit = Terminator{Exit::Return, JMP, 0, {operand.value()}};
+                        terminated = true;
+                        break;
+                    }
+                    default:
+                        return {};
+                }
+            }
+            if (!terminated) {
+                auto next = blocks[b].end;
+                exit = next < code.size() ? Terminator{Exit::Jump, JMP, 0, {}, {target(next)}} : Terminator{Exit::FallOff};
+            }
+            exitState[ib] = std::move(state);
+        }
+
+        // 前驱按照块的编号和出口的次序排列，phi 的参数与之对应
+        for (BlockId b = 0; b < f.blocks.size(); ++b) {
+            for (auto s : f.blocks[b].exit.targets) {
+                f.blocks[s].predecessors.push_back(b);
+            }
+        }
+        for (auto& [phi, c] : pendingPhis) {
+            auto& value = f.values[phi];
+            for (auto p : f.blocks[value.block].predecessors) {
+                auto& cell = exitState[p].value()[c];
+                if (cell.kind != Cell::Value) {
+                    return {};
+                }
+                value.args.push_back(static_cast<ValueId>(cell.index));
+            }
+        }
+        for (auto& [b, c, address] : pendingAddresses) {
+            for (auto p : f.blocks[b].predecessors) {
+                if (!(exitState[p].value()[c] == address)) {
+                    return {};
+                }
+            }
+        }
+        f.RemoveTrivialPhis();
+        return f;
+    }
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include "analyser/analyser.h"
+#include "instruction/instruction.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace cc0::ssa {
+
+    using ValueId = std::uint32_t;
+    using BlockId = std::uint32_t;
+    constexpr BlockId NoBlock = std::numeric_limits<BlockId>::max();
+
+    enum class Op {
+        // imm 是常量的值
+        Const,
+        // loadc imm，只作为 sprint 的操作数
+        String,
+        // 第 imm 个参数，在栈帧的第 imm 个单元
+        Param,
+        // 读取之前没有写入过的单元
+        Undef,
+        // 参数与所在块的 predecessors 一一对应
+        Phi,
+        Add, Sub, Mul, Div, Neg, Cmp, I2C,
+        // 全局变量 loada level,imm 的读写，Store 的参数是写入的值
+        Load, Store,
+        // call imm，参数按入栈顺序排列；返回 void 时没有结果
+        Call,
+        // iscan 或 cscan，imm 是对应的 Operation
+        Scan,
+        // iprint、cprint 或 sprint，imm 是对应的 Operation
+        Print,
+        PrintLine,
+    };
+
+    struct Value {
+        Op op;
+        std::int32_t imm = 0;
+        std::int32_t level = 0;
+        std::vector<ValueId> args = {};
+        BlockId block = NoBlock;
+        bool hasResult = true;
+        // 被优化删除，不再出现在任何块中
+        bool removed = false;
+    };
+
+    enum class Exit {
+        Jump,
+        // 按 condition 把 args[0] 与 0 比较，成立时到 targets[0]，否则到 targets[1]
+        Branch,
+        // tableswitch low=imm：targets 是各个表项的块，最后一个是 default
+        Switch,
+        // args 为空时是 ret，否则是 iret
+        Return,
+        // tailcall imm
+        TailCall,
+        // 落出函数末尾，运行时报错
+        FallOff,
+    };
+
+    struct Terminator {
+        Exit kind = Exit::FallOff;
+        Operation condition = JMP;
+        std::int32_t imm = 0;
+        std::vector<ValueId> args = {};
+        std::vector<BlockId> targets = {};
+    };
+
+    struct Block {
+        std::vector<ValueId> phis;
+        std::vector<ValueId> code;
+        Terminator exit;
+        // 同一个前驱可能出现多次，例如两个目标相同的条件跳转
+        std::vector<BlockId> predecessors;
+        // tableswitch 的表项，只能是一条 jmp，紧跟在 tableswitch 之后
+        bool tableEntry = false;
+        bool removed = false;
+    };
+
+    // 一个函数的 SSA 形式，第 0 块是入口，没有前驱
+    struct Function {
+        std::vector<Value> values;
+        std::vector<Block> blocks;
+        int paramNum = 0;
+        // 常量值到 Const 的映射，同一个常量只有一个值
+        std::unordered_map<std::int32_t, ValueId> constants;
+
+        ValueId Add(Value value);
+        ValueId Constant(std::int32_t c);
+        // 删除 from 到 to 的一条边，同时删除 to 中 phi 对应的参数
+        void RemoveEdge(BlockId from, BlockId to);
+        // replacement[v] 不是 v 时，对 v 的使用都改为 replacement[v]，v 从所在的块中删除
+        void Replace(std::vector<ValueId> replacement);
+        // 删除只有一种取值（除了自己）的 phi，返回删除的个数
+        std::size_t RemoveTrivialPhis();
+        // 每个值被使用的次数，包括 phi 和块出口
+        std::vector<std::uint32_t> UseCounts() const;
+        // 未删除的块的逆后序
+        std::vector<BlockId> ReversePostorder() const;
+        // 直接支配者，入口和不可达的块为 NoBlock
+        std::vector<BlockId> Dominators() const;
+        // 存活的指令条数，不包括 phi
+        std::size_t Size() const;
+    };
+
+    // 删除之后可以观察到区别的运算：写全局变量、调用、输入输出，以及可能除零的除法
+    bool HasSideEffects(const Function& function, ValueId value);
+    // 按照虚拟机的语义计算 Add、Sub、Mul、Div、Neg、Cmp，会在运行时报错时返回空
+    std::optional<std::int32_t> Fold(Op op, const std::vector<std::int32_t>& operands);
+
+    // 从栈式代码构造 SSA：栈帧中的每个单元（局部变量和表达式的临时值）都是一个变量
+    // 栈深度不确定、栈帧的地址被当作值使用、入口是跳转目标时返回空
+    std::optional<Function> Build(const funcInfo& func, const std::vector<funcInfo>& funcs);
+
+    // 生成栈式代码：只使用一次的值在使用处直接计算，其余的值按照活跃区间着色分配栈帧中的单元
+    // phi 在前驱的末尾并行复制，复制都在栈上进行
+    // 生成的代码不合法时返回空
+    std::optional<std::vector<Instruction>> Lower(const Function& function, const std::vector<funcInfo>& funcs);
+}
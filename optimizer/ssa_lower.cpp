@@ -0,0 +1,474 @@
+#include "optimizer/ssa.h"
+#include "optimizer/cfg.h"
+
+#include <algorithm>
+
+namespace cc0::ssa {
+
+    namespace {
+
+        // 移动运算时需要保持次序的副作用
+        enum class Effect { None, Read, Write, Other };
+
+        Effect effectOf(const Function& function, ValueId v) {
+            switch (function.values[v].op) {
+                case Op::Load: return Effect::Read;
+                case Op::Store: return Effect::Write;
+                default: return HasSideEffects(function, v) ? Effect::Other : Effect::None;
+            }
+        }
+
+        // 两个运算交换次序之后结果不变
+        bool commute(const Function& function, ValueId a, ValueId b) {
+            auto ea = effectOf(function, a), eb = effectOf(function, b);
+            if (ea == Effect::None || eb == Effect::None) {
+                return true;
+            }
+            if (ea == Effect::Other || eb == Effect::Other) {
+                return false;
+            }
+            if (ea == Effect::Read && eb == Effect::Read) {
+                return true;
+            }
+            // 读写或者写写不同的全局变量
+            auto& x = function.values[a];
+            auto& y = function.values[b];
+            return x.imm != y.imm || x.level != y.level;
+        }
+
+        class Lowering final {
+        public:
+            Lowering(const Function& function, const std::vector<funcInfo>& funcs)
+                : _f(function), _funcs(funcs), _uses(function.UseCounts()),
+                  _inlined(function.values.size(), false), _color(function.values.size(), -1),
+                  _order(function.blocks.size()) {}
+
+            std::optional<std::vector<Instruction>> Run() {
+                for (BlockId b = 0; b < _f.blocks.size(); ++b) {
+                    if (!_f.blocks[b].removed) {
+                        stackify(b);
+                    }
+                }
+                allocate();
+                return emit();
+            }
+
+        private:
+            // 需要保存在栈帧单元中的值
+            bool needsSlot(ValueId v) const {
+                auto& value = _f.values[v];
+                return value.hasResult && !_inlined[v] && _uses[v] != 0
+                    && value.op != Op::Const && value.op != Op::String && value.op != Op::Undef;
+            }
+
+            // 在块 b 中把只使用一次的值移动到使用者之前，生成代码时在使用处计算
+            // 自底向上处理，被移动的值的操作数接着尝试移动到它之前，这样一棵表达式树在列表中总是连续的
+            void stackify(BlockId b) {
+                auto& order = _order[b];
+                order = _f.blocks[b].code;
+                auto i = tree(b, order, _f.blocks[b].exit.args, order.size());
+                while (i-- > 0) {
+                    i = tree(b, order, _f.values[order[i]].args, i);
+                }
+            }
+
+            // 把 args 中的值移动到 insert 之前，返回这棵树在 order 中的开始位置
+            std::size_t tree(BlockId b, std::vector<ValueId>& order, const std::vector<ValueId>& args, std::size_t insert) {
+                for (auto k = args.size(); k-- > 0; ) {
+                    auto v = args[k];
+                    auto& value = _f.values[v];
+                    if (value.block != b || _uses[v] != 1 || !value.hasResult || value.op == Op::Phi || _inlined[v]) {
+                        continue;
+                    }
+                    auto end = order.begin() + static_cast<std::ptrdiff_t>(insert);
+                    auto at = std::find(order.begin(), end, v);
+                    if (at == end) {
+                        continue;
+                    }
+                    // 中间的运算必须都可以与它交换次序
+                    if (!std::all_of(at + 1, end, [&](ValueId w) { return commute(_f, v, w); })) {
+                        continue;
+                    }
+                    std::rotate(at, at + 1, end);
+                    _inlined[v] = true;
+                    insert = tree(b, order, value.args, insert - 1);
+                }
+                return insert;
+            }
+
+            // 表达式树中读取栈帧单元的值
+            void leaves(const std::vector<ValueId>& args, std::vector<ValueId>& out) const {
+                for (auto a : args) {
+                    if (_inlined[a]) {
+                        leaves(_f.values[a].args, out);
+                    }
+                    else if (needsSlot(a)) {
+                        out.push_back(a);
+                    }
+                }
+            }
+
+            // from 到 to 的边上 phi 的参数
+            std::size_t edgeIndex(BlockId from, BlockId to) const {
+                auto& preds = _f.blocks[to].predecessors;
+                return static_cast<std::size_t>(std::find(preds.begin(), preds.end(), from) - preds.begin());
+            }
+
+            // 活跃区间相交的值不能使用同一个单元；SSA 的冲突图是弦图，按支配次序贪心着色
+            void allocate() {
+                auto order = _f.ReversePostorder();
+                auto n = _f.values.size();
+                std::vector<std::vector<bool>> liveIn(_f.blocks.size(), std::vector<bool>(n, false));
+                std::vector<std::vector<ValueId>> adjacent(n);
+                // 从块的出口倒推到入口，record 时记录每个定义与此时活跃的值冲突
+                auto scan = [&](BlockId b, bool record) {
+                    auto& block = _f.blocks[b];
+                    std::vector<bool> live(n, false);
+                    for (auto s : block.exit.targets) {
+                        for (ValueId v = 0; v < n; ++v) {
+                            live[v] = live[v] || liveIn[s][v];
+                        }
+                        auto index = edgeIndex(b, s);
+                        for (auto phi : _f.blocks[s].phis) {
+                            auto arg = _f.values[phi].args[index];
+                            if (needsSlot(phi) && needsSlot(arg)) {
+                                live[arg] = true;
+                            }
+                        }
+                    }
+                    auto use = [&](const std::vector<ValueId>& args) {
+                        std::vector<ValueId> used;
+                        leaves(args, used);
+                        for (auto u : used) {
+                            live[u] = true;
+                        }
+                    };
+                    auto define = [&](const std::vector<ValueId>& defined) {
+                        for (auto d : defined) {
+                            for (ValueId x = 0; record && x < n; ++x) {
+                                if (live[x] && x != d) {
+                                    adjacent[d].push_back(x);
+                                    adjacent[x].push_back(d);
+                                }
+                            }
+                        }
+                        for (auto d : defined) {
+                            live[d] = false;
+                        }
+                    };
+                    use(block.exit.args);
+                    auto& values = _order[b];
+                    for (auto r = values.size(); r-- > 0; ) {
+                        auto v = values[r];
+                        if (_inlined[v]) {
+                            continue;
+                        }
+                        if (needsSlot(v)) {
+                            define({v});
+                        }
+                        use(_f.values[v].args);
+                    }
+                    // phi 在块的入口同时定义，参数在函数的入口同时定义，它们互相冲突
+                    std::vector<ValueId> defined;
+                    for (auto phi : block.phis) {
+                        if (needsSlot(phi)) {
+                            defined.push_back(phi);
+                        }
+                    }
+                    if (b == 0) {
+                        for (ValueId v = 0; v < n; ++v) {
+                            if (_f.values[v].op == Op::Param && needsSlot(v)) {
+                                defined.push_back(v);
+                            }
+                        }
+                    }
+                    for (auto d : defined) {
+                        live[d] = true;
+                    }
+                    define(defined);
+                    return live;
+                };
+                for (bool changed = true; changed; ) {
+                    changed = false;
+                    for (auto it = order.rbegin(); it != order.rend(); ++it) {
+                        auto live = scan(*it, false);
+                        if (live != liveIn[*it]) {
+                            liveIn[*it] = std::move(live);
+                            changed = true;
+                        }
+                    }
+                }
+                for (auto b : order) {
+                    scan(b, true);
+                }
+
+                // phi 和它的参数尽量使用同一个单元，省去复制
+                std::vector<std::vector<ValueId>> related(n);
+                for (auto b : order) {
+                    for (auto phi : _f.blocks[b].phis) {
+                        for (auto arg : _f.values[phi].args) {
+                            related[phi].push_back(arg);
+                            related[arg].push_back(phi);
+                        }
+                    }
+                }
+                auto assign = [&](ValueId v) {
+                    if (!needsSlot(v) || _color[v] >= 0) {
+                        return;
+                    }
+                    std::vector<bool> taken;
+                    for (auto x : adjacent[v]) {
+                        if (_color[x] >= 0) {
+                            if (static_cast<std::size_t>(_color[x]) >= taken.size()) {
+                                taken.resize(_color[x] + 1, false);
+                            }
+                            taken[_color[x]] = true;
+                        }
+                    }
+                    auto free = [&](std::int64_t c) {
+                        return static_cast<std::size_t>(c) >= taken.size() || !taken[c];
+                    };
+                    for (auto r : related[v]) {
+                        if (_color[r] >= 0 && free(_color[r])) {
+                            _color[v] = _color[r];
+                            return;
+                        }
+                    }
+                    std::int64_t c = 0;
+                    while (!free(c)) {
+                        ++c;
+                    }
+                    _color[v] = c;
+                };
+                // 参数已经在栈帧的前几个单元
+                for (ValueId v = 0; v < n; ++v) {
+                    if (_f.values[v].op == Op::Param) {
+                        _color[v] = _f.values[v].imm;
+                    }
+                }
+                for (auto b : order) {
+                    for (auto phi : _f.blocks[b].phis) {
+                        assign(phi);
+                    }
+                    for (auto v : _order[b]) {
+                        assign(v);
+                    }
+                }
+                _frame = _f.paramNum;
+                for (ValueId v = 0; v < n; ++v) {
+                    if (needsSlot(v)) {
+                        _frame = std::max(_frame, _color[v] + 1);
+                    }
+                }
+            }
+
+            void operand(ValueId v) {
+                auto& value = _f.values[v];
+                switch (value.op) {
+                    case Op::Const: _out.emplace_back(IPUSH, value.imm); return;
+                    case Op::String: _out.emplace_back(LOADC, value.imm); return;
+                    case Op::Undef: _out.emplace_back(IPUSH, 0); return;
+                    default: break;
+                }
+                if (_inlined[v]) {
+                    compute(v);
+                    return;
+                }
+                _out.emplace_back(LOADA, 0, static_cast<std::int32_t>(_color[v]));
+                _out.emplace_back(ILOAD);
+            }
+
+            void compute(ValueId v) {
+                auto& value = _f.values[v];
+                if (value.op == Op::Load || value.op == Op::Store) {
+                    _out.emplace_back(LOADA, value.level, value.imm);
+                }
+                for (auto a : value.args) {
+                    operand(a);
+                }
+                switch (value.op) {
+                    case Op::Add: _out.emplace_back(IADD); break;
+                    case Op::Sub: _out.emplace_back(ISUB); break;
+                    case Op::Mul: _out.emplace_back(IMUL); break;
+                    case Op::Div: _out.emplace_back(IDIV); break;
+                    case Op::Neg: _out.emplace_back(INEG); break;
+                    case Op::Cmp: _out.emplace_back(ICMP); break;
+                    case Op::I2C: _out.emplace_back(I2C); break;
+                    case Op::Load: _out.emplace_back(ILOAD); break;
+                    case Op::Store: _out.emplace_back(ISTORE); break;
+                    case Op::Call: _out.emplace_back(CALL, value.imm); break;
+                    case Op::Scan: case Op::Print: _out.emplace_back(static_cast<Operation>(value.imm)); break;
+                    case Op::PrintLine: _out.emplace_back(PRINTL); break;
+                    default: break;
+                }
+            }
+
+            // 代码中的值：需要保存的存入它的单元，否则只为副作用计算
+            void root(ValueId v) {
+                if (needsSlot(v)) {
+                    _out.emplace_back(LOADA, 0, static_cast<std::int32_t>(_color[v]));
+                    compute(v);
+                    _out.emplace_back(ISTORE);
+                }
+                else if (HasSideEffects(_f, v)) {
+                    compute(v);
+                    if (_f.values[v].hasResult) {
+                        _out.emplace_back(POP);
+                    }
+                }
+            }
+
+            // from 到 to 的边上需要复制的 phi 和参数，已经在同一个单元中的不需要复制
+            std::vector<std::pair<ValueId, ValueId>> copyList(BlockId from, BlockId to) const {
+                std::vector<std::pair<ValueId, ValueId>> list;
+                auto index = edgeIndex(from, to);
+                for (auto phi : _f.blocks[to].phis) {
+                    auto arg = _f.values[phi].args[index];
+                    if (!needsSlot(phi) || _f.values[arg].op == Op::Undef || (needsSlot(arg) && _color[arg] == _color[phi])) {
+                        continue;
+                    }
+                    list.emplace_back(phi, arg);
+                }
+                return list;
+            }
+
+            // 并行复制：先压入所有的地址和值，再依次 istore
+            void copies(BlockId from, BlockId to) {
+                auto list = copyList(from, to);
+                for (auto& [phi, arg] : list) {
+                    _out.emplace_back(LOADA, 0, static_cast<std::int32_t>(_color[phi]));
+                    operand(arg);
+                }
+                for (std::size_t k = 0; k < list.size(); ++k) {
+                    _out.emplace_back(ISTORE);
+                }
+            }
+
+            // 跳到块 to，目标在所有代码生成之后回填
+            void jump(Operation op, std::size_t target) {
+                _fixups.emplace_back(_out.size(), target);
+                _out.emplace_back(op, 0);
+            }
+
+            std::optional<std::vector<Instruction>> emit() {
+                std::vector<BlockId> layout;
+                for (BlockId b = 0; b < _f.blocks.size(); ++b) {
+                    if (!_f.blocks[b].removed) {
+                        layout.push_back(b);
+                    }
+                }
+                // 目标 [0, blocks) 是块，之后是拆分的边，End 是函数末尾
+                std::vector<std::pair<BlockId, BlockId>> splits;
+                std::vector<std::size_t> start(_f.blocks.size(), 0);
+                std::vector<bool> inTable(_f.blocks.size(), false);
+                const std::size_t end = static_cast<std::size_t>(-1);
+                auto edge = [&](BlockId from, BlockId to) -> std::size_t {
+                    if (copyList(from, to).empty()) {
+                        return to;
+                    }
+                    splits.emplace_back(from, to);
+                    return _f.blocks.size() + splits.size() - 1;
+                };
+
+                for (auto k = _frame - _f.paramNum; k > 0; --k) {
+                    _out.emplace_back(IPUSH, 0);
+                }
+                for (std::size_t position = 0; position < layout.size(); ++position) {
+                    auto b = layout[position];
+                    auto& block = _f.blocks[b];
+                    start[b] = _out.size();
+                    for (auto v : _order[b]) {
+                        if (!_inlined[v]) {
+                            root(v);
+                        }
+                    }
+                    auto& exit = block.exit;
+                    switch (exit.kind) {
+                        case Exit::Jump:
+                            if (inTable[b]) {
+                                jump(JMP, edge(b, exit.targets[0]));
+                                break;
+                            }
+                            copies(b, exit.targets[0]);
+                            jump(JMP, exit.targets[0]);
+                            break;
+                        case Exit::Branch:
+                            operand(exit.args[0]);
+                            jump(exit.condition, edge(b, exit.targets[0]));
+                            copies(b, exit.targets[1]);
+                            jump(JMP, exit.targets[1]);
+                            break;
+                        case Exit::Switch: {
+                            // 表项必须按顺序紧跟在后面，并且只有一条 jmp
+                            auto count = exit.targets.size();
+                            for (std::size_t k = 0; k < count; ++k) {
+                                auto& entry = _f.blocks[exit.targets[k]];
+                                if (position + 1 + k >= layout.size() || layout[position + 1 + k] != exit.targets[k]
+                                    || entry.exit.kind != Exit::Jump || !entry.phis.empty() || !_order[exit.targets[k]].empty()) {
+                                    return {};
+                                }
+                                inTable[exit.targets[k]] = true;
+                            }
+                            operand(exit.args[0]);
+                            _out.emplace_back(TABLESWITCH, exit.imm, static_cast<std::int32_t>(count - 1));
+                            break;
+                        }
+                        case Exit::Return:
+                            if (exit.args.empty()) {
+                                _out.emplace_back(RET);
+                            }
+                            else {
+                                operand(exit.args[0]);
+                                _out.emplace_back(IRET);
+                            }
+                            break;
+                        case Exit::TailCall:
+                            for (auto a : exit.args) {
+                                operand(a);
+                            }
+                            _out.emplace_back(TAILCALL, exit.imm);
+                            break;
+                        case Exit::FallOff:
+                            jump(JMP, end);
+                            break;
+                    }
+                }
+                std::vector<std::size_t> splitStart;
+                for (auto& [from, to] : splits) {
+                    splitStart.push_back(_out.size());
+                    copies(from, to);
+                    jump(JMP, to);
+                }
+                for (auto& [at, target] : _fixups) {
+                    std::size_t index = target == end ? _out.size()
+                        : target < _f.blocks.size() ? start[target] : splitStart[target - _f.blocks.size()];
+                    _out[at].SetParam1(static_cast<std::int32_t>(index));
+                }
+
+                // 生成的代码必须有确定的栈深度
+                funcInfo check{"", "", _f.paramNum, 0, false, _out};
+                if (!StackDepths(check, _funcs).has_value()) {
+                    return {};
+                }
+                return std::move(_out);
+            }
+
+            const Function& _f;
+            const std::vector<funcInfo>& _funcs;
+            std::vector<std::uint32_t> _uses;
+            // 在使用处计算的值
+            std::vector<bool> _inlined;
+            // 分配的栈帧单元
+            std::vector<std::int64_t> _color;
+            // 每个块中值的计算次序
+            std::vector<std::vector<ValueId>> _order;
+            std::int64_t _frame = 0;
+            std::vector<Instruction> _out;
+            std::vector<std::pair<std::size_t, std::size_t>> _fixups;
+        };
+    }
+
+    std::optional<std::vector<Instruction>> Lower(const Function& function, const std::vector<funcInfo>& funcs) {
+        return Lowering(function, funcs).Run();
+    }
+}
@@ -0,0 +1,668 @@
+#include "optimizer/ssa_passes.h"
+#include "optimizer/cfg.h"
+#include "optimizer/peephole.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <numeric>
+#include <set>
+#include <tuple>
+#include <utility>
+
+namespace cc0::ssa {
+
+    namespace {
+
+        struct Lattice {
+            enum Kind { Top, Constant, Bottom } kind = Top;
+            std::int32_t value = 0;
+
+            bool operator==(const Lattice& other) const {
+                return kind == other.kind && (kind != Constant || value == other.value);
+            }
+        };
+
+        Lattice meet(const Lattice& a, const Lattice& b) {
+            if (a.kind == Lattice::Top) {
+                return b;
+            }
+            if (b.kind == Lattice::Top) {
+                return a;
+            }
+            if (a.kind == Lattice::Bottom || b.kind == Lattice::Bottom || a.value != b.value) {
+                return Lattice{Lattice::Bottom};
+            }
+            return a;
+        }
+
+        bool isArithmetic(Op op) {
+            return op == Op::Add || op == Op::Sub || op == Op::Mul || op == Op::Div || op == Op::Neg || op == Op::Cmp;
+        }
+
+        // 与虚拟机的 je、jne 等指令相同，条件成立时跳转
+        bool jumpTaken(Operation condition, std::int32_t value) {
+            switch (condition) {
+                case JE: return value == 0;
+                case JNE: return value != 0;
+                case JL: return value < 0;
+                case JGE: return value >= 0;
+                case JG: return value > 0;
+                case JLE: return value <= 0;
+                default: return true;
+            }
+        }
+
+        // 与虚拟机的 tableswitch 相同，超出范围时到最后一个表项
+        std::size_t switchTarget(const Terminator& exit, std::int32_t value) {
+            auto count = static_cast<std::uint32_t>(exit.targets.size() - 1);
+            auto index = static_cast<std::uint32_t>(value) - static_cast<std::uint32_t>(exit.imm);
+            return std::min(index, count);
+        }
+
+        std::vector<ValueId> identity(std::size_t size) {
+            std::vector<ValueId> replacement(size);
+            std::iota(replacement.begin(), replacement.end(), 0);
+            return replacement;
+        }
+    }
+
+    bool PropagateConstants(Function& f) {
+        std::vector<Lattice> state(f.values.size());
+        std::vector<bool> executable(f.blocks.size(), false);
+        std::set<std::pair<BlockId, BlockId>> edges;
+        executable[0] = true;
+
+        // 不在块中的值：常量、参数、字符串和未定义的值
+        auto get = [&](ValueId v) {
+            auto& value = f.values[v];
+            switch (value.op) {
+                case Op::Const: return Lattice{Lattice::Constant, value.imm};
+                case Op::Param: case Op::String: case Op::Undef: return Lattice{Lattice::Bottom};
+                default: return state[v];
+            }
+        };
+        auto evaluate = [&](BlockId b, ValueId v) {
+            auto& value = f.values[v];
+            if (value.op == Op::Phi) {
+                Lattice result;
+                auto& preds = f.blocks[b].predecessors;
+                for (std::size_t k = 0; k < preds.size(); ++k) {
+                    if (edges.count({preds[k], b}) != 0) {
+                        result = meet(result, get(value.args[k]));
+                    }
+                }
+                return result;
+            }
+            if (!isArithmetic(value.op)) {
+                return Lattice{Lattice::Bottom};
+            }
+            std::vector<std::int32_t> operands;
+            bool top = false, bottom = false;
+            for (auto arg : value.args) {
+                auto l = get(arg);
+                // 乘以 0 的结果与另一个操作数无关
+                if (value.op == Op::Mul && l.kind == Lattice::Constant && l.value == 0) {
+                    return Lattice{Lattice::Constant, 0};
+                }
+                top = top || l.kind == Lattice::Top;
+                bottom = bottom || l.kind == Lattice::Bottom;
+                operands.push_back(l.value);
+            }
+            if (bottom) {
+                return Lattice{Lattice::Bottom};
+            }
+            if (top) {
+                return Lattice{};
+            }
+            auto folded = Fold(value.op, operands);
+            return folded.has_value() ? Lattice{Lattice::Constant, folded.value()} : Lattice{Lattice::Bottom};
+        };
+
+        // 格的高度有限，每个值最多下降两次，按逆后序反复计算直到不再变化
+        auto order = f.ReversePostorder();
+        for (bool changed = true; changed; ) {
+            changed = false;
+            auto markEdge = [&](BlockId from, BlockId to) {
+                if (edges.emplace(from, to).second) {
+                    executable[to] = true;
+                    changed = true;
+                }
+            };
+            for (auto b : order) {
+                if (!executable[b]) {
+                    continue;
+                }
+                auto& block = f.blocks[b];
+                for (auto list : {&block.phis, &block.code}) {
+                    for (auto v : *list) {
+                        auto l = evaluate(b, v);
+                        if (!(l == state[v])) {
+                            state[v] = l;
+                            changed = true;
+                        }
+                    }
+                }
+                auto& exit = block.exit;
+                if (exit.kind == Exit::Jump) {
+                    markEdge(b, exit.targets[0]);
+                }
+                else if (exit.kind == Exit::Branch || exit.kind == Exit::Switch) {
+                    auto condition = get(exit.args[0]);
+                    if (condition.kind == Lattice::Bottom) {
+                        for (auto t : exit.targets) {
+                            markEdge(b, t);
+                        }
+                    }
+                    else if (condition.kind == Lattice::Constant) {
+                        auto chosen = exit.kind == Exit::Branch
+                            ? exit.targets[jumpTaken(exit.condition, condition.value) ? 0 : 1]
+                            : exit.targets[switchTarget(exit, condition.value)];
+                        markEdge(b, chosen);
+                    }
+                }
+            }
+        }
+
+        bool modified = false;
+        for (auto b : order) {
+            auto& exit = f.blocks[b].exit;
+            if (!executable[b] || (exit.kind != Exit::Branch && exit.kind != Exit::Switch)) {
+                continue;
+            }
+            auto condition = get(exit.args[0]);
+            if (condition.kind == Lattice::Top) {
+                // 可以执行的块的条件总会有值，否则分析有误，不做修改
+                return false;
+            }
+        }
+
+        // 删除不会执行的块，以及从它们出发的边
+        for (BlockId b = 0; b < f.blocks.size(); ++b) {
+            auto& block = f.blocks[b];
+            if (block.removed || executable[b]) {
+                continue;
+            }
+            for (auto t : block.exit.targets) {
+                if (executable[t]) {
+                    f.RemoveEdge(b, t);
+                }
+            }
+            for (auto list : {&block.phis, &block.code}) {
+                for (auto v : *list) {
+                    f.values[v].removed = true;
+                }
+            }
+            block = Block{};
+            block.removed = true;
+            modified = true;
+        }
+        // 条件已知的分支和 tableswitch 改为 jmp
+        for (auto b : order) {
+            if (!executable[b]) {
+                continue;
+            }
+            auto exit = f.blocks[b].exit;
+            if ((exit.kind != Exit::Branch && exit.kind != Exit::Switch) || get(exit.args[0]).kind != Lattice::Constant) {
+                continue;
+            }
+            auto value = get(exit.args[0]).value;
+            auto chosen = exit.kind == Exit::Branch ? (jumpTaken(exit.condition, value) ? 0 : 1) : switchTarget(exit, value);
+            for (std::size_t k = 0; k < exit.targets.size(); ++k) {
+                if (k != chosen && executable[exit.targets[k]]) {
+                    f.RemoveEdge(b, exit.targets[k]);
+                }
+            }
+            f.blocks[b].exit = Terminator{Exit::Jump, JMP, 0, {}, {exit.targets[chosen]}};
+            modified = true;
+        }
+
+        // 结果是常量的值改为使用常量
+        std::vector<std::pair<ValueId, std::int32_t>> folded;
+        for (auto b : order) {
+            if (!executable[b]) {
+                continue;
+            }
+            for (auto list : {&f.blocks[b].phis, &f.blocks[b].code}) {
+                for (auto v : *list) {
+                    if (f.values[v].hasResult && state[v].kind == Lattice::Constant) {
+                        folded.emplace_back(v, state[v].value);
+                    }
+                }
+            }
+        }
+        if (!folded.empty()) {
+            std::vector<ValueId> constants;
+            for (auto& [v, c] : folded) {
+                constants.push_back(f.Constant(c));
+            }
+            auto replacement = identity(f.values.size());
+            for (std::size_t k = 0; k < folded.size(); ++k) {
+                replacement[folded[k].first] = constants[k];
+            }
+            f.Replace(std::move(replacement));
+            modified = true;
+        }
+        if (modified) {
+            f.RemoveTrivialPhis();
+        }
+        return modified;
+    }
+
+    bool NumberValues(Function& f) {
+        auto idom = f.Dominators();
+        auto order = f.ReversePostorder();
+        std::vector<std::vector<BlockId>> children(f.blocks.size());
+        for (auto b : order) {
+            if (idom[b] != NoBlock) {
+                children[idom[b]].push_back(b);
+            }
+        }
+
+        auto replacement = identity(f.values.size());
+        auto find = [&](ValueId v) {
+            while (replacement[v] != v) {
+                v = replacement[v];
+            }
+            return v;
+        };
+        // 新建的常量也要有对应的项
+        auto constant = [&](std::int32_t c) {
+            auto id = f.Constant(c);
+            while (replacement.size() < f.values.size()) {
+                replacement.push_back(static_cast<ValueId>(replacement.size()));
+            }
+            return id;
+        };
+        auto isConstant = [&](ValueId v, std::int32_t c) {
+            return f.values[v].op == Op::Const && f.values[v].imm == c;
+        };
+
+        // 常量折叠和代数化简，返回与之相等的已有的值
+        auto simplify = [&](Op op, const std::vector<ValueId>& args) -> std::optional<ValueId> {
+            if (isArithmetic(op) && std::all_of(args.begin(), args.end(), [&](ValueId a) { return f.values[a].op == Op::Const; })) {
+                std::vector<std::int32_t> operands;
+                for (auto a : args) {
+                    operands.push_back(f.values[a].imm);
+                }
+                if (auto folded = Fold(op, operands); folded.has_value()) {
+                    return constant(folded.value());
+                }
+                return {};
+            }
+            switch (op) {
+                case Op::Add:
+                    if (isConstant(args[1], 0)) return args[0];
+                    if (isConstant(args[0], 0)) return args[1];
+                    break;
+                case Op::Sub:
+                    if (isConstant(args[1], 0)) return args[0];
+                    if (args[0] == args[1]) return constant(0);
+                    break;
+                case Op::Mul:
+                    if (isConstant(args[1], 1)) return args[0];
+                    if (isConstant(args[0], 1)) return args[1];
+                    if (isConstant(args[0], 0) || isConstant(args[1], 0)) return constant(0);
+                    break;
+                case Op::Div:
+                    if (isConstant(args[1], 1)) return args[0];
+                    break;
+                case Op::Neg:
+                    if (f.values[args[0]].op == Op::Neg) return find(f.values[args[0]].args[0]);
+                    break;
+                case Op::Cmp:
+                    if (args[0] == args[1]) return constant(0);
+                    break;
+                default:
+                    break;
+            }
+            return {};
+        };
+
+        // 运算、立即数、全局变量的层次、所在的块（只对 phi 有意义）和参数
+        using Key = std::tuple<Op, std::int32_t, std::int32_t, BlockId, std::vector<ValueId>>;
+        std::map<Key, ValueId> table;
+        std::vector<Key> inserted;
+        bool changed = false;
+
+        auto number = [&](BlockId b) {
+            // 块内已知的全局变量的值
+            std::map<std::pair<std::int32_t, std::int32_t>, ValueId> memory;
+            for (auto list : {&f.blocks[b].phis, &f.blocks[b].code}) {
+                for (auto v : *list) {
+                    // 新建常量会使 f.values 重新分配，先复制需要的内容
+                    auto op = f.values[v].op;
+                    auto imm = f.values[v].imm;
+                    auto level = f.values[v].level;
+                    auto args = f.values[v].args;
+                    for (auto& arg : args) {
+                        arg = find(arg);
+                    }
+                    auto replace = [&](ValueId with) {
+                        replacement[v] = with;
+                        changed = true;
+                    };
+                    if (op == Op::Load) {
+                        if (auto it = memory.find({imm, level}); it != memory.end()) {
+                            replace(it->second);
+                        }
+                        else {
+                            memory.emplace(std::make_pair(imm, level), v);
+                        }
+                        continue;
+                    }
+                    if (op == Op::Store) {
+                        memory[{imm, level}] = args[0];
+                        continue;
+                    }
+                    if (op == Op::Call) {
+                        memory.clear();
+                        continue;
+                    }
+                    if (!isArithmetic(op) && op != Op::I2C && op != Op::Phi) {
+                        continue;
+                    }
+                    if (op != Op::Phi) {
+                        if (auto same = simplify(op, args); same.has_value()) {
+                            replace(same.value());
+                            continue;
+                        }
+                    }
+                    if (op == Op::Add || op == Op::Mul) {
+                        std::sort(args.begin(), args.end());
+                    }
+                    // 被支配的相同除法不会在支配者之后再出错，可以直接使用支配者的结果
+                    Key key{op, imm, level, op == Op::Phi ? b : NoBlock, std::move(args)};
+                    if (auto it = table.find(key); it != table.end()) {
+                        replace(it->second);
+                    }
+                    else {
+                        table.emplace(key, v);
+                        inserted.push_back(std::move(key));
+                    }
+                }
+            }
+        };
+
+        // 支配树的先序遍历，离开子树时撤销其中加入的项
+        std::vector<std::tuple<BlockId, std::size_t, std::size_t>> stack;
+        if (!order.empty()) {
+            number(0);
+            stack.emplace_back(0, 0, 0);
+        }
+        while (!stack.empty()) {
+            auto& [b, next, mark] = stack.back();
+            if (next < children[b].size()) {
+                auto child = children[b][next++];
+                auto before = inserted.size();
+                number(child);
+                stack.emplace_back(child, 0, before);
+                continue;
+            }
+            while (inserted.size() > mark) {
+                table.erase(inserted.back());
+                inserted.pop_back();
+            }
+            stack.pop_back();
+        }
+
+        if (changed) {
+            f.Replace(std::move(replacement));
+            f.RemoveTrivialPhis();
+        }
+        return changed;
+    }
+
+    bool EliminateDeadCode(Function& f) {
+        std::vector<bool> live(f.values.size(), false);
+        std::vector<ValueId> work;
+        auto mark = [&](ValueId v) {
+            if (!live[v]) {
+                live[v] = true;
+                work.push_back(v);
+            }
+        };
+        for (auto& block : f.blocks) {
+            if (block.removed) {
+                continue;
+            }
+            for (auto v : block.code) {
+                if (!f.values[v].hasResult || HasSideEffects(f, v)) {
+                    mark(v);
+                }
+            }
+            for (auto arg : block.exit.args) {
+                mark(arg);
+            }
+        }
+        while (!work.empty()) {
+            auto v = work.back();
+            work.pop_back();
+            for (auto arg : f.values[v].args) {
+                mark(arg);
+            }
+        }
+
+        bool changed = false;
+        for (auto& block : f.blocks) {
+            if (block.removed) {
+                continue;
+            }
+            for (auto list : {&block.phis, &block.code}) {
+                list->erase(std::remove_if(list->begin(), list->end(), [&](ValueId v) {
+                    if (live[v]) {
+                        return false;
+                    }
+                    f.values[v].removed = true;
+                    changed = true;
+                    return true;
+                }), list->end());
+            }
+        }
+        return changed;
+    }
+
+    bool HoistInvariants(Function& f) {
+        auto idom = f.Dominators();
+        auto order = f.ReversePostorder();
+        auto dominates = [&](BlockId a, BlockId b) {
+            for (; b != NoBlock; b = idom[b]) {
+                if (b == a) {
+                    return true;
+                }
+            }
+            return false;
+        };
+
+        // 自然循环：回边的目标支配回边的起点，循环体是不经过循环头能到达回边起点的块
+        struct Loop {
+            BlockId header;
+            std::vector<bool> body;
+            std::size_t size = 0;
+        };
+        std::map<BlockId, std::vector<BlockId>> latches;
+        for (auto b : order) {
+            for (auto t : f.blocks[b].exit.targets) {
+                if (dominates(t, b)) {
+                    latches[t].push_back(b);
+                }
+            }
+        }
+        std::vector<Loop> loops;
+        for (auto& [header, sources] : latches) {
+            Loop loop{header, std::vector<bool>(f.blocks.size(), false), 1};
+            loop.body[header] = true;
+            auto work = sources;
+            while (!work.empty()) {
+                auto b = work.back();
+                work.pop_back();
+                if (loop.body[b]) {
+                    continue;
+                }
+                loop.body[b] = true;
+                ++loop.size;
+                for (auto p : f.blocks[b].predecessors) {
+                    work.push_back(p);
+                }
+            }
+            loops.push_back(std::move(loop));
+        }
+        // 内层循环先处理，移出的运算接着可能是外层循环的不变量
+        std::stable_sort(loops.begin(), loops.end(), [](const Loop& a, const Loop& b) { return a.size < b.size; });
+
+        bool changed = false;
+        for (auto& loop : loops) {
+            auto preheader = NoBlock;
+            bool unique = true;
+            for (auto p : f.blocks[loop.header].predecessors) {
+                if (!loop.body[p]) {
+                    unique = unique && (preheader == NoBlock || preheader == p);
+                    preheader = p;
+                }
+            }
+            // 表项只能是一条 jmp
+            if (!unique || preheader == NoBlock || f.blocks[preheader].tableEntry) {
+                continue;
+            }
+
+            bool calls = false;
+            std::set<std::pair<std::int32_t, std::int32_t>> stored;
+            for (auto b : order) {
+                if (!loop.body[b]) {
+                    continue;
+                }
+                for (auto v : f.blocks[b].code) {
+                    auto& value = f.values[v];
+                    calls = calls || value.op == Op::Call;
+                    if (value.op == Op::Store) {
+                        stored.emplace(value.imm, value.level);
+                    }
+                }
+            }
+
+            // 按逆后序找出不变量，操作数总在使用者之前
+            std::vector<bool> invariant(f.values.size(), false);
+            std::vector<ValueId> candidates;
+            for (auto b : order) {
+                if (!loop.body[b]) {
+                    continue;
+                }
+                for (auto v : f.blocks[b].code) {
+                    auto& value = f.values[v];
+                    bool movable = false;
+                    switch (value.op) {
+                        case Op::Add: case Op::Sub: case Op::Mul: case Op::Neg: case Op::Cmp: case Op::I2C:
+                            movable = true;
+                            break;
+                        // 可能出错的除法移出循环会提前报错
+                        case Op::Div:
+                            movable = !HasSideEffects(f, v);
+                            break;
+                        case Op::Load:
+                            movable = !calls && stored.count({value.imm, value.level}) == 0;
+                            break;
+                        default:
+                            break;
+                    }
+                    auto outside = [&](ValueId a) {
+                        auto block = f.values[a].block;
+                        return block == NoBlock || !loop.body[block] || invariant[a];
+                    };
+                    if (movable && std::all_of(value.args.begin(), value.args.end(), outside)) {
+                        invariant[v] = true;
+                        candidates.push_back(v);
+                    }
+                }
+            }
+            std::vector<bool> hoist(f.values.size(), false);
+            for (auto it = candidates.rbegin(); it != candidates.rend(); ++it) {
+                auto& value = f.values[*it];
+                if (value.op != Op::Load) {
+                    hoist[*it] = true;
+                }
+                if (hoist[*it]) {
+                    for (auto arg : value.args) {
+                        hoist[arg] = hoist[arg] || invariant[arg];
+                    }
+                }
+            }
+
+            // 放在外部前驱的出口之前，它支配循环头，也就支配原来的所有使用
+            bool moved = false;
+            for (auto b : order) {
+                if (!loop.body[b]) {
+                    continue;
+                }
+                auto& code = f.blocks[b].code;
+                code.erase(std::remove_if(code.begin(), code.end(), [&](ValueId v) { return hoist[v]; }), code.end());
+            }
+            for (auto v : candidates) {
+                if (hoist[v]) {
+                    f.blocks[preheader].code.push_back(v);
+                    f.values[v].block = preheader;
+                    moved = true;
+                }
+            }
+            changed = changed || moved;
+        }
+        return changed;
+    }
+}
+
+namespace cc0 {
+
+    namespace {
+        // 每一轮之后可能产生新的机会，例如折叠的条件删除了块，phi 变成常量
+        constexpr int maxRounds = 4;
+
+        // 按执行次数估计的代码长度：每层循环中的指令算作 8 条
+        // 外提循环不变量会让代码变长，但是循环中执行的指令变少
+        std::optional<std::uint64_t> weightedSize(const std::vector<Instruction>& code) {
+            auto cfg = ControlFlowGraph::Build(code);
+            if (!cfg.has_value()) {
+                return {};
+            }
+            auto depth = cfg->LoopDepths();
+            std::uint64_t size = 0;
+            for (std::size_t i = 0; i < code.size(); ++i) {
+                size += std::uint64_t(1) << (3 * std::min<std::size_t>(depth[cfg->BlockOf(i)], 6));
+            }
+            return size;
+        }
+    }
+
+    SSAStats OptimizeSSA(resultInfo& result) {
+        SSAStats stats;
+        for (auto& func : result.funcList) {
+            auto f = ssa::Build(func, result.funcList);
+            if (!f.has_value()) {
+                continue;
+            }
+            for (int round = 0; round < maxRounds; ++round) {
+                bool changed = ssa::PropagateConstants(f.value());
+                changed = ssa::NumberValues(f.value()) || changed;
+                changed = ssa::EliminateDeadCode(f.value()) || changed;
+                changed = ssa::HoistInvariants(f.value()) || changed;
+                if (!changed) {
+                    break;
+                }
+            }
+            auto code = ssa::Lower(f.value(), result.funcList);
+            if (!code.has_value()) {
+                continue;
+            }
+            PeepholeOptimize(code.value());
+            auto before = weightedSize(func.localCode), after = weightedSize(code.value());
+            // 加权更短的代码也可能更长，目标文件中一个函数最多 UINT16_MAX 条指令
+            if (!before.has_value() || !after.has_value() || after.value() > before.value()
+                || code->size() > UINT16_MAX) {
+                continue;
+            }
+            ++stats.functions;
+            stats.before += func.localCode.size();
+            stats.after += code->size();
+            func.localCode = std::move(code.value());
+        }
+        return stats;
+    }
+}
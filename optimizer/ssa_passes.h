@@ -0,0 +1,40 @@
+#pragma once
+
+#include "analyser/analyser.h"
+#include "optimizer/ssa.h"
+
+#include <cstddef>
+
+namespace cc0 {
+
+    namespace ssa {
+
+        // 稀疏条件常量传播：只沿可能执行的边传播常量，条件已知的跳转改为 jmp，删除不会执行的块
+        // 返回是否有修改
+        bool PropagateConstants(Function& function);
+
+        // 沿支配树的全局值编号：被支配的相同运算改用支配者的结果，同时做常量折叠和代数化简
+        // 全局变量的读取只在块内编号，写入之后的读取直接使用写入的值，调用之后全部失效
+        bool NumberValues(Function& function);
+
+        // 删除结果没有被使用、也没有副作用的值
+        bool EliminateDeadCode(Function& function);
+
+        // 循环不变量外提：操作数都在循环之外的运算移到循环唯一的外部前驱的末尾
+        // 全局变量的读取只在循环中没有写入它、也没有调用时才是不变量；单独的读取和读栈帧单元一样快，
+        // 只在被其它移出的运算使用时才一起移出
+        bool HoistInvariants(Function& function);
+    }
+
+    struct SSAStats {
+        // 使用了 SSA 优化结果的函数
+        std::size_t functions = 0;
+        // 这些函数优化前后的指令条数
+        std::size_t before = 0;
+        std::size_t after = 0;
+    };
+
+    // -O2：把每个函数转换为 SSA，反复进行常量传播、值编号、死代码消除和循环不变量外提，再生成栈式代码
+    // 生成的代码经过窥孔优化之后按循环层数加权的长度比原来的更长，或者函数无法转换时保留原来的代码
+    SSAStats OptimizeSSA(resultInfo& result);
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+#include "catch2/catch.hpp"
+
+#include "tokenizer/tokenizer.h"
+#include "analyser/analyser.h"
+#include "optimizer/pipeline.h"
+#include "assembler/assembler.h"
+#include "vm.h"
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace cc0::test {
+
+	// 程序运行一次的标准输出和标准错误（运行时错误和栈回溯）
+	struct Run {
+		std::string out;
+		std::string err;
+	};
+
+	// 参与比较的引擎，第一个作为基准
+	inline const std::vector<std::pair<const char*, vm::VM::Engine>>& Engines() {
+		static const std::vector<std::pair<const char*, vm::VM::Engine>> engines = {
+			{"switch", vm::VM::Engine::Switch},
+			{"threaded", vm::VM::Engine::Threaded},
+			{"register", vm::VM::Engine::Register},
+			{"jit", vm::VM::Engine::Jit},
+		};
+		return engines;
+	}
+
+	// 按优化级别（0、1 即 -O、2 即 -O2）编译，源代码必须没有错误
+	inline resultInfo Compile(const std::string& source, int level, const InlineOptions& inlining = InlineOptions{}) {
+		std::istringstream input(source);
+		Tokenizer tkz(input);
+		auto tokens = tkz.AllCompactTokens();
+		REQUIRE_FALSE(tokens.second.has_value());
+		Analyser analyser(std::move(tokens.first));
+		auto result = analyser.Analyse();
+		REQUIRE_FALSE(result.second.has_value());
+		Optimize(result.first, level, inlining);
+		return std::move(result.first);
+	}
+
+	// 在 engine 上运行，input 作为标准输入
+	inline Run Execute(File file, vm::VM::Engine engine, vm::VM::Limits limits = vm::VM::Limits{}, const std::string& input = "") {
+		std::istringstream in(input);
+		std::ostringstream out, err;
+		auto* savedIn = std::cin.rdbuf(in.rdbuf());
+		auto* savedOut = std::cout.rdbuf(out.rdbuf());
+		auto* savedErr = std::cerr.rdbuf(err.rdbuf());
+		// 运行时错误由 start 自己报告，其它异常（如文件无效）也要先恢复标准流
+		try {
+			auto avm = vm::VM::make_vm(std::move(file), engine, limits);
+			avm->start();
+		}
+		catch (...) {
+			std::cin.rdbuf(savedIn);
+			std::cout.rdbuf(savedOut);
+			std::cerr.rdbuf(savedErr);
+			throw;
+		}
+		std::cin.rdbuf(savedIn);
+		std::cout.rdbuf(savedOut);
+		std::cerr.rdbuf(savedErr);
+		std::cin.clear();
+		return Run{out.str(), err.str()};
+	}
+
+	// 在所有引擎上运行同一个目标文件，输出和错误信息都必须相同，返回基准引擎的结果
+	inline Run ExecuteAll(const File& file, vm::VM::Limits limits = vm::VM::Limits{}, const std::string& input = "") {
+		auto& engines = Engines();
+		auto expected = Execute(file, engines.front().second, limits, input);
+		for (std::size_t i = 1; i < engines.size(); ++i) {
+			INFO("engine " << engines[i].first);
+			auto run = Execute(file, engines[i].second, limits, input);
+			CHECK(run.out == expected.out);
+			CHECK(run.err == expected.err);
+		}
+		return expected;
+	}
+
+	// 在每个优化级别、每个引擎上运行
+	// 同一级别的各个引擎结果完全相同；栈回溯中的指令随级别不同，因此不同级别只比较输出和是否出错
+	// 返回不优化时的结果
+	inline Run RunAll(const std::string& source, vm::VM::Limits limits = vm::VM::Limits{}, const std::string& input = "") {
+		Run expected;
+		for (int level = 0; level <= 2; ++level) {
+			INFO("level " << level);
+			auto run = ExecuteAll(Assemble(Compile(source, level)), limits, input);
+			if (level == 0) {
+				expected = run;
+				continue;
+			}
+			CHECK(run.out == expected.out);
+			CHECK(run.err.empty() == expected.err.empty());
+		}
+		return expected;
+	}
+
+	// 测试用的临时文件，目标文件只能经由文件读写
+	inline std::string TempPath(const std::string& name) {
+		return (std::filesystem::temp_directory_path() / ("cc0_test_" + name)).string();
+	}
+
+	// -c 写出的目标文件的内容
+	inline std::string Binary(File file) {
+		auto path = TempPath("binary.o0");
+		{
+			std::ofstream out(path, std::ios::binary | std::ios::trunc);
+			file.output_binary(out);
+		}
+		std::ifstream in(path, std::ios::binary);
+		return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+	}
+
+	// -r 读入目标文件或者文本汇编
+	inline File ParseBinary(const std::string& bytes) {
+		auto path = TempPath("parse.o0");
+		std::ofstream(path, std::ios::binary | std::ios::trunc) << bytes;
+		std::ifstream in(path, std::ios::binary);
+		return File::parse_file_binary(in);
+	}
+
+	inline File ParseText(const std::string& text) {
+		auto path = TempPath("parse.s0");
+		std::ofstream(path, std::ios::trunc) << text;
+		std::ifstream in(path);
+		return File::parse_file_text(in);
+	}
+
+	// -s 写出的文本汇编
+	inline std::string Text(const resultInfo& result) {
+		std::ostringstream out;
+		WriteText(result, out);
+		return out.str();
+	}
+
+	// 运行时错误的第一行
+	inline std::string ErrorLine(const Run& run) {
+		return run.err.substr(0, run.err.find('\n'));
+	}
+}
@@ -1,9 +1,277 @@
 #include "catch2/catch.hpp"
+#include "tests/run_c0.hpp"
 
 #include "instruction/instruction.h"
 #include "tokenizer/tokenizer.h"
 #include "analyser/analyser.h"
+#include "analyser/function_cache.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <utility>
 
 /*
 	不要忘记写测试用例喔。
-*/
\ No newline at end of file
+*/
+
+using namespace cc0;
+
+namespace {
+	// 按 -s、-c 的方式分析：jobs 个线程分析函数体，cache 不为空时使用缓存
+	resultInfo AnalyseWith(const std::string& source, unsigned jobs, FunctionCache* cache = nullptr, int level = 0) {
+		std::istringstream input(source);
+		Tokenizer tkz(input);
+		auto tokens = tkz.AllCompactTokens();
+		REQUIRE_FALSE(tokens.second.has_value());
+		Analyser analyser(std::move(tokens.first));
+		analyser.SetJobs(jobs);
+		analyser.SetCache(cache);
+		auto result = analyser.Analyse();
+		REQUIRE_FALSE(result.second.has_value());
+		Optimize(result.first, level);
+		return std::move(result.first);
+	}
+
+	// 分析的结果或者错误（词法错误优先）；语法错误的信息输出到标准输出，这里丢弃
+	using Analysed = std::pair<resultInfo, std::optional<CompilationError>>;
+
+	Analysed AnalyseAll(const std::string& source) {
+		std::ostringstream discarded;
+		auto* saved = std::cout.rdbuf(discarded.rdbuf());
+		std::istringstream input(source);
+		Tokenizer tkz(input);
+		auto tokens = tkz.AllCompactTokens();
+		Analysed rtv;
+		if (tokens.second.has_value()) {
+			rtv.second = tokens.second;
+		}
+		else {
+			Analyser analyser(std::move(tokens.first));
+			rtv = analyser.Analyse();
+		}
+		std::cout.rdbuf(saved);
+		return rtv;
+	}
+
+	// --stream：边读 token 边分析
+	Analysed AnalyseStream(const std::string& source) {
+		std::ostringstream discarded;
+		auto* saved = std::cout.rdbuf(discarded.rdbuf());
+		std::istringstream input(source);
+		Tokenizer tkz(input);
+		Analyser analyser(tkz);
+		auto rtv = analyser.Analyse();
+		if (analyser.TokenizationError().has_value()) {
+			REQUIRE(rtv.second == analyser.TokenizationError());
+		}
+		std::cout.rdbuf(saved);
+		return rtv;
+	}
+
+	// 足够大的程序才会多线程分析：函数之间互相调用，引用全局变量和字符串常量
+	std::string ManyFunctions(int count) {
+		std::string source = "int total;\nconst int base = 7;\nint scale = 3;\n";
+		for (int i = 0; i < count; ++i) {
+			auto name = "f" + std::to_string(i);
+			source += "int " + name + "(int x) {\n";
+			source += "    int y = x * " + std::to_string(i + 1) + " + base;\n";
+			source += "    while (y > 100) { y = y - 100 + scale; }\n";
+			source += "    switch (y - y / 4 * 4) {\n"
+			          "        case 0: y = y + 1;\n"
+			          "        case 1: { y = y + 2; break; }\n"
+			          "        case 2: y = y * 2;\n"
+			          "        case 3: y = y - 5;\n"
+			          "    }\n";
+			source += "    total = total + y;\n";
+			if (i > 0) {
+				source += "    return f" + std::to_string(i - 1) + "(y) + y;\n";
+			}
+			else {
+				source += "    print(\"" + name + "\", y, 'c');\n    return y;\n";
+			}
+			source += "}\n";
+		}
+		source += "int main() {\n    print(f" + std::to_string(count - 1) + "(5), total);\n    return 0;\n}\n";
+		return source;
+	}
+}
+
+TEST_CASE("Analysing functions in parallel gives the same target file.") {
+	auto source = ManyFunctions(80);
+	for (int level = 0; level <= 2; ++level) {
+		INFO("level " << level);
+		auto serial = AnalyseWith(source, 1, nullptr, level);
+		auto expected = test::Binary(Assemble(serial));
+		for (unsigned jobs : {2u, 3u, 8u}) {
+			INFO("jobs " << jobs);
+			REQUIRE(test::Binary(Assemble(AnalyseWith(source, jobs, nullptr, level))) == expected);
+		}
+	}
+	auto run = test::ExecuteAll(Assemble(AnalyseWith(source, 4)));
+	REQUIRE(run.err.empty());
+	REQUIRE(run.out.find("f0 ") == 0);
+}
+
+TEST_CASE("Function cache reanalyses only what changed.") {
+	auto directory = test::TempPath("cache");
+	std::filesystem::remove_all(directory);
+	// 带缓存编译一次，结果必须与不带缓存的相同；返回命中和未命中的次数
+	auto build = [&](const std::string& source) {
+		FunctionCache cache(directory);
+		auto cached = test::Binary(Assemble(AnalyseWith(source, 1, &cache)));
+		REQUIRE(cached == test::Binary(Assemble(AnalyseWith(source, 1))));
+		return std::make_pair(cache.Hits(), cache.Misses());
+	};
+	using Count = std::pair<std::size_t, std::size_t>;
+	auto source = [](const std::string& globals, const std::string& note, const std::string& other) {
+		return globals +
+			note +
+			"int sq(int x) { return x * x; }\n"
+			"int twice(int x) { note(x); return sq(x) + sq(x); }\n"
+			"int other(int x) { return " + other + "; }\n"
+			"int useG() { return g; }\n"
+			"int main() { print(twice(3), other(4), useG()); return 0; }\n";
+	};
+	const std::string globals = "int g = 1;\n";
+	const std::string note = "void note(int x) { print(x); }\n";
+
+	// 第一次全部未命中，之后全部命中
+	REQUIRE(build(source(globals, note, "x + 1")) == Count{0, 6});
+	REQUIRE(build(source(globals, note, "x + 1")) == Count{6, 0});
+	REQUIRE(test::ExecuteAll(Assemble(AnalyseWith(source(globals, note, "x + 1"), 1))).out == "3\n18 5 1\n");
+
+	// 只改动 other 的函数体
+	REQUIRE(build(source(globals, note, "x + 2")) == Count{5, 1});
+
+	// note 有了返回值，调用它的 twice 要多弹出一个值，尽管 twice 的 token 没有变化
+	const std::string noteInt = "int note(int x) { print(x); return 0; }\n";
+	REQUIRE(build(source(globals, noteInt, "x + 2")) == Count{4, 2});
+
+	// g 的偏移改变，引用它的 useG 失效
+	const std::string shifted = "int h = 5;\nint g = 1;\n";
+	REQUIRE(build(source(shifted, noteInt, "x + 2")) == Count{5, 1});
+	auto run = test::ExecuteAll(Assemble(AnalyseWith(source(shifted, noteInt, "x + 2"), 1)));
+	REQUIRE(run.out == "3\n18 6 1\n");
+
+	std::filesystem::remove_all(directory);
+}
+
+TEST_CASE("Streaming analysis gives the same code.") {
+	const std::string mixed =
+		"const int limit = 0x10;\n"
+		"int total, scale = 3;\n"
+		"void show(int x) { print(\"x =\", x, 'x'); }\n"
+		"int kind(int x) {\n"
+		"    switch (x) { case 1: return 10; case 2: return 20; case 3: return 30; case 4: return 40; default: return 0; }\n"
+		"}\n"
+		"int main() {\n"
+		"    int i = 0;\n"
+		"    /* 跨过很多个 token 的注释 */\n"
+		"    do { total = total + kind(i) * scale; i = i + 1; } while (i < limit); // 行尾注释\n"
+		"    show(total);\n"
+		"    return 0;\n"
+		"}\n";
+	for (auto& source : {mixed, ManyFunctions(80)}) {
+		auto whole = AnalyseAll(source);
+		auto stream = AnalyseStream(source);
+		REQUIRE_FALSE(whole.second.has_value());
+		REQUIRE_FALSE(stream.second.has_value());
+		REQUIRE(test::Text(stream.first) == test::Text(whole.first));
+		REQUIRE(test::Binary(Assemble(stream.first)) == test::Binary(Assemble(whole.first)));
+	}
+	REQUIRE(test::ExecuteAll(Assemble(AnalyseStream(mixed).first)).out == "x = 300 x\n");
+}
+
+TEST_CASE("Streaming analysis reports the same errors.") {
+	for (auto& source : {
+		// 词法错误，在它之前的代码没有语法错误
+		std::string("int a = 1;\nint main() { print(a); return 09; }\n"),
+		std::string("int main() { int a = 1 ! 2; return 0; }\n"),
+		// 语法错误；之后还有词法错误时只有流式分析先报告语法错误，因此不比较
+		std::string("int main() { print(x); return 0; }\n"),
+		std::string("int main() { return 0 }\n"),
+		std::string("int f() { return 1; }\n"),
+	}) {
+		INFO(source);
+		auto whole = AnalyseAll(source);
+		auto stream = AnalyseStream(source);
+		REQUIRE(whole.second.has_value());
+		REQUIRE(stream.second == whole.second);
+	}
+}
+
+TEST_CASE("Repeated string literals share one constant.") {
+	const std::string source =
+		"void f(int n) { print(\"hi\", n); print(\"f\"); }\n"
+		"int main() {\n"
+		"    print(\"hi\");\n"
+		"    f(1); f(2);\n"
+		"    print(\"hi\", \"main\", \"hi\");\n"
+		"    return 0;\n"
+		"}\n";
+	auto result = AnalyseWith(source, 1);
+	auto count = [&](const std::string& value) {
+		std::size_t n = 0;
+		for (auto& c : result.constList) {
+			n += c.type == 'S' && c.value == value;
+		}
+		return n;
+	};
+	// 五处 "hi" 共用一项，与函数名相同的字符串共用函数名那一项
+	REQUIRE(result.constList.size() == 3);
+	REQUIRE(count("\"hi\"") == 1);
+	REQUIRE(count("\"f\"") == 1);
+	REQUIRE(count("\"main\"") == 1);
+
+	auto run = test::RunAll(source);
+	REQUIRE(run.out == "hi\nhi 1\nf\nhi 2\nf\nhi main hi\n");
+	REQUIRE(run.err.empty());
+	// -c 仍然与汇编 -s 的输出相同
+	auto file = Assemble(result);
+	REQUIRE(test::Binary(test::ParseText(test::Text(result))) == test::Binary(file));
+}
+
+TEST_CASE("Instructions hold integer operands.") {
+	Instruction jump(JMP, 7);
+	REQUIRE(jump == Instruction(JMP, 7, 0));
+	jump.SetParam1(-3);
+	REQUIRE(jump.GetParam1() == -3);
+	REQUIRE_FALSE(jump == Instruction(JMP, 7));
+	REQUIRE(Instruction() == Instruction(NOP, 0, 0));
+
+	const std::string source =
+		"int main() {\n"
+		"    int i = 0;\n"
+		"    while (i < 3) i = i + 1;\n"
+		"    print(2147483647, 0x7fffffff, 0x10);\n"
+		"    return 0;\n"
+		"}\n";
+	auto result = AnalyseWith(source, 1);
+	auto& code = result.funcList.back().localCode;
+	REQUIRE(std::count(code.begin(), code.end(), Instruction(IPUSH, 2147483647)) == 2);
+	REQUIRE(std::count(code.begin(), code.end(), Instruction(IPUSH, 16)) == 1);
+	// 回填的跳转都落在函数之内，向回跳的是循环的开始
+	std::size_t backward = 0;
+	for (std::size_t i = 0; i < code.size(); ++i) {
+		if (JMP <= code[i].GetOperation() && code[i].GetOperation() <= JLE) {
+			REQUIRE(code[i].GetParam1() >= 0);
+			REQUIRE(static_cast<std::size_t>(code[i].GetParam1()) <= code.size());
+			backward += static_cast<std::size_t>(code[i].GetParam1()) <= i;
+		}
+	}
+	REQUIRE(backward == 1);
+	REQUIRE(test::Text(result).find("ipush 2147483647") != std::string::npos);
+	REQUIRE(test::RunAll(source).out == "2147483647 2147483647 16\n");
+}
+
+TEST_CASE("Integer literals must fit in 32 bits.") {
+	for (auto literal : {"2147483648", "0x80000000", "0xffffffff", "0x100000000"}) {
+		INFO(literal);
+		auto result = AnalyseAll(std::string("int main() { print(") + literal + "); return 0; }\n");
+		REQUIRE(result.second.has_value());
+		REQUIRE(result.second.value().GetCode() == ErrIntegerOverflow);
+	}
+}
@@ -0,0 +1,72 @@
+#include "catch2/catch.hpp"
+#include "tests/run_c0.hpp"
+
+#include <cstddef>
+#include <string>
+
+using namespace cc0;
+
+namespace {
+	// 以前的 -c 先把 -s 的输出写到 ./wyxlj.txt 再读回来；下面是它对 Source 输出的字节
+	const std::string Source =
+		"const int size = 0x10;\n"
+		"int total;\n"
+		"int square(int x) {\n"
+		"    return x * x;\n"
+		"}\n"
+		"void show(int n) {\n"
+		"    print(\"n =\", n, 'z');\n"
+		"}\n"
+		"int main() {\n"
+		"    int i = 0;\n"
+		"    scan(total);\n"
+		"    while (i < size) {\n"
+		"        if (i != 3) total = total + square(i) / 2 - 1;\n"
+		"        i = i + 1;\n"
+		"    }\n"
+		"    show(total);\n"
+		"    return 0;\n"
+		"}\n";
+
+	const std::string OldBinary =
+		"43303a2900000001000400000673717561726500000473686f770000036e203d"
+		"0000046d61696e000802000000000a0000000000000200000010200200000000"
+		"0a0000000000010200000000200003000000010000000702000000000a000000"
+		"000000100a000000000000103889000100010000000e0200000000090002a302"
+		"00000020a20a00000000000010a00200000020a2020000007aa2af8800030000"
+		"0000002a02000000000a0000000000000200000000200a000100000001b0200a"
+		"000000000000100a00010000000010447400250a000000000000100200000003"
+		"4471001e0a0001000000010a000100000001100a000000000000108000000200"
+		"0000023c30020000000134200a0000000000000a000000000000100200000001"
+		"30207000070a00010000000110800001020000000089";
+
+	std::string Bytes(const std::string& hex) {
+		std::string bytes;
+		for (std::size_t i = 0; i < hex.size(); i += 2) {
+			bytes.push_back(static_cast<char>(std::stoi(hex.substr(i, 2), nullptr, 16)));
+		}
+		return bytes;
+	}
+}
+
+TEST_CASE("Assemble writes the same bytes as the old -c.") {
+	auto result = test::Compile(Source, 0);
+	auto bytes = test::Binary(Assemble(result));
+	REQUIRE(bytes == Bytes(OldBinary));
+	REQUIRE(test::ExecuteAll(test::ParseBinary(bytes), vm::VM::Limits{}, "5").out == "n = 602 z\n");
+}
+
+TEST_CASE("Assemble agrees with reading the -s output back.") {
+	for (int level = 0; level <= 2; ++level) {
+		INFO("level " << level);
+		auto result = test::Compile(Source, level);
+		REQUIRE(test::Binary(Assemble(result)) == test::Binary(test::ParseText(test::Text(result))));
+	}
+}
+
+TEST_CASE("Assemble keeps # inside strings.") {
+	// -s 的文本里 # 开始注释，以前经过文本的 -c 会把字符串截断
+	auto run = test::RunAll("int main() { print(\"a # b\", '#'); return 0; }\n");
+	REQUIRE(run.out == "a # b #\n");
+	REQUIRE(run.err.empty());
+}
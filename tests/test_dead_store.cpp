@@ -0,0 +1,101 @@
+#include "catch2/catch.hpp"
+#include "tests/run_c0.hpp"
+
+#include "optimizer/cfg.h"
+#include "optimizer/dead_store.h"
+
+#include <vector>
+
+using namespace cc0;
+
+TEST_CASE("Control-flow graph splits code into basic blocks.") {
+	std::vector<Instruction> code = {
+		{LOADA, 0, 0}, {ILOAD}, {JE, 6},
+		{IPUSH, 1}, {IPRINT}, {JMP, 8},
+		{IPUSH, 2}, {IPRINT},
+		{RET},
+		{IPUSH, 3}, {IPRINT},
+	};
+	auto cfg = ControlFlowGraph::Build(code);
+	REQUIRE(cfg.has_value());
+	auto& blocks = cfg->Blocks();
+	REQUIRE(blocks.size() == 5);
+	REQUIRE(blocks[0].begin == 0);
+	REQUIRE(blocks[0].end == 3);
+	// 先是跳转目标，再是顺序执行的下一块
+	REQUIRE(blocks[0].successors == std::vector<std::size_t>{2, 1});
+	REQUIRE(blocks[1].successors == std::vector<std::size_t>{3});
+	REQUIRE(blocks[3].predecessors == std::vector<std::size_t>{1, 2});
+	REQUIRE(blocks[3].successors.empty());
+	REQUIRE(blocks[4].successors.empty());
+	REQUIRE(cfg->BlockOf(7) == 2);
+	REQUIRE(cfg->Reachable() == std::vector<bool>{true, true, true, true, false});
+	REQUIRE(cfg->ReversePostorder().front() == 0);
+	REQUIRE(cfg->ReversePostorder().size() == 4);
+}
+
+TEST_CASE("Control-flow graph finds loop depths.") {
+	std::vector<Instruction> code = {
+		{LOADA, 0, 0}, {ILOAD}, {JE, 9},
+		{LOADA, 0, 1}, {ILOAD}, {JE, 7},
+		{JMP, 3},
+		{JMP, 0},
+		{NOP},
+		{RET},
+	};
+	auto cfg = ControlFlowGraph::Build(code);
+	REQUIRE(cfg.has_value());
+	auto depth = cfg->LoopDepths();
+	REQUIRE(depth[cfg->BlockOf(0)] == 1);
+	REQUIRE(depth[cfg->BlockOf(3)] == 2);
+	REQUIRE(depth[cfg->BlockOf(6)] == 2);
+	REQUIRE(depth[cfg->BlockOf(7)] == 1);
+	REQUIRE(depth[cfg->BlockOf(8)] == 0);
+	REQUIRE(depth[cfg->BlockOf(9)] == 0);
+}
+
+TEST_CASE("Control-flow graph rejects jumps out of the function.") {
+	REQUIRE_FALSE(ControlFlowGraph::Build({{IPUSH, 0}, {JE, 4}, {RET}}).has_value());
+	REQUIRE_FALSE(ControlFlowGraph::Build({{IPUSH, 0}, {TABLESWITCH, 0, 1}, {RET}, {RET}}).has_value());
+}
+
+TEST_CASE("Dead stores and unreachable blocks are removed.") {
+	resultInfo result;
+	result.funcList.push_back(funcInfo{"f", "void", 1, 0, false, {
+		{IPUSH, 0},
+		// 被之后的写入覆盖
+		{LOADA, 0, 1}, {IPUSH, 5}, {ISTORE},
+		{LOADA, 0, 1}, {IPUSH, 7}, {ISTORE},
+		{LOADA, 0, 1}, {ILOAD}, {IPRINT},
+		// 返回之前不再读取
+		{LOADA, 0, 0}, {IPUSH, 1}, {ISTORE},
+		{RET},
+		{IPUSH, 9}, {IPRINT},
+	}});
+	auto stats = EliminateDeadStores(result);
+	REQUIRE(stats.unreachable == 2);
+	REQUIRE(stats.stores == 2);
+	REQUIRE(result.funcList[0].localCode == std::vector<Instruction>{
+		{IPUSH, 0},
+		{LOADA, 0, 1}, {IPUSH, 5}, {POPN, 2},
+		{LOADA, 0, 1}, {IPUSH, 7}, {ISTORE},
+		{LOADA, 0, 1}, {ILOAD}, {IPRINT},
+		{LOADA, 0, 0}, {IPUSH, 1}, {POPN, 2},
+		{RET},
+	});
+}
+
+TEST_CASE("Stores read around a loop are kept.") {
+	// s = s + i 在下一次迭代中被读取，最后的 t 不再被读取
+	auto run = test::RunAll(
+		"int main() {\n"
+		"    int i = 0, s = 0, t = 0;\n"
+		"    while (i < 5) { s = s + i; t = s * 2; i = i + 1; }\n"
+		"    t = 1;\n"
+		"    print(s);\n"
+		"    return 0;\n"
+		"    print(t);\n"
+		"}\n");
+	REQUIRE(run.out == "10\n");
+	REQUIRE(run.err.empty());
+}
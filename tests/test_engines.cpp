@@ -0,0 +1,365 @@
+#include "catch2/catch.hpp"
+#include "tests/run_c0.hpp"
+
+// 各个引擎执行同一个程序的结果必须与 switch 引擎完全相同，包括运行时错误和栈回溯
+
+using cc0::test::RunAll;
+using cc0::test::ExecuteAll;
+using cc0::test::ErrorLine;
+using cc0::test::Compile;
+
+TEST_CASE("Engines agree on arithmetic and printing.") {
+	auto run = RunAll(
+		"int main() {\n"
+		"    int a = -7, b = 2;\n"
+		"    print(a / b, a * b, a - b, -a + b, 100 / 7);\n"
+		"    print('c', \"str\", 'x');\n"
+		"    print(2147483647 + 1);\n"
+		"    return 0;\n"
+		"}\n");
+	REQUIRE(run.out == "-3 -14 -9 9 14\nc str x\n-2147483648\n");
+	REQUIRE(run.err.empty());
+}
+
+TEST_CASE("Engines agree on loops and branches.") {
+	auto run = RunAll(
+		"int main() {\n"
+		"    int i, s = 0, n = 0;\n"
+		"    for (i = 0; i < 10; i = i + 1) {\n"
+		"        if (i == 3) continue;\n"
+		"        if (i == 8) break;\n"
+		"        s = s + i;\n"
+		"    }\n"
+		"    while (n < 5) { n = n + 2; }\n"
+		"    do { n = n - 3; } while (n > 0);\n"
+		"    print(s, n);\n"
+		"    return 0;\n"
+		"}\n");
+	REQUIRE(run.out == "25 0\n");
+}
+
+TEST_CASE("Engines agree on calls, recursion and globals.") {
+	auto run = RunAll(
+		"int calls;\n"
+		"const int limit = 15;\n"
+		"int fib(int n) { calls = calls + 1; if (n < 2) return n; return fib(n - 1) + fib(n - 2); }\n"
+		"void show(int x, int y) { print(x, y); }\n"
+		"int main() {\n"
+		"    show(fib(limit), calls);\n"
+		"    return 0;\n"
+		"}\n");
+	REQUIRE(run.out == "610 1973\n");
+}
+
+TEST_CASE("Engines return into callers of different sizes.") {
+	// 返回后继续执行调用者的代码，big 的返回地址远超出 small 的代码长度
+	auto run = RunAll(
+		"int small(int x) { return 10 / x; }\n"
+		"int big(int x) {\n"
+		"    int a = x + 1, b = a * 2, c = b - 3;\n"
+		"    if (a > 1000) { print(a, b, c); print(c, b, a); print(a * b * c); }\n"
+		"    print(small(x + 1), a, b, c);\n"
+		"    return small(x) + c;\n"
+		"}\n"
+		"int main() {\n"
+		"    print(big(4), small(5), big(1));\n"
+		"    print(big(0));\n"
+		"    return 0;\n"
+		"}\n");
+	REQUIRE(run.out == "2 5 10 7\n9 2 5 2 4 1\n11\n10 1 2 -1\n");
+	REQUIRE(ErrorLine(run) == "runtime error: divide integer by zero !");
+	REQUIRE(run.err.find("function small at instruction 4 : idiv") != std::string::npos);
+	REQUIRE(run.err.find("called by function big at instruction 89 : call 0") != std::string::npos);
+	REQUIRE(run.err.find("called by function main at instruction 15 : call 1") != std::string::npos);
+}
+
+TEST_CASE("Engines agree on dense and sparse switches.") {
+	auto run = RunAll(
+		"int dense(int x) {\n"
+		"    switch (x) {\n"
+		"        case 0: return 10;\n"
+		"        case 1: return 11;\n"
+		"        case 2: return 12;\n"
+		"        case 3: return 13;\n"
+		"        case 4: return 14;\n"
+		"        default: return -1;\n"
+		"    }\n"
+		"}\n"
+		"int sparse(int x) {\n"
+		"    switch (x) {\n"
+		"        case 3: return 1;\n"
+		"        case 700: return 2;\n"
+		"        case 50000: return 3;\n"
+		"    }\n"
+		"    return 0;\n"
+		"}\n"
+		"int main() {\n"
+		"    int i = -2;\n"
+		"    while (i < 7) { print(dense(i)); i = i + 1; }\n"
+		"    print(sparse(3), sparse(700), sparse(50000), sparse(8));\n"
+		"    return 0;\n"
+		"}\n");
+	REQUIRE(run.out == "-1\n-1\n10\n11\n12\n13\n14\n-1\n-1\n1 2 3 0\n");
+}
+
+TEST_CASE("Engines agree on scanned input.") {
+	auto run = RunAll(
+		"int main() {\n"
+		"    int a, b;\n"
+		"    scan(a);\n"
+		"    scan(b);\n"
+		"    print(a * b);\n"
+		"    return 0;\n"
+		"}\n", vm::VM::Limits{}, "6 -7");
+	REQUIRE(run.out == "-42\n");
+}
+
+TEST_CASE("Engines report division by zero with the same trace.") {
+	auto run = RunAll(
+		"int f(int a, int b) { return a / b; }\n"
+		"int h(int n) { if (n == 0) return f(7, n); return h(n - 1) + 1; }\n"
+		"int main() {\n"
+		"    print(f(9, 3));\n"
+		"    print(h(3));\n"
+		"    return 0;\n"
+		"}\n");
+	REQUIRE(run.out == "3\n");
+	REQUIRE(ErrorLine(run) == "runtime error: divide integer by zero !");
+	REQUIRE(run.err.find("called by function h") != std::string::npos);
+}
+
+TEST_CASE("Engines report running off the end of a function.") {
+	auto run = RunAll(
+		"int f(int x) { if (x > 0) return 1; }\n"
+		"int main() { print(f(1)); print(f(0)); return 0; }\n");
+	REQUIRE(run.out == "1\n");
+	REQUIRE(ErrorLine(run) == "runtime error: invalid control transfer !");
+}
+
+TEST_CASE("Engines report the stack limit with the same trace.") {
+	auto run = RunAll(
+		"int d(int n) { if (n == 0) return 0; return d(n - 1) + 1; }\n"
+		"int main() { print(d(10)); print(d(100000)); return 0; }\n",
+		vm::VM::Limits{1000, 0});
+	REQUIRE(run.out == "10\n");
+	REQUIRE(ErrorLine(run) == "runtime error: stack overflow !");
+}
+
+TEST_CASE("Engines report a bad address.") {
+	using vm::OpCode;
+	std::vector<vm::Constant> constants = {
+		{vm::Constant::Type::STRING, vm::str_t("main")},
+	};
+	// 读取栈顶之上的单元，再读取一个不存在的地址
+	std::vector<vm::Instruction> above = {
+		{OpCode::snew, 1, 0},
+		{OpCode::loada, 0, 3},
+		{OpCode::iload, 0, 0},
+		{OpCode::iprint, 0, 0},
+		{OpCode::ret, 0, 0},
+	};
+	std::vector<vm::Instruction> wild = {
+		{OpCode::ipush, 7, 0},
+		{OpCode::iprint, 0, 0},
+		{OpCode::ipush, 123456789, 0},
+		{OpCode::iload, 0, 0},
+		{OpCode::iprint, 0, 0},
+		{OpCode::ret, 0, 0},
+	};
+	for (auto& code : {above, wild}) {
+		auto run = ExecuteAll(File{1, constants, {}, {{0, 0, 1, code}}});
+		REQUIRE(ErrorLine(run).find("runtime error:") == 0);
+		REQUIRE(run.err.find("function main at instruction") != std::string::npos);
+	}
+}
+
+TEST_CASE("Engines agree on frames close to the stack limit.") {
+	// 不会执行的分支让每一层的最大深度远大于实际用到的深度
+	// 优化后每一层用的栈不同，递归的层数也不同，因此只比较同一级别的各个引擎
+	const std::string source =
+		"int d(int n) {\n"
+		"    if (n < 0) return n * (n + (n * (n + (n * (n + (n * (n + (n * (n + n)))))))));\n"
+		"    if (n == 0) return 0;\n"
+		"    return d(n - 1) + 1;\n"
+		"}\n"
+		"int main() {\n"
+		"    int i = 0;\n"
+		"    while (1) { print(d(i)); i = i + 7; }\n"
+		"    return 0;\n"
+		"}\n";
+	for (int level = 0; level <= 2; ++level) {
+		INFO("level " << level);
+		auto run = ExecuteAll(Assemble(Compile(source, level)), vm::VM::Limits{1000, 0});
+		REQUIRE(run.out.find("0\n7\n14\n21\n") == 0);
+		REQUIRE(ErrorLine(run) == "runtime error: stack overflow !");
+	}
+}
+
+TEST_CASE("Engines get a stack of MAX_STACK_SIZE by default.") {
+	// VM::MAX_STACK_SIZE 是 0x01000000 个单元；栈上的页只在用到时才分配，这里只用到两端
+	constexpr vm::addr_t size = 0x01000000;
+	using vm::OpCode;
+	std::vector<vm::Constant> constants = {
+		{vm::Constant::Type::STRING, vm::str_t("main")},
+	};
+	for (int spare : {0, 1}) {
+		INFO("spare " << spare);
+		std::vector<vm::Instruction> code = {
+			{OpCode::snew, size - 1 + spare, 0},
+			{OpCode::ipush, 5, 0},
+			{OpCode::iprint, 0, 0},
+			{OpCode::ret, 0, 0},
+		};
+		// 寄存器翻译为帧中的每个单元建立记录，这么大的帧只用解释执行的引擎
+		for (auto engine : {vm::VM::Engine::Switch, vm::VM::Engine::Threaded}) {
+			auto run = cc0::test::Execute(File{1, constants, {}, {{0, 0, 1, code}}}, engine);
+			REQUIRE(run.out == (spare == 0 ? "5" : ""));
+			REQUIRE(ErrorLine(run) == (spare == 0 ? "" : "runtime error: stack overflow !"));
+		}
+	}
+}
+
+TEST_CASE("Engines agree on stores at the stack limit.") {
+	// 融合的 storev 不压入地址，它之前的指令在少一个单元时仍能放下，但其它引擎会溢出
+	using vm::OpCode;
+	std::vector<vm::Constant> constants = {
+		{vm::Constant::Type::STRING, vm::str_t("main")},
+	};
+	std::vector<vm::Instruction> code = {
+		{OpCode::snew, 1, 0},
+		{OpCode::loada, 0, 0},
+		{OpCode::ipush, 5, 0},
+		{OpCode::istore, 0, 0},
+		{OpCode::loada, 0, 0},
+		{OpCode::iload, 0, 0},
+		{OpCode::iprint, 0, 0},
+		{OpCode::ret, 0, 0},
+	};
+	for (int size = 1; size <= 4; ++size) {
+		INFO("stack size " << size);
+		auto run = ExecuteAll(File{1, constants, {}, {{0, 0, 1, code}}}, vm::VM::Limits{size, 0});
+		REQUIRE(run.out == (size < 3 ? "" : "5"));
+	}
+
+	const std::string source =
+		"int d(int n) {\n"
+		"    int t;\n"
+		"    t = n + (n + (n + (n + (n + (n + n)))));\n"
+		"    if (n == 0) return 0;\n"
+		"    return d(n - 1) + 1;\n"
+		"}\n"
+		"int main() { print(d(60)); return 0; }\n";
+	for (int level = 0; level <= 2; ++level) {
+		auto file = Assemble(Compile(source, level));
+		for (int size = 150; size <= 250; ++size) {
+			INFO("level " << level << ", stack size " << size);
+			ExecuteAll(file, vm::VM::Limits{size, 0});
+		}
+	}
+}
+
+TEST_CASE("Rotated and inlined stores fuse correctly on the threaded engine.") {
+	// 内联和旋转会在 loada 与 istore 之间读取其后压入的单元，融合 storev 时不能把它们算错位置
+	using vm::OpCode;
+	std::vector<vm::Constant> constants = {
+		{vm::Constant::Type::STRING, vm::str_t("main")},
+	};
+	std::vector<vm::Instruction> code = {
+		{OpCode::ipush, 5, 0},
+		{OpCode::loada, 0, 0},
+		{OpCode::ipush, 2, 0},
+		{OpCode::loada, 0, 2},
+		{OpCode::iload, 0, 0},
+		{OpCode::iadd, 0, 0},
+		{OpCode::istore, 0, 0},
+		{OpCode::loada, 0, 0},
+		{OpCode::iload, 0, 0},
+		{OpCode::iprint, 0, 0},
+		{OpCode::ret, 0, 0},
+	};
+	auto run = ExecuteAll(File{1, constants, {}, {{0, 0, 1, code}}});
+	REQUIRE(run.out == "4");
+	REQUIRE(run.err.empty());
+
+	auto inlined = RunAll(
+		"int add(int a, int b) { return a + b; }\n"
+		"int main() {\n"
+		"    int i = 0, s = 0;\n"
+		"    while (i < 5) { s = add(s, i) + add(i, 1); i = i + 1; }\n"
+		"    print(s);\n"
+		"    return 0;\n"
+		"}\n");
+	REQUIRE(inlined.out == "25\n");
+}
+
+TEST_CASE("Threaded engine counts instructions and fusions like --vm-stats.") {
+	using vm::OpCode;
+	std::vector<vm::Constant> constants = {
+		{vm::Constant::Type::STRING, vm::str_t("main")},
+	};
+	// for (i = 0; i < 3; i = i + 1); print(i);
+	std::vector<vm::Instruction> code = {
+		{OpCode::ipush, 0, 0},
+		{OpCode::loada, 0, 0},
+		{OpCode::iload, 0, 0},
+		{OpCode::ipush, 3, 0},
+		{OpCode::icmp, 0, 0},
+		{OpCode::jge, 13, 0},
+		{OpCode::loada, 0, 0},
+		{OpCode::loada, 0, 0},
+		{OpCode::iload, 0, 0},
+		{OpCode::ipush, 1, 0},
+		{OpCode::iadd, 0, 0},
+		{OpCode::istore, 0, 0},
+		{OpCode::jmp, 1, 0},
+		{OpCode::loada, 0, 0},
+		{OpCode::iload, 0, 0},
+		{OpCode::iprint, 0, 0},
+		{OpCode::ret, 0, 0},
+	};
+	auto stats = [&](vm::VM::Engine engine) {
+		std::ostringstream out, err;
+		auto* saved = std::cout.rdbuf(out.rdbuf());
+		auto avm = vm::VM::make_vm(File{1, constants, {}, {{0, 0, 1, code}}}, engine);
+		avm->start();
+		std::cout.rdbuf(saved);
+		REQUIRE(out.str() == "3");
+		avm->printStats(err);
+		return err.str();
+	};
+	// 46 条加上 __START__ 调用 main 和返回的两条
+	auto switched = stats(vm::VM::Engine::Switch);
+	REQUIRE(switched.find("vm instructions: 48\nvm dispatches: 48\n") != std::string::npos);
+	// 每次迭代融合两个 loadv、icmp_jge 和 storev，退出循环时比较的 loadv、icmp_jge 和打印前的 loadv 共三条
+	auto threaded = stats(vm::VM::Engine::Threaded);
+	REQUIRE(threaded.find("vm instructions: 48\nvm dispatches: 33\n") != std::string::npos);
+	REQUIRE(threaded.find("vm fused at run time: 15 ") != std::string::npos);
+	// 三个 iload、一个 icmp 和 storev 的 loada
+	REQUIRE(threaded.find("vm fused at load time: 5 of 19 ") != std::string::npos);
+}
+
+TEST_CASE("Engines report loads and stores just above the frame.") {
+	// 地址在操作数弹出之后才检查，这时只剩下一个局部变量
+	using vm::OpCode;
+	std::vector<vm::Constant> constants = {
+		{vm::Constant::Type::STRING, vm::str_t("main")},
+	};
+	std::vector<vm::Instruction> load = {
+		{OpCode::ipush, 0, 0},
+		{OpCode::loada, 0, 1},
+		{OpCode::iload, 0, 0},
+		{OpCode::iprint, 0, 0},
+		{OpCode::ret, 0, 0},
+	};
+	std::vector<vm::Instruction> store = {
+		{OpCode::ipush, 0, 0},
+		{OpCode::loada, 0, 1},
+		{OpCode::ipush, 7, 0},
+		{OpCode::istore, 0, 0},
+		{OpCode::ret, 0, 0},
+	};
+	for (auto& code : {load, store}) {
+		auto run = ExecuteAll(File{1, constants, {}, {{0, 0, 1, code}}});
+		REQUIRE(ErrorLine(run) == "runtime error: tried to access unexistent memory !");
+	}
+}
@@ -0,0 +1,143 @@
+#include "catch2/catch.hpp"
+
+#include "heap.h"
+#include "exception.h"
+#include "memory.h"
+
+#include <utility>
+
+// 堆从 base 开始，下面的地址都相对于它
+namespace {
+	constexpr vm::addr_t base = 1000;
+}
+
+TEST_CASE("Heap reuses a released block.") {
+	vm::Heap heap(base, 64);
+	auto a = heap.allocate(4);
+	auto b = heap.allocate(4);
+	REQUIRE(a == base);
+	REQUIRE(b == base + 4);
+	heap.release(a);
+	REQUIRE(heap.find(a, 1) == nullptr);
+	// 放得下就不再从顶部分配，剩下的一格仍然空闲
+	REQUIRE(heap.allocate(3) == a);
+	REQUIRE(heap.find(a + 3, 1) == nullptr);
+	REQUIRE(heap.allocate(1) == a + 3);
+	REQUIRE(heap.stats().reused == 2);
+	REQUIRE(heap.stats().highWater == 8);
+	REQUIRE(heap.liveBlocks() == 3);
+}
+
+TEST_CASE("Heap picks the smallest free block that fits.") {
+	vm::Heap heap(base, 64);
+	auto large = heap.allocate(8);
+	heap.allocate(1);
+	auto small = heap.allocate(3);
+	heap.allocate(1);
+	auto middle = heap.allocate(5);
+	heap.allocate(1);
+	heap.release(large);
+	heap.release(small);
+	heap.release(middle);
+	REQUIRE(heap.allocate(3) == small);
+	REQUIRE(heap.allocate(4) == middle);
+	REQUIRE(heap.allocate(8) == large);
+	// 五格的块分出四格之后剩下的一格
+	REQUIRE(heap.allocate(1) == middle + 4);
+	// 没有空闲的块了，从顶部分配
+	REQUIRE(heap.allocate(1) == base + 19);
+}
+
+TEST_CASE("Heap coalesces neighbouring free blocks.") {
+	vm::Heap heap(base, 64);
+	auto a = heap.allocate(2);
+	auto b = heap.allocate(2);
+	auto c = heap.allocate(2);
+	heap.allocate(1);
+	heap.release(a);
+	heap.release(c);
+	// 与前后两个空闲块合并成一块
+	heap.release(b);
+	REQUIRE(heap.allocate(6) == a);
+	REQUIRE(heap.stats().reused == 1);
+	REQUIRE(heap.stats().releases == 3);
+}
+
+TEST_CASE("Heap returns a free block at the top to the bump area.") {
+	vm::Heap heap(base, 8);
+	auto a = heap.allocate(4);
+	auto b = heap.allocate(4);
+	heap.release(a);
+	// 与前面的空闲块合并后到达顶部，整个堆又可以一次分配
+	heap.release(b);
+	REQUIRE(heap.liveBlocks() == 0);
+	REQUIRE(heap.allocate(8) == base);
+	REQUIRE(heap.stats().reused == 0);
+	REQUIRE_THROWS_AS(heap.allocate(1), vm::HeapOverflow);
+}
+
+TEST_CASE("Heap rejects bad releases and accesses.") {
+	vm::Heap heap(base, 8);
+	auto a = heap.allocate(4);
+	auto b = heap.allocate(4);
+	REQUIRE(heap.find(a, 4) != nullptr);
+	// 不能跨过块的边界
+	REQUIRE(heap.find(a + 2, 4) == nullptr);
+	REQUIRE(heap.find(b + 4, 1) == nullptr);
+	REQUIRE_THROWS_AS(heap.release(a + 1), vm::InvalidMemoryAccess);
+	heap.release(a);
+	REQUIRE_THROWS_AS(heap.release(a), vm::InvalidMemoryAccess);
+	REQUIRE_THROWS_AS(heap.allocate(5), vm::HeapOverflow);
+	REQUIRE_THROWS_AS(heap.allocate(-1), vm::HeapOverflow);
+}
+
+TEST_CASE("Slot region reserves its whole capacity up front.") {
+	// 只保留地址，用到的页才分配
+	constexpr vm::addr_t capacity = 1 << 24;
+	vm::SlotRegion region(capacity);
+#if !defined(CC0_NO_MMAP) && (defined(__unix__) || defined(__APPLE__))
+	REQUIRE(region.mapped());
+#endif
+	if (!region.mapped()) {
+		region.commit(capacity);
+	}
+	auto data = region.data();
+	REQUIRE(region.capacity() == capacity);
+	REQUIRE(region[0] == 0);
+	REQUIRE(region[capacity - 1] == 0);
+	region[capacity - 1] = 42;
+	region.commit(capacity);
+	REQUIRE(region.data() == data);
+	REQUIRE(region[capacity - 1] == 42);
+}
+
+TEST_CASE("Slot region falls back to a growing vector.") {
+	constexpr vm::addr_t capacity = 100000;
+	vm::SlotRegion region(capacity, false);
+	REQUIRE_FALSE(region.mapped());
+	REQUIRE(region.data() == nullptr);
+	region.commit(10);
+	REQUIRE(region.data() != nullptr);
+	region[9] = 7;
+	// 每次至少翻倍，新的单元与新的页一样为 0，旧的单元保持不变
+	for (vm::addr_t size : {5000, 5001, 20000, 60000, capacity}) {
+		INFO("size " << size);
+		region.commit(size);
+		REQUIRE(region[9] == 7);
+		REQUIRE(region[size - 1] == 0);
+		region[size - 1] = size;
+	}
+	REQUIRE(region[59999] == 60000);
+	auto data = region.data();
+	region.commit(1);
+	REQUIRE(region.data() == data);
+
+	vm::SlotRegion moved(std::move(region));
+	REQUIRE(moved.data() == data);
+	REQUIRE(moved[capacity - 1] == capacity);
+	REQUIRE(region.data() == nullptr);
+	REQUIRE(region.capacity() == 0);
+	region = std::move(moved);
+	REQUIRE(region[9] == 7);
+	REQUIRE(moved.data() == nullptr);
+}
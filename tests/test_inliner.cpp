@@ -0,0 +1,125 @@
+#include "catch2/catch.hpp"
+#include "tests/run_c0.hpp"
+
+#include "optimizer/inliner.h"
+
+#include <cstddef>
+#include <string>
+
+using namespace cc0;
+
+namespace {
+	// 函数中调用第 index 个函数的指令条数
+	std::size_t CallsTo(const funcInfo& func, std::size_t index) {
+		std::size_t count = 0;
+		for (auto& ins : func.localCode) {
+			auto op = ins.GetOperation();
+			if ((op == CALL || op == TAILCALL) && static_cast<std::size_t>(ins.GetParam1()) == index) {
+				++count;
+			}
+		}
+		return count;
+	}
+
+	// 内联前后在所有引擎上的结果必须相同
+	test::Run RunInlined(const std::string& source, const InlineOptions& options, std::size_t& inlined) {
+		auto result = test::Compile(source, 0);
+		auto expected = test::ExecuteAll(Assemble(result));
+		inlined = InlineFunctions(result, options);
+		auto run = test::ExecuteAll(Assemble(result));
+		REQUIRE(run.out == expected.out);
+		REQUIRE(run.err.empty() == expected.err.empty());
+		return run;
+	}
+
+	const std::string squares =
+		"int sq(int x) { return x * x; }\n"
+		"int main() {\n"
+		"    int a = 3;\n"
+		"    print(sq(a), sq(4), sq(a + 1), sq(sq(2)));\n"
+		"    return 0;\n"
+		"}\n";
+}
+
+TEST_CASE("Inliner replaces calls of a small function.") {
+	auto result = test::Compile(squares, 0);
+	REQUIRE(CallsTo(result.funcList[1], 0) == 5);
+	REQUIRE(InlineFunctions(result) == 5);
+	REQUIRE(CallsTo(result.funcList[1], 0) == 0);
+
+	std::size_t inlined = 0;
+	auto run = RunInlined(squares, InlineOptions{}, inlined);
+	REQUIRE(inlined == 5);
+	REQUIRE(run.out == "9 16 16 16\n");
+}
+
+TEST_CASE("Inliner does nothing at depth 0.") {
+	auto result = test::Compile(squares, 0);
+	auto before = result.funcList[1].localCode;
+	REQUIRE(InlineFunctions(result, InlineOptions{16, 0}) == 0);
+	REQUIRE(result.funcList[1].localCode == before);
+}
+
+TEST_CASE("Inliner keeps recursive and large functions.") {
+	std::size_t inlined = 0;
+	auto run = RunInlined(
+		"int fib(int n) { if (n < 2) return n; return fib(n - 1) + fib(n - 2); }\n"
+		"int big(int x) {\n"
+		"    int s = x;\n"
+		"    s = s * 3 + 1; s = s * 3 + 2; s = s * 3 + 3; s = s * 3 + 4;\n"
+		"    return s;\n"
+		"}\n"
+		"int main() { print(fib(10), big(1)); return 0; }\n",
+		InlineOptions{}, inlined);
+	REQUIRE(inlined == 0);
+	REQUIRE(run.out == "55 139\n");
+}
+
+TEST_CASE("Inliner nests at most maxDepth levels.") {
+	const std::string source =
+		"int a(int x) { return x + 1; }\n"
+		"int b(int x) { return a(x) * 2; }\n"
+		"int c(int x) { return b(x) - 3; }\n"
+		"int main() { print(c(5)); return 0; }\n";
+	auto result = test::Compile(source, 0);
+	// a 内联到 b，b 内联到 c；c 已经嵌套了两层，不再内联到 main
+	REQUIRE(InlineFunctions(result, InlineOptions{64, 2}) == 2);
+	REQUIRE(CallsTo(result.funcList[3], 2) == 1);
+
+	std::size_t inlined = 0;
+	auto run = RunInlined(source, InlineOptions{64, 3}, inlined);
+	REQUIRE(inlined == 3);
+	REQUIRE(run.out == "9\n");
+}
+
+TEST_CASE("Inliner stops before a caller outgrows maxCallerSize.") {
+	std::string source = "int f(int x) { return x * 3 + 1; }\nint main() {\n    int s = 0;\n";
+	for (int i = 0; i < 40; ++i) {
+		source += "    s = s + f(s);\n";
+	}
+	source += "    print(s);\n    return 0;\n}\n";
+
+	auto result = test::Compile(source, 0);
+	auto limit = result.funcList[1].localCode.size() + 20;
+	std::size_t inlined = 0;
+	auto run = RunInlined(source, InlineOptions{16, 2, limit}, inlined);
+	REQUIRE(inlined > 0);
+	REQUIRE(inlined < 40);
+
+	REQUIRE(InlineFunctions(result, InlineOptions{16, 2, limit}) == inlined);
+	REQUIRE(result.funcList[1].localCode.size() <= limit);
+	// 撤销的那一处和其后的调用原样保留
+	REQUIRE(CallsTo(result.funcList[1], 0) == 40 - inlined);
+}
+
+TEST_CASE("Inlined functions report runtime errors like calls.") {
+	auto run = test::RunAll(
+		"int quot(int a, int b) { return a / b; }\n"
+		"int main() {\n"
+		"    int i = 3;\n"
+		"    while (i >= 0) { print(quot(12, i)); i = i - 1; }\n"
+		"    return 0;\n"
+		"}\n");
+	REQUIRE(run.out == "4\n6\n12\n");
+	REQUIRE(test::ErrorLine(run) == "runtime error: divide integer by zero !");
+}
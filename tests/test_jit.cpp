@@ -0,0 +1,70 @@
+#include "catch2/catch.hpp"
+#include "tests/run_c0.hpp"
+
+// jit 的机器代码在慢速路径上调用 vm 或者离开，再从离开的地方继续；这些路径的结果必须与其它引擎相同
+
+using cc0::test::RunAll;
+using cc0::test::ErrorLine;
+
+TEST_CASE("Jit raises a zero divisor found in a hot loop.") {
+	auto run = RunAll(
+		"int main() {\n"
+		"    int i = 0, s = 0;\n"
+		"    while (i < 100000) {\n"
+		"        s = s + 1000000 / (5000 - i);\n"
+		"        i = i + 1;\n"
+		"    }\n"
+		"    print(s);\n"
+		"    return 0;\n"
+		"}\n");
+	REQUIRE(run.out.empty());
+	REQUIRE(ErrorLine(run) == "runtime error: divide integer by zero !");
+	REQUIRE(run.err.find("function main at instruction") != std::string::npos);
+}
+
+TEST_CASE("Jit raises a constant zero divisor.") {
+	auto run = RunAll(
+		"int z;\n"
+		"int f(int x) { return x / 0; }\n"
+		"int main() { print(z); print(f(3)); return 0; }\n");
+	REQUIRE(run.out == "0\n");
+	REQUIRE(ErrorLine(run) == "runtime error: divide integer by zero !");
+	REQUIRE(run.err.find("called by function main") != std::string::npos);
+}
+
+TEST_CASE("Jit jumps through switch tables.") {
+	auto run = RunAll(
+		"int kind(int x) {\n"
+		"    switch (x) {\n"
+		"        case 1: return 10;\n"
+		"        case 2: return 20;\n"
+		"        case 3: return 30;\n"
+		"        case 4: return 40;\n"
+		"        case 6: return 60;\n"
+		"    }\n"
+		"    return 0;\n"
+		"}\n"
+		"int main() {\n"
+		"    int i = -3, s = 0;\n"
+		"    while (i < 3000) { s = s + kind(i - i / 8 * 8); i = i + 1; }\n"
+		"    print(s, kind(-2147483647 - 1), kind(2147483647));\n"
+		"    return 0;\n"
+		"}\n");
+	REQUIRE(run.out == "60000 0 0\n");
+}
+
+TEST_CASE("Jit leaves machine code for stack instructions and calls.") {
+	auto run = RunAll(
+		"int depth(int n) { if (n == 0) return 0; return depth(n - 1) + 1; }\n"
+		"int main() {\n"
+		"    int i = 0, a;\n"
+		"    while (i < 3) {\n"
+		"        scan(a);\n"
+		"        print(\"got\", a, ':', depth(a));\n"
+		"        i = i + 1;\n"
+		"    }\n"
+		"    return 0;\n"
+		"}\n", vm::VM::Limits{}, "4 0 300");
+	REQUIRE(run.out == "got 4 : 4\ngot 0 : 0\ngot 300 : 300\n");
+	REQUIRE(run.err.empty());
+}
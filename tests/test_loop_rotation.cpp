@@ -0,0 +1,93 @@
+#include "catch2/catch.hpp"
+#include "tests/run_c0.hpp"
+
+#include "optimizer/loop_rotation.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace cc0;
+
+namespace {
+	// 向回跳的 jmp 的条数
+	std::size_t BackwardJumps(const std::vector<Instruction>& code) {
+		std::size_t count = 0;
+		for (std::size_t i = 0; i < code.size(); ++i) {
+			if (code[i].GetOperation() == JMP && static_cast<std::size_t>(code[i].GetParam1()) <= i) {
+				++count;
+			}
+		}
+		return count;
+	}
+
+	// 旋转前后在所有引擎上的结果必须相同
+	test::Run RunRotated(const std::string& source, std::size_t maxSize, std::size_t& rotated, resultInfo& result) {
+		result = test::Compile(source, 0);
+		auto expected = test::ExecuteAll(Assemble(result));
+		rotated = RotateLoops(result, maxSize);
+		auto run = test::ExecuteAll(Assemble(result));
+		REQUIRE(run.out == expected.out);
+		REQUIRE(run.err == expected.err);
+		return run;
+	}
+}
+
+TEST_CASE("Loop rotation moves the test of while and for to the bottom.") {
+	resultInfo result;
+	std::size_t rotated = 0;
+	auto run = RunRotated(
+		"int main() {\n"
+		"    int i = 0, j, s = 0;\n"
+		"    while (i < 4) {\n"
+		"        for (j = 0; j < i; j = j + 1) {\n"
+		"            if (j == 1) continue;\n"
+		"            if (j == 2) break;\n"
+		"            s = s + j * 10 + i;\n"
+		"        }\n"
+		"        i = i + 1;\n"
+		"    }\n"
+		"    do { s = s - 1; } while (s > 40);\n"
+		"    print(s, i, j);\n"
+		"    return 0;\n"
+		"}\n", 16, rotated, result);
+	REQUIRE(run.out == "5 4 2\n");
+	// 每个向回跳的 jmp：while 的末尾，for 的循环体末尾、continue 和更新语句之后，以及 do 的条件之后
+	REQUIRE(rotated == 5);
+	REQUIRE(BackwardJumps(result.funcList.back().localCode) == 0);
+}
+
+TEST_CASE("Loop rotation keeps loops whose test is too long.") {
+	const std::string source =
+		"int main() {\n"
+		"    int i = 0;\n"
+		"    while (i * i + i * 3 - (i + 1) * (i + 2) + 2 * i + 2 < 6 - i) { i = i + 1; }\n"
+		"    print(i);\n"
+		"    return 0;\n"
+		"}\n";
+	resultInfo result;
+	std::size_t rotated = 0;
+	auto run = RunRotated(source, 4, rotated, result);
+	REQUIRE(rotated == 0);
+	REQUIRE(BackwardJumps(result.funcList.back().localCode) == 1);
+	RunRotated(source, 32, rotated, result);
+	REQUIRE(rotated == 1);
+	REQUIRE(run.out == "2\n");
+}
+
+TEST_CASE("Loop rotation keeps a function within the object format.") {
+	std::string source = "int main() {\n    int i = 0;\n";
+	for (int k = 1; k <= 5000; ++k) {
+		source += "    while (i < " + std::to_string(k) + ") { i = i + 1; }\n";
+	}
+	source += "    print(i);\n    return 0;\n}\n";
+	resultInfo result;
+	std::size_t rotated = 0;
+	auto run = RunRotated(source, 16, rotated, result);
+	REQUIRE(run.out == "5000\n");
+	REQUIRE(rotated > 0);
+	REQUIRE(rotated < 5000);
+	REQUIRE(result.funcList.back().localCode.size() <= UINT16_MAX);
+}
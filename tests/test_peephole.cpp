@@ -0,0 +1,109 @@
+#include "catch2/catch.hpp"
+#include "tests/run_c0.hpp"
+
+#include "optimizer/peephole.h"
+
+#include <vector>
+
+using namespace cc0;
+
+TEST_CASE("Peephole folds constant arithmetic.") {
+	std::vector<Instruction> code = {
+		{IPUSH, 2}, {IPUSH, 3}, {IADD}, {IPUSH, 4}, {IMUL}, {INEG}, {IRET},
+	};
+	REQUIRE(PeepholeOptimize(code) == 5);
+	REQUIRE(code == std::vector<Instruction>{{IPUSH, -20}, {IRET}});
+}
+
+TEST_CASE("Peephole wraps folded arithmetic like the vm.") {
+	std::vector<Instruction> code = {
+		{IPUSH, 2147483647}, {IPUSH, 1}, {IADD}, {IRET},
+	};
+	PeepholeOptimize(code);
+	REQUIRE(code == std::vector<Instruction>{{IPUSH, -2147483647 - 1}, {IRET}});
+}
+
+TEST_CASE("Peephole leaves division by zero to the vm.") {
+	std::vector<Instruction> code = {
+		{IPUSH, 1}, {IPUSH, 0}, {IDIV}, {IRET},
+	};
+	auto expected = code;
+	REQUIRE(PeepholeOptimize(code) == 0);
+	REQUIRE(code == expected);
+}
+
+TEST_CASE("Peephole drops discarded values without side effects.") {
+	std::vector<Instruction> code = {
+		// 读出后丢弃的局部变量
+		{LOADA, 0, 0}, {ILOAD}, {POP},
+		// 结果被丢弃的运算只丢弃它的操作数
+		{LOADA, 0, 0}, {ILOAD}, {LOADA, 0, 1}, {ILOAD}, {IADD}, {POP},
+		// 地址可能不合法的读取必须保留
+		{IPUSH, 5}, {ILOAD}, {POP},
+		{RET},
+	};
+	PeepholeOptimize(code);
+	REQUIRE(code == std::vector<Instruction>{{IPUSH, 5}, {ILOAD}, {POP}, {RET}});
+}
+
+TEST_CASE("Peephole inverts a branch over a jmp.") {
+	std::vector<Instruction> code = {
+		{LOADA, 0, 0}, {ILOAD},
+		{JE, 4},
+		{JMP, 6},
+		{IPUSH, 1}, {IPRINT},
+		{IPUSH, 2}, {IPRINT},
+		{RET},
+	};
+	REQUIRE(PeepholeOptimize(code) == 1);
+	REQUIRE(code == std::vector<Instruction>{
+		{LOADA, 0, 0}, {ILOAD},
+		{JNE, 5},
+		{IPUSH, 1}, {IPRINT},
+		{IPUSH, 2}, {IPRINT},
+		{RET},
+	});
+}
+
+TEST_CASE("Peephole folds constant branches and drops unreachable code.") {
+	std::vector<Instruction> code = {
+		{IPUSH, 0}, {JE, 4},
+		{IPUSH, 1}, {IPRINT},
+		{IPUSH, 2}, {IPRINT},
+		{RET},
+		{IPUSH, 3}, {IPRINT},
+	};
+	PeepholeOptimize(code);
+	REQUIRE(code == std::vector<Instruction>{{IPUSH, 2}, {IPRINT}, {RET}});
+}
+
+TEST_CASE("Peephole threads jump chains.") {
+	std::vector<Instruction> code = {
+		{LOADA, 0, 0}, {ILOAD}, {JE, 6},
+		{IPUSH, 1}, {IPRINT}, {RET},
+		{JMP, 9},
+		{IPUSH, 2}, {IPRINT},
+		{IPUSH, 3}, {IPRINT}, {RET},
+	};
+	PeepholeOptimize(code);
+	// 跳向 jmp 的条件跳转直接跳到最终目标，jmp 和它之后不可达的代码都被删除
+	REQUIRE(code == std::vector<Instruction>{
+		{LOADA, 0, 0}, {ILOAD}, {JE, 6},
+		{IPUSH, 1}, {IPRINT}, {RET},
+		{IPUSH, 3}, {IPRINT}, {RET},
+	});
+}
+
+TEST_CASE("Optimized programs behave like unoptimized ones.") {
+	auto run = test::RunAll(
+		"int main() {\n"
+		"    int x = 3;\n"
+		"    print(2 * 3 + x * 0 + 0 - -x, 2147483647 + 1);\n"
+		"    if (1) print(1); else print(2);\n"
+		"    while (0) print(3);\n"
+		"    print(7 / (x - 3));\n"
+		"    return 0;\n"
+		"}\n");
+	REQUIRE(run.out == "9 -2147483648\n1\n");
+	REQUIRE(test::ErrorLine(run) == "runtime error: divide integer by zero !");
+}
@@ -0,0 +1,135 @@
+#include "catch2/catch.hpp"
+#include "tests/run_c0.hpp"
+
+#include "optimizer/ssa.h"
+#include "optimizer/ssa_passes.h"
+
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace cc0;
+
+namespace {
+	// main 的代码，它总是最后一个函数
+	const std::vector<Instruction>& MainCode(const resultInfo& result) {
+		return result.funcList.back().localCode;
+	}
+
+	// switch 引擎执行的指令条数
+	int Executed(const resultInfo& result) {
+		std::ostringstream out;
+		auto* saved = std::cout.rdbuf(out.rdbuf());
+		auto avm = vm::VM::make_vm(Assemble(result), vm::VM::Engine::Switch);
+		avm->start();
+		std::cout.rdbuf(saved);
+		return avm->executedInstructions();
+	}
+
+	bool HasConditionalJump(const std::vector<Instruction>& code) {
+		return std::any_of(code.begin(), code.end(), [](const Instruction& ins) {
+			return JE <= ins.GetOperation() && ins.GetOperation() <= JLE;
+		});
+	}
+}
+
+TEST_CASE("SSA folds constants and simplifies algebra.") {
+	resultInfo result;
+	// x * 0 + (x - x) + 6 * 7
+	result.funcList.push_back(funcInfo{"f", "int", 1, 0, true, {
+		{LOADA, 0, 0}, {ILOAD}, {IPUSH, 0}, {IMUL},
+		{LOADA, 0, 0}, {ILOAD}, {LOADA, 0, 0}, {ILOAD}, {ISUB}, {IADD},
+		{IPUSH, 6}, {IPUSH, 7}, {IMUL}, {IADD},
+		{IRET},
+	}});
+	auto stats = OptimizeSSA(result);
+	REQUIRE(stats.functions == 1);
+	REQUIRE(stats.before == 15);
+	REQUIRE(MainCode(result) == std::vector<Instruction>{{IPUSH, 42}, {IRET}});
+}
+
+TEST_CASE("SSA builds code whose branches target the end.") {
+	// 跳到末尾的边都指向翻译时才加入的落出末尾的块，块的个数不同时它会在不同的时候导致重新分配
+	for (int branches = 1; branches <= 8; ++branches) {
+		INFO("branches " << branches);
+		funcInfo func{"f", "void", 1, 0, false, {}};
+		auto end = static_cast<std::int32_t>(branches * 5);
+		for (int k = 0; k < branches; ++k) {
+			func.localCode.insert(func.localCode.end(), {
+				{LOADA, 0, 0}, {ILOAD}, {JE, end}, {IPUSH, k}, {IPRINT},
+			});
+		}
+		auto function = ssa::Build(func, {func});
+		REQUIRE(function.has_value());
+		REQUIRE(ssa::Lower(*function, {func}).has_value());
+	}
+	auto run = test::RunAll(
+		"void f(int x) { if (x) print(x); }\n"
+		"int g(int x) { if (x) return x; }\n"
+		"int main() { f(0); f(2); print(g(3)); print(g(0)); return 0; }\n");
+	REQUIRE(run.out == "2\n3\n");
+	REQUIRE(test::ErrorLine(run) == "runtime error: invalid control transfer !");
+}
+
+TEST_CASE("-O2 removes branches on known values.") {
+	const std::string source =
+		"int main() {\n"
+		"    int mode = 2, step;\n"
+		"    if (mode == 1) { step = 3; } else { step = 5; }\n"
+		"    if (step > 4) { print(step); } else { print(-step); }\n"
+		"    return 0;\n"
+		"}\n";
+	auto o1 = test::Compile(source, 1);
+	auto o2 = test::Compile(source, 2);
+	REQUIRE(HasConditionalJump(MainCode(o1)));
+	REQUIRE_FALSE(HasConditionalJump(MainCode(o2)));
+	REQUIRE(MainCode(o2).size() < MainCode(o1).size());
+	REQUIRE(test::RunAll(source).out == "5\n");
+}
+
+TEST_CASE("-O2 shares repeated expressions and hoists invariants.") {
+	const std::string source =
+		"int w = 7, h = 3;\n"
+		"int main() {\n"
+		"    int i = 0, j, s = 0;\n"
+		"    while (i < 4) {\n"
+		"        j = 0;\n"
+		"        while (j < 5) {\n"
+		"            s = s + (w * h + i * w) - j + (i * 3 + 1) * (i * 3 + 1);\n"
+		"            j = j + 1;\n"
+		"        }\n"
+		"        i = i + 1;\n"
+		"    }\n"
+		"    print(s);\n"
+		"    return 0;\n"
+		"}\n";
+	auto o1 = test::Compile(source, 1);
+	auto o2 = test::Compile(source, 2);
+	auto r1 = test::Execute(Assemble(o1), vm::VM::Engine::Switch);
+	auto r2 = test::Execute(Assemble(o2), vm::VM::Engine::Switch);
+	REQUIRE(r1.out == r2.out);
+	REQUIRE(test::RunAll(source).out == "1420\n");
+	// 移到循环外的临时变量让代码变长，但是内层循环每次执行的指令少得多
+	auto e1 = Executed(o1);
+	auto e2 = Executed(o2);
+	INFO("-O " << e1 << " -O2 " << e2);
+	REQUIRE(e2 * 4 < e1 * 3);
+}
+
+TEST_CASE("-O2 keeps side effects and runtime errors.") {
+	auto run = test::RunAll(
+		"int calls;\n"
+		"int tick(int x) { calls = calls + 1; return x; }\n"
+		"int main() {\n"
+		"    int a, b = 0, unused;\n"
+		"    scan(a);\n"
+		"    unused = tick(a) * 0;\n"
+		"    print(calls, a * 1 + 0, a - a);\n"
+		"    print(a / b);\n"
+		"    return 0;\n"
+		"}\n", vm::VM::Limits{}, "9");
+	REQUIRE(run.out == "1 9 0\n");
+	REQUIRE(test::ErrorLine(run) == "runtime error: divide integer by zero !");
+}
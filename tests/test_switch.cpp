@@ -0,0 +1,166 @@
+#include "catch2/catch.hpp"
+#include "tests/run_c0.hpp"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+using namespace cc0;
+
+namespace {
+	// 分派代码的形状
+	struct Shape {
+		bool table = false;
+		bool binary = false;
+		std::size_t compares = 0;
+	};
+
+	// switch 写在第一个函数 f 里，其中没有其它的比较
+	Shape ShapeOf(const std::string& source) {
+		auto result = test::Compile(source, 0);
+		auto& code = result.funcList.front().localCode;
+		Shape shape;
+		shape.table = std::any_of(code.begin(), code.end(), [](const Instruction& ins) {
+			return ins.GetOperation() == TABLESWITCH;
+		});
+		shape.binary = std::any_of(code.begin(), code.end(), [](const Instruction& ins) {
+			return ins.GetOperation() == JGE;
+		});
+		shape.compares = static_cast<std::size_t>(std::count_if(code.begin(), code.end(), [](const Instruction& ins) {
+			return ins.GetOperation() == ICMP;
+		}));
+		return shape;
+	}
+
+	// 各个值对应的 case，没有 default；main 打印从 -1 到 last 的每个值的结果
+	std::string SwitchOf(const std::vector<int>& values, int last) {
+		std::string source = "int f(int x) {\n    switch (x) {\n";
+		for (auto value : values) {
+			source += "        case " + std::to_string(value) + ": return " + std::to_string(value * 10) + ";\n";
+		}
+		source += "    }\n    return -1;\n}\n";
+		source += "int main() {\n    int i = -1;\n";
+		source += "    while (i <= " + std::to_string(last) + ") { print(f(i)); i = i + 1; }\n";
+		source += "    return 0;\n}\n";
+		return source;
+	}
+
+	std::string Expected(const std::vector<int>& values, int last) {
+		std::string out;
+		for (int i = -1; i <= last; ++i) {
+			auto found = std::find(values.begin(), values.end(), i) != values.end();
+			out += std::to_string(found ? i * 10 : -1) + "\n";
+		}
+		return out;
+	}
+}
+
+TEST_CASE("Switch uses a table from four dense cases on.") {
+	// 值的范围不超过 case 个数的两倍
+	for (auto& values : std::vector<std::vector<int>>{{1, 2, 3, 4}, {1, 3, 5, 8}, {0, 2, 4, 6, 8, 10, 12, 15}}) {
+		auto source = SwitchOf(values, 17);
+		auto shape = ShapeOf(source);
+		REQUIRE(shape.table);
+		REQUIRE_FALSE(shape.binary);
+		REQUIRE(shape.compares == 0);
+		REQUIRE(test::RunAll(source).out == Expected(values, 17));
+	}
+}
+
+TEST_CASE("Switch compares up to three cases one by one.") {
+	for (auto& values : std::vector<std::vector<int>>{{5}, {1, 2, 3}, {1, 100, 10000}}) {
+		auto source = SwitchOf(values, 6);
+		auto shape = ShapeOf(source);
+		REQUIRE_FALSE(shape.table);
+		REQUIRE_FALSE(shape.binary);
+		REQUIRE(shape.compares == values.size());
+		REQUIRE(test::RunAll(source).out == Expected(values, 6));
+	}
+}
+
+TEST_CASE("Switch searches sparse cases by halves.") {
+	// 范围比两倍多一：二分成两组逐个比较
+	std::vector<int> sparse = {1, 3, 5, 9};
+	auto shape = ShapeOf(SwitchOf(sparse, 10));
+	REQUIRE_FALSE(shape.table);
+	REQUIRE(shape.binary);
+	REQUIRE(shape.compares == 5);
+	REQUIRE(test::RunAll(SwitchOf(sparse, 10)).out == Expected(sparse, 10));
+
+	// 左半边稠密，用表；右半边稀疏，逐个比较
+	std::vector<int> mixed = {1, 2, 3, 4, 20, 40, 60, 80};
+	shape = ShapeOf(SwitchOf(mixed, 81));
+	REQUIRE(shape.table);
+	REQUIRE(shape.binary);
+	REQUIRE(test::RunAll(SwitchOf(mixed, 81)).out == Expected(mixed, 81));
+}
+
+TEST_CASE("Switch falls through and leaves without default on every engine.") {
+	// 三种分派方式各一个，都没有 default；没有 break 的 case 继续执行下一个
+	const std::string source =
+		"int table(int x) {\n"
+		"    int s = 0;\n"
+		"    switch (x) {\n"
+		"        case 1: s = s + 1;\n"
+		"        case 2: { s = s + 10; break; }\n"
+		"        case 3: ;\n"
+		"        case 4: s = s + 100;\n"
+		"        case 6: s = s + 1000;\n"
+		"    }\n"
+		"    return s;\n"
+		"}\n"
+		"int linear(int x) {\n"
+		"    int s = 0;\n"
+		"    switch (x) {\n"
+		"        case 1: s = s + 1;\n"
+		"        case 50: s = s + 10;\n"
+		"        case 900: { s = s + 100; break; }\n"
+		"    }\n"
+		"    return s;\n"
+		"}\n"
+		"int binary(int x) {\n"
+		"    int s = 0;\n"
+		"    switch (x) {\n"
+		"        case 1: s = s + 1;\n"
+		"        case 30: { s = s + 10; break; }\n"
+		"        case 500: s = s + 100;\n"
+		"        case 7000: s = s + 1000;\n"
+		"        case 80000: s = s + 10000;\n"
+		"    }\n"
+		"    return s;\n"
+		"}\n"
+		"int main() {\n"
+		"    print(table(0), table(1), table(2), table(3), table(4), table(5), table(6), table(7));\n"
+		"    print(linear(0), linear(1), linear(50), linear(900), linear(901));\n"
+		"    print(binary(0), binary(1), binary(30), binary(500), binary(7000), binary(80000), binary(80001));\n"
+		"    return 0;\n"
+		"}\n";
+	auto run = test::RunAll(source);
+	REQUIRE(run.out ==
+		"0 11 10 1100 1100 0 1000 0\n"
+		"0 111 110 100 0\n"
+		"0 11 10 11100 11000 10000 0\n");
+	REQUIRE(run.err.empty());
+}
+
+TEST_CASE("Switch tables survive the text and binary files.") {
+	std::vector<int> values = {7, 8, 9, 11};
+	auto source = SwitchOf(values, 12);
+	auto result = test::Compile(source, 0);
+	REQUIRE(ShapeOf(source).table);
+	auto file = Assemble(result);
+	auto expected = test::ExecuteAll(file);
+	REQUIRE(expected.out == Expected(values, 12));
+
+	// -s 写出的 tableswitch low, count 由 -r 原样读回
+	auto text = test::Text(result);
+	REQUIRE(text.find("tableswitch 7, 5") != std::string::npos);
+	auto fromText = test::ParseText(text);
+	REQUIRE(test::Binary(fromText) == test::Binary(file));
+	REQUIRE(test::ExecuteAll(fromText).out == expected.out);
+
+	auto bytes = test::Binary(file);
+	auto fromBinary = test::ParseBinary(bytes);
+	REQUIRE(test::Binary(fromBinary) == bytes);
+	REQUIRE(test::ExecuteAll(fromBinary).out == expected.out);
+}
@@ -0,0 +1,85 @@
+#include "catch2/catch.hpp"
+#include "tests/run_c0.hpp"
+
+#include "analyser/symbol_table.h"
+
+#include <string>
+
+using cc0::SymbolTable;
+
+TEST_CASE("Symbol table shadows outer scopes and restores them.") {
+	SymbolTable<int> table;
+	REQUIRE(table.Depth() == 0);
+	REQUIRE(table.Declare("x", 1));
+	REQUIRE(table.Declare("y", 2));
+	REQUIRE_FALSE(table.Declare("x", 3));
+	REQUIRE(table.Find("x")->value == 1);
+	REQUIRE(table.Find("z") == nullptr);
+
+	table.PushScope();
+	REQUIRE(table.Depth() == 1);
+	REQUIRE(table.Size() == 0);
+	REQUIRE(table.Declare("x", 10));
+	REQUIRE(table.Declare("z", 30));
+	REQUIRE_FALSE(table.Declare("z", 31));
+	REQUIRE(table.Find("x")->value == 10);
+	REQUIRE(table.Find("x")->scope == 1);
+	REQUIRE(table.Find("y")->scope == 0);
+	REQUIRE(table.FindIn("x", 0)->value == 1);
+	REQUIRE(table.FindIn("y", 1) == nullptr);
+	REQUIRE(table.Size() == 2);
+
+	table.PopScope();
+	REQUIRE(table.Depth() == 0);
+	REQUIRE(table.Find("x")->value == 1);
+	REQUIRE(table.Find("z") == nullptr);
+	REQUIRE(table.Size() == 2);
+	// 最外层不会被弹出
+	table.PopScope();
+	REQUIRE(table.Find("y")->value == 2);
+
+	table.Clear();
+	REQUIRE(table.Find("x") == nullptr);
+	REQUIRE(table.Size() == 0);
+}
+
+TEST_CASE("Copied symbol tables are independent.") {
+	SymbolTable<int> table;
+	table.Declare("g", 0);
+	table.PushScope();
+	table.Declare("g", 1);
+	table.Declare("l", 2);
+
+	SymbolTable<int> copy(table);
+	// 大量插入会让副本的哈希表重新散列，各层记录的名字仍然要有效
+	for (int i = 0; i < 1000; ++i) {
+		copy.Declare("v" + std::to_string(i), i);
+	}
+	copy.PopScope();
+	REQUIRE(copy.Find("g")->value == 0);
+	REQUIRE(copy.Find("l") == nullptr);
+	REQUIRE(copy.Find("v999") == nullptr);
+	REQUIRE(table.Find("g")->value == 1);
+	REQUIRE(table.Find("l")->value == 2);
+
+	copy = table;
+	table.PopScope();
+	REQUIRE(copy.Find("g")->value == 1);
+	copy.PopScope();
+	REQUIRE(copy.Find("g")->value == 0);
+	REQUIRE(copy.Find("l") == nullptr);
+}
+
+TEST_CASE("Locals shadow globals of the same name.") {
+	std::string source = "int x = 1;\n";
+	// 很多全局变量，查找不随符号个数变慢
+	for (int i = 0; i < 3000; ++i) {
+		source += "int g" + std::to_string(i) + " = " + std::to_string(i) + ";\n";
+	}
+	source +=
+		"int f() { int x = 2; return x + g2999; }\n"
+		"int main() { print(f(), x, g7); return 0; }\n";
+	auto run = cc0::test::RunAll(source);
+	REQUIRE(run.out == "3001 1 7\n");
+	REQUIRE(run.err.empty());
+}
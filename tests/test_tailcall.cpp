@@ -0,0 +1,62 @@
+#include "catch2/catch.hpp"
+#include "tests/run_c0.hpp"
+
+#include <algorithm>
+#include <string>
+
+using namespace cc0;
+
+namespace {
+	// 第 index 个函数中 op 的条数
+	std::size_t Count(const resultInfo& result, std::size_t index, Operation op) {
+		auto& code = result.funcList[index].localCode;
+		return static_cast<std::size_t>(std::count_if(code.begin(), code.end(), [op](const Instruction& ins) {
+			return ins.GetOperation() == op;
+		}));
+	}
+
+	// 每一层只用几个单元，64 个单元的栈放不下十万层
+	const vm::VM::Limits small{64, 0};
+}
+
+TEST_CASE("Tail calls run in constant stack on every engine.") {
+	const std::string source =
+		"int loop(int n, int acc) {\n"
+		"    if (n == 0) return acc;\n"
+		"    return loop(n - 1, acc + n);\n"
+		"}\n"
+		"int main() { print(loop(100000, 0)); return 0; }\n";
+	for (int level = 0; level <= 2; ++level) {
+		INFO("level " << level);
+		auto result = test::Compile(source, level);
+		REQUIRE(Count(result, 0, TAILCALL) == 1);
+		REQUIRE(Count(result, 0, CALL) == 0);
+	}
+	// 100000 * 100001 / 2 对 2^32 取模
+	auto run = test::RunAll(source, small);
+	REQUIRE(run.out == "705082704\n");
+	REQUIRE(run.err.empty());
+}
+
+TEST_CASE("Tail calls replace frames of a different size.") {
+	auto run = test::RunAll(
+		"int sum(int a, int b, int c) { int t = a + b; return t + c; }\n"
+		"int down(int n) {\n"
+		"    if (n == 0) return sum(1, 2, 3);\n"
+		"    return down(n - 1);\n"
+		"}\n"
+		"int main() { print(down(50000)); return 0; }\n", small);
+	REQUIRE(run.out == "6\n");
+	REQUIRE(run.err.empty());
+}
+
+TEST_CASE("Calls followed by more work still overflow.") {
+	const std::string source =
+		"int d(int n) { if (n == 0) return 0; return d(n - 1) + 1; }\n"
+		"int main() { print(d(10)); print(d(100000)); return 0; }\n";
+	auto result = test::Compile(source, 0);
+	REQUIRE(Count(result, 0, TAILCALL) == 0);
+	auto run = test::RunAll(source, small);
+	REQUIRE(run.out == "10\n");
+	REQUIRE(test::ErrorLine(run) == "runtime error: stack overflow !");
+}
@@ -1,8 +1,15 @@
 #include "catch2/catch.hpp"
+#include "tests/run_c0.hpp"
 #include "tokenizer/tokenizer.h"
+#include "tokenizer/lexer_tables.h"
+#include "fmts.hpp"
 #include "fmt/core.h"
 
+#include <cstdint>
+#include <fstream>
 #include <sstream>
+#include <string>
+#include <utility>
 #include <vector>
 
 // 下面是示例如何书写测试用例
@@ -24,4 +31,353 @@ TEST_CASE("Test hello world.") {
 	}
 	REQUIRE( (result.first == output) );
 	*/
-}
\ No newline at end of file
+}
+namespace {
+	// 写入临时文件，返回路径
+	std::string WriteFile(const std::string& name, const std::string& content) {
+		auto path = cc0::test::TempPath(name);
+		std::ofstream(path, std::ios::binary | std::ios::trunc) << content;
+		return path;
+	}
+
+	std::string Content(const cc0::SourceBuffer& source) {
+		return std::string(source.begin(), source.end());
+	}
+
+	std::vector<cc0::Token> TokensOf(cc0::SourceBuffer source) {
+		cc0::Tokenizer tkz(std::move(source));
+		auto result = tkz.AllTokens();
+		REQUIRE_FALSE(result.second.has_value());
+		return result.first;
+	}
+}
+
+TEST_CASE("Source buffers map files and read streams alike.") {
+	const std::string text = "int main() {\n    print(\"x\");\n    return 0;\n}";
+	std::istringstream stream(text);
+	auto read = cc0::SourceBuffer::FromStream(stream);
+	// 最后一行补上换行
+	REQUIRE(Content(read) == text + "\n");
+
+	// 以换行结尾的文件直接映射，否则读入后补上换行，两者的内容和 token 都相同
+	for (auto& content : {text + "\n", text}) {
+		auto source = cc0::SourceBuffer::FromFile(WriteFile("source.c0", content));
+		REQUIRE(source.has_value());
+		REQUIRE(Content(*source) == text + "\n");
+		std::istringstream again(content);
+		REQUIRE(TokensOf(std::move(*source)) == TokensOf(cc0::SourceBuffer::FromStream(again)));
+	}
+
+	auto empty = cc0::SourceBuffer::FromFile(WriteFile("empty.c0", ""));
+	REQUIRE(empty.has_value());
+	REQUIRE(empty->size() == 0);
+	REQUIRE(TokensOf(std::move(*empty)).empty());
+	REQUIRE_FALSE(cc0::SourceBuffer::FromFile(cc0::test::TempPath("missing/none.c0")).has_value());
+}
+
+TEST_CASE("Source buffers find positions in any order.") {
+	auto source = cc0::SourceBuffer::FromFile(WriteFile("lines.c0", "ab\n\ncde\n"));
+	REQUIRE(source.has_value());
+	using Position = std::pair<std::uint64_t, std::uint64_t>;
+	REQUIRE(source->Position(6) == Position{2, 2});
+	REQUIRE(source->Position(0) == Position{0, 0});
+	REQUIRE(source->Position(2) == Position{0, 2});
+	REQUIRE(source->Position(3) == Position{1, 0});
+	REQUIRE(source->Position(4) == Position{2, 0});
+	// 文件尾是最后一行之后
+	REQUIRE(source->Position(8) == Position{3, 0});
+	REQUIRE(source->Position(100) == Position{3, 0});
+
+	// 移动之后原来的缓冲区为空，映射只释放一次
+	auto moved = std::move(*source);
+	REQUIRE(source->size() == 0);
+	REQUIRE(Content(moved) == "ab\n\ncde\n");
+	REQUIRE(moved.Position(5) == Position{2, 1});
+}
+
+TEST_CASE("Compact tokens expand to the full tokens.") {
+	const std::string text =
+		"int count = 0x1F, big = 4294967296;\n"
+		"int main() { count = count + 2147483647; print(\"count\", 'c'); return 0; }\n";
+	std::istringstream full(text), compact(text);
+	auto expected = TokensOf(cc0::SourceBuffer::FromStream(full));
+	cc0::Tokenizer tkz(compact);
+	auto tokens = tkz.AllCompactTokens();
+	REQUIRE_FALSE(tokens.second.has_value());
+	auto& list = tokens.first;
+	REQUIRE(list.size() == expected.size());
+	for (std::size_t i = 0; i < list.size(); ++i) {
+		INFO("token " << i);
+		REQUIRE(list.Expand(list[i].Get()) == expected[i]);
+		REQUIRE(list[i].GetValueString() == expected[i].GetValueString());
+		REQUIRE(list[i].GetStartPos() == expected[i].GetStartPos());
+		REQUIRE(list[i].GetEndPos() == expected[i].GetEndPos());
+	}
+
+	// 相同的文本驻留为同一个编号；字符串连同引号一起驻留，与同名的标识符不同
+	REQUIRE(list[1].GetType() == cc0::IDENTIFIER);
+	REQUIRE(list[1].Get().payload == list[14].Get().payload);
+	REQUIRE(list[1].Get().payload == list[16].Get().payload);
+	REQUIRE(list[22].GetType() == cc0::STRING);
+	REQUIRE(list.Text(list[22].Get()) == "\"count\"");
+	REQUIRE(list[22].Get().payload != list[1].Get().payload);
+
+	// 整数的值直接存在 payload 中，超出 int32 的保留原文本，留给语法分析报错
+	std::int32_t value = 0;
+	REQUIRE(list[3].GetType() == cc0::HEXADECIMAL_INTEGER);
+	REQUIRE(list[3].GetIntValue(value));
+	REQUIRE(value == 31);
+	REQUIRE(list[7].Get().overflow);
+	REQUIRE_FALSE(list[7].GetIntValue(value));
+	REQUIRE(list[7].GetValueString() == "4294967296");
+	REQUIRE(list[18].GetIntValue(value));
+	REQUIRE(value == 2147483647);
+}
+
+TEST_CASE("Block scanning finds the same ends as scanning bytes.") {
+	auto& scalar = cc0::ScalarKernels();
+	auto& best = cc0::BestKernels();
+	INFO("kernels " << best.name);
+	using Kernel = const char* (*)(const char*, const char*);
+	std::vector<std::pair<Kernel, Kernel>> kernels = {
+		{scalar.whitespace, best.whitespace},
+		{scalar.identifier, best.identifier},
+		{scalar.digits, best.digits},
+		{scalar.lineEnd, best.lineEnd},
+		{scalar.commentEnd, best.commentEnd},
+		{scalar.stringRun, best.stringRun},
+	};
+	// 每类字符连续出现，中间夹着结束它们的字符；\x80 以上的字节不属于任何一类
+	std::string text;
+	for (int run = 0; run < 70; ++run) {
+		text += std::string(run, " \t\n\v\f\r"[run % 6]);
+		text += std::string(run, "aZ9_x"[run % 5]);
+		text += std::string(run, '7');
+		text += run % 3 == 0 ? "*/" : run % 3 == 1 ? "\"\\" : "\x80\xff*";
+		text += "\n";
+	}
+	for (std::size_t k = 0; k < kernels.size(); ++k) {
+		INFO("kernel " << k);
+		for (std::size_t begin = 0; begin < text.size(); begin += 7) {
+			for (std::size_t length : {std::size_t{0}, std::size_t{1}, std::size_t{15}, std::size_t{16}, std::size_t{31},
+			                           std::size_t{32}, std::size_t{33}, std::size_t{100}}) {
+				auto p = text.data() + begin;
+				auto end = text.data() + std::min(text.size(), begin + length);
+				REQUIRE(kernels[k].first(p, end) == kernels[k].second(p, end));
+			}
+		}
+	}
+}
+
+TEST_CASE("Tokens are the same with any scan kernels.") {
+	// 长的空白、注释、标识符、数字和字符串跨过多个块
+	std::string source = "int " + std::string(100, 'v') + "1 = " + std::string(9, '9') + ";\n";
+	source += std::string(70, ' ') + "/* " + std::string(90, '*') + " */\n";
+	source += "// " + std::string(80, '-') + "\n";
+	source += "int main() {\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\n";
+	source += "    print(\"" + std::string(50, 'a') + "\\n\\t\\\\\\\"" + std::string(40, '#') + "\");\n";
+	source += "    return 0x" + std::string(6, 'f') + ";\n}\n";
+	auto tokens = [&](const cc0::ScanKernels& kernels) {
+		std::istringstream input(source);
+		cc0::Tokenizer tkz(input);
+		tkz.SetScanKernels(kernels);
+		auto result = tkz.AllTokens();
+		REQUIRE_FALSE(result.second.has_value());
+		return result.first;
+	};
+	auto scalar = tokens(cc0::ScalarKernels());
+	REQUIRE(scalar.size() == 19);
+	REQUIRE(scalar[1].GetValueString() == std::string(100, 'v') + "1");
+	REQUIRE(tokens(cc0::BestKernels()) == scalar);
+}
+
+TEST_CASE("Every kind of token prints as before with -t.") {
+	// 标点的位置一直输出为 0 0，-t 的输出要与以前逐字节相同
+	std::istringstream input(
+		"const int k = 0x1F;\n"
+		"void v(char c, double d, struct s) {}\n"
+		"int main() {\n"
+		"    if (k <= 3) ; else print('a', \"s\\n\", 12 + 3 - 4 * 5 / 6);\n"
+		"    switch (k) { case 1: break; default: continue; }\n"
+		"    while (k < 1) if (k > 2) if (k >= 3) if (k != 4) if (k == 5) do scan(k); while (0);\n"
+		"    for (;;) return 0;\n"
+		"}\n");
+	cc0::Tokenizer tkz(input);
+	auto result = tkz.AllTokens();
+	REQUIRE_FALSE(result.second.has_value());
+	std::string printed;
+	for (auto& token : result.first) {
+		printed += fmt::format("{}\n", token);
+	}
+	REQUIRE(printed ==
+		"Line: 0 Column: 0 Type: CONST Value: const\n"
+		"Line: 0 Column: 6 Type: INT Value: int\n"
+		"Line: 0 Column: 10 Type: IDENTIFIER Value: k\n"
+		"Line: 0 Column: 12 Type: EQUAL_SIGN Value: =\n"
+		"Line: 0 Column: 14 Type: HEXADECIMAL_INTEGER Value: 31\n"
+		"Line: 0 Column: 0 Type: SEMICOLON Value: ;\n"
+		"Line: 1 Column: 0 Type: VOID Value: void\n"
+		"Line: 1 Column: 5 Type: IDENTIFIER Value: v\n"
+		"Line: 0 Column: 0 Type: LEFT_PARENTHESIS Value: (\n"
+		"Line: 1 Column: 7 Type: CHARtype Value: char\n"
+		"Line: 1 Column: 12 Type: IDENTIFIER Value: c\n"
+		"Line: 0 Column: 0 Type: COMMA Value: ,\n"
+		"Line: 1 Column: 15 Type: DOUBLE Value: double\n"
+		"Line: 1 Column: 22 Type: IDENTIFIER Value: d\n"
+		"Line: 0 Column: 0 Type: COMMA Value: ,\n"
+		"Line: 1 Column: 25 Type: STRUCT Value: struct\n"
+		"Line: 1 Column: 32 Type: IDENTIFIER Value: s\n"
+		"Line: 0 Column: 0 Type: RIGHT_PARENTHESIS Value: )\n"
+		"Line: 0 Column: 0 Type: LEFT_BRACE Value: {\n"
+		"Line: 0 Column: 0 Type: RIGHT_BRACE Value: }\n"
+		"Line: 2 Column: 0 Type: INT Value: int\n"
+		"Line: 2 Column: 4 Type: IDENTIFIER Value: main\n"
+		"Line: 0 Column: 0 Type: LEFT_PARENTHESIS Value: (\n"
+		"Line: 0 Column: 0 Type: RIGHT_PARENTHESIS Value: )\n"
+		"Line: 0 Column: 0 Type: LEFT_BRACE Value: {\n"
+		"Line: 3 Column: 4 Type: IF Value: if\n"
+		"Line: 0 Column: 0 Type: LEFT_PARENTHESIS Value: (\n"
+		"Line: 3 Column: 8 Type: IDENTIFIER Value: k\n"
+		"Line: 3 Column: 10 Type: LESS_EQUAL_SIGN Value: <=\n"
+		"Line: 3 Column: 13 Type: DECIMAL_INTEGER Value: 3\n"
+		"Line: 0 Column: 0 Type: RIGHT_PARENTHESIS Value: )\n"
+		"Line: 0 Column: 0 Type: SEMICOLON Value: ;\n"
+		"Line: 3 Column: 18 Type: ELSE Value: else\n"
+		"Line: 3 Column: 23 Type: PRINT Value: print\n"
+		"Line: 0 Column: 0 Type: LEFT_PARENTHESIS Value: (\n"
+		"Line: 3 Column: 29 Type: CHAR Value: 'a'\n"
+		"Line: 0 Column: 0 Type: COMMA Value: ,\n"
+		"Line: 3 Column: 34 Type: STRING Value: \"s\\n\"\n"
+		"Line: 0 Column: 0 Type: COMMA Value: ,\n"
+		"Line: 3 Column: 41 Type: DECIMAL_INTEGER Value: 12\n"
+		"Line: 0 Column: 0 Type: PLUS_SIGN Value: +\n"
+		"Line: 3 Column: 46 Type: DECIMAL_INTEGER Value: 3\n"
+		"Line: 0 Column: 0 Type: MINUS_SIGN Value: -\n"
+		"Line: 3 Column: 50 Type: DECIMAL_INTEGER Value: 4\n"
+		"Line: 0 Column: 0 Type: MULTIPLICATION_SIGN Value: *\n"
+		"Line: 3 Column: 54 Type: DECIMAL_INTEGER Value: 5\n"
+		"Line: 3 Column: 56 Type: DIVISION_SIGN Value: /\n"
+		"Line: 3 Column: 58 Type: DECIMAL_INTEGER Value: 6\n"
+		"Line: 0 Column: 0 Type: RIGHT_PARENTHESIS Value: )\n"
+		"Line: 0 Column: 0 Type: SEMICOLON Value: ;\n"
+		"Line: 4 Column: 4 Type: SWITCH Value: switch\n"
+		"Line: 0 Column: 0 Type: LEFT_PARENTHESIS Value: (\n"
+		"Line: 4 Column: 12 Type: IDENTIFIER Value: k\n"
+		"Line: 0 Column: 0 Type: RIGHT_PARENTHESIS Value: )\n"
+		"Line: 0 Column: 0 Type: LEFT_BRACE Value: {\n"
+		"Line: 4 Column: 17 Type: CASE Value: case\n"
+		"Line: 4 Column: 22 Type: DECIMAL_INTEGER Value: 1\n"
+		"Line: 0 Column: 0 Type: COLON Value: :\n"
+		"Line: 4 Column: 25 Type: BREAK Value: break\n"
+		"Line: 0 Column: 0 Type: SEMICOLON Value: ;\n"
+		"Line: 4 Column: 32 Type: DEFAULT Value: default\n"
+		"Line: 0 Column: 0 Type: COLON Value: :\n"
+		"Line: 4 Column: 41 Type: CONTINUE Value: continue\n"
+		"Line: 0 Column: 0 Type: SEMICOLON Value: ;\n"
+		"Line: 0 Column: 0 Type: RIGHT_BRACE Value: }\n"
+		"Line: 5 Column: 4 Type: WHILE Value: while\n"
+		"Line: 0 Column: 0 Type: LEFT_PARENTHESIS Value: (\n"
+		"Line: 5 Column: 11 Type: IDENTIFIER Value: k\n"
+		"Line: 5 Column: 13 Type: LESS_SIGN Value: <\n"
+		"Line: 5 Column: 15 Type: DECIMAL_INTEGER Value: 1\n"
+		"Line: 0 Column: 0 Type: RIGHT_PARENTHESIS Value: )\n"
+		"Line: 5 Column: 18 Type: IF Value: if\n"
+		"Line: 0 Column: 0 Type: LEFT_PARENTHESIS Value: (\n"
+		"Line: 5 Column: 22 Type: IDENTIFIER Value: k\n"
+		"Line: 5 Column: 24 Type: MORE_SIGN Value: >\n"
+		"Line: 5 Column: 26 Type: DECIMAL_INTEGER Value: 2\n"
+		"Line: 0 Column: 0 Type: RIGHT_PARENTHESIS Value: )\n"
+		"Line: 5 Column: 29 Type: IF Value: if\n"
+		"Line: 0 Column: 0 Type: LEFT_PARENTHESIS Value: (\n"
+		"Line: 5 Column: 33 Type: IDENTIFIER Value: k\n"
+		"Line: 5 Column: 35 Type: MORE_EQUAL_SIGN Value: >=\n"
+		"Line: 5 Column: 38 Type: DECIMAL_INTEGER Value: 3\n"
+		"Line: 0 Column: 0 Type: RIGHT_PARENTHESIS Value: )\n"
+		"Line: 5 Column: 41 Type: IF Value: if\n"
+		"Line: 0 Column: 0 Type: LEFT_PARENTHESIS Value: (\n"
+		"Line: 5 Column: 45 Type: IDENTIFIER Value: k\n"
+		"Line: 5 Column: 47 Type: NOT_EQUAL_SIGN Value: !=\n"
+		"Line: 5 Column: 50 Type: DECIMAL_INTEGER Value: 4\n"
+		"Line: 0 Column: 0 Type: RIGHT_PARENTHESIS Value: )\n"
+		"Line: 5 Column: 53 Type: IF Value: if\n"
+		"Line: 0 Column: 0 Type: LEFT_PARENTHESIS Value: (\n"
+		"Line: 5 Column: 57 Type: IDENTIFIER Value: k\n"
+		"Line: 5 Column: 59 Type: VALUE_EQUAL_SIGN Value: ==\n"
+		"Line: 5 Column: 62 Type: DECIMAL_INTEGER Value: 5\n"
+		"Line: 0 Column: 0 Type: RIGHT_PARENTHESIS Value: )\n"
+		"Line: 5 Column: 65 Type: DO Value: do\n"
+		"Line: 5 Column: 68 Type: SCAN Value: scan\n"
+		"Line: 0 Column: 0 Type: LEFT_PARENTHESIS Value: (\n"
+		"Line: 5 Column: 73 Type: IDENTIFIER Value: k\n"
+		"Line: 0 Column: 0 Type: RIGHT_PARENTHESIS Value: )\n"
+		"Line: 0 Column: 0 Type: SEMICOLON Value: ;\n"
+		"Line: 5 Column: 77 Type: WHILE Value: while\n"
+		"Line: 0 Column: 0 Type: LEFT_PARENTHESIS Value: (\n"
+		"Line: 5 Column: 84 Type: DECIMAL_INTEGER Value: 0\n"
+		"Line: 0 Column: 0 Type: RIGHT_PARENTHESIS Value: )\n"
+		"Line: 0 Column: 0 Type: SEMICOLON Value: ;\n"
+		"Line: 6 Column: 4 Type: FOR Value: for\n"
+		"Line: 0 Column: 0 Type: LEFT_PARENTHESIS Value: (\n"
+		"Line: 0 Column: 0 Type: SEMICOLON Value: ;\n"
+		"Line: 0 Column: 0 Type: SEMICOLON Value: ;\n"
+		"Line: 0 Column: 0 Type: RIGHT_PARENTHESIS Value: )\n"
+		"Line: 6 Column: 13 Type: RETURN Value: return\n"
+		"Line: 6 Column: 20 Type: DECIMAL_INTEGER Value: 0\n"
+		"Line: 0 Column: 0 Type: SEMICOLON Value: ;\n"
+		"Line: 0 Column: 0 Type: RIGHT_BRACE Value: }\n");
+}
+
+TEST_CASE("Keywords are found by their perfect hash.") {
+	for (auto& keyword : cc0::lexer::Keywords) {
+		INFO(keyword.spelling);
+		REQUIRE(cc0::lexer::keywordOf(keyword.spelling) == keyword.type);
+	}
+	REQUIRE(cc0::lexer::keywordOf("char") == cc0::CHART);
+	// 与某个关键字的哈希相同，或者只差一个字母、大小写和长度的都是标识符
+	for (auto word : {"i", "in", "int_", "Int", "INT", "iff", "fi", "ese", "eelse", "cas", "cast", "whilE",
+	                  "doo", "d", "printf", "scanf", "continu", "continues", "struc", "voids", "defaulT", "_if"}) {
+		INFO(word);
+		REQUIRE(cc0::lexer::keywordOf(word) == cc0::IDENTIFIER);
+	}
+	std::istringstream input("if iff int1 print printf");
+	cc0::Tokenizer tkz(input);
+	auto result = tkz.AllTokens();
+	REQUIRE_FALSE(result.second.has_value());
+	std::vector<cc0::TokenType> types;
+	for (auto& token : result.first) {
+		types.push_back(token.GetType());
+	}
+	REQUIRE(types == std::vector<cc0::TokenType>{cc0::IF, cc0::IDENTIFIER, cc0::IDENTIFIER, cc0::PRINT, cc0::IDENTIFIER});
+}
+
+TEST_CASE("The lexer reports malformed input where it starts.") {
+	std::vector<std::pair<std::string, cc0::CompilationError>> cases = {
+		{"a ! b", {0, 2, cc0::ErrWrongSign}},
+		{"x = 09;", {0, 4, cc0::ErrWrongNum}},
+		{"0x", {0, 0, cc0::ErrWrongNum}},
+		{"0xg", {0, 0, cc0::ErrInvalidIdentifier}},
+		{"\n 0x1G", {1, 1, cc0::ErrInvalidIdentifier}},
+		{"12abc", {0, 0, cc0::ErrInvalidIdentifier}},
+		{"'ab'", {0, 0, cc0::ErrWrongChar}},
+		{"s = \"abc", {0, 4, cc0::ErrWrongString}},
+		{"/* x", {0, 0, cc0::ErrWrongComment}},
+		// 不能开始 token 的字符在初始状态就失败，位置沿用函数开始时的 0
+		{"int @", {0, 0, cc0::ErrInvalidInput}},
+		{"int_", {0, 0, cc0::ErrInvalidInput}},
+	};
+	for (auto& [source, error] : cases) {
+		INFO(source);
+		std::istringstream input(source);
+		cc0::Tokenizer tkz(input);
+		auto result = tkz.AllTokens();
+		REQUIRE(result.second.has_value());
+		REQUIRE(result.second.value() == error);
+	}
+	// 大写的 0X 和超出 int 的数由后面的分析检查
+	std::istringstream input("0X1f 2147483648");
+	cc0::Tokenizer tkz(input);
+	auto result = tkz.AllTokens();
+	REQUIRE_FALSE(result.second.has_value());
+	REQUIRE(result.first.size() == 2);
+	REQUIRE(result.first[0].GetValueString() == "31");
+}
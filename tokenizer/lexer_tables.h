@@ -0,0 +1,237 @@
+#pragma once
+
+#include "tokenizer/token.h"
+#include "error/error.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// 词法分析用到的所有表，全部在编译期生成
+// 状态机在 Tokenizer::nextToken 中执行，字符和字符串字面量、注释由专门的循环处理
+namespace cc0::lexer {
+
+	// 字符类别
+	enum CharClass : std::uint8_t {
+		OTHER_CLASS, // 不能开始一个 token 的字符，包括不可打印的字符
+		SPACE_CLASS,
+		ZERO_CLASS,
+		DIGIT_CLASS, // 1-9
+		HEX_LETTER_CLASS, // a-f A-F
+		X_CLASS, // x X
+		LETTER_CLASS, // 其他字母
+		LESS_CLASS,
+		MORE_CLASS,
+		POINT_CLASS, // !
+		EQUAL_CLASS,
+		SLASH_CLASS,
+		STAR_CLASS,
+		SINGLE_QUOTATION_CLASS,
+		DOUBLE_QUOTATION_CLASS,
+		SINGLE_CLASS, // 其他单字符的符号
+		CLASS_COUNT
+	};
+
+	// 状态机的所有状态，字符和字符串字面量不在其中
+	enum DFAState : std::uint8_t {
+		INITIAL_STATE,
+		ZERO_STATE, // 读到了开头的 0，可能是十六进制
+		DECIMAL_INTEGER_STATE,
+		HEXADECIMAL_INTEGER_STATE,
+		IDENTIFIER_STATE,
+		LESS_SIGN_STATE,
+		MORE_SIGN_STATE,
+		POINT_SIGN_STATE,
+		EQUAL_SIGN_STATE,
+		SLASH_SIGN_STATE,
+		STATE_COUNT
+	};
+
+	enum Action : std::uint8_t {
+		FAIL_ACTION, // 退回字符并报错，错误码为 arg
+		SKIP_ACTION, // 跳过空白，停留在初始状态
+		SHIFT_ACTION, // 读入字符，转到 arg 状态
+		ACCEPT_ACTION, // 退回字符，以当前状态对应的 token 结束
+		ACCEPT_WITH_ACTION, // 读入字符，以类型为 arg 的 token 结束
+		SINGLE_ACTION, // 单字符的 token，类型见 SingleTokens
+		CHAR_ACTION, // 字符字面量
+		STRING_ACTION, // 字符串字面量
+		LINE_COMMENT_ACTION,
+		BLOCK_COMMENT_ACTION,
+	};
+
+	struct Transition {
+		Action action;
+		std::uint8_t arg;
+	};
+
+	constexpr std::array<CharClass, 256> makeCharClasses() {
+		std::array<CharClass, 256> table{};
+		for (int ch = 'a'; ch <= 'z'; ++ch) {
+			table[ch] = LETTER_CLASS;
+			table[ch - 'a' + 'A'] = LETTER_CLASS;
+		}
+		for (int ch = 'a'; ch <= 'f'; ++ch) {
+			table[ch] = HEX_LETTER_CLASS;
+			table[ch - 'a' + 'A'] = HEX_LETTER_CLASS;
+		}
+		table['x'] = table['X'] = X_CLASS;
+		table['0'] = ZERO_CLASS;
+		for (int ch = '1'; ch <= '9'; ++ch) {
+			table[ch] = DIGIT_CLASS;
+		}
+		// 与 C locale 下的 isspace 相同
+		for (int ch : {' ', '\t', '\n', '\v', '\f', '\r'}) {
+			table[ch] = SPACE_CLASS;
+		}
+		table['<'] = LESS_CLASS;
+		table['>'] = MORE_CLASS;
+		table['!'] = POINT_CLASS;
+		table['='] = EQUAL_CLASS;
+		table['/'] = SLASH_CLASS;
+		table['*'] = STAR_CLASS;
+		table['\''] = SINGLE_QUOTATION_CLASS;
+		table['\"'] = DOUBLE_QUOTATION_CLASS;
+		for (int ch : {'+', '-', ',', ';', ':', '(', ')', '{', '}'}) {
+			table[ch] = SINGLE_CLASS;
+		}
+		return table;
+	}
+
+	constexpr std::array<TokenType, 256> makeSingleTokens() {
+		std::array<TokenType, 256> table{};
+		table['+'] = PLUS_SIGN;
+		table['-'] = MINUS_SIGN;
+		table['*'] = MULTIPLICATION_SIGN;
+		table[','] = COMMA;
+		table[';'] = SEMICOLON;
+		table[':'] = COLON;
+		table['('] = LEFT_PARENTHESIS;
+		table[')'] = RIGHT_PARENTHESIS;
+		table['{'] = LEFT_BRACE;
+		table['}'] = RIGHT_BRACE;
+		return table;
+	}
+
+	constexpr std::array<std::array<Transition, CLASS_COUNT>, STATE_COUNT> makeTransitions() {
+		std::array<std::array<Transition, CLASS_COUNT>, STATE_COUNT> table{};
+		// 默认在下一个字符处结束当前的 token
+		for (auto& row : table) {
+			for (auto& t : row) {
+				t = Transition{ACCEPT_ACTION, 0};
+			}
+		}
+
+		auto& initial = table[INITIAL_STATE];
+		for (auto& t : initial) {
+			t = Transition{FAIL_ACTION, ErrInvalidInput};
+		}
+		initial[SPACE_CLASS] = Transition{SKIP_ACTION, 0};
+		initial[ZERO_CLASS] = Transition{SHIFT_ACTION, ZERO_STATE};
+		initial[DIGIT_CLASS] = Transition{SHIFT_ACTION, DECIMAL_INTEGER_STATE};
+		initial[HEX_LETTER_CLASS] = initial[X_CLASS] = initial[LETTER_CLASS] = Transition{SHIFT_ACTION, IDENTIFIER_STATE};
+		initial[LESS_CLASS] = Transition{SHIFT_ACTION, LESS_SIGN_STATE};
+		initial[MORE_CLASS] = Transition{SHIFT_ACTION, MORE_SIGN_STATE};
+		initial[POINT_CLASS] = Transition{SHIFT_ACTION, POINT_SIGN_STATE};
+		initial[EQUAL_CLASS] = Transition{SHIFT_ACTION, EQUAL_SIGN_STATE};
+		initial[SLASH_CLASS] = Transition{SHIFT_ACTION, SLASH_SIGN_STATE};
+		initial[STAR_CLASS] = initial[SINGLE_CLASS] = Transition{SINGLE_ACTION, 0};
+		initial[SINGLE_QUOTATION_CLASS] = Transition{CHAR_ACTION, 0};
+		initial[DOUBLE_QUOTATION_CLASS] = Transition{STRING_ACTION, 0};
+
+		// 0 后面紧跟数字是错误的，字母则说明是以数字开头的标识符，交给 checkToken 报错
+		auto& zero = table[ZERO_STATE];
+		zero[X_CLASS] = Transition{SHIFT_ACTION, HEXADECIMAL_INTEGER_STATE};
+		zero[ZERO_CLASS] = zero[DIGIT_CLASS] = Transition{FAIL_ACTION, ErrWrongNum};
+		zero[HEX_LETTER_CLASS] = zero[LETTER_CLASS] = Transition{SHIFT_ACTION, IDENTIFIER_STATE};
+
+		auto& decimal = table[DECIMAL_INTEGER_STATE];
+		decimal[ZERO_CLASS] = decimal[DIGIT_CLASS] = Transition{SHIFT_ACTION, DECIMAL_INTEGER_STATE};
+		decimal[HEX_LETTER_CLASS] = decimal[X_CLASS] = decimal[LETTER_CLASS] = Transition{SHIFT_ACTION, IDENTIFIER_STATE};
+
+		// 格式由 checkHexDigit 检查，这里只要是十六进制数字或者 x 都接受
+		auto& hex = table[HEXADECIMAL_INTEGER_STATE];
+		hex[ZERO_CLASS] = hex[DIGIT_CLASS] = hex[HEX_LETTER_CLASS] = hex[X_CLASS] = Transition{SHIFT_ACTION, HEXADECIMAL_INTEGER_STATE};
+		hex[LETTER_CLASS] = Transition{SHIFT_ACTION, IDENTIFIER_STATE};
+
+		auto& identifier = table[IDENTIFIER_STATE];
+		identifier[ZERO_CLASS] = identifier[DIGIT_CLASS] = identifier[HEX_LETTER_CLASS] = identifier[X_CLASS]
+			= identifier[LETTER_CLASS] = Transition{SHIFT_ACTION, IDENTIFIER_STATE};
+
+		table[LESS_SIGN_STATE][EQUAL_CLASS] = Transition{ACCEPT_WITH_ACTION, LESS_EQUAL_SIGN};
+		table[MORE_SIGN_STATE][EQUAL_CLASS] = Transition{ACCEPT_WITH_ACTION, MORE_EQUAL_SIGN};
+		table[EQUAL_SIGN_STATE][EQUAL_CLASS] = Transition{ACCEPT_WITH_ACTION, VALUE_EQUAL_SIGN};
+		// 单独的 ! 是错误的
+		for (auto& t : table[POINT_SIGN_STATE]) {
+			t = Transition{FAIL_ACTION, ErrWrongSign};
+		}
+		table[POINT_SIGN_STATE][EQUAL_CLASS] = Transition{ACCEPT_WITH_ACTION, NOT_EQUAL_SIGN};
+
+		table[SLASH_SIGN_STATE][SLASH_CLASS] = Transition{LINE_COMMENT_ACTION, 0};
+		table[SLASH_SIGN_STATE][STAR_CLASS] = Transition{BLOCK_COMMENT_ACTION, 0};
+		return table;
+	}
+
+	// 各状态下以 ACCEPT_ACTION 结束时 token 的类型
+	constexpr std::array<TokenType, STATE_COUNT> AcceptTokens = {
+		NULL_TOKEN,
+		DECIMAL_INTEGER,
+		DECIMAL_INTEGER,
+		HEXADECIMAL_INTEGER,
+		IDENTIFIER,
+		LESS_SIGN,
+		MORE_SIGN,
+		NULL_TOKEN,
+		EQUAL_SIGN,
+		DIVISION_SIGN,
+	};
+
+	constexpr auto CharClasses = makeCharClasses();
+	constexpr auto SingleTokens = makeSingleTokens();
+	constexpr auto Transitions = makeTransitions();
+
+	// 关键字的完美哈希：长度、首字母和末字母的组合在 32 个槽中互不冲突
+	struct Keyword {
+		std::string_view spelling;
+		TokenType type;
+	};
+
+	constexpr Keyword Keywords[] = {
+		{"const", CONST}, {"void", VOID}, {"int", INT}, {"char", CHART}, {"double", DOUBLE},
+		{"struct", STRUCT}, {"if", IF}, {"else", ELSE}, {"switch", SWITCH}, {"case", CASE},
+		{"default", DEFAULT}, {"while", WHILE}, {"for", FOR}, {"do", DO}, {"return", RETURN},
+		{"break", BREAK}, {"continue", CONTINUE}, {"print", PRINT}, {"scan", SCAN},
+	};
+
+	constexpr std::size_t keywordHash(std::string_view word) {
+		return (word.size() * 4 + static_cast<unsigned char>(word.front()) * 4
+			+ static_cast<unsigned char>(word.back()) * 5) & 31;
+	}
+
+	constexpr std::array<Keyword, 32> makeKeywordTable() {
+		std::array<Keyword, 32> table{};
+		for (auto& keyword : Keywords) {
+			table[keywordHash(keyword.spelling)] = keyword;
+		}
+		return table;
+	}
+
+	constexpr auto KeywordTable = makeKeywordTable();
+
+	constexpr bool isPerfectHash() {
+		for (auto& keyword : Keywords) {
+			if (KeywordTable[keywordHash(keyword.spelling)].type != keyword.type) {
+				return false;
+			}
+		}
+		return true;
+	}
+	static_assert(isPerfectHash(), "keywordHash has collisions, pick other multipliers");
+
+	// 关键字对应的类型，不是关键字时为 IDENTIFIER，word 不能为空
+	constexpr TokenType keywordOf(std::string_view word) {
+		auto& keyword = KeywordTable[keywordHash(word)];
+		return keyword.spelling == word ? keyword.type : IDENTIFIER;
+	}
+}
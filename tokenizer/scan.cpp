@@ -0,0 +1,72 @@
+#include "tokenizer/scan.h"
+#include "tokenizer/scan_simd.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CC0_SCAN_SSE2 1
+#endif
+
+namespace cc0 {
+
+#ifdef CC0_SCAN_AVX2
+	// 定义在 scan_avx2.cpp 中，只有 CPU 支持 AVX2 时才能调用
+	const ScanKernels& Avx2Kernels();
+#endif
+
+	namespace {
+
+#ifdef CC0_SCAN_SSE2
+		struct Sse2 {
+			using vec = __m128i;
+			static constexpr int width = 16;
+			static constexpr unsigned all = 0xffff;
+
+			static vec load(const char* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+			static vec splat(char ch) { return _mm_set1_epi8(ch); }
+			static unsigned mask(vec v) { return static_cast<unsigned>(_mm_movemask_epi8(v)); }
+			static vec eq(vec v, char ch) { return _mm_cmpeq_epi8(v, splat(ch)); }
+			static vec orv(vec a, vec b) { return _mm_or_si128(a, b); }
+			// ~a & b
+			static vec andnot(vec a, vec b) { return _mm_andnot_si128(a, b); }
+			// lo <= v <= hi（无符号），即 v - lo 不超过 hi - lo
+			static vec inRange(vec v, char lo, char hi) {
+				vec d = _mm_sub_epi8(v, splat(lo));
+				return _mm_cmpeq_epi8(_mm_min_epu8(d, splat(static_cast<char>(hi - lo))), d);
+			}
+		};
+#endif
+
+		const ScanKernels scalar{
+			"scalar",
+			scalarRun<isWhitespaceByte>,
+			scalarRun<isIdentifierByte>,
+			scalarRun<isDigitByte>,
+			scalarLineEnd,
+			scalarCommentEnd,
+			scalarRun<isStringByte>,
+		};
+
+		const ScanKernels& detect() {
+#ifdef CC0_SCAN_AVX2
+			if (__builtin_cpu_supports("avx2")) {
+				return Avx2Kernels();
+			}
+#endif
+#ifdef CC0_SCAN_SSE2
+			static const ScanKernels sse2 = SimdKernels<Sse2>::Make("sse2");
+			return sse2;
+#else
+			return scalar;
+#endif
+		}
+	}
+
+	const ScanKernels& ScalarKernels() {
+		return scalar;
+	}
+
+	const ScanKernels& BestKernels() {
+		static const ScanKernels& best = detect();
+		return best;
+	}
+}
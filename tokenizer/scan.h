@@ -0,0 +1,28 @@
+#pragma once
+
+namespace cc0 {
+
+	// 词法分析中可以成块扫描的几类字符
+	// 每个函数都返回 [p, end) 中第一个不属于该类的位置，找不到时返回 end
+	// 字符的分类与 utils.hpp 中的函数（C locale）一致
+	struct ScanKernels {
+		const char* name;
+		// 空白字符：空格和 \t \n \v \f \r
+		const char* (*whitespace)(const char* p, const char* end);
+		// 标识符中的字符：字母和数字
+		const char* (*identifier)(const char* p, const char* end);
+		// 十进制数字
+		const char* (*digits)(const char* p, const char* end);
+		// 单行注释：返回第一个 \n 的位置
+		const char* (*lineEnd)(const char* p, const char* end);
+		// 多行注释：返回第一个 */ 中 * 的位置
+		const char* (*commentEnd)(const char* p, const char* end);
+		// 字符串字面量中原样保存的字符：除 " 和 \ 以外的可打印字符
+		const char* (*stringRun)(const char* p, const char* end);
+	};
+
+	// 逐字节的实现
+	const ScanKernels& ScalarKernels();
+	// 当前机器上最快的实现，依次尝试 AVX2、SSE2，都不支持时就是 ScalarKernels()
+	const ScanKernels& BestKernels();
+}
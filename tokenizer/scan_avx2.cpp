@@ -0,0 +1,37 @@
+// 这个文件以 -mavx2 编译，其中的代码只能在 BestKernels() 检测到 AVX2 后执行
+// 不要在这里包含标准库头文件，见 scan_simd.hpp
+
+#include "tokenizer/scan.h"
+#include "tokenizer/scan_simd.hpp"
+
+#include <immintrin.h>
+
+namespace cc0 {
+
+	namespace {
+
+		struct Avx2 {
+			using vec = __m256i;
+			static constexpr int width = 32;
+			static constexpr unsigned all = 0xffffffffu;
+
+			static vec load(const char* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+			static vec splat(char ch) { return _mm256_set1_epi8(ch); }
+			static unsigned mask(vec v) { return static_cast<unsigned>(_mm256_movemask_epi8(v)); }
+			static vec eq(vec v, char ch) { return _mm256_cmpeq_epi8(v, splat(ch)); }
+			static vec orv(vec a, vec b) { return _mm256_or_si256(a, b); }
+			// ~a & b
+			static vec andnot(vec a, vec b) { return _mm256_andnot_si256(a, b); }
+			// lo <= v <= hi（无符号），即 v - lo 不超过 hi - lo
+			static vec inRange(vec v, char lo, char hi) {
+				vec d = _mm256_sub_epi8(v, splat(lo));
+				return _mm256_cmpeq_epi8(_mm256_min_epu8(d, splat(static_cast<char>(hi - lo))), d);
+			}
+		};
+	}
+
+	const ScanKernels& Avx2Kernels() {
+		static const ScanKernels avx2 = SimdKernels<Avx2>::Make("avx2");
+		return avx2;
+	}
+}
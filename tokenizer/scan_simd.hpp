@@ -0,0 +1,167 @@
+#pragma once
+
+// ScanKernels 的实现，只由 scan.cpp 和 scan_avx2.cpp 包含
+// 两者的编译选项不同，这里的一切都放在匿名命名空间中，也不包含标准库头文件，
+// 以免同一个函数的 AVX2 版本被链接到其他地方
+
+#include "tokenizer/scan.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace cc0 {
+	namespace {
+
+		inline bool isWhitespaceByte(unsigned char ch) {
+			return ch == ' ' || (ch >= '\t' && ch <= '\r');
+		}
+
+		inline bool isDigitByte(unsigned char ch) {
+			return ch >= '0' && ch <= '9';
+		}
+
+		inline bool isIdentifierByte(unsigned char ch) {
+			return isDigitByte(ch) || ((ch | 0x20) >= 'a' && (ch | 0x20) <= 'z');
+		}
+
+		inline bool isStringByte(unsigned char ch) {
+			return ch >= ' ' && ch <= '~' && ch != '\"' && ch != '\\';
+		}
+
+		template <bool (*In)(unsigned char)>
+		const char* scalarRun(const char* p, const char* end) {
+			while (p != end && In(static_cast<unsigned char>(*p))) {
+				++p;
+			}
+			return p;
+		}
+
+		inline const char* scalarLineEnd(const char* p, const char* end) {
+			while (p != end && *p != '\n') {
+				++p;
+			}
+			return p;
+		}
+
+		inline const char* scalarCommentEnd(const char* p, const char* end) {
+			for (; p != end; ++p) {
+				if (*p == '*' && p + 1 != end && p[1] == '/') {
+					return p;
+				}
+			}
+			return end;
+		}
+
+		inline unsigned firstBit(unsigned mask) {
+#if defined(_MSC_VER)
+			unsigned long index;
+			_BitScanForward(&index, mask);
+			return index;
+#else
+			return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+		}
+
+		// V 提供一种向量宽度下的基本操作，见 scan.cpp 和 scan_avx2.cpp
+		// 很多 token 之间只有一个空格，连续的字符也不多，因此先单独检查第一个字节
+		// 整块处理之后剩下不足一块的部分交给标量实现
+		template <typename V>
+		struct SimdKernels {
+			using vec = typename V::vec;
+
+			static vec isWhitespace(vec v) {
+				return V::orv(V::eq(v, ' '), V::inRange(v, '\t', '\r'));
+			}
+
+			static vec isDigit(vec v) {
+				return V::inRange(v, '0', '9');
+			}
+
+			static vec isIdentifier(vec v) {
+				return V::orv(isDigit(v), V::inRange(V::orv(v, V::splat(0x20)), 'a', 'z'));
+			}
+
+			static vec isString(vec v) {
+				return V::andnot(V::orv(V::eq(v, '\"'), V::eq(v, '\\')), V::inRange(v, ' ', '~'));
+			}
+
+			static const char* whitespace(const char* p, const char* end) {
+				if (p != end && !isWhitespaceByte(static_cast<unsigned char>(*p))) {
+					return p;
+				}
+				for (; end - p >= V::width; p += V::width) {
+					unsigned stop = ~V::mask(isWhitespace(V::load(p))) & V::all;
+					if (stop != 0) {
+						return p + firstBit(stop);
+					}
+				}
+				return scalarRun<isWhitespaceByte>(p, end);
+			}
+
+			static const char* identifier(const char* p, const char* end) {
+				if (p != end && !isIdentifierByte(static_cast<unsigned char>(*p))) {
+					return p;
+				}
+				for (; end - p >= V::width; p += V::width) {
+					unsigned stop = ~V::mask(isIdentifier(V::load(p))) & V::all;
+					if (stop != 0) {
+						return p + firstBit(stop);
+					}
+				}
+				return scalarRun<isIdentifierByte>(p, end);
+			}
+
+			static const char* digits(const char* p, const char* end) {
+				if (p != end && !isDigitByte(static_cast<unsigned char>(*p))) {
+					return p;
+				}
+				for (; end - p >= V::width; p += V::width) {
+					unsigned stop = ~V::mask(isDigit(V::load(p))) & V::all;
+					if (stop != 0) {
+						return p + firstBit(stop);
+					}
+				}
+				return scalarRun<isDigitByte>(p, end);
+			}
+
+			static const char* lineEnd(const char* p, const char* end) {
+				for (; end - p >= V::width; p += V::width) {
+					unsigned stop = V::mask(V::eq(V::load(p), '\n'));
+					if (stop != 0) {
+						return p + firstBit(stop);
+					}
+				}
+				return scalarLineEnd(p, end);
+			}
+
+			// 同时比较 p[i] == '*' 和 p[i + 1] == '/'，因此要多读一个字节
+			static const char* commentEnd(const char* p, const char* end) {
+				for (; end - p > V::width; p += V::width) {
+					unsigned stop = V::mask(V::eq(V::load(p), '*')) & V::mask(V::eq(V::load(p + 1), '/'));
+					if (stop != 0) {
+						return p + firstBit(stop);
+					}
+				}
+				return scalarCommentEnd(p, end);
+			}
+
+			static const char* stringRun(const char* p, const char* end) {
+				if (p != end && !isStringByte(static_cast<unsigned char>(*p))) {
+					return p;
+				}
+				for (; end - p >= V::width; p += V::width) {
+					unsigned stop = ~V::mask(isString(V::load(p))) & V::all;
+					if (stop != 0) {
+						return p + firstBit(stop);
+					}
+				}
+				return scalarRun<isStringByte>(p, end);
+			}
+
+			static ScanKernels Make(const char* name) {
+				return ScanKernels{name, whitespace, identifier, digits, lineEnd, commentEnd, stringRun};
+			}
+		};
+	}
+}
@@ -0,0 +1,112 @@
+#include "tokenizer/source.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#if !defined(CC0_NO_MMAP) && (defined(__unix__) || defined(__APPLE__))
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define CC0_USE_MMAP 1
+#endif
+
+namespace cc0 {
+
+	SourceBuffer::SourceBuffer()
+		: _mapped(nullptr), _owned(), _size(0), _lineStarts{0}, _scanned(0) {}
+
+	SourceBuffer::SourceBuffer(SourceBuffer&& other) noexcept
+		: _mapped(std::exchange(other._mapped, nullptr)), _owned(std::move(other._owned)),
+		  _size(std::exchange(other._size, 0)), _lineStarts(std::move(other._lineStarts)),
+		  _scanned(std::exchange(other._scanned, 0)) {
+		other._lineStarts.assign(1, 0);
+	}
+
+	SourceBuffer& SourceBuffer::operator=(SourceBuffer&& other) noexcept {
+		if (this != &other) {
+			release();
+			_mapped = std::exchange(other._mapped, nullptr);
+			_owned = std::move(other._owned);
+			_size = std::exchange(other._size, 0);
+			_lineStarts = std::move(other._lineStarts);
+			_scanned = std::exchange(other._scanned, 0);
+			other._lineStarts.assign(1, 0);
+		}
+		return *this;
+	}
+
+	SourceBuffer::~SourceBuffer() {
+		release();
+	}
+
+	void SourceBuffer::release() noexcept {
+#ifdef CC0_USE_MMAP
+		if (_mapped != nullptr) {
+			::munmap(const_cast<char*>(_mapped), _size);
+		}
+#endif
+		_mapped = nullptr;
+	}
+
+	SourceBuffer SourceBuffer::FromStream(std::istream& in) {
+		SourceBuffer source;
+		source._owned.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+		// 最后一行没有换行时补上
+		if (!source._owned.empty() && source._owned.back() != '\n') {
+			source._owned += '\n';
+		}
+		source._size = source._owned.size();
+		return source;
+	}
+
+	std::optional<SourceBuffer> SourceBuffer::FromFile(const std::string& path) {
+#ifdef CC0_USE_MMAP
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) {
+			return {};
+		}
+		struct stat st;
+		if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+			auto size = static_cast<std::size_t>(st.st_size);
+			void* p = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (p != MAP_FAILED) {
+				// 映射的内容无法补换行，这种文件退回读入
+				if (static_cast<const char*>(p)[size - 1] == '\n') {
+					::close(fd);
+					SourceBuffer source;
+					source._mapped = static_cast<const char*>(p);
+					source._size = size;
+					return source;
+				}
+				::munmap(p, size);
+			}
+		}
+		::close(fd);
+#endif
+		std::ifstream in(path, std::ios::binary | std::ios::in);
+		if (!in) {
+			return {};
+		}
+		return FromStream(in);
+	}
+
+	std::pair<std::uint64_t, std::uint64_t> SourceBuffer::Position(std::size_t offset) const {
+		offset = std::min(offset, _size);
+		// 位置一般是递增地查询，只需要继续向后扫描
+		auto data = begin();
+		while (_scanned < offset) {
+			auto p = static_cast<const char*>(std::memchr(data + _scanned, '\n', offset - _scanned));
+			if (p == nullptr) {
+				_scanned = offset;
+				break;
+			}
+			_scanned = p - data + 1;
+			_lineStarts.push_back(_scanned);
+		}
+		auto line = std::upper_bound(_lineStarts.begin(), _lineStarts.end(), offset) - _lineStarts.begin() - 1;
+		return std::make_pair(static_cast<std::uint64_t>(line), static_cast<std::uint64_t>(offset - _lineStarts[line]));
+	}
+}
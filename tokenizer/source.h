@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace cc0 {
+
+	// 连续存放的源代码，词法分析只需要一个指针
+	// 内容为空或者以 \n 结尾，与按行读入再补上 \n 的结果相同
+	// 行号表在需要位置时才按需扫描建立
+	class SourceBuffer final {
+	public:
+		SourceBuffer();
+		SourceBuffer(SourceBuffer&& other) noexcept;
+		SourceBuffer& operator=(SourceBuffer&& other) noexcept;
+		SourceBuffer(const SourceBuffer&) = delete;
+		SourceBuffer& operator=(const SourceBuffer&) = delete;
+		~SourceBuffer();
+
+		// 读入整个流
+		static SourceBuffer FromStream(std::istream& in);
+		// 尽量内存映射整个文件，无法映射时退回读入，打不开则返回空
+		static std::optional<SourceBuffer> FromFile(const std::string& path);
+
+		const char* begin() const { return _mapped != nullptr ? _mapped : _owned.data(); }
+		const char* end() const { return begin() + _size; }
+		std::size_t size() const { return _size; }
+
+		// 偏移对应的 <行号，列号>，都从 0 开始
+		// 文件尾的位置是 <行数，0>
+		std::pair<std::uint64_t, std::uint64_t> Position(std::size_t offset) const;
+
+	private:
+		void release() noexcept;
+
+		const char* _mapped;
+		std::string _owned;
+		std::size_t _size;
+		// 已知的每行起始偏移，扫描到 _scanned 为止，只是缓存
+		mutable std::vector<std::size_t> _lineStarts;
+		mutable std::size_t _scanned;
+	};
+}
@@ -0,0 +1,102 @@
+#include "tokenizer/token_list.h"
+
+namespace cc0 {
+
+	namespace {
+
+		// 关键字和符号的文本只由类型决定
+		const char* spellingOf(TokenType type) {
+			switch (type) {
+				case CONST: return "const";
+				case VOID: return "void";
+				case INT: return "int";
+				case CHART: return "char";
+				case DOUBLE: return "double";
+				case STRUCT: return "struct";
+				case IF: return "if";
+				case ELSE: return "else";
+				case SWITCH: return "switch";
+				case CASE: return "case";
+				case DEFAULT: return "default";
+				case WHILE: return "while";
+				case FOR: return "for";
+				case DO: return "do";
+				case RETURN: return "return";
+				case BREAK: return "break";
+				case CONTINUE: return "continue";
+				case PRINT: return "print";
+				case SCAN: return "scan";
+				case PLUS_SIGN: return "+";
+				case MINUS_SIGN: return "-";
+				case MULTIPLICATION_SIGN: return "*";
+				case DIVISION_SIGN: return "/";
+				case EQUAL_SIGN: return "=";
+				case LESS_SIGN: return "<";
+				case LESS_EQUAL_SIGN: return "<=";
+				case MORE_SIGN: return ">";
+				case MORE_EQUAL_SIGN: return ">=";
+				case NOT_EQUAL_SIGN: return "!=";
+				case VALUE_EQUAL_SIGN: return "==";
+				case COMMA: return ",";
+				case SEMICOLON: return ";";
+				case COLON: return ":";
+				case SINGLE_QUOTATION: return "\'";
+				case DOUBLE_QUOTATION: return "\"";
+				case LEFT_PARENTHESIS: return "(";
+				case RIGHT_PARENTHESIS: return ")";
+				case LEFT_BRACE: return "{";
+				case RIGHT_BRACE: return "}";
+				default: return "";
+			}
+		}
+	}
+
+	std::uint32_t StringPool::Intern(std::string_view text) {
+		auto it = _index.find(text);
+		if (it != _index.end()) {
+			return it->second;
+		}
+		auto id = static_cast<std::uint32_t>(_strings.size());
+		_strings.emplace_back(text);
+		_index.emplace(_strings.back(), id);
+		return id;
+	}
+
+	std::string TokenList::ValueString(const CompactToken& token) const {
+		switch (token.type) {
+			case IDENTIFIER:
+			case CHAR:
+			case STRING:
+				return Text(token);
+			case DECIMAL_INTEGER:
+			case HEXADECIMAL_INTEGER:
+				return token.overflow ? Text(token) : std::to_string(static_cast<std::int32_t>(token.payload));
+			default:
+				return spellingOf(token.type);
+		}
+	}
+
+	Token TokenList::Expand(const CompactToken& token) const {
+		return Token(token.type, ValueString(token), Position(token.offset), Position(token.end));
+	}
+
+	std::string TokenRef::GetValueString() const {
+		return _list->ValueString(_token);
+	}
+
+	bool TokenRef::GetIntValue(std::int32_t& out) const {
+		if (_token.overflow) {
+			return false;
+		}
+		out = static_cast<std::int32_t>(_token.payload);
+		return true;
+	}
+
+	std::pair<std::uint64_t, std::uint64_t> TokenRef::GetStartPos() const {
+		return _list->Position(_token.offset);
+	}
+
+	std::pair<std::uint64_t, std::uint64_t> TokenRef::GetEndPos() const {
+		return _list->Position(_token.end);
+	}
+}
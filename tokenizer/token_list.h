@@ -0,0 +1,107 @@
+#pragma once
+
+#include "tokenizer/token.h"
+#include "tokenizer/source.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace cc0 {
+
+	// 字符串驻留表，相同的文本只保存一份，用编号表示
+	class StringPool final {
+	public:
+		StringPool() = default;
+		StringPool(StringPool&&) = default;
+		StringPool& operator=(StringPool&&) = default;
+		StringPool(const StringPool&) = delete;
+		StringPool& operator=(const StringPool&) = delete;
+
+		std::uint32_t Intern(std::string_view text);
+		const std::string& Get(std::uint32_t id) const { return _strings[id]; }
+		std::size_t Size() const { return _strings.size(); }
+
+	private:
+		// deque 追加时不移动已有元素，_index 的键可以直接引用它们
+		std::deque<std::string> _strings;
+		std::unordered_map<std::string_view, std::uint32_t> _index;
+	};
+
+	// 紧凑的 token，16 字节，不含任何堆内存
+	// 标识符、字符和字符串字面量的 payload 是驻留表中的编号，整数字面量的 payload 就是它的值
+	// 关键字和符号的文本由类型决定，不需要 payload
+	struct CompactToken {
+		// 在源代码中的起止偏移，[offset, end)
+		std::uint32_t offset;
+		std::uint32_t end;
+		std::uint32_t payload;
+		TokenType type;
+		// 整数字面量超出 int32 时 payload 改为原文本的编号，语法分析时再报错
+		bool overflow;
+	};
+	static_assert(sizeof(CompactToken) == 16, "CompactToken should stay 16 bytes");
+
+	class TokenList;
+
+	// token 和它所属的 TokenList（驻留表和源代码）的引用，可以随意复制
+	// token 本身按值保存，流式分析时环形缓冲区中的位置被覆盖也不受影响
+	class TokenRef final {
+	private:
+		using uint64_t = std::uint64_t;
+	public:
+		TokenRef(const TokenList& list, const CompactToken& token) : _list(&list), _token(token) {}
+
+		TokenType GetType() const { return _token.type; }
+		// 与展开的 Token::GetValueString 相同
+		std::string GetValueString() const;
+		// 整数字面量的值，超出 int32 时返回 false
+		bool GetIntValue(std::int32_t& out) const;
+		std::pair<uint64_t, uint64_t> GetStartPos() const;
+		std::pair<uint64_t, uint64_t> GetEndPos() const;
+		const CompactToken& Get() const { return _token; }
+
+	private:
+		const TokenList* _list;
+		CompactToken _token;
+	};
+
+	// 一次词法分析的结果：紧凑的 token 序列、驻留表和源代码
+	// 词法分析器边读边把字符串驻留到自己的 TokenList 中，逐个读取 token 时 size() 始终为 0
+	class TokenList final {
+	private:
+		using uint64_t = std::uint64_t;
+	public:
+		TokenList() = default;
+		TokenList(TokenList&&) = default;
+		TokenList& operator=(TokenList&&) = default;
+		TokenList(const TokenList&) = delete;
+		TokenList& operator=(const TokenList&) = delete;
+
+		std::size_t size() const { return _tokens.size(); }
+		bool empty() const { return _tokens.empty(); }
+		TokenRef operator[](std::size_t i) const { return TokenRef(*this, _tokens[i]); }
+
+		std::string ValueString(const CompactToken& token) const;
+		// 驻留的文本，只对标识符、字符、字符串以及超出范围的整数有意义
+		const std::string& Text(const CompactToken& token) const { return _strings.Get(token.payload); }
+		// 偏移对应的 <行号，列号>，见 SourceBuffer::Position
+		std::pair<uint64_t, uint64_t> Position(std::size_t offset) const { return _source.Position(offset); }
+		// 展开为完整的 Token
+		Token Expand(const CompactToken& token) const;
+
+	private:
+		friend class Tokenizer;
+
+		explicit TokenList(SourceBuffer source) : _source(std::move(source)) {}
+
+		std::vector<CompactToken> _tokens;
+		StringPool _strings;
+		SourceBuffer _source;
+	};
+}
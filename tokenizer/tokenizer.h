@@ -1,7 +1,11 @@
 #pragma once
 
 #include "tokenizer/token.h"
+#include "tokenizer/token_list.h"
 #include "tokenizer/utils.hpp"
+#include "tokenizer/source.h"
+#include "tokenizer/scan.h"
+#include "tokenizer/lexer_tables.h"
 #include "error/error.h"
 
 #include <utility>
@@ -11,30 +15,19 @@
 #include <memory>
 #include <vector>
 #include <string>
+#include <string_view>
 
 namespace cc0 {
 
 	class Tokenizer final {
 	private:
 		using uint64_t = std::uint64_t;
-
-		// 状态机的所有状态
-		enum DFAState {
-			INITIAL_STATE,
-            DECIMAL_INTEGER_STATE,
-            HEXADECIMAL_INTEGER_STATE,
-            CHAR_STATE,
-            STRING_STATE,
-            IDENTIFIER_STATE,
-            SLASH_SIGN_STATE,
-            LESS_SIGN_STATE,
-            MORE_SIGN_STATE,
-            POINT_SIGN_STATE,
-			EQUAL_SIGN_STATE,
-		};
 	public:
 		Tokenizer(std::istream& ifs)
-			: _rdr(ifs), _initialized(false), _ptr(0, 0),_lines_buffer() {}
+			: _rdr(&ifs), _initialized(false), _list(), _ptr(nullptr), _scan(&BestKernels()) {}
+		// 直接使用已经读入（或映射）的源代码
+		Tokenizer(SourceBuffer source)
+			: _rdr(nullptr), _initialized(true), _list(std::move(source)), _ptr(_list._source.begin()), _scan(&BestKernels()) {}
 		Tokenizer(Tokenizer&& tkz) = delete;
 		Tokenizer(const Tokenizer&) = delete;
 		Tokenizer& operator=(const Tokenizer&) = delete;
@@ -43,24 +36,40 @@ namespace cc0 {
 		std::pair<std::optional<Token>, std::optional<CompilationError>> NextToken();
 		// 一次返回所有 token
 		std::pair<std::vector<Token>, std::optional<CompilationError>> AllTokens();
+		// 一次返回所有 token 的紧凑形式，语法分析使用这个
+		// 调用之后词法分析器不再可用
+		std::pair<TokenList, std::optional<CompilationError>> AllCompactTokens();
+		// 逐个返回紧凑的 token，字符串驻留在 Tokens() 中
+		std::pair<std::optional<CompactToken>, std::optional<CompilationError>> NextCompactToken();
+		// 驻留表和源代码，逐个读取时用于取得 token 的值和位置
+		const TokenList& Tokens() const { return _list; }
+		// 替换成块扫描的实现，默认为 BestKernels()，用于对比不同的实现
+		void SetScanKernels(const ScanKernels& kernels) { _scan = &kernels; }
 	private:
 		// 检查 Token 的合法性
-		std::optional<CompilationError> checkToken(const Token&);
-		// 
-		// ** 你需要完成这个函数 **
-		//
-		// 返回下一个 token，是 NextToken 实际实现部分
-		std::pair<std::optional<Token>, std::optional<CompilationError>> nextToken();
+		std::optional<CompilationError> checkToken(const CompactToken&);
+		// 返回下一个 token，是 NextToken 实际实现部分，状态机的表见 lexer_tables.h
+		std::pair<std::optional<CompactToken>, std::optional<CompilationError>> nextToken();
+		// 在 state 状态下结束从 start 开始的 token
+		std::pair<std::optional<CompactToken>, std::optional<CompilationError>> acceptToken(lexer::DFAState state, std::size_t start);
+		// 字符和字符串字面量，start 是开头引号的偏移
+		std::pair<std::optional<CompactToken>, std::optional<CompilationError>> lexChar(std::size_t start);
+		std::pair<std::optional<CompactToken>, std::optional<CompilationError>> lexString(std::size_t start);
+
+		// 构造从 start 到当前位置的 token
+		CompactToken makeToken(TokenType type, std::size_t start, std::uint32_t payload = 0);
+		// 标识符或关键字
+		CompactToken makeWord(TokenType type, std::size_t start, std::string_view word);
+		// 整数字面量，值直接存在 payload 中
+		CompactToken makeInteger(TokenType type, std::size_t start, std::string_view text);
 
-		// 从这里开始其实是一个基于行号的缓冲区的实现
-		// 为了简单起见，我们没有单独拿出一个类实现
+		// 从这里开始是缓冲区的读取，缓冲区本身见 SourceBuffer
 		// 核心思想和 C 的文件输入输出类似，就是一个 buffer 加一个指针，有三个细节
 		// 1.缓冲区包括 \n
 		// 2.指针始终指向下一个要读取的 char
-		// 3.行号和列号从 0 开始
+		// 3.行号和列号从 0 开始，只有在需要位置时才由偏移换算
 
-		// 一次读入全部内容，并且替换所有换行为 \n
-		// 这样其实是不合理的，这里只是简单起见这么实现
+		// 一次读入全部内容
 		void readAll();
 		// 一个简单的总结
 		// | 0 | 1 | 2 | 3 | 4 | 5 | 6 | 7 | 8 | 9  | 偏移
@@ -73,6 +82,8 @@ namespace cc0 {
 		// previousPos() = (0, 8)
 		// nextChar() = '\n' 并且指针移动到 (1, 0)
 		// unreadLast() 指针移动到 (0, 8)
+		// 指针当前的偏移
+		std::size_t offset();
 		std::pair<uint64_t, uint64_t> nextPos();
 		std::pair<uint64_t, uint64_t> currentPos();
 		std::pair<uint64_t, uint64_t> previousPos();
@@ -80,12 +91,15 @@ namespace cc0 {
 		bool isEOF();
 		void unreadLast();
 	private:
-		std::istream& _rdr;
+		// 直接给出源代码时为空
+		std::istream* _rdr;
 		// 如果没有初始化，那么就 readAll
 		bool _initialized;
+		// 连续的缓冲区、已经读出的 token 和驻留的字符串
+		TokenList _list;
 		// 指向下一个要读取的字符
-		std::pair<uint64_t, uint64_t> _ptr;
-		// 以行为基础的缓冲区
-		std::vector<std::string> _lines_buffer;
+		const char* _ptr;
+		// 空白、注释、标识符等的成块扫描
+		const ScanKernels* _scan;
 	};
 }
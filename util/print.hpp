@@ -7,7 +7,7 @@
 #include <sstream>
 #include <tuple>
 
-inline void print(std::ostream& out) {
+inline void print(std::ostream&) {
 	;
 }
 
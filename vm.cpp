@@ -3,7 +3,10 @@
 #include "./instruction.h"
 #include "./exception.h"
 
+#include <algorithm>
 #include <iostream>
+#include <string_view>
+#include <unordered_map>
 #include <iomanip>
 #include <cmath>
 
@@ -17,11 +20,13 @@ const addr_t VM::MIN_HEAP_ADDR  = 0x01000000;
 const addr_t VM::MAX_HEAP_ADDR  = 0x01ffffff;
 const addr_t VM::MAX_HEAP_SIZE  = 0x01000000;
 
-VM::VM(File file) noexcept : _file(std::move(file)){
+VM::VM(File file) noexcept
+    : _engine(Engine::Switch), _file(std::move(file)), _failedOrigin(-1), _fusedInstructions(0), _decodedInstructions(0),
+      _registerFailed(false), _interpretedFrom(SIZE_MAX), _jitFailed(false) {
     init();
 }
 
-std::unique_ptr<VM> VM::make_vm(File file) {
+std::unique_ptr<VM> VM::make_vm(File file, Engine engine, Limits limits) {
     // found main function
     vm::u4 mainIndex = 0;
     bool mainFound = false;
@@ -45,8 +50,23 @@ std::unique_ptr<VM> VM::make_vm(File file) {
         throw InvalidFile("main not found");
     }
     auto vm = std::make_unique<VM>(std::move(file));
-    vm->_stack = std::make_unique<slot_t[]>(MAX_STACK_ADDR-MIN_STACK_ADDR);
-    vm->_heap  = std::make_unique<slot_t[]>(MAX_HEAP_ADDR-MIN_HEAP_ADDR);
+    vm->_engine = engine;
+    if ((engine == Engine::Register || engine == Engine::Jit) && !vm->translateRegister()) {
+        vm->_registerFailed = true;
+        vm->_engine = Engine::Threaded;
+    }
+    if (vm->_engine == Engine::Jit && !vm->compileJit()) {
+        vm->_jitFailed = true;
+        vm->_engine = Engine::Register;
+    }
+    if (vm->_engine == Engine::Threaded) {
+        vm->predecode();
+    }
+    auto clamp = [](addr_t size, addr_t max) {
+        return 0 < size && size < max ? size : max;
+    };
+    vm->_stack = SlotRegion(clamp(limits.stackSize, MAX_STACK_SIZE));
+    vm->_heap  = Heap(MIN_HEAP_ADDR, clamp(limits.heapSize, MAX_HEAP_SIZE));
     return std::move(vm);
 }
 
@@ -56,19 +76,34 @@ void VM::init() noexcept {
     _bp = 0;
     _ip = 0;
     _counterInstruction = 0;
+    _counterFused = 0;
+    _jitExits = 0;
+    _jitHelperCalls = 0;
+    _jitError = nullptr;
+    _failedOrigin = -1;
+    _interpretedFrom = SIZE_MAX;
+    _currentInstructions = nullptr;
     _contexts.clear();
-    _heapRecord.clear();
+    _heap.reset();
     _stringLiteralPool.clear();
 }
 
+// String literals are read-only, so constants with the same text share one heap copy.
 void VM::buildStringLiteralPool() {
+    std::unordered_map<std::string_view, addr_t> copies;
     u2 i = 0;
     for (auto it = _file.constants.begin(), ed = _file.constants.end(); it != ed; ++it) {
         auto& c = *it;
         if (c.type == vm::Constant::Type::STRING) {
-            str_t str = std::get<str_t>(c.value);
+            const str_t& str = std::get<str_t>(c.value);
+            if (auto found = copies.find(str); found != copies.end()) {
+                _stringLiteralPool[i] = found->second;
+                ++i;
+                continue;
+            }
             addr_t addr = NEW(str.length()+1);
             _stringLiteralPool[i] = addr;
+            copies.emplace(str, addr);
             slot_t* dst =  toHeapPtr(addr);
             for (auto ch : str) {
                 *dst++ = ch & 0xff;
@@ -89,18 +124,30 @@ void VM::start() {
     globalContext.BP = 0;
     globalContext.staticLink = 0;
     globalContext.functionIndex = -1;
-    globalContext.functionName = "__START__";
+    static const str_t startName = "__START__";
+    globalContext.functionName = &startName;
     globalContext.functionLevel = 0;
-    _currentInstructions = _file.start;
+    _currentInstructions = &_file.start;
     _contexts.push_back(globalContext);
     prepared = true;
-    run();
+    if (_engine == Engine::Threaded) {
+        runThreaded();
+    }
+    else if (_engine == Engine::Register) {
+        runRegister();
+    }
+    else if (_engine == Engine::Jit) {
+        runJit();
+    }
+    else {
+        run();
+    }
 }
 
 void VM::run() {
     try {
-        while (_ip < _currentInstructions.size()) {
-            executeInstruction(_currentInstructions.at(_ip));
+        while (_ip < _currentInstructions->size()) {
+            executeInstruction(_currentInstructions->at(_ip));
             ++_ip;
             ++_counterInstruction;
         }
@@ -122,12 +169,12 @@ void VM::printStackTrace(std::ostream& out) {
     if (red == rit) {
         return;
     }
-    auto pc = this->_ip;
-    if (pc >= _currentInstructions.size()) {
-        println(out, "          control reaches the end of function", rit->functionName, "without return");
+    auto pc = _failedOrigin >= 0 ? _failedOrigin : frameOrigin(_contexts.size() - 1, this->_ip);
+    if (pc >= _currentInstructions->size()) {
+        println(out, "          control reaches the end of function", *rit->functionName, "without return");
     }
     else {
-        println(out, "          function", rit->functionName, "at instruction", pc, ":", _currentInstructions.at(pc));
+        println(out, "          function", *rit->functionName, "at instruction", pc, ":", _currentInstructions->at(pc));
     }
     while (true) {
         pc = rit->prevPC;
@@ -135,18 +182,41 @@ void VM::printStackTrace(std::ostream& out) {
         if (rit == red) {
             return;
         }
+        pc = frameOrigin(red - rit - 1, pc);
         if (rit->functionIndex == -1) {
             println(out, "called by .start at instruction", pc, ":", _file.start.at(pc));
             return;
         }
-        println(out, "called by function", rit->functionName, "at instruction", pc, ":", _file.functions.at(rit->functionIndex).instructions.at(pc));
+        println(out, "called by function", *rit->functionName, "at instruction", pc, ":", _file.functions.at(rit->functionIndex).instructions.at(pc));
     }
 }
 
+void VM::printStats(std::ostream& out) const {
+    auto percent = [](int part, int total) {
+        return total == 0 ? 0.0 : 100.0 * part / total;
+    };
+    static const char* names[] = {"switch", "threaded", "register", "jit"};
+    println(out, "vm engine:", names[static_cast<int>(_engine)],
+        _registerFailed ? "(register translation failed)" : _jitFailed ? "(jit unavailable)" : "");
+    if (_engine == Engine::Jit) {
+        // machine code counts nothing, only what runs in the interpreter is known
+        println(out, "jit code size:", _jit.size, "bytes");
+        println(out, "jit exits to the vm:", _jitExits);
+        println(out, "jit helper calls:", _jitHelperCalls);
+        return;
+    }
+    println(out, "vm instructions:", _counterInstruction);
+    println(out, "vm dispatches:", _counterInstruction - _counterFused);
+    println(out, "vm fused at run time:", _counterFused, "(", percent(_counterFused, _counterInstruction), "% )");
+    println(out, "vm fused at load time:", _fusedInstructions, "of", _decodedInstructions,
+        "(", percent(_fusedInstructions, _decodedInstructions), "% )");
+}
+
 void VM::ensureStackRest(addr_t count) {
-    if (_sp + count > MAX_STACK_ADDR) {
+    if (count > _stack.capacity() - _sp) {
         throw StackOverflow();
     }
+    _stack.commit(_sp + count);
 }
 
 void VM::ensureStackUsed(addr_t count) {
@@ -156,10 +226,10 @@ void VM::ensureStackUsed(addr_t count) {
 }
 
 slot_t* VM::toStackPtr(addr_t addr) {
-    return _stack.get() + addr;
+    return _stack.data() + addr;
 }
 slot_t* VM::toHeapPtr(addr_t addr) {
-    return _heap.get() + (addr-MIN_HEAP_ADDR);
+    return _heap.toPtr(addr);
 }
 
 slot_t* VM::checkAddr(addr_t addr, addr_t count) {
@@ -170,11 +240,9 @@ slot_t* VM::checkAddr(addr_t addr, addr_t count) {
         }
         return toStackPtr(addr);
     }
-    if (MIN_HEAP_ADDR <= addr && addr < MAX_HEAP_ADDR) {
-        for (auto& p : _heapRecord) {
-            if (p.first <= addr && end <= p.first+p.second) {
-                return toHeapPtr(addr);
-            }
+    if (MIN_HEAP_ADDR <= addr && addr <= MAX_HEAP_ADDR) {
+        if (slot_t* p = _heap.find(addr, count)) {
+            return p;
         }
         throw InvalidMemoryAccess("tried to access unused or constant heap memory");
     }
@@ -193,16 +261,7 @@ void VM::INC_SP(addr_t count) {
 }
 
 addr_t VM::NEW(addr_t count) {
-    addr_t st = MIN_HEAP_ADDR;
-    if (!_heapRecord.empty()) {
-        auto& last = _heapRecord.back();
-        st = last.first + last.second;
-    }
-    if (st + count >= MAX_HEAP_ADDR) {
-        throw HeapOverflow();
-    }
-    _heapRecord.emplace_back(st, count);
-    return st;
+    return _heap.allocate(count);
 }
 
 void VM::DUP() {
@@ -255,7 +314,7 @@ void VM::PUSH<int_t>(int_t value) {
 template<>
 void VM::PUSH<double_t>(double_t val) {
     ensureStackRest(2);
-    double_t* p = reinterpret_cast<double_t*>(_stack.get() + _sp);
+    double_t* p = reinterpret_cast<double_t*>(_stack.data() + _sp);
     *p = val;
     _sp += 2;
 }
@@ -292,7 +351,7 @@ void VM::WRITE<double_t>(addr_t addr, double_t value) {
 }
 
 void VM::JUMP(u2 offset) {
-    if (0 > offset || offset >= _currentInstructions.size()) {
+    if (0 > offset || offset >= _currentInstructions->size()) {
         throw InvalidControlTransfer();
     }
     this->_ip = offset - 1;
@@ -305,7 +364,7 @@ void VM::CALL(u2 index) {
     Function& calledFunction = this->_file.functions.at(index);
     Context newContext;
     newContext.functionIndex = index;
-    newContext.functionName = std::get<str_t>(this->_file.constants.at(calledFunction.nameIndex).value);
+    newContext.functionName = &std::get<str_t>(this->_file.constants.at(calledFunction.nameIndex).value);
 
     newContext.functionLevel = calledFunction.level;
     int newLv = newContext.functionLevel;
@@ -331,23 +390,54 @@ void VM::CALL(u2 index) {
     newContext.BP = this->_bp;
     _contexts.push_back(newContext);
     this->_ip = -1;
-    this->_currentInstructions = calledFunction.instructions;
+    this->_currentInstructions = &calledFunction.instructions;
+}
+
+// The frame of the current function is reused: the params on top of the
+// stack are moved down to its base and the callee takes over its context,
+// so it returns straight to our caller and the stack does not grow.
+void VM::TAILCALL(u2 index) {
+    if (index >= this->_file.functions.size() || _contexts.size() <= 1) {
+        throw InvalidControlTransfer();
+    }
+    Function& calledFunction = this->_file.functions.at(index);
+    Context& context = _contexts.back();
+    int newLv = calledFunction.level;
+    int curLv = context.functionLevel;
+    // the static link can not point to the frame being replaced
+    if (newLv > curLv) {
+        throw InvalidControlTransfer();
+    }
+    int staticLink = context.staticLink;
+    for (; curLv > newLv; --curLv) {
+        staticLink = _contexts.at(staticLink).staticLink;
+    }
+    ensureStackUsed(calledFunction.paramSize);
+    slot_t* params = _stack.data() + this->_sp - calledFunction.paramSize;
+    std::copy(params, params + calledFunction.paramSize, _stack.data() + this->_bp);
+    this->_sp = this->_bp + calledFunction.paramSize;
+    context.functionIndex = index;
+    context.functionName = &std::get<str_t>(this->_file.constants.at(calledFunction.nameIndex).value);
+    context.functionLevel = calledFunction.level;
+    context.staticLink = staticLink;
+    this->_ip = -1;
+    this->_currentInstructions = &calledFunction.instructions;
 }
 
 void VM::RET() {
     if (_contexts.size() <= 1) {
         throw InvalidControlTransfer();
     }
-    Context curContext = _contexts.back();
+    const Context& curContext = _contexts.back();
     this->_sp = curContext.prevSP;
     this->_bp = curContext.prevBP;
     this->_ip = curContext.prevPC;
     _contexts.pop_back();
     if (_contexts.size() != 1) {
-        this->_currentInstructions = _file.functions.at(_contexts.back().functionIndex).instructions;
+        this->_currentInstructions = &_file.functions.at(_contexts.back().functionIndex).instructions;
     }
     else {
-        this->_currentInstructions = _file.start;
+        this->_currentInstructions = &_file.start;
     }
 }
 
@@ -381,13 +471,20 @@ void VM::loadc(u2 index) {
     }
 }
 
-void VM::loada(u2 level_diff, addr_t offset) {
+addr_t VM::frameAddr(u2 level_diff, addr_t offset) {
+    if (level_diff == 0) {
+        return _contexts.back().BP + offset;
+    }
     int staticLink = _contexts.size()-1;
     for (int ld = level_diff; ld > 0; --ld) {
         staticLink = _contexts.at(staticLink).staticLink;
     }
     addr_t bp = _contexts.at(staticLink).BP;
-    PUSH<addr_t>(bp+offset);
+    return bp+offset;
+}
+
+void VM::loada(u2 level_diff, addr_t offset) {
+    PUSH<addr_t>(frameAddr(level_diff, offset));
 }
 
 void VM::_new() {
@@ -547,10 +644,26 @@ void VM::jle(u2 offset) {
     }
 }
 
+// the jmp right after this instruction is the first entry of the table
+void VM::tableswitch(int_t low, u2 count) {
+    u4 index = static_cast<u4>(POP<int_t>()) - static_cast<u4>(low);
+    if (index > count) {
+        index = count;
+    }
+    if (_ip + 1 + index >= _currentInstructions->size()) {
+        throw InvalidControlTransfer();
+    }
+    JUMP(static_cast<u2>(_ip + 1 + index));
+}
+
 void VM::call(u2 index) {
     CALL(index);
 }
 
+void VM::tailcall(u2 index) {
+    TAILCALL(index);
+}
+
 template <typename T>
 void VM::Tret() {
     auto rtv = POP<T>();
@@ -653,8 +766,10 @@ void VM::executeInstruction(const Instruction& ins) {
     case OpCode::jge:     jge(ins.x);   break;
     case OpCode::jg:      jg(ins.x);    break;
     case OpCode::jle:     jle(ins.x);   break;
+    case OpCode::tableswitch: tableswitch(ins.x, ins.y); break;
 
     case OpCode::call:    call(ins.x);      break;
+    case OpCode::tailcall: tailcall(ins.x); break;
     case OpCode::ret:     Tret<void>();     break;
     case OpCode::iret:    Tret<int_t>();    break;
     case OpCode::dret:    Tret<double_t>(); break;
@@ -673,4 +788,538 @@ void VM::executeInstruction(const Instruction& ins) {
     }
 }
 
-}
\ No newline at end of file
+void VM::predecode() {
+    _fusedInstructions = 0;
+    _decodedInstructions = 0;
+    // computed once: it scans every function
+    const auto slots = returnSlots();
+    _threadedStart = fuse(_file.start, stackDepths(_file.start, -1, slots));
+    _threadedFunctions.clear();
+    for (std::size_t i = 0; i < _file.functions.size(); ++i) {
+        auto& code = _file.functions[i].instructions;
+        _threadedFunctions.push_back(fuse(code, stackDepths(code, static_cast<int>(i), slots)));
+    }
+}
+
+// slots an instruction needs on the stack and how it changes the depth
+// only for straight-line code, control transfer returns false
+bool VM::stackEffect(const Instruction& ins, i8& need, i8& effect) const {
+    switch (ins.op) {
+    case OpCode::nop:     need = 0; effect = 0;  return true;
+    case OpCode::loadc:
+        if (static_cast<u2>(ins.x) >= _file.constants.size()) {
+            return false;
+        }
+        need = 0;
+        effect = _file.constants[static_cast<u2>(ins.x)].type == Constant::Type::DOUBLE ? 2 : 1;
+        return true;
+    case OpCode::bipush:
+    case OpCode::ipush:
+    case OpCode::loada:
+    case OpCode::iscan:
+    case OpCode::cscan:   need = 0; effect = 1;  return true;
+    case OpCode::dscan:   need = 0; effect = 2;  return true;
+    case OpCode::snew:    need = 0; effect = static_cast<addr_t>(ins.x); return effect >= 0;
+    case OpCode::pop:     need = 1; effect = -1; return true;
+    case OpCode::pop2:    need = 2; effect = -2; return true;
+    case OpCode::popn:    need = static_cast<addr_t>(ins.x); effect = -need; return need >= 0;
+    case OpCode::dup:     need = 1; effect = 1;  return true;
+    case OpCode::dup2:    need = 2; effect = 2;  return true;
+    case OpCode::_new:
+    case OpCode::iload:
+    case OpCode::aload:
+    case OpCode::ineg:
+    case OpCode::i2c:     need = 1; effect = 0;  return true;
+    case OpCode::dload:
+    case OpCode::i2d:     need = 1; effect = 1;  return true;
+    case OpCode::iaload:
+    case OpCode::aaload:
+    case OpCode::iadd:
+    case OpCode::isub:
+    case OpCode::imul:
+    case OpCode::idiv:
+    case OpCode::icmp:
+    case OpCode::d2i:     need = 2; effect = -1; return true;
+    case OpCode::daload:
+    case OpCode::dneg:    need = 2; effect = 0;  return true;
+    case OpCode::istore:
+    case OpCode::astore:  need = 2; effect = -2; return true;
+    case OpCode::dstore:
+    case OpCode::iastore:
+    case OpCode::aastore: need = 3; effect = -3; return true;
+    case OpCode::dastore: need = 4; effect = -4; return true;
+    case OpCode::dadd:
+    case OpCode::dsub:
+    case OpCode::dmul:
+    case OpCode::ddiv:    need = 4; effect = -2; return true;
+    case OpCode::dcmp:    need = 4; effect = -3; return true;
+    case OpCode::iprint:
+    case OpCode::cprint:
+    case OpCode::sprint:  need = 1; effect = -1; return true;
+    case OpCode::dprint:  need = 2; effect = -2; return true;
+    case OpCode::printl:  need = 0; effect = 0;  return true;
+    default:              return false;
+    }
+}
+
+bool VM::isJump(OpCode op) {
+    return OpCode::jmp <= op && op <= OpCode::jle;
+}
+
+// Fuses
+//     loada L,x; iload                => loadv L,x
+//     loada L,x; <straight>; istore   => <straight>; storev L,x
+//     icmp; jCOND t                   => icmp_jCOND t
+// Nothing may jump into the middle of a fused sequence. Dropped instructions
+// are compacted away, so jump targets are remapped and origin keeps the index
+// in the file for stack traces: that of the jump for icmp_jCOND, which fails
+// where jCOND would. loadv keeps the loada, whose push may overflow the stack,
+// and reports a failed read at the iload after it.
+// Fusing a store drops the address cell, so the cells pushed after it move
+// down by one: the straight code must not address them with loada 0,x. That
+// needs the depth of the loada, without depthAt no store is fused. The first
+// instruction of the window reserves the stack the window needs with the
+// cell, where it does not fit the window runs unfused to overflow in place.
+std::vector<VM::ThreadedInstruction> VM::fuse(const std::vector<Instruction>& instructions, const std::vector<i8>& depthAt) {
+    const std::size_t size = instructions.size();
+    std::vector<bool> isTarget(size + 1, false);
+    for (std::size_t i = 0; i < size; ++i) {
+        auto& ins = instructions[i];
+        if (isJump(ins.op) && static_cast<u2>(ins.x) < size) {
+            isTarget[static_cast<u2>(ins.x)] = true;
+        }
+        // the entries of a table must stay in place, one after another
+        if (ins.op == OpCode::tableswitch) {
+            for (std::size_t j = i + 1; j < size && j <= i + 1 + static_cast<u2>(ins.y); ++j) {
+                isTarget[j] = true;
+            }
+        }
+    }
+
+    // loada at i whose address is consumed by the istore at storeOf[i]
+    const std::size_t maxScan = 64;
+    std::vector<std::size_t> storeOf(size, size);
+    std::vector<bool> storeFused(size, false);
+    std::vector<u2> reserveOf(size, 0);
+    for (std::size_t i = 0; i + 1 < size; ++i) {
+        if (instructions[i].op != OpCode::loada || instructions[i+1].op == OpCode::iload
+            || depthAt.empty() || depthAt[i] < 0) {
+            continue;
+        }
+        // windows starting one after another would share their first instruction
+        if (i > 0 && storeOf[i-1] < size) {
+            continue;
+        }
+        i8 depth = 1;
+        i8 peak = 1;
+        for (std::size_t j = i + 1; j < size && j <= i + maxScan && !isTarget[j]; ++j) {
+            auto& ins = instructions[j];
+            if (ins.op == OpCode::loada && ins.x == 0 && static_cast<i8>(ins.y) >= depthAt[i]) {
+                break;
+            }
+            if (ins.op == OpCode::istore && depth == 2) {
+                storeOf[i] = j;
+                storeFused[j] = true;
+                reserveOf[i] = static_cast<u2>(peak);
+                break;
+            }
+            i8 need, effect;
+            // the address must stay untouched below the value
+            if (!stackEffect(ins, need, effect) || need > depth - 1) {
+                break;
+            }
+            depth += effect;
+            peak = std::max(peak, depth);
+            if (peak > UINT16_MAX) {
+                break;
+            }
+        }
+    }
+
+    std::vector<ThreadedInstruction> rtv;
+    std::vector<u4> newIndex(size + 1);
+    rtv.reserve(size);
+    for (std::size_t i = 0; i < size; ++i) {
+        newIndex[i] = rtv.size();
+        auto& ins = instructions[i];
+        if (ins.op == OpCode::loada && storeOf[i] < size) {
+            continue;
+        }
+        if (storeFused[i]) {
+            // the matching loada is the closest one pointing here
+            std::size_t k = i;
+            while (storeOf[--k] != i) {
+            }
+            auto& addr = instructions[k];
+            rtv.push_back(ThreadedInstruction{nullptr, Fused::storev, 0, addr.x, addr.y, static_cast<u4>(i)});
+            continue;
+        }
+        if (i + 1 < size && !isTarget[i+1]) {
+            auto& next = instructions[i+1];
+            if (ins.op == OpCode::loada && next.op == OpCode::iload) {
+                rtv.push_back(ThreadedInstruction{nullptr, Fused::loadv, 0, ins.x, ins.y, static_cast<u4>(i)});
+                newIndex[++i] = rtv.size() - 1;
+                continue;
+            }
+            if (ins.op == OpCode::icmp && OpCode::je <= next.op && next.op <= OpCode::jle) {
+                auto op = static_cast<OpCode>(static_cast<u1>(Fused::icmp_je)
+                    + static_cast<u1>(next.op) - static_cast<u1>(OpCode::je));
+                rtv.push_back(ThreadedInstruction{nullptr, op, 0, next.x, 0, static_cast<u4>(i + 1)});
+                newIndex[++i] = rtv.size() - 1;
+                continue;
+            }
+        }
+        rtv.push_back(ThreadedInstruction{nullptr, ins.op, 0, ins.x, ins.y, static_cast<u4>(i)});
+    }
+    newIndex[size] = rtv.size();
+    for (std::size_t i = 0; i < size; ++i) {
+        if (reserveOf[i] != 0) {
+            rtv[newIndex[i+1]].reserve = reserveOf[i];
+        }
+    }
+
+    // jumps past the end stay past the end so they still fail
+    for (auto& ins : rtv) {
+        if (isJump(ins.op) || (Fused::icmp_je <= ins.op && ins.op <= Fused::icmp_jle)) {
+            u2 target = static_cast<u2>(ins.x);
+            ins.x = target <= size ? newIndex[target] : rtv.size() + (target - size);
+        }
+    }
+    _decodedInstructions += size;
+    _fusedInstructions += size - rtv.size();
+    return rtv;
+}
+
+addr_t VM::originOf(int functionIndex, addr_t pc) const {
+    if (_engine == Engine::Threaded) {
+        auto& code = functionIndex < 0 ? _threadedStart : _threadedFunctions[functionIndex];
+        if (0 <= pc && static_cast<std::size_t>(pc) < code.size()) {
+            return code[pc].origin;
+        }
+    }
+    else if (_engine == Engine::Register || _engine == Engine::Jit) {
+        auto& code = functionIndex < 0 ? _registerStart.code : _registerFunctions[functionIndex].code;
+        if (0 <= pc && static_cast<std::size_t>(pc) < code.size()) {
+            return code[pc].origin;
+        }
+    }
+    else {
+        return pc;
+    }
+    return functionIndex < 0 ? _file.start.size() : _file.functions[functionIndex].instructions.size();
+}
+
+addr_t VM::frameOrigin(std::size_t frame, addr_t pc) const {
+    return frame >= _interpretedFrom ? pc : originOf(_contexts[frame].functionIndex, pc);
+}
+
+// Runs the instructions of the file a fused store window stands for, from
+// its loada to the istore, whose index it returns. Whatever fails does so
+// at the instruction the other engines stop at.
+addr_t VM::replayStore(addr_t loada) {
+    auto& instructions = *_currentInstructions;
+    i8 depth = 0;
+    for (auto k = loada; ; ++k) {
+        auto& ins = instructions[k];
+        bool last = ins.op == OpCode::istore && depth == 2;
+        try {
+            executeInstruction(ins);
+        }
+        catch (...) {
+            _failedOrigin = k;
+            throw;
+        }
+        if (last) {
+            return k;
+        }
+        i8 need, effect;
+        stackEffect(ins, need, effect);
+        depth += effect;
+    }
+}
+
+void VM::runThreaded() {
+    try {
+        executeThreaded();
+        if (_contexts.size() != 1) {
+            // no ret at the end of funtion
+            throw InvalidControlTransfer();
+        }
+    }
+    catch (const std::exception& e) {
+        println(std::cerr, "runtime error:", e.what(), "!");
+        println(std::cerr, "occurred at:");
+        printStackTrace(std::cerr);
+    }
+}
+
+// Labels as values are a GNU extension, fall back to a switch elsewhere.
+#if defined(__GNUC__) && !defined(CC0_NO_COMPUTED_GOTO)
+#define CC0_COMPUTED_GOTO 1
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#else
+#define CC0_COMPUTED_GOTO 0
+#endif
+
+void VM::executeThreaded() {
+    // the counter lives in a register and is written back however we leave
+    // a superinstruction counts as every instruction it replaces
+    struct Counter {
+        int& total;
+        int& fusedTotal;
+        int n = 0;
+        int fused = 0;
+        ~Counter() { total += n + fused; fusedTotal += fused; }
+    } counter{_counterInstruction, _counterFused};
+
+    const ThreadedInstruction* code = nullptr;
+    const ThreadedInstruction* ins = nullptr;
+    u4 size = 0;
+    const auto reload = [&]() {
+        int index = _contexts.back().functionIndex;
+        auto& v = index < 0 ? _threadedStart : _threadedFunctions[index];
+        code = v.data();
+        size = v.size();
+    };
+    // the window from ins to its storev does not fit, run it unfused
+    const auto replay = [&]() {
+        addr_t loada = ins->origin - 1;
+        addr_t istore = replayStore(loada);
+        counter.n += istore - loada;
+        while (code[_ip].origin != static_cast<u4>(istore)) {
+            ++_ip;
+        }
+    };
+
+#if CC0_COMPUTED_GOTO
+    const void* table[256];
+    for (auto& handler : table) {
+        handler = &&L_invalid;
+    }
+    #define BIND(name) table[static_cast<u1>(OpCode::name)] = &&L_##name
+    BIND(nop);
+    BIND(bipush);  BIND(ipush);
+    BIND(pop);     BIND(pop2);    BIND(popn);
+    BIND(dup);     BIND(dup2);
+    BIND(loadc);   BIND(loada);
+    BIND(_new);    BIND(snew);
+    BIND(iload);   BIND(dload);   BIND(aload);
+    BIND(iaload);  BIND(daload);  BIND(aaload);
+    BIND(istore);  BIND(dstore);  BIND(astore);
+    BIND(iastore); BIND(dastore); BIND(aastore);
+    BIND(iadd);    BIND(dadd);
+    BIND(isub);    BIND(dsub);
+    BIND(imul);    BIND(dmul);
+    BIND(idiv);    BIND(ddiv);
+    BIND(ineg);    BIND(dneg);
+    BIND(icmp);    BIND(dcmp);
+    BIND(i2d);     BIND(d2i);     BIND(i2c);
+    BIND(jmp);
+    BIND(je);      BIND(jne);     BIND(jl);
+    BIND(jge);     BIND(jg);      BIND(jle);
+    BIND(tableswitch);
+    BIND(call);    BIND(tailcall);
+    BIND(ret);     BIND(iret);    BIND(dret);    BIND(aret);
+    BIND(iprint);  BIND(dprint);  BIND(cprint);  BIND(sprint);
+    BIND(printl);
+    BIND(iscan);   BIND(dscan);   BIND(cscan);
+    #undef BIND
+    #define BIND_FUSED(name) table[static_cast<u1>(Fused::name)] = &&L_fused_##name
+    BIND_FUSED(loadv);    BIND_FUSED(storev);
+    BIND_FUSED(icmp_je);  BIND_FUSED(icmp_jne); BIND_FUSED(icmp_jl);
+    BIND_FUSED(icmp_jge); BIND_FUSED(icmp_jg);  BIND_FUSED(icmp_jle);
+    #undef BIND_FUSED
+    for (auto& ins : _threadedStart) {
+        ins.handler = ins.reserve != 0 ? &&L_reserve : table[static_cast<u1>(ins.op)];
+    }
+    for (auto& fun : _threadedFunctions) {
+        for (auto& ins : fun) {
+            ins.handler = ins.reserve != 0 ? &&L_reserve : table[static_cast<u1>(ins.op)];
+        }
+    }
+    #define TARGET(name) L_##name:
+    #define FUSED(name) L_fused_##name:
+    #define DISPATCH() do { \
+            if (static_cast<u4>(_ip) >= size) goto L_end; \
+            ins = code + _ip; \
+            ++counter.n; \
+            goto *ins->handler; \
+        } while (false)
+#else
+    #define TARGET(name) case OpCode::name:
+    #define FUSED(name) case Fused::name:
+    #define DISPATCH() goto L_dispatch
+#endif
+    #define NEXT() do { ++_ip; DISPATCH(); } while (false)
+    #define JUMP_TO(offset) do { \
+            u2 target = (offset); \
+            if (target >= size) throw InvalidControlTransfer(); \
+            _ip = target; \
+            DISPATCH(); \
+        } while (false)
+
+    reload();
+#if CC0_COMPUTED_GOTO
+    DISPATCH();
+L_reserve:
+    if (ins->reserve > _stack.capacity() - _sp) {
+        replay();
+        NEXT();
+    }
+    goto *table[static_cast<u1>(ins->op)];
+#else
+L_dispatch:
+    if (static_cast<u4>(_ip) >= size) goto L_end;
+    ins = code + _ip;
+    ++counter.n;
+    if (ins->reserve > _stack.capacity() - _sp) {
+        replay();
+        NEXT();
+    }
+    switch (ins->op) {
+#endif
+    TARGET(nop)     NEXT();
+    TARGET(bipush)
+    TARGET(ipush)   ipush(ins->x);       NEXT();
+    TARGET(pop)     popn(1);             NEXT();
+    TARGET(pop2)    popn(2);             NEXT();
+    TARGET(popn)    popn(ins->x);        NEXT();
+    TARGET(dup)     dup();               NEXT();
+    TARGET(dup2)    dup2();              NEXT();
+    TARGET(loadc)   loadc(ins->x);       NEXT();
+    TARGET(loada)   loada(ins->x, ins->y); NEXT();
+    TARGET(_new)    _new();              NEXT();
+    TARGET(snew)    snew(ins->x);        NEXT();
+
+    TARGET(iload)   Tload<int_t>();      NEXT();
+    TARGET(dload)   Tload<double_t>();   NEXT();
+    TARGET(aload)   Tload<addr_t>();     NEXT();
+    TARGET(iaload)  Taload<int_t>();     NEXT();
+    TARGET(daload)  Taload<double_t>();  NEXT();
+    TARGET(aaload)  Taload<addr_t>();    NEXT();
+
+    TARGET(istore)  Tstore<int_t>();     NEXT();
+    TARGET(dstore)  Tstore<double_t>();  NEXT();
+    TARGET(astore)  Tstore<addr_t>();    NEXT();
+    TARGET(iastore) Tastore<int_t>();    NEXT();
+    TARGET(dastore) Tastore<double_t>(); NEXT();
+    TARGET(aastore) Tastore<addr_t>();   NEXT();
+
+    TARGET(iadd)    Tadd<int_t>();       NEXT();
+    TARGET(dadd)    Tadd<double_t>();    NEXT();
+    TARGET(isub)    Tsub<int_t>();       NEXT();
+    TARGET(dsub)    Tsub<double_t>();    NEXT();
+    TARGET(imul)    Tmul<int_t>();       NEXT();
+    TARGET(dmul)    Tmul<double_t>();    NEXT();
+    TARGET(idiv)    Tdiv<int_t>();       NEXT();
+    TARGET(ddiv)    Tdiv<double_t>();    NEXT();
+    TARGET(ineg)    Tneg<int_t>();       NEXT();
+    TARGET(dneg)    Tneg<double_t>();    NEXT();
+
+    TARGET(icmp)    Tcmp<int_t>();       NEXT();
+    TARGET(dcmp)    Tcmp<double_t>();    NEXT();
+
+    TARGET(i2d)     T2T<int_t, double_t>(); NEXT();
+    TARGET(d2i)     T2T<double_t, int_t>(); NEXT();
+    TARGET(i2c)     T2T<int_t, char_t>();   NEXT();
+
+    TARGET(jmp)     JUMP_TO(ins->x);
+    TARGET(je)      if (POP<int_t>() == 0) JUMP_TO(ins->x); NEXT();
+    TARGET(jne)     if (POP<int_t>() != 0) JUMP_TO(ins->x); NEXT();
+    TARGET(jl)      if (POP<int_t>() <  0) JUMP_TO(ins->x); NEXT();
+    TARGET(jge)     if (POP<int_t>() >= 0) JUMP_TO(ins->x); NEXT();
+    TARGET(jg)      if (POP<int_t>() >  0) JUMP_TO(ins->x); NEXT();
+    TARGET(jle)     if (POP<int_t>() <= 0) JUMP_TO(ins->x); NEXT();
+    TARGET(tableswitch) {
+        u4 index = static_cast<u4>(POP<int_t>()) - ins->x;
+        if (index > ins->y) {
+            index = ins->y;
+        }
+        u4 entry = _ip + 1 + index;
+        if (entry >= size) throw InvalidControlTransfer();
+        // the entry is a jmp as generated, take it without another dispatch
+        if (code[entry].op == OpCode::jmp) {
+            ++counter.fused;
+            JUMP_TO(code[entry].x);
+        }
+        _ip = entry;
+        DISPATCH();
+    }
+
+    TARGET(call)    CALL(ins->x);      reload(); _ip = 0; DISPATCH();
+    TARGET(tailcall) TAILCALL(ins->x); reload(); _ip = 0; DISPATCH();
+    TARGET(ret)     Tret<void>();      reload(); NEXT();
+    TARGET(iret)    Tret<int_t>();     reload(); NEXT();
+    TARGET(dret)    Tret<double_t>();  reload(); NEXT();
+    TARGET(aret)    Tret<addr_t>();    reload(); NEXT();
+
+    TARGET(iprint)  Tprint<int_t>();    NEXT();
+    TARGET(dprint)  Tprint<double_t>(); NEXT();
+    TARGET(cprint)  Tprint<char_t>();   NEXT();
+    TARGET(sprint)  sprint();           NEXT();
+    TARGET(printl)  printl();           NEXT();
+    TARGET(iscan)   Tscan<int_t>();     NEXT();
+    TARGET(dscan)   Tscan<double_t>();  NEXT();
+    TARGET(cscan)   Tscan<char_t>();    NEXT();
+
+    FUSED(loadv) {
+        ensureStackRest(1);
+        auto addr = frameAddr(ins->x, ins->y);
+        int_t value;
+        try {
+            value = READ<int_t>(addr);
+        }
+        catch (...) {
+            _failedOrigin = ins->origin + 1;
+            throw;
+        }
+        PUSH(value);
+        ++counter.fused;
+        NEXT();
+    }
+    FUSED(storev) {
+        auto value = POP<int_t>();
+        WRITE(frameAddr(ins->x, ins->y), value);
+        ++counter.fused;
+        NEXT();
+    }
+    #define ICMP_JUMP(cond) do { \
+            auto rhs = POP<int_t>(); \
+            auto lhs = POP<int_t>(); \
+            ++counter.fused; \
+            if (lhs cond rhs) JUMP_TO(ins->x); \
+            NEXT(); \
+        } while (false)
+    FUSED(icmp_je)  ICMP_JUMP(==);
+    FUSED(icmp_jne) ICMP_JUMP(!=);
+    FUSED(icmp_jl)  ICMP_JUMP(<);
+    FUSED(icmp_jge) ICMP_JUMP(>=);
+    FUSED(icmp_jg)  ICMP_JUMP(>);
+    FUSED(icmp_jle) ICMP_JUMP(<=);
+    #undef ICMP_JUMP
+#if CC0_COMPUTED_GOTO
+L_invalid:
+#else
+    default:
+#endif
+    // executeInstruction ignores unknown opcodes as well
+    NEXT();
+#if !CC0_COMPUTED_GOTO
+    }
+#endif
+L_end:
+    return;
+
+    #undef JUMP_TO
+    #undef NEXT
+    #undef DISPATCH
+    #undef FUSED
+    #undef TARGET
+}
+
+#if CC0_COMPUTED_GOTO
+#pragma GCC diagnostic pop
+#endif
+
+}
@@ -6,9 +6,12 @@
 #include "./constant.h"
 #include "./function.h"
 #include "./file.h"
+#include "./memory.h"
+#include "./heap.h"
 
 #include <memory>
 #include <cstdint>
+#include <exception>
 #include <string>
 #include <vector>
 #include <variant>
@@ -16,6 +19,25 @@
 namespace vm {
 
 class VM {
+public:
+    // switch: decode and dispatch every instruction through executeInstruction
+    // threaded: pre-decode each function and dispatch through bound handlers
+    // register: translate each function to three-address code over frame slots,
+    //           falls back to threaded if any function can not be translated
+    // jit: compile the register code to x86-64 machine code, calls, returns and
+    //      whatever needs the vm leave it for the interpreter; falls back to
+    //      register where no machine code can be generated
+    enum class Engine {
+        Switch, Threaded, Register, Jit
+    };
+
+    // sizes in slots, memory is committed lazily up to these limits
+    // 0 (or anything beyond the address layout) means the layout maximum
+    struct Limits {
+        addr_t stackSize;
+        addr_t heapSize;
+    };
+
 private:
     static const addr_t MIN_STACK_ADDR;
     static const addr_t MAX_STACK_ADDR;
@@ -25,16 +47,20 @@ private:
     static const addr_t MAX_HEAP_SIZE;
 
 private:
+    friend class RegisterTranslator;
+    friend class JitCompiler;
+
     bool prepared;
+    Engine _engine;
     File _file;
     //std::vector<std::shared_ptr<Stack>> stacks;
-    std::unique_ptr<slot_t[]> _stack;
-    std::unique_ptr<slot_t[]> _heap;
-    std::vector<std::pair<addr_t, addr_t>> _heapRecord;
+    SlotRegion _stack;
+    Heap _heap;
     addr_t _sp;
     addr_t _bp;
     addr_t _ip;
     int _counterInstruction;
+    int _counterFused;
     // int _counterMicroIns;
     
     struct Context {
@@ -44,12 +70,107 @@ private:
         addr_t BP;
         int staticLink; // index in contexts
         int functionIndex;
-        std::string functionName;
+        const str_t* functionName;
         vm::u2 functionLevel;
     };
     std::vector<Context> _contexts;
-    std::vector<Instruction> _currentInstructions;
+    // points into _file, so CALL and RET never copy code
+    const std::vector<Instruction>* _currentInstructions;
     std::unordered_map<vm::u2, addr_t> _stringLiteralPool;
+
+    // threaded engine: every function is decoded once, handler is bound when run
+    // hot sequences are fused into superinstructions, origin maps back to the file
+    struct ThreadedInstruction {
+        const void* handler;
+        OpCode op;
+        // stack a fused store window needs from here, 0 outside of one
+        u2 reserve;
+        u4 x;
+        u4 y;
+        u4 origin;
+    };
+    std::vector<ThreadedInstruction> _threadedStart;
+    std::vector<std::vector<ThreadedInstruction>> _threadedFunctions;
+    // index in the file of a fused instruction that failed part way, -1 if none
+    addr_t _failedOrigin;
+    int _fusedInstructions;
+    int _decodedInstructions;
+
+    // internal opcodes of the superinstructions, never read from or written to a file
+    struct Fused {
+        // loada level_diff,offset; iload
+        static constexpr OpCode loadv = static_cast<OpCode>(0xe0);
+        // loada level_diff,offset; <value>; istore
+        static constexpr OpCode storev = static_cast<OpCode>(0xe1);
+        // icmp; jCOND offset
+        static constexpr OpCode icmp_je  = static_cast<OpCode>(0xe8);
+        static constexpr OpCode icmp_jne = static_cast<OpCode>(0xe9);
+        static constexpr OpCode icmp_jl  = static_cast<OpCode>(0xea);
+        static constexpr OpCode icmp_jge = static_cast<OpCode>(0xeb);
+        static constexpr OpCode icmp_jg  = static_cast<OpCode>(0xec);
+        static constexpr OpCode icmp_jle = static_cast<OpCode>(0xed);
+    };
+
+    // register engine: operand stack slot d of a frame is register r[d] = stack[bp+d],
+    // the stack depth of every instruction is known when translating, so operands
+    // are addressed directly and only generic instructions touch sp
+    enum class RegOp : u1 {
+        movr, movi, lea,                // r[a] = r[b] | b | address of level b, offset c
+        load, loadv,                    // r[a] = *r[b] | *(level b, offset c)
+        store, storei,                  // *r[a] = r[b] | b
+        storev, storevi,                // *(level a, offset b) = r[c] | c
+        addr, addi, subr, subi,         // r[a] = r[b] op (r[c] | c)
+        mulr, muli, divr, divi,
+        cmpr, cmpi, neg,
+        jer, jei, jner, jnei,           // if (r[a] cond (r[b] | b)) goto c
+        jlr, jli, jger, jgei,
+        jgr, jgi, jler, jlei,
+        jmp,                            // goto a
+        table,                          // goto the jmp at min(r[a] - b, c) after this one
+        call,                           // call function a
+        tailcall,                       // call function a in place of this frame
+        ret,                            // return with original opcode a
+        stack,                          // original instruction {a, b, c} on the stack
+        end,                            // control reaches the end
+    };
+    struct RegisterInstruction {
+        const void* handler;
+        RegOp op;
+        u2 covers;      // instructions of the file this one completes
+        i4 a, b, c;
+        i4 depth;       // stack depth before the original instruction
+        u4 origin;
+    };
+    struct RegisterFunction {
+        std::vector<RegisterInstruction> code;
+        i4 maxDepth;
+    };
+    RegisterFunction _registerStart;
+    std::vector<RegisterFunction> _registerFunctions;
+    bool _registerFailed;
+    // contexts from this index on run in the interpreter and keep pcs of the file
+    std::size_t _interpretedFrom;
+
+    // jit engine: one executable mapping for the register code of every function,
+    // entered through the thunk at its start; label holds the native offset of
+    // every register instruction, so the interpreter can resume anywhere
+    struct JitCode {
+        u1* memory = nullptr;
+        std::size_t size = 0;
+        std::vector<u4> startLabels;
+        std::vector<std::vector<u4>> labels;
+
+        JitCode() = default;
+        JitCode(const JitCode&) = delete;
+        JitCode& operator=(const JitCode&) = delete;
+        ~JitCode();
+    };
+    JitCode _jit;
+    bool _jitFailed;
+    // raised in a helper called from machine code, rethrown once it is left
+    std::exception_ptr _jitError;
+    int _jitExits;
+    int _jitHelperCalls;
     
 public:
     VM(File) noexcept;
@@ -58,13 +179,40 @@ public:
     VM& operator=(VM) = delete;
 
 public:
-    static std::unique_ptr<VM> make_vm(File file);
+    static std::unique_ptr<VM> make_vm(File file, Engine engine = Engine::Switch, Limits limits = Limits{});
     void start();
+    const Heap& heap() const noexcept { return _heap; }
+    // instructions of the file run by the last start, as counted by printStats
+    int executedInstructions() const noexcept { return _counterInstruction; }
+    void printStats(std::ostream&) const;
 
 private: 
     void init() noexcept;
     void buildStringLiteralPool();
     void run();
+    void predecode();
+    bool translateRegister();
+    void runRegister();
+    void executeRegister();
+    bool reserveRegister(const RegisterFunction& fun, addr_t bp);
+    void interpretFrame();
+    bool compileJit();
+    void runJit();
+    void executeJit();
+    bool stackEffect(const Instruction& ins, i8& need, i8& effect) const;
+    static bool isJump(OpCode op);
+    // stack depth before each instruction counted from the frame, -1 where
+    // unreachable, empty if two paths disagree; shared with the register translation
+    std::vector<i8> stackDepths(const std::vector<Instruction>& code, int functionIndex,
+                                const std::vector<int>& returnSlots) const;
+    // slots left by a call of each function, -1 if unknown; scans every function
+    std::vector<int> returnSlots() const;
+    std::vector<ThreadedInstruction> fuse(const std::vector<Instruction>&, const std::vector<i8>& depthAt);
+    addr_t originOf(int functionIndex, addr_t pc) const;
+    addr_t frameOrigin(std::size_t frame, addr_t pc) const;
+    addr_t replayStore(addr_t loada);
+    void runThreaded();
+    void executeThreaded();
     void ensureStackRest(addr_t count);
     void ensureStackUsed(addr_t count);
     slot_t* checkAddr(addr_t addr, addr_t count);
@@ -88,6 +236,7 @@ private:
 
     void    JUMP(u2 offset);
     void    CALL(u2 index);
+    void    TAILCALL(u2 index);
     void    RET();
 
 private:
@@ -98,6 +247,7 @@ private:
     void dup(); void dup2();
     void loadc(u2 index);
     void loada(u2 level_diff, addr_t offset);
+    addr_t frameAddr(u2 level_diff, addr_t offset);
     
     void _new();
     void snew(addr_t count);
@@ -131,8 +281,10 @@ private:
     void je(u2 offset); void jne(u2 offset); 
     void jl(u2 offset); void jge(u2 offset); 
     void jg(u2 offset); void jle(u2 offset);
+    void tableswitch(int_t low, u2 count);
 
     void call(u2 index);
+    void tailcall(u2 index);
     template <typename T>
     void Tret();
     
@@ -0,0 +1,665 @@
+#include "./vm.h"
+#include "./exception.h"
+
+#include <cstring>
+#include <initializer_list>
+#include <iostream>
+#include <tuple>
+#include <utility>
+
+// Machine code is only generated for x86-64 with the System V calling
+// convention, everywhere else the jit engine falls back to register.
+#if !defined(CC0_NO_JIT) && defined(__x86_64__) && defined(__linux__)
+#include <sys/mman.h>
+#define CC0_JIT 1
+#else
+#define CC0_JIT 0
+#endif
+
+namespace vm {
+
+VM::JitCode::~JitCode() {
+#if CC0_JIT
+    if (memory != nullptr) {
+        ::munmap(memory, size);
+    }
+#endif
+}
+
+namespace {
+
+// registers by their encoding
+enum Reg : u1 {
+    rax, rcx, rdx, rbx, rsp, rbp, rsi, rdi,
+};
+
+// condition codes, added to 0x70 (rel8) or 0x0f 0x80 (rel32)
+enum Cond : u1 {
+    ae = 0x3, e = 0x4, ne = 0x5, be = 0x6, l = 0xc, ge = 0xd, le = 0xe, g = 0xf,
+};
+
+// Only the encodings the jit needs. A frame slot is [rbx + 4*slot], values
+// are 32 bit and kept in eax, ecx and edx, so no REX prefix is needed there.
+class Assembler {
+public:
+    std::size_t size() const { return _code.size(); }
+    std::vector<u1>& code() { return _code; }
+
+    void bytes(std::initializer_list<u1> list) {
+        _code.insert(_code.end(), list);
+    }
+
+    void u32(u4 value) {
+        for (int i = 0; i < 4; ++i) {
+            _code.push_back(static_cast<u1>(value >> (8 * i)));
+        }
+    }
+
+    void u64(u8 value) {
+        for (int i = 0; i < 8; ++i) {
+            _code.push_back(static_cast<u1>(value >> (8 * i)));
+        }
+    }
+
+    void patch(std::size_t at, u4 value) {
+        for (int i = 0; i < 4; ++i) {
+            _code[at + i] = static_cast<u1>(value >> (8 * i));
+        }
+    }
+
+    // rel32 at `at` so that it lands on target
+    void link(std::size_t at, std::size_t target) {
+        patch(at, static_cast<u4>(static_cast<i8>(target) - static_cast<i8>(at + 4)));
+    }
+
+    // <opcode> reg, [rbx + 4*slot]
+    void slot(std::initializer_list<u1> opcode, Reg reg, i4 slot) {
+        bytes(opcode);
+        _code.push_back(static_cast<u1>(0x80 | reg << 3 | rbx));
+        u32(static_cast<u4>(slot) * 4);
+    }
+
+    void load(Reg reg, i4 from)     { slot({0x8b}, reg, from); }
+    void store(i4 to, Reg reg)      { slot({0x89}, reg, to); }
+    void add(Reg reg, i4 from)      { slot({0x03}, reg, from); }
+    void sub(Reg reg, i4 from)      { slot({0x2b}, reg, from); }
+    void cmp(Reg reg, i4 from)      { slot({0x3b}, reg, from); }
+    void imul(Reg reg, i4 from)     { slot({0x0f, 0xaf}, reg, from); }
+
+    void storeImm(i4 to, i4 value) {
+        slot({0xc7}, rax, to);
+        u32(static_cast<u4>(value));
+    }
+
+    // and dword [rbx + 4*slot], value is 0x81 /4
+    void andImm(i4 to, i4 value) {
+        slot({0x81}, rsp, to);
+        u32(static_cast<u4>(value));
+    }
+
+    void movImm(Reg reg, i4 value) {
+        _code.push_back(static_cast<u1>(0xb8 + reg));
+        u32(static_cast<u4>(value));
+    }
+
+    // add, sub and cmp with an immediate are 0x81 /0, /5 and /7
+    void addImm(Reg reg, i4 value) { aluImm(0, reg, value); }
+    void subImm(Reg reg, i4 value) { aluImm(5, reg, value); }
+    void cmpImm(Reg reg, i4 value) { aluImm(7, reg, value); }
+
+    // reg = reg * value
+    void imulImm(Reg reg, i4 value) {
+        bytes({0x69, static_cast<u1>(0xc0 | reg << 3 | reg)});
+        u32(static_cast<u4>(value));
+    }
+
+    // reg = r14d + value, the base of the frame plus an offset
+    void leaFrame(Reg reg, i4 value) {
+        bytes({0x41, 0x8d, static_cast<u1>(0x80 | reg << 3 | 6)});
+        u32(static_cast<u4>(value));
+    }
+
+    // jmp or jcc with a rel32 to fill in, returns where it is
+    std::size_t jmp() {
+        _code.push_back(0xe9);
+        u32(0);
+        return size() - 4;
+    }
+
+    std::size_t jcc(Cond cond) {
+        bytes({0x0f, static_cast<u1>(0x80 | cond)});
+        u32(0);
+        return size() - 4;
+    }
+
+private:
+    void aluImm(u1 ext, Reg reg, i4 value) {
+        bytes({0x81, static_cast<u1>(0xc0 | ext << 3 | reg)});
+        u32(static_cast<u4>(value));
+    }
+
+private:
+    std::vector<u1> _code;
+};
+
+}
+
+// Compiles the register code of the start code and every function into one
+// executable mapping. While machine code runs
+//     rbx = r, the slots of the frame     r12 = the vm
+//     r14 = bp                            r15 = the stack
+// and a slot is never cached in a register, so the vm may take over after
+// any instruction. Calls, returns and the end of the code leave to the
+// interpreter with the index of the instruction in eax: the vm keeps every
+// frame, its limits and its stack trace, and deep recursion grows the vm stack
+// instead of the native one. Whatever else needs the vm (the heap, other
+// frames, print and scan, errors) calls step, which catches the exception and
+// makes the machine code leave the same way.
+class JitCompiler {
+public:
+    using RegOp = VM::RegOp;
+    using RegisterInstruction = VM::RegisterInstruction;
+    using RegisterFunction = VM::RegisterFunction;
+
+    explicit JitCompiler(VM& vm) : _vm(vm), _exit(0), _fixedGlobals(true) {
+        // when every function has the same level, 0 or 1, the static link of
+        // every frame is the start code at bp 0, whatever calls what
+        for (auto& fun : vm._file.functions) {
+            _fixedGlobals = _fixedGlobals && fun.level <= 1 && fun.level == vm._file.functions.front().level;
+        }
+    }
+
+    bool run() {
+        thunk();
+        if (!compile(_vm._registerStart, _vm._jit.startLabels)) {
+            return false;
+        }
+        _vm._jit.labels.assign(_vm._registerFunctions.size(), {});
+        for (std::size_t i = 0; i < _vm._registerFunctions.size(); ++i) {
+            if (!compile(_vm._registerFunctions[i], _vm._jit.labels[i])) {
+                return false;
+            }
+        }
+        return install();
+    }
+
+    // operands of the original iload or istore that are gone when it touches
+    // memory, sp leaves them out as in the register engine
+    static i4 popped(RegOp op) {
+        switch (op) {
+        case RegOp::load:
+        case RegOp::loadv:   return 1;
+        case RegOp::store:
+        case RegOp::storei:
+        case RegOp::storev:
+        case RegOp::storevi: return 2;
+        default:             return 0;
+        }
+    }
+
+    // slow path of an instruction, returns r or nullptr if it raised
+    static slot_t* step(VM* vm, const RegisterInstruction* pc) noexcept {
+        try {
+            ++vm->_jitHelperCalls;
+            vm->_sp = vm->_bp + pc->depth - popped(pc->op);
+            slot_t* r = vm->_stack.data() + vm->_bp;
+            switch (pc->op) {
+            case RegOp::lea:     r[pc->a] = vm->frameAddr(pc->b, pc->c); break;
+            case RegOp::load:    r[pc->a] = *vm->checkAddr(r[pc->b], 1); break;
+            case RegOp::loadv:   r[pc->a] = *vm->checkAddr(vm->frameAddr(pc->b, pc->c), 1); break;
+            case RegOp::store:   *vm->checkAddr(r[pc->a], 1) = r[pc->b]; break;
+            case RegOp::storei:  *vm->checkAddr(r[pc->a], 1) = pc->b; break;
+            case RegOp::storev:  *vm->checkAddr(vm->frameAddr(pc->a, pc->b), 1) = r[pc->c]; break;
+            case RegOp::storevi: *vm->checkAddr(vm->frameAddr(pc->a, pc->b), 1) = pc->c; break;
+            case RegOp::divr:
+            case RegOp::divi: {
+                int_t rhs = pc->op == RegOp::divr ? r[pc->c] : pc->c;
+                if (rhs == 0) {
+                    throw DivideByZero();
+                }
+                r[pc->a] = r[pc->b] / rhs;
+                break;
+            }
+            case RegOp::stack:
+                vm->executeInstruction(Instruction{static_cast<OpCode>(pc->a), static_cast<u4>(pc->b), static_cast<u4>(pc->c)});
+                break;
+            default:
+                break;
+            }
+            return vm->_stack.data() + vm->_bp;
+        }
+        catch (...) {
+            vm->_jitError = std::current_exception();
+            return nullptr;
+        }
+    }
+
+private:
+    // u4 enter(slot_t* r, VM* vm, const u1* target, slot_t* stack, u8 bp)
+    // saves what the machine code uses and jumps to target; leaving jumps to _exit
+    void thunk() {
+        _as.bytes({0x53});                      // push rbx
+        _as.bytes({0x41, 0x54});                // push r12
+        _as.bytes({0x41, 0x56});                // push r14
+        _as.bytes({0x41, 0x57});                // push r15
+        _as.bytes({0x48, 0x83, 0xec, 0x08});    // sub rsp, 8 (helper calls need rsp aligned)
+        _as.bytes({0x48, 0x89, 0xfb});          // mov rbx, rdi
+        _as.bytes({0x49, 0x89, 0xf4});          // mov r12, rsi
+        _as.bytes({0x49, 0x89, 0xcf});          // mov r15, rcx
+        _as.bytes({0x4d, 0x89, 0xc6});          // mov r14, r8
+        _as.bytes({0xff, 0xe2});                // jmp rdx
+        _exit = _as.size();
+        _as.bytes({0x48, 0x83, 0xc4, 0x08});    // add rsp, 8
+        _as.bytes({0x41, 0x5f});                // pop r15
+        _as.bytes({0x41, 0x5e});                // pop r14
+        _as.bytes({0x41, 0x5c});                // pop r12
+        _as.bytes({0x5b});                      // pop rbx
+        _as.bytes({0xc3});                      // ret
+    }
+
+    bool compile(const RegisterFunction& fun, std::vector<u4>& labels) {
+        // every slot must be addressable by a disp32
+        if (fun.maxDepth > INT32_MAX / 4) {
+            return false;
+        }
+        const auto& code = fun.code;
+        labels.assign(code.size(), 0);
+        _jumps.clear();
+        _entries.clear();
+        for (std::size_t i = 0; i < code.size(); ++i) {
+            labels[i] = static_cast<u4>(_as.size());
+            instruction(code, static_cast<u4>(i));
+        }
+        for (auto [at, target] : _jumps) {
+            _as.link(at, labels[target]);
+        }
+        // entries of a table are relative to the table
+        for (auto [at, start, target] : _entries) {
+            _as.patch(at, labels[target] - static_cast<u4>(start));
+        }
+        return true;
+    }
+
+    void instruction(const std::vector<RegisterInstruction>& code, u4 index) {
+        const auto& ins = code[index];
+        switch (ins.op) {
+        case RegOp::movr:
+            _as.load(rax, ins.b);
+            _as.store(ins.a, rax);
+            break;
+        case RegOp::movi:
+            _as.storeImm(ins.a, ins.b);
+            break;
+        case RegOp::lea:
+            if (frameAddress(ins.b, ins.c)) {
+                _as.store(ins.a, rax);
+            }
+            else {
+                helper(ins, index);
+            }
+            break;
+        case RegOp::load:
+            _as.load(rax, ins.b);
+            access(ins, index, true);
+            break;
+        case RegOp::loadv:
+            if (frameAddress(ins.b, ins.c)) {
+                access(ins, index, true);
+            }
+            else {
+                helper(ins, index);
+            }
+            break;
+        case RegOp::store:
+        case RegOp::storei:
+            _as.load(rax, ins.a);
+            access(ins, index, false);
+            break;
+        case RegOp::storev:
+        case RegOp::storevi:
+            if (frameAddress(ins.a, ins.b)) {
+                access(ins, index, false);
+            }
+            else {
+                helper(ins, index);
+            }
+            break;
+        case RegOp::addr: binary(ins, [&]() { _as.add(rax, ins.c); }); break;
+        case RegOp::addi: binary(ins, [&]() { _as.addImm(rax, ins.c); }); break;
+        case RegOp::subr: binary(ins, [&]() { _as.sub(rax, ins.c); }); break;
+        case RegOp::subi: binary(ins, [&]() { _as.subImm(rax, ins.c); }); break;
+        case RegOp::mulr: binary(ins, [&]() { _as.imul(rax, ins.c); }); break;
+        case RegOp::muli: binary(ins, [&]() { _as.imulImm(rax, ins.c); }); break;
+        case RegOp::divr:
+        case RegOp::divi:
+            divide(ins, index);
+            break;
+        case RegOp::cmpr:
+        case RegOp::cmpi:
+            _as.load(rax, ins.b);
+            if (ins.op == RegOp::cmpr) {
+                _as.cmp(rax, ins.c);
+            }
+            else {
+                _as.cmpImm(rax, ins.c);
+            }
+            _as.bytes({0x0f, 0x9f, 0xc1});      // setg cl
+            _as.bytes({0x0f, 0x9c, 0xc2});      // setl dl
+            _as.bytes({0x0f, 0xb6, 0xc9});      // movzx ecx, cl
+            _as.bytes({0x0f, 0xb6, 0xd2});      // movzx edx, dl
+            _as.bytes({0x29, 0xd1});            // sub ecx, edx
+            _as.store(ins.a, rcx);
+            break;
+        case RegOp::neg:
+            _as.load(rax, ins.b);
+            _as.bytes({0xf7, 0xd8});            // neg eax
+            _as.store(ins.a, rax);
+            break;
+        case RegOp::jer:  branch(ins, e, false);  break;
+        case RegOp::jei:  branch(ins, e, true);   break;
+        case RegOp::jner: branch(ins, ne, false); break;
+        case RegOp::jnei: branch(ins, ne, true);  break;
+        case RegOp::jlr:  branch(ins, l, false);  break;
+        case RegOp::jli:  branch(ins, l, true);   break;
+        case RegOp::jger: branch(ins, ge, false); break;
+        case RegOp::jgei: branch(ins, ge, true);  break;
+        case RegOp::jgr:  branch(ins, g, false);  break;
+        case RegOp::jgi:  branch(ins, g, true);   break;
+        case RegOp::jler: branch(ins, le, false); break;
+        case RegOp::jlei: branch(ins, le, true);  break;
+        case RegOp::jmp:
+            _jumps.emplace_back(_as.jmp(), ins.a);
+            break;
+        case RegOp::table:
+            table(code, index);
+            break;
+        case RegOp::stack:
+            generic(ins, index);
+            break;
+        default:
+            // call, tailcall, ret and end
+            leave(index);
+            break;
+        }
+    }
+
+    // eax = the address of (level b, offset c) if it is known without the vm
+    bool frameAddress(i4 b, i4 c) {
+        if (b == 0) {
+            _as.leaFrame(rax, c);
+            return true;
+        }
+        if (_fixedGlobals && b > 0) {
+            _as.movImm(rax, c);
+            return true;
+        }
+        return false;
+    }
+
+    // load from or store to the address in eax; an address below sp is a slot
+    // of the stack, anything else (the heap, errors) is left to step
+    void access(const RegisterInstruction& ins, u4 index, bool load) {
+        _as.leaFrame(rcx, ins.depth - popped(ins.op));  // ecx = sp
+        _as.bytes({0x39, 0xc8});                        // cmp eax, ecx
+        auto slow = _as.jcc(ae);
+        if (load) {
+            _as.bytes({0x41, 0x8b, 0x04, 0x87});        // mov eax, [r15 + rax*4]
+            _as.store(ins.a, rax);
+        }
+        else {
+            i4 value = ins.op == RegOp::storev || ins.op == RegOp::storevi ? ins.c : ins.b;
+            if (ins.op == RegOp::storei || ins.op == RegOp::storevi) {
+                _as.movImm(rcx, value);
+            }
+            else {
+                _as.load(rcx, value);
+            }
+            _as.bytes({0x41, 0x89, 0x0c, 0x87});        // mov [r15 + rax*4], ecx
+        }
+        auto done = _as.jmp();
+        _as.link(slow, _as.size());
+        helper(ins, index);
+        _as.link(done, _as.size());
+    }
+
+    template <typename Op>
+    void binary(const RegisterInstruction& ins, Op op) {
+        _as.load(rax, ins.b);
+        op();
+        _as.store(ins.a, rax);
+    }
+
+    // a zero divisor raises in step
+    void divide(const RegisterInstruction& ins, u4 index) {
+        std::size_t slow = 0;
+        if (ins.op == RegOp::divi) {
+            if (ins.c == 0) {
+                helper(ins, index);
+                return;
+            }
+            _as.movImm(rcx, ins.c);
+        }
+        else {
+            _as.load(rcx, ins.c);
+            _as.bytes({0x85, 0xc9});                    // test ecx, ecx
+            slow = _as.jcc(e);
+        }
+        _as.load(rax, ins.b);
+        _as.bytes({0x99});                              // cdq
+        _as.bytes({0xf7, 0xf9});                        // idiv ecx
+        _as.store(ins.a, rax);
+        if (ins.op == RegOp::divr) {
+            auto done = _as.jmp();
+            _as.link(slow, _as.size());
+            helper(ins, index);
+            _as.link(done, _as.size());
+        }
+    }
+
+    void branch(const RegisterInstruction& ins, Cond cond, bool imm) {
+        _as.load(rax, ins.a);
+        if (imm) {
+            _as.cmpImm(rax, ins.b);
+        }
+        else {
+            _as.cmp(rax, ins.b);
+        }
+        _jumps.emplace_back(_as.jcc(cond), ins.c);
+    }
+
+    // the entries are the jmps after the table, jump straight to their targets
+    void table(const std::vector<RegisterInstruction>& code, u4 index) {
+        const auto& ins = code[index];
+        _as.load(rax, ins.a);
+        _as.subImm(rax, ins.b);
+        _as.cmpImm(rax, ins.c);
+        _as.bytes({0x76, 0x05});                        // jbe +5
+        _as.movImm(rax, ins.c);
+        _as.bytes({0x48, 0x8d, 0x0d, 0x09, 0, 0, 0});   // lea rcx, [rip + 9], the table
+        _as.bytes({0x48, 0x63, 0x04, 0x81});            // movsxd rax, [rcx + rax*4]
+        _as.bytes({0x48, 0x01, 0xc8});                  // add rax, rcx
+        _as.bytes({0xff, 0xe0});                        // jmp rax
+        const std::size_t start = _as.size();
+        for (std::size_t k = 0; k <= static_cast<u4>(ins.c); ++k) {
+            _entries.emplace_back(_as.size(), start, code[index + 1 + k].a);
+            _as.u32(0);
+        }
+    }
+
+    // the depth is checked when translating and the frame is committed when it
+    // is entered, so what only moves values within it can not fail
+    void generic(const RegisterInstruction& ins, u4 index) {
+        const i4 d = ins.depth;
+        switch (static_cast<OpCode>(ins.a)) {
+        case OpCode::snew:
+            // sp follows the depth, the new slots are left as they are
+            break;
+        case OpCode::dup:
+            _as.load(rax, d - 1);
+            _as.store(d, rax);
+            break;
+        case OpCode::dup2:
+            _as.load(rax, d - 2);
+            _as.load(rcx, d - 1);
+            _as.store(d, rax);
+            _as.store(d + 1, rcx);
+            break;
+        case OpCode::i2c:
+            _as.andImm(d - 1, 0xff);
+            break;
+        default:
+            helper(ins, index);
+            break;
+        }
+    }
+
+    // call step for ins, leave if it raised, then reload r and the stack
+    void helper(const RegisterInstruction& ins, u4 index) {
+        _as.bytes({0x4c, 0x89, 0xe7});                  // mov rdi, r12
+        _as.bytes({0x48, 0xbe});                        // mov rsi, &ins
+        _as.u64(reinterpret_cast<u8>(&ins));
+        _as.bytes({0x48, 0xb8});                        // mov rax, step
+        _as.u64(reinterpret_cast<u8>(&JitCompiler::step));
+        _as.bytes({0xff, 0xd0});                        // call rax
+        _as.bytes({0x48, 0x85, 0xc0});                  // test rax, rax
+        _as.bytes({0x75, 0x0a});                        // jnz +10, over leave
+        leave(index);
+        _as.bytes({0x48, 0x89, 0xc3});                  // mov rbx, rax
+        // the stack moves when it grows without a reservation
+        _as.bytes({0x49, 0x89, 0xdf});                  // mov r15, rbx
+        _as.bytes({0x44, 0x89, 0xf1});                  // mov ecx, r14d
+        _as.bytes({0x48, 0xc1, 0xe1, 0x02});            // shl rcx, 2
+        _as.bytes({0x49, 0x29, 0xcf});                  // sub r15, rcx
+    }
+
+    // return index to the vm
+    void leave(u4 index) {
+        _as.movImm(rax, static_cast<i4>(index));
+        _as.link(_as.jmp(), _exit);
+    }
+
+    bool install() {
+#if CC0_JIT
+        auto& code = _as.code();
+        void* p = ::mmap(nullptr, code.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) {
+            return false;
+        }
+        std::memcpy(p, code.data(), code.size());
+        if (::mprotect(p, code.size(), PROT_READ | PROT_EXEC) != 0) {
+            ::munmap(p, code.size());
+            return false;
+        }
+        _vm._jit.memory = static_cast<u1*>(p);
+        _vm._jit.size = code.size();
+        return true;
+#else
+        return false;
+#endif
+    }
+
+private:
+    VM& _vm;
+    Assembler _as;
+    std::size_t _exit;
+    bool _fixedGlobals;
+    // rel32 to patch and the register instruction it jumps to
+    std::vector<std::pair<std::size_t, std::size_t>> _jumps;
+    // table entry, the start of its table and the target
+    std::vector<std::tuple<std::size_t, std::size_t, std::size_t>> _entries;
+};
+
+bool VM::compileJit() {
+#if CC0_JIT
+    return JitCompiler(*this).run();
+#else
+    return false;
+#endif
+}
+
+void VM::runJit() {
+    try {
+        executeJit();
+        if (_contexts.size() != 1) {
+            // no ret at the end of funtion
+            throw InvalidControlTransfer();
+        }
+    }
+    catch (const std::exception& e) {
+        println(std::cerr, "runtime error:", e.what(), "!");
+        println(std::cerr, "occurred at:");
+        printStackTrace(std::cerr);
+    }
+}
+
+// Runs machine code until it leaves, then does what made it leave the way
+// executeRegister does and enters it again where the interpreter goes on.
+void VM::executeJit() {
+#if CC0_JIT
+    using Enter = u4 (*)(slot_t*, VM*, const u1*, slot_t*, u8);
+    const auto enter = reinterpret_cast<Enter>(_jit.memory);
+    const RegisterInstruction* code = nullptr;
+    const std::vector<u4>* labels = nullptr;
+    const auto reload = [&]() {
+        int index = _contexts.back().functionIndex;
+        code = (index < 0 ? _registerStart : _registerFunctions[index]).code.data();
+        labels = index < 0 ? &_jit.startLabels : &_jit.labels[index];
+    };
+
+    reload();
+    u4 at = 0;
+    if (!reserveRegister(_registerStart, _bp)) {
+        _ip = -1;
+        interpretFrame();
+        return;
+    }
+    while (true) {
+        _ip = enter(_stack.data() + _bp, this, _jit.memory + (*labels)[at], _stack.data(), static_cast<u8>(_bp));
+        ++_jitExits;
+        if (_jitError) {
+            std::rethrow_exception(std::exchange(_jitError, nullptr));
+        }
+        const auto pc = code + _ip;
+        _sp = _bp + pc->depth;
+        switch (pc->op) {
+        case RegOp::call: {
+            auto& callee = _file.functions[pc->a];
+            bool fits = reserveRegister(_registerFunctions[pc->a], _sp - callee.paramSize);
+            CALL(pc->a);
+            if (!fits) {
+                interpretFrame();
+                reload();
+                at = _ip + 1;
+                break;
+            }
+            reload();
+            at = 0;
+            break;
+        }
+        case RegOp::tailcall: {
+            bool fits = reserveRegister(_registerFunctions[pc->a], _bp);
+            TAILCALL(pc->a);
+            if (!fits) {
+                interpretFrame();
+                reload();
+                at = _ip + 1;
+                break;
+            }
+            reload();
+            at = 0;
+            break;
+        }
+        case RegOp::ret:
+            executeInstruction(Instruction{static_cast<OpCode>(pc->a), 0, 0});
+            reload();
+            at = _ip + 1;
+            break;
+        default:
+            // control reaches the end
+            return;
+        }
+    }
+#endif
+}
+
+}
@@ -0,0 +1,865 @@
+#include "./vm.h"
+#include "./exception.h"
+
+#include <algorithm>
+#include <iostream>
+
+namespace vm {
+
+// Translates one function of the file to register code.
+// The stack depth before every reachable instruction is found first; code
+// where two paths meet with different depths is rejected. Values pushed by
+// ipush, loada and `loada 0,x; iload` are kept symbolic and only written to
+// their slot when something needs them there, so most pushes and pops vanish.
+// Every jump target starts with all slots written.
+class RegisterTranslator {
+public:
+    using RegOp = VM::RegOp;
+    using RegisterInstruction = VM::RegisterInstruction;
+
+    RegisterTranslator(const VM& vm, const std::vector<int>& returnSlots,
+                       const std::vector<Instruction>& code, int functionIndex)
+        : _vm(vm), _returnSlots(returnSlots), _code(code), _functionIndex(functionIndex),
+          _depthAt(code.size() + 1, -1), _isTarget(code.size() + 1, false),
+          _label(code.size() + 1, 0), _covers(0), _origin(0) {}
+
+    // slots left by a call of each function, -1 if its returns disagree
+    // a tail call leaves what its callee leaves
+    static std::vector<int> returnSlots(const VM& vm) {
+        const auto& functions = vm._file.functions;
+        // -1 until a return is seen, -2 once two of them disagree
+        const auto merge = [](int a, int b) {
+            return a == -1 ? b : b == -1 || a == b ? a : -2;
+        };
+        std::vector<int> slots(functions.size(), -1);
+        std::vector<std::vector<u2>> tails(functions.size());
+        for (std::size_t f = 0; f < functions.size(); ++f) {
+            for (auto& ins : functions[f].instructions) {
+                if (ins.op == OpCode::tailcall && static_cast<u2>(ins.x) < functions.size()) {
+                    tails[f].push_back(static_cast<u2>(ins.x));
+                }
+                int s = ins.op == OpCode::ret ? 0
+                    : ins.op == OpCode::iret || ins.op == OpCode::aret ? 1
+                    : ins.op == OpCode::dret ? 2 : -1;
+                if (s >= 0) {
+                    slots[f] = merge(slots[f], s);
+                }
+            }
+        }
+        // callees usually come first, so this settles after a pass or two
+        for (bool changed = true; changed; ) {
+            changed = false;
+            for (std::size_t f = 0; f < functions.size(); ++f) {
+                for (auto t : tails[f]) {
+                    int s = merge(slots[f], slots[t]);
+                    changed = changed || s != slots[f];
+                    slots[f] = s;
+                }
+            }
+        }
+        for (auto& s : slots) {
+            s = s == -2 ? -1 : s == -1 ? 0 : s;
+        }
+        return slots;
+    }
+
+    // the depth before each instruction, empty if it cannot be found
+    std::vector<i8> depths() {
+        if (!computeDepths()) {
+            return {};
+        }
+        return _depthAt;
+    }
+
+    bool run(VM::RegisterFunction& out) {
+        if (!computeDepths()) {
+            return false;
+        }
+        for (std::size_t i = 0; i < _code.size(); ++i) {
+            if (_isTarget[i]) {
+                flush();
+                _covers = 0;
+            }
+            _label[i] = _out.size();
+            if (_depthAt[i] < 0) {
+                continue;
+            }
+            if (_isTarget[i] || !_reachable) {
+                _stack.assign(_depthAt[i], Entry{Entry::Slot, 0, 0});
+                _reachable = true;
+            }
+            _origin = i;
+            ++_covers;
+            if (!translate(i)) {
+                return false;
+            }
+            if (_skip) {
+                _skip = false;
+                _label[++i] = _out.size();
+            }
+        }
+        flush();
+        _label[_code.size()] = _out.size();
+        _origin = _code.size();
+        emit(RegOp::end, 0, 0, 0);
+        for (auto [index, target] : _fixups) {
+            _out[index].c = _label[target];
+        }
+        for (auto index : _jumps) {
+            _out[index].a = _label[_out[index].a];
+        }
+        out.code = std::move(_out);
+        out.maxDepth = _maxDepth;
+        return true;
+    }
+
+private:
+    struct Entry {
+        enum Kind { Slot, Imm, Local, Addr } kind;
+        i4 v;   // value, local slot or level
+        i4 w;   // offset
+    };
+    struct Operand {
+        bool imm;
+        i4 value;
+    };
+
+    // the depth before each instruction, by walking every path once
+    bool computeDepths() {
+        const auto size = _code.size();
+        std::vector<std::size_t> work;
+        i8 params = 0;
+        if (_functionIndex >= 0) {
+            params = _vm._file.functions[_functionIndex].paramSize;
+        }
+        _maxDepth = params;
+        auto reach = [&](std::size_t i, i8 depth) {
+            if (i > size) {
+                return false;
+            }
+            if (_depthAt[i] < 0) {
+                _depthAt[i] = depth;
+                work.push_back(i);
+                return true;
+            }
+            return _depthAt[i] == depth;
+        };
+        reach(0, params);
+        while (!work.empty()) {
+            auto i = work.back();
+            work.pop_back();
+            if (i == size) {
+                continue;
+            }
+            auto& ins = _code[i];
+            i8 depth = _depthAt[i], need = 0, effect = 0;
+            bool fallthrough = true;
+            if (VM::isJump(ins.op)) {
+                need = ins.op == OpCode::jmp ? 0 : 1;
+                effect = -need;
+                fallthrough = ins.op != OpCode::jmp;
+                // jumping out of the function fails at run time
+                u2 target = static_cast<u2>(ins.x);
+                if (target >= size) {
+                    return false;
+                }
+                _isTarget[target] = true;
+                if (need > depth || !reach(target, depth + effect)) {
+                    return false;
+                }
+            }
+            else if (ins.op == OpCode::tableswitch) {
+                // every entry must be a jmp, so each one becomes a single jmp here
+                need = 1;
+                effect = -1;
+                fallthrough = false;
+                for (std::size_t j = i + 1; j <= i + 1 + static_cast<u2>(ins.y); ++j) {
+                    if (j >= size || _code[j].op != OpCode::jmp) {
+                        return false;
+                    }
+                    _isTarget[j] = true;
+                    if (need > depth || !reach(j, depth + effect)) {
+                        return false;
+                    }
+                }
+            }
+            else if (ins.op == OpCode::call) {
+                auto index = static_cast<u2>(ins.x);
+                if (index >= _vm._file.functions.size()) {
+                    return false;
+                }
+                need = _vm._file.functions[index].paramSize;
+                int slots = _returnSlots[index];
+                if (slots < 0) {
+                    return false;
+                }
+                effect = slots - need;
+            }
+            else if (ins.op == OpCode::tailcall) {
+                // leaves the frame like a ret, the start code has no frame to reuse
+                auto index = static_cast<u2>(ins.x);
+                if (_functionIndex < 0 || index >= _vm._file.functions.size()) {
+                    return false;
+                }
+                need = _vm._file.functions[index].paramSize;
+                fallthrough = false;
+            }
+            else if (ins.op == OpCode::ret || ins.op == OpCode::iret
+                || ins.op == OpCode::aret || ins.op == OpCode::dret) {
+                need = ins.op == OpCode::ret ? 0 : ins.op == OpCode::dret ? 2 : 1;
+                fallthrough = false;
+            }
+            else if (!_vm.stackEffect(ins, need, effect)) {
+                return false;
+            }
+            // would fail at run time, the other engines report it there
+            if (need > depth) {
+                return false;
+            }
+            _maxDepth = std::max(_maxDepth, depth + std::max<i8>(effect, 0));
+            if (fallthrough && !reach(i + 1, depth + effect)) {
+                return false;
+            }
+        }
+        return _maxDepth <= INT32_MAX;
+    }
+
+    void emit(RegOp op, i4 a, i4 b, i4 c) {
+        _out.push_back(RegisterInstruction{nullptr, op, static_cast<u2>(std::min<std::size_t>(_covers, U2_MAX)),
+            a, b, c, static_cast<i4>(_depthAt[_origin]), static_cast<u4>(_origin)});
+        _covers = 0;
+    }
+
+    i4 depth() const {
+        return static_cast<i4>(_stack.size());
+    }
+
+    // write the entry at p to its slot
+    void materialize(i4 p) {
+        auto e = _stack[p];
+        if (e.kind == Entry::Slot) {
+            return;
+        }
+        clobber(p);
+        switch (e.kind) {
+        case Entry::Imm:   emit(RegOp::movi, p, e.v, 0); break;
+        case Entry::Local: emit(RegOp::movr, p, e.v, 0); break;
+        case Entry::Addr:  emit(RegOp::lea, p, e.v, e.w); break;
+        default: break;
+        }
+        _stack[p] = Entry{Entry::Slot, 0, 0};
+    }
+
+    // slot p is about to be written, pending reads of it must happen first
+    void clobber(i4 p) {
+        for (i4 q = p + 1; q < depth(); ++q) {
+            if (_stack[q].kind == Entry::Local && _stack[q].v == p) {
+                materialize(q);
+            }
+        }
+    }
+
+    void flush() {
+        if (!_reachable) {
+            return;
+        }
+        for (i4 p = 0; p < depth(); ++p) {
+            materialize(p);
+        }
+    }
+
+    // a store through an unknown address may hit any pending read
+    void flushLocals() {
+        for (i4 p = 0; p < depth(); ++p) {
+            if (_stack[p].kind == Entry::Local) {
+                materialize(p);
+            }
+        }
+    }
+
+    Operand operand(i4 p) {
+        auto e = _stack[p];
+        switch (e.kind) {
+        case Entry::Imm:   return {true, e.v};
+        case Entry::Local: return {false, e.v};
+        case Entry::Slot:  return {false, p};
+        default:
+            materialize(p);
+            return {false, p};
+        }
+    }
+
+    Operand registerOperand(i4 p) {
+        materializeImm(p);
+        return operand(p);
+    }
+
+    void materializeImm(i4 p) {
+        if (_stack[p].kind == Entry::Imm) {
+            materialize(p);
+        }
+    }
+
+    void push(Entry e) {
+        _stack.push_back(e);
+    }
+
+    void pop(i8 n) {
+        _stack.resize(_stack.size() - n);
+    }
+
+    static RegOp pick(RegOp reg, bool imm) {
+        return static_cast<RegOp>(static_cast<u1>(reg) + (imm ? 1 : 0));
+    }
+
+    static RegOp jumpOf(OpCode op) {
+        switch (op) {
+        case OpCode::je:  return RegOp::jer;
+        case OpCode::jne: return RegOp::jner;
+        case OpCode::jl:  return RegOp::jlr;
+        case OpCode::jge: return RegOp::jger;
+        case OpCode::jg:  return RegOp::jgr;
+        default:          return RegOp::jler;
+        }
+    }
+
+    // a cond b <=> b swapped(cond) a
+    static RegOp swapped(RegOp op) {
+        switch (op) {
+        case RegOp::jlr:  return RegOp::jgr;
+        case RegOp::jger: return RegOp::jler;
+        case RegOp::jgr:  return RegOp::jlr;
+        case RegOp::jler: return RegOp::jger;
+        default:          return op;
+        }
+    }
+
+    void binary(RegOp reg, bool commutative) {
+        i4 d = depth();
+        auto lhs = operand(d - 2);
+        auto rhs = operand(d - 1);
+        if (lhs.imm && !rhs.imm && commutative) {
+            std::swap(lhs, rhs);
+        }
+        if (lhs.imm) {
+            lhs = registerOperand(d - 2);
+        }
+        pop(2);
+        clobber(d - 2);
+        emit(pick(reg, rhs.imm), d - 2, lhs.value, rhs.value);
+        push(Entry{Entry::Slot, 0, 0});
+    }
+
+    // jump to target if lhs cond rhs, both are popped
+    void conditional(RegOp reg, i4 lhsAt, i4 rhsAt, std::size_t target, std::size_t origin) {
+        auto lhs = operand(lhsAt);
+        auto rhs = operand(rhsAt);
+        if (lhs.imm && !rhs.imm) {
+            std::swap(lhs, rhs);
+            reg = swapped(reg);
+        }
+        if (lhs.imm) {
+            lhs = registerOperand(lhsAt);
+        }
+        pop(depth() - lhsAt);
+        flush();
+        // the branch fails as the jump, like on the other engines
+        _origin = origin;
+        _fixups.emplace_back(_out.size(), target);
+        emit(pick(reg, rhs.imm), lhs.value, rhs.value, 0);
+    }
+
+    void generic(const Instruction& ins) {
+        flush();
+        i8 need, effect;
+        _vm.stackEffect(ins, need, effect);
+        emit(RegOp::stack, static_cast<i4>(ins.op), static_cast<i4>(ins.x), static_cast<i4>(ins.y));
+        pop(need);
+        _stack.resize(_stack.size() + need + effect, Entry{Entry::Slot, 0, 0});
+    }
+
+    bool translate(std::size_t i) {
+        auto& ins = _code[i];
+        i4 d = depth();
+        switch (ins.op) {
+        case OpCode::nop:
+            return true;
+        case OpCode::bipush:
+        case OpCode::ipush:
+            push(Entry{Entry::Imm, static_cast<i4>(ins.x), 0});
+            return true;
+        case OpCode::loada:
+            push(Entry{Entry::Addr, static_cast<u2>(ins.x), static_cast<i4>(ins.y)});
+            return true;
+        case OpCode::pop:
+        case OpCode::pop2:
+        case OpCode::popn: {
+            i8 need, effect;
+            _vm.stackEffect(ins, need, effect);
+            pop(need);
+            return true;
+        }
+        case OpCode::iload:
+        case OpCode::aload: {
+            auto addr = _stack[d - 1];
+            // the slot lies below sp, reading it can not fail
+            if (addr.kind == Entry::Addr && addr.v == 0 && 0 <= addr.w && addr.w < d - 1) {
+                materialize(addr.w);
+                _stack[d - 1] = Entry{Entry::Local, addr.w, 0};
+            }
+            else if (addr.kind == Entry::Addr) {
+                clobber(d - 1);
+                emit(RegOp::loadv, d - 1, addr.v, addr.w);
+                _stack[d - 1] = Entry{Entry::Slot, 0, 0};
+            }
+            else {
+                auto from = registerOperand(d - 1);
+                clobber(d - 1);
+                emit(RegOp::load, d - 1, from.value, 0);
+                _stack[d - 1] = Entry{Entry::Slot, 0, 0};
+            }
+            return true;
+        }
+        case OpCode::istore:
+        case OpCode::astore: {
+            auto addr = _stack[d - 2];
+            if (addr.kind == Entry::Addr && addr.v == 0 && 0 <= addr.w && addr.w < d - 2) {
+                i4 x = addr.w;
+                materialize(x);
+                clobber(x);
+                auto value = operand(d - 1);
+                emit(value.imm ? RegOp::movi : RegOp::movr, x, value.value, 0);
+                pop(2);
+                return true;
+            }
+            flushLocals();
+            auto value = operand(d - 1);
+            if (addr.kind == Entry::Addr) {
+                emit(pick(RegOp::storev, value.imm), addr.v, addr.w, value.value);
+            }
+            else {
+                auto to = registerOperand(d - 2);
+                emit(pick(RegOp::store, value.imm), to.value, value.value, 0);
+            }
+            pop(2);
+            return true;
+        }
+        case OpCode::iadd: binary(RegOp::addr, true);  return true;
+        case OpCode::isub: binary(RegOp::subr, false); return true;
+        case OpCode::imul: binary(RegOp::mulr, true);  return true;
+        case OpCode::idiv: binary(RegOp::divr, false); return true;
+        case OpCode::ineg: {
+            auto& top = _stack[d - 1];
+            if (top.kind == Entry::Imm) {
+                top.v = static_cast<i4>(0u - static_cast<u4>(top.v));
+                return true;
+            }
+            auto from = operand(d - 1);
+            pop(1);
+            clobber(d - 1);
+            emit(RegOp::neg, d - 1, from.value, 0);
+            push(Entry{Entry::Slot, 0, 0});
+            return true;
+        }
+        case OpCode::icmp: {
+            if (i + 1 < _code.size() && !_isTarget[i + 1]
+                && OpCode::je <= _code[i + 1].op && _code[i + 1].op <= OpCode::jle) {
+                // icmp; jCOND is a single compare and branch
+                auto& next = _code[i + 1];
+                ++_covers;
+                conditional(jumpOf(next.op), d - 2, d - 1, static_cast<u2>(next.x), i + 1);
+                _skip = true;
+                return true;
+            }
+            binary(RegOp::cmpr, false);
+            return true;
+        }
+        case OpCode::jmp:
+            flush();
+            _jumps.push_back(_out.size());
+            emit(RegOp::jmp, static_cast<u2>(ins.x), 0, 0);
+            _reachable = false;
+            return true;
+        case OpCode::je: case OpCode::jne:
+        case OpCode::jl: case OpCode::jge:
+        case OpCode::jg: case OpCode::jle:
+            push(Entry{Entry::Imm, 0, 0});
+            conditional(jumpOf(ins.op), d - 1, d, static_cast<u2>(ins.x), i);
+            return true;
+        case OpCode::tableswitch: {
+            // the entries follow as they are targets and nothing is pending
+            auto value = registerOperand(d - 1);
+            pop(1);
+            flush();
+            emit(RegOp::table, value.value, static_cast<i4>(ins.x), static_cast<u2>(ins.y));
+            _reachable = false;
+            return true;
+        }
+        case OpCode::call: {
+            flush();
+            auto index = static_cast<u2>(ins.x);
+            emit(RegOp::call, index, 0, 0);
+            pop(_vm._file.functions[index].paramSize);
+            _stack.resize(_stack.size() + _returnSlots[index], Entry{Entry::Slot, 0, 0});
+            return true;
+        }
+        case OpCode::tailcall:
+            flush();
+            emit(RegOp::tailcall, static_cast<u2>(ins.x), 0, 0);
+            _reachable = false;
+            return true;
+        case OpCode::ret: case OpCode::iret:
+        case OpCode::aret: case OpCode::dret:
+            flush();
+            emit(RegOp::ret, static_cast<i4>(ins.op), 0, 0);
+            _reachable = false;
+            return true;
+        default:
+            generic(ins);
+            return true;
+        }
+    }
+
+private:
+    const VM& _vm;
+    const std::vector<int>& _returnSlots;
+    const std::vector<Instruction>& _code;
+    int _functionIndex;
+    std::vector<i8> _depthAt;
+    std::vector<bool> _isTarget;
+    std::vector<std::size_t> _label;
+    std::vector<Entry> _stack;
+    std::vector<RegisterInstruction> _out;
+    // conditional jumps keep the target in c, jmp in a
+    std::vector<std::pair<std::size_t, std::size_t>> _fixups;
+    std::vector<std::size_t> _jumps;
+    std::size_t _covers;
+    std::size_t _origin;
+    i8 _maxDepth = 0;
+    // the entry starts with the parameters as written slots
+    bool _reachable = false;
+    // set when the next instruction was consumed by this one
+    bool _skip = false;
+};
+
+std::vector<i8> VM::stackDepths(const std::vector<Instruction>& code, int functionIndex,
+                                const std::vector<int>& returnSlots) const {
+    return RegisterTranslator(*this, returnSlots, code, functionIndex).depths();
+}
+
+std::vector<int> VM::returnSlots() const {
+    return RegisterTranslator::returnSlots(*this);
+}
+
+bool VM::translateRegister() {
+    _decodedInstructions = 0;
+    _fusedInstructions = 0;
+    const auto slots = returnSlots();
+    const auto translate = [&](const std::vector<Instruction>& code, int index, RegisterFunction& out) {
+        if (!RegisterTranslator(*this, slots, code, index).run(out)) {
+            return false;
+        }
+        _decodedInstructions += code.size();
+        _fusedInstructions += static_cast<int>(code.size()) - static_cast<int>(out.code.size());
+        return true;
+    };
+    if (!translate(_file.start, -1, _registerStart)) {
+        return false;
+    }
+    _registerFunctions.assign(_file.functions.size(), RegisterFunction());
+    for (std::size_t i = 0; i < _file.functions.size(); ++i) {
+        if (!translate(_file.functions[i].instructions, i, _registerFunctions[i])) {
+            _registerFunctions.clear();
+            return false;
+        }
+    }
+    return true;
+}
+
+void VM::runRegister() {
+    try {
+        executeRegister();
+        if (_contexts.size() != 1) {
+            // no ret at the end of funtion
+            throw InvalidControlTransfer();
+        }
+    }
+    catch (const std::exception& e) {
+        println(std::cerr, "runtime error:", e.what(), "!");
+        println(std::cerr, "occurred at:");
+        printStackTrace(std::cerr);
+    }
+}
+
+// the whole frame is checked once instead of on every push; false if it
+// may not fit, it is then interpreted, so the overflow is reported at its push
+bool VM::reserveRegister(const RegisterFunction& fun, addr_t bp) {
+    if (fun.maxDepth > _stack.capacity() - bp) {
+        return false;
+    }
+    _stack.commit(bp + fun.maxDepth);
+    return true;
+}
+
+// Runs the innermost frame and what it calls like run() until it returns,
+// then _ip is the register pc of the call. The start frame runs to its end.
+void VM::interpretFrame() {
+    const auto depth = _contexts.size();
+    _interpretedFrom = depth - 1;
+    while (true) {
+        ++_ip;
+        if (static_cast<std::size_t>(_ip) >= _currentInstructions->size()) {
+            if (_contexts.size() == 1) {
+                break;
+            }
+            // no ret at the end of funtion
+            throw InvalidControlTransfer();
+        }
+        executeInstruction(_currentInstructions->at(_ip));
+        ++_counterInstruction;
+        if (_contexts.size() < depth) {
+            break;
+        }
+    }
+    _interpretedFrom = SIZE_MAX;
+}
+
+// Labels as values are a GNU extension, fall back to a switch elsewhere.
+#if defined(__GNUC__) && !defined(CC0_NO_COMPUTED_GOTO)
+#define CC0_COMPUTED_GOTO 1
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#else
+#define CC0_COMPUTED_GOTO 0
+#endif
+
+void VM::executeRegister() {
+    // instructions of the file, not dispatches
+    struct Counter {
+        int& total;
+        int& fusedTotal;
+        int n = 0;
+        int dispatched = 0;
+        ~Counter() { total += n; fusedTotal += n - dispatched; }
+    } counter{_counterInstruction, _counterFused};
+
+    const RegisterInstruction* code = nullptr;
+    const RegisterInstruction* pc = nullptr;
+    slot_t* r = nullptr;
+    const auto reload = [&]() {
+        int index = _contexts.back().functionIndex;
+        code = (index < 0 ? _registerStart : _registerFunctions[index]).code.data();
+        r = _stack.data() + _bp;
+    };
+    // popped: operands of the instruction in the file that are gone when it
+    // touches memory, the switch engine checks addresses without them
+    const auto sync = [&](i4 popped = 0) {
+        _sp = _bp + pc->depth - popped;
+    };
+
+#if CC0_COMPUTED_GOTO
+    const void* table[] = {
+        &&L_movr, &&L_movi, &&L_lea,
+        &&L_load, &&L_loadv,
+        &&L_store, &&L_storei,
+        &&L_storev, &&L_storevi,
+        &&L_addr, &&L_addi, &&L_subr, &&L_subi,
+        &&L_mulr, &&L_muli, &&L_divr, &&L_divi,
+        &&L_cmpr, &&L_cmpi, &&L_neg,
+        &&L_jer, &&L_jei, &&L_jner, &&L_jnei,
+        &&L_jlr, &&L_jli, &&L_jger, &&L_jgei,
+        &&L_jgr, &&L_jgi, &&L_jler, &&L_jlei,
+        &&L_jmp,
+        &&L_table,
+        &&L_call,
+        &&L_tailcall,
+        &&L_ret,
+        &&L_stack,
+        &&L_end,
+    };
+    static_assert(sizeof(table) / sizeof(table[0]) == static_cast<std::size_t>(RegOp::end) + 1);
+    for (auto& ins : _registerStart.code) {
+        ins.handler = table[static_cast<u1>(ins.op)];
+    }
+    for (auto& fun : _registerFunctions) {
+        for (auto& ins : fun.code) {
+            ins.handler = table[static_cast<u1>(ins.op)];
+        }
+    }
+    #define TARGET(name) L_##name:
+    #define DISPATCH() do { \
+            counter.n += pc->covers; \
+            ++counter.dispatched; \
+            goto *pc->handler; \
+        } while (false)
+#else
+    #define TARGET(name) case RegOp::name:
+    #define DISPATCH() goto L_dispatch
+#endif
+    #define NEXT() do { ++pc; DISPATCH(); } while (false)
+    #define JUMP_TO(target) do { pc = code + (target); DISPATCH(); } while (false)
+    #define BINARY(expr) do { \
+            auto lhs = static_cast<u4>(r[pc->b]); \
+            auto rhs = static_cast<u4>(expr); \
+            r[pc->a] = static_cast<int_t>(OP(lhs, rhs)); \
+            NEXT(); \
+        } while (false)
+    #define DIVIDE(expr) do { \
+            int_t rhs = (expr); \
+            if (rhs == 0) throw DivideByZero(); \
+            r[pc->a] = r[pc->b] / rhs; \
+            NEXT(); \
+        } while (false)
+    #define COMPARE(expr) do { \
+            int_t lhs = r[pc->b], rhs = (expr); \
+            r[pc->a] = lhs > rhs ? 1 : lhs < rhs ? -1 : 0; \
+            NEXT(); \
+        } while (false)
+    #define BRANCH(cond, expr) do { \
+            if (r[pc->a] cond (expr)) JUMP_TO(pc->c); \
+            NEXT(); \
+        } while (false)
+
+    reload();
+    pc = code;
+    if (!reserveRegister(_registerStart, _bp)) {
+        _ip = -1;
+        interpretFrame();
+        return;
+    }
+    try {
+#if CC0_COMPUTED_GOTO
+    DISPATCH();
+#else
+L_dispatch:
+    counter.n += pc->covers;
+    ++counter.dispatched;
+    switch (pc->op) {
+#endif
+    TARGET(movr)    r[pc->a] = r[pc->b];                 NEXT();
+    TARGET(movi)    r[pc->a] = pc->b;                    NEXT();
+    TARGET(lea)     r[pc->a] = frameAddr(pc->b, pc->c);  NEXT();
+    TARGET(load)    sync(1); r[pc->a] = *checkAddr(r[pc->b], 1);                    NEXT();
+    TARGET(loadv)   sync(1); r[pc->a] = *checkAddr(frameAddr(pc->b, pc->c), 1);     NEXT();
+    TARGET(store)   sync(2); *checkAddr(r[pc->a], 1) = r[pc->b];                    NEXT();
+    TARGET(storei)  sync(2); *checkAddr(r[pc->a], 1) = pc->b;                       NEXT();
+    TARGET(storev)  sync(2); *checkAddr(frameAddr(pc->a, pc->b), 1) = r[pc->c];     NEXT();
+    TARGET(storevi) sync(2); *checkAddr(frameAddr(pc->a, pc->b), 1) = pc->c;        NEXT();
+
+    #define OP(x, y) (x + y)
+    TARGET(addr)    BINARY(r[pc->c]);
+    TARGET(addi)    BINARY(pc->c);
+    #undef OP
+    #define OP(x, y) (x - y)
+    TARGET(subr)    BINARY(r[pc->c]);
+    TARGET(subi)    BINARY(pc->c);
+    #undef OP
+    #define OP(x, y) (x * y)
+    TARGET(mulr)    BINARY(r[pc->c]);
+    TARGET(muli)    BINARY(pc->c);
+    #undef OP
+    TARGET(divr)    DIVIDE(r[pc->c]);
+    TARGET(divi)    DIVIDE(pc->c);
+    TARGET(cmpr)    COMPARE(r[pc->c]);
+    TARGET(cmpi)    COMPARE(pc->c);
+    TARGET(neg)     r[pc->a] = static_cast<int_t>(0u - static_cast<u4>(r[pc->b])); NEXT();
+
+    TARGET(jer)     BRANCH(==, r[pc->b]);
+    TARGET(jei)     BRANCH(==, pc->b);
+    TARGET(jner)    BRANCH(!=, r[pc->b]);
+    TARGET(jnei)    BRANCH(!=, pc->b);
+    TARGET(jlr)     BRANCH(<,  r[pc->b]);
+    TARGET(jli)     BRANCH(<,  pc->b);
+    TARGET(jger)    BRANCH(>=, r[pc->b]);
+    TARGET(jgei)    BRANCH(>=, pc->b);
+    TARGET(jgr)     BRANCH(>,  r[pc->b]);
+    TARGET(jgi)     BRANCH(>,  pc->b);
+    TARGET(jler)    BRANCH(<=, r[pc->b]);
+    TARGET(jlei)    BRANCH(<=, pc->b);
+    TARGET(jmp)     JUMP_TO(pc->a);
+    TARGET(table) {
+        u4 index = static_cast<u4>(r[pc->a]) - static_cast<u4>(pc->b);
+        if (index > static_cast<u4>(pc->c)) {
+            index = pc->c;
+        }
+        // the jmp of the entry is not dispatched
+        auto entry = pc + 1 + index;
+        counter.n += entry->covers;
+        JUMP_TO(entry->a);
+    }
+
+    TARGET(call) {
+        sync();
+        _ip = pc - code;
+        auto& callee = _file.functions[pc->a];
+        bool fits = reserveRegister(_registerFunctions[pc->a], _sp - callee.paramSize);
+        CALL(pc->a);
+        if (!fits) {
+            interpretFrame();
+            reload();
+            pc = code + _ip + 1;
+            DISPATCH();
+        }
+        reload();
+        pc = code;
+        DISPATCH();
+    }
+    TARGET(tailcall) {
+        sync();
+        _ip = pc - code;
+        bool fits = reserveRegister(_registerFunctions[pc->a], _bp);
+        TAILCALL(pc->a);
+        if (!fits) {
+            interpretFrame();
+            reload();
+            pc = code + _ip + 1;
+            DISPATCH();
+        }
+        reload();
+        pc = code;
+        DISPATCH();
+    }
+    TARGET(ret)
+        sync();
+        _ip = pc - code;
+        executeInstruction(Instruction{static_cast<OpCode>(pc->a), 0, 0});
+        reload();
+        pc = code + _ip + 1;
+        DISPATCH();
+    TARGET(stack)
+        sync();
+        executeInstruction(Instruction{static_cast<OpCode>(pc->a), static_cast<u4>(pc->b), static_cast<u4>(pc->c)});
+        r = _stack.data() + _bp;
+        NEXT();
+    TARGET(end)
+        _ip = pc - code;
+        goto L_exit;
+#if !CC0_COMPUTED_GOTO
+    }
+#endif
+    }
+    catch (...) {
+        // an interpreted frame has set _ip itself
+        if (_interpretedFrom == SIZE_MAX) {
+            _ip = pc - code;
+        }
+        throw;
+    }
+L_exit:
+    return;
+
+    #undef BRANCH
+    #undef COMPARE
+    #undef DIVIDE
+    #undef BINARY
+    #undef JUMP_TO
+    #undef NEXT
+    #undef DISPATCH
+    #undef TARGET
+}
+
+#if CC0_COMPUTED_GOTO
+#pragma GCC diagnostic pop
+#endif
+
+}